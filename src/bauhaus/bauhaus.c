@@ -2766,6 +2766,13 @@ void dt_bauhaus_slider_set_step(GtkWidget *widget, float val)
   d->step = val;
 }
 
+gboolean dt_bauhaus_slider_is_dragging(GtkWidget *widget)
+{
+  dt_bauhaus_widget_t *w = (dt_bauhaus_widget_t *)DT_BAUHAUS_WIDGET(widget);
+
+  return w->type == DT_BAUHAUS_SLIDER && w->data.slider.is_dragging;
+}
+
 float dt_bauhaus_slider_get_step(GtkWidget *widget)
 {
   dt_bauhaus_widget_t *w = (dt_bauhaus_widget_t *)DT_BAUHAUS_WIDGET(widget);
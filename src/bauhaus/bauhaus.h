@@ -315,6 +315,8 @@ void dt_bauhaus_slider_set_digits(GtkWidget *w, int val);
 int dt_bauhaus_slider_get_digits(GtkWidget *w);
 void dt_bauhaus_slider_set_step(GtkWidget *w, float val);
 float dt_bauhaus_slider_get_step(GtkWidget *w);
+// whether the mouse is dragging the slider, or a shortcut is changing it, right now
+gboolean dt_bauhaus_slider_is_dragging(GtkWidget *w);
 
 void dt_bauhaus_slider_set_feedback(GtkWidget *w, int feedback);
 int dt_bauhaus_slider_get_feedback(GtkWidget *w);
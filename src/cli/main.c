@@ -34,6 +34,7 @@
 #include "common/history.h"
 #include "common/image.h"
 #include "common/image_cache.h"
+#include "common/mipmap_cache.h"
 #include "common/points.h"
 #include "control/conf.h"
 #include "develop/imageop.h"
@@ -41,6 +42,7 @@
 #include "imageio/imageio_jpeg.h"
 #include "imageio/imageio_module.h"
 
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <libintl.h>
 #include <sys/time.h>
@@ -78,6 +80,8 @@ static void usage(const char *progname)
   fprintf(stderr, "                          if specified, takes preference over output\n");
   fprintf(stderr, "   --import <file or dir> specify input file or dir, can be used'\n");
   fprintf(stderr, "                          multiple times instead of input file\n");
+  fprintf(stderr, "   --batch <list file>    read input files from a list, one per line, instead of input file\n");
+  fprintf(stderr, "                          use - to read them from stdin as they arrive. output has to be a dir\n");
   fprintf(stderr, "   --icc-type <type> specify icc type, default to NONE\n");
   fprintf(stderr, "                     use --help icc-type for list of supported types\n");
   fprintf(stderr, "   --icc-file <file> specify icc filename, default to NONE\n");
@@ -175,6 +179,76 @@ static dt_iop_color_intent_t get_icc_intent(const char* option)
 }
 #undef ICC_INTENT_FROM_STR
 
+// import a file or all files of a folder, returns the list of new image ids
+static GList *_import_input(const gchar *input)
+{
+  if(g_file_test(input, G_FILE_TEST_IS_DIR))
+  {
+    const int filmid = dt_film_import(input);
+    if(!filmid)
+    {
+      // one of inputs was a failure, no prob
+      fprintf(stderr, _("error: can't open folder %s"), input);
+      fprintf(stderr, "\n");
+      return NULL;
+    }
+    return dt_film_get_image_ids(filmid);
+  }
+
+  dt_film_t film;
+  int filmid = 0;
+
+  gchar *directory = g_path_get_dirname(input);
+  filmid = dt_film_new(&film, directory);
+  const int32_t id = dt_image_import(filmid, input, TRUE, TRUE);
+  g_free(directory);
+  if(!id)
+  {
+    fprintf(stderr, _("error: can't open file %s"), input);
+    fprintf(stderr, "\n");
+    return NULL;
+  }
+  return g_list_append(NULL, GINT_TO_POINTER(id));
+}
+
+static int _attach_xmp(const int id, const char *xmp_filename)
+{
+  dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'w');
+  const int res = dt_exif_xmp_read(image, xmp_filename, 1);
+  if(res != 0)
+  {
+    fprintf(stderr, _("error: can't open XMP file %s"), xmp_filename);
+    fprintf(stderr, "\n");
+  }
+  // don't write new xmp:
+  dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+  return res;
+}
+
+// read the next non empty line of a batch list, without the line break. returns FALSE at the end.
+static gboolean _batch_next_input(FILE *f, char *line, const size_t size)
+{
+  while(fgets(line, size, f))
+  {
+    g_strstrip(line);
+    if(line[0] != '\0' && line[0] != '#') return TRUE;
+  }
+  return FALSE;
+}
+
+// the number of images in a batch list, -1 when it isn't known up front: the list is read from stdin as it
+// arrives, or names a folder
+static int _batch_count(FILE *f)
+{
+  if(f == stdin) return -1;
+  char line[PATH_MAX] = { 0 };
+  int count = 0;
+  while(count >= 0 && _batch_next_input(f, line, sizeof(line)))
+    count = g_file_test(line, G_FILE_TEST_IS_DIR) ? -1 : count + 1;
+  rewind(f);
+  return count;
+}
+
 int main(int argc, char *arg[])
 {
 #ifdef __APPLE__
@@ -195,6 +269,7 @@ int main(int argc, char *arg[])
   gchar *output_filename = NULL;
   gchar *output_ext = NULL;
   char *style = NULL;
+  char *batch_filename = NULL;
   int file_counter = 0;
   int width = 0, height = 0, bpp = 0;
   gboolean verbose = FALSE, high_quality = TRUE, upscale = FALSE,
@@ -343,6 +418,11 @@ int main(int argc, char *arg[])
         else
           fprintf(stderr, _("notice: input file or dir '%s' doesn't exist, skipping\n"), arg[k]);
       }
+      else if(!strcmp(arg[k], "--batch") && argc > k + 1)
+      {
+        k++;
+        batch_filename = arg[k];
+      }
       else if(!strcmp(arg[k], "--icc-type") && argc > k + 1)
       {
         k++;
@@ -420,7 +500,22 @@ int main(int argc, char *arg[])
   for(; k < argc; k++) m_arg[m_argc++] = arg[k];
   m_arg[m_argc] = NULL;
 
-  if( (inputs && file_counter < 1) || (!inputs && file_counter < 2) || file_counter > 3)
+  // a batch list replaces the input file just like --import does
+  const gboolean has_inputs = inputs || batch_filename;
+  if(inputs && batch_filename)
+  {
+    fprintf(stderr, _("error: --import and --batch can't be combined\n"));
+    usage(arg[0]);
+    free(m_arg);
+    if(output_filename)
+      g_free(output_filename);
+    if(output_ext)
+      g_free(output_ext);
+    g_list_free_full(inputs, g_free);
+    exit(1);
+  }
+
+  if( (has_inputs && file_counter < 1) || (!has_inputs && file_counter < 2) || file_counter > 3)
   {
     usage(arg[0]);
     free(m_arg);
@@ -432,7 +527,7 @@ int main(int argc, char *arg[])
       g_list_free_full(inputs, g_free);
     exit(1);
   }
-  else if(inputs && file_counter == 1)
+  else if(has_inputs && file_counter == 1)
   {
     //user specified inputs as options, and only dest is present
     if(output_filename)
@@ -440,7 +535,7 @@ int main(int argc, char *arg[])
     output_filename = g_strdup(input_filename);
     input_filename = xmp_filename = NULL;
   }
-  else if(inputs && file_counter == 2)
+  else if(has_inputs && file_counter == 2)
   {
     // inputs as options, xmp & output specified
     if(output_filename)
@@ -449,7 +544,7 @@ int main(int argc, char *arg[])
     xmp_filename = input_filename;
     input_filename = NULL;
   }
-  else if(inputs && file_counter == 3)
+  else if(has_inputs && file_counter == 3)
   {
     fprintf(stderr, _("error: input file and import opts specified! that's not supported!\n"));
     usage(arg[0]);
@@ -458,7 +553,8 @@ int main(int argc, char *arg[])
       g_free(output_filename);
     if(output_ext)
       g_free(output_ext);
-    g_list_free_full(inputs, g_free);
+    if(inputs)
+      g_list_free_full(inputs, g_free);
     exit(1);
   }
   else if(file_counter == 2)
@@ -470,7 +566,7 @@ int main(int argc, char *arg[])
     xmp_filename = NULL;
   }
 
-  if(!inputs && input_filename)
+  if(!has_inputs && input_filename)
   {
     // input is present as param
     inputs = g_list_prepend(inputs, g_strdup(input_filename));
@@ -494,6 +590,31 @@ int main(int argc, char *arg[])
     g_free(temp_of);
   }
 
+  if(batch_filename && !output_to_dir)
+  {
+    fprintf(stderr, _("error: output has to be a directory in batch mode\n"));
+    free(m_arg);
+    g_free(output_filename);
+    if(output_ext)
+      g_free(output_ext);
+    exit(1);
+  }
+
+  FILE *batch = NULL;
+  if(batch_filename)
+  {
+    batch = strcmp(batch_filename, "-") ? g_fopen(batch_filename, "r") : stdin;
+    if(!batch)
+    {
+      fprintf(stderr, _("error: can't open batch list %s\n"), batch_filename);
+      free(m_arg);
+      g_free(output_filename);
+      if(output_ext)
+        g_free(output_ext);
+      exit(1);
+    }
+  }
+
   // the output file already exists, so there will be a sequence number added
   if(g_file_test(output_filename, G_FILE_TEST_EXISTS) && !output_to_dir)
   {
@@ -520,39 +641,7 @@ int main(int argc, char *arg[])
   GList *id_list = NULL;
 
   for(GList *l = inputs; l != NULL; l=g_list_next(l))
-  {
-    gchar* input = l->data;
-
-    if(g_file_test(input, G_FILE_TEST_IS_DIR))
-    {
-      const int filmid = dt_film_import(input);
-      if(!filmid)
-      {
-        // one of inputs was a failure, no prob
-        fprintf(stderr, _("error: can't open folder %s"), input);
-        fprintf(stderr, "\n");
-        continue;
-      }
-      id_list = g_list_concat(id_list, dt_film_get_image_ids(filmid));
-    }
-    else
-    {
-      dt_film_t film;
-      int filmid = 0;
-
-      gchar *directory = g_path_get_dirname(input);
-      filmid = dt_film_new(&film, directory);
-      const int32_t id = dt_image_import(filmid, input, TRUE, TRUE);
-      g_free(directory);
-      if(!id)
-      {
-        fprintf(stderr, _("error: can't open file %s"), input);
-        fprintf(stderr, "\n");
-        continue;
-      }
-      id_list = g_list_append(id_list, GINT_TO_POINTER(id));
-    }
-  }
+    id_list = g_list_concat(id_list, _import_input((gchar *)l->data));
 
   //we no longer need inputs
   if(inputs)
@@ -561,7 +650,7 @@ int main(int argc, char *arg[])
 
   const int total = g_list_length(id_list);
 
-  if(total == 0)
+  if(total == 0 && !batch)
   {
     fprintf(stderr, _("no images to export, aborting\n"));
     free(m_arg);
@@ -576,25 +665,19 @@ int main(int argc, char *arg[])
   {
     for(GList *iter = id_list; iter; iter = g_list_next(iter))
     {
-      int id = GPOINTER_TO_INT(iter->data);
-      dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'w');
-      if(dt_exif_xmp_read(image, xmp_filename, 1) != 0)
+      if(_attach_xmp(GPOINTER_TO_INT(iter->data), xmp_filename) != 0)
       {
-        fprintf(stderr, _("error: can't open XMP file %s"), xmp_filename);
-        fprintf(stderr, "\n");
         free(m_arg);
         g_free(output_filename);
         if(output_ext)
           g_free(output_ext);
         exit(1);
       }
-      // don't write new xmp:
-      dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
     }
   }
 
   // print the history stack. only look at the first image and assume all got the same processing applied
-  if(verbose)
+  if(verbose && id_list)
   {
     int id = GPOINTER_TO_INT(id_list->data);
     gchar *history = dt_history_get_items_as_string(id);
@@ -742,18 +825,80 @@ int main(int argc, char *arg[])
 
   // TODO: add a callback to set the bpp without going through the config
 
+  // one develop and pixelpipe for all images: only the history changes from one to the next
+  dt_imageio_export_keep_pipe(TRUE);
+
+  // the storage numbers the images of the batch list after the ones given on the command line, 0 is unknown
+  const int batch_count = batch ? _batch_count(batch) : 0;
+  const int export_total = batch_count < 0 ? 0 : total + batch_count;
+
   int num = 1, res = 0;
+  dt_mipmap_prefetch_t *prefetch = NULL;
   for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
   {
     const int id = GPOINTER_TO_INT(iter->data);
+    // decode the next image while this one is processed
+    dt_mipmap_cache_prefetch_finish(prefetch);
+    prefetch = iter->next ? dt_mipmap_cache_prefetch_full(darktable.mipmap_cache, GPOINTER_TO_INT(iter->next->data))
+                          : NULL;
     // TODO: have a parameter in command line to get the export presets
     dt_export_metadata_t metadata;
     metadata.flags = dt_lib_export_metadata_default_flags();
     metadata.list = NULL;
-    if(storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale, export_masks,
+    if(storage->store(storage, sdata, id, format, fdata, num, export_total, high_quality, upscale, export_masks,
                       icc_type, icc_filename, icc_intent, &metadata) != 0)
       res = 1;
   }
+  dt_mipmap_cache_prefetch_finish(prefetch);
+
+  if(batch)
+  {
+    // batch mode: everything set up above (modules, presets, styles, profiles, the export modules' params)
+    // is shared by all images of the list, and so are the develop and the pixelpipe. only import, reading the
+    // history and processing happen per image.
+    char input[PATH_MAX] = { 0 };
+    int done = 0, failed = 0;
+    const double batch_start = dt_get_wtime();
+    while(_batch_next_input(batch, input, sizeof(input)))
+    {
+      const double start = dt_get_wtime();
+      GList *ids = g_file_test(input, G_FILE_TEST_EXISTS) ? _import_input(input) : NULL;
+      if(!ids)
+      {
+        fprintf(stderr, _("notice: input file or dir '%s' doesn't exist, skipping\n"), input);
+        failed++;
+        continue;
+      }
+      for(GList *iter = ids; iter; iter = g_list_next(iter), num++)
+      {
+        const int id = GPOINTER_TO_INT(iter->data);
+        dt_export_metadata_t metadata;
+        metadata.flags = dt_lib_export_metadata_default_flags();
+        metadata.list = NULL;
+        if((xmp_filename && _attach_xmp(id, xmp_filename) != 0)
+           || storage->store(storage, sdata, id, format, fdata, num, export_total, high_quality, upscale,
+                             export_masks, icc_type, icc_filename, icc_intent, &metadata) != 0)
+        {
+          res = 1;
+          failed++;
+        }
+        else
+          done++;
+      }
+      g_list_free(ids);
+      if(verbose)
+      {
+        printf("[batch] %s: %.3f s\n", input, dt_get_wtime() - start);
+        fflush(stdout);
+      }
+    }
+    const double elapsed = dt_get_wtime() - batch_start;
+    printf("[batch] %d images exported, %d failed, %.3f s (%.2f images/s)\n", done, failed, elapsed,
+           elapsed > 0.0 ? done / elapsed : 0.0);
+    if(batch != stdin) fclose(batch);
+  }
+
+  dt_imageio_export_keep_pipe(FALSE);
 
   // cleanup time
   if(storage->finalize_store) storage->finalize_store(storage, sdata);
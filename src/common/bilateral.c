@@ -28,6 +28,81 @@
 // mode (only 1mpix there).
 #define DT_COMMON_BILATERAL_MAX_RES_S 3000
 #define DT_COMMON_BILATERAL_MAX_RES_R 50
+// the grid has at most that many planes along the range axis, see dt_bilateral_grid_size()
+#define DT_COMMON_BILATERAL_MAX_SIZE_Z (DT_COMMON_BILATERAL_MAX_RES_R + 2)
+
+// Freed grids are kept for the next dt_bilateral_init(), as the modules set up the same grid again for every
+// run of the pipe. Large grids go back to the system right away to keep the memory idle in here bounded.
+#define DT_COMMON_BILATERAL_POOL_SIZE 4
+#define DT_COMMON_BILATERAL_POOL_MAX_BYTES ((size_t)32 << 20)
+
+typedef struct dt_bilateral_pooled_t
+{
+  float *buf;
+  size_t size; // in floats
+} dt_bilateral_pooled_t;
+
+static GMutex _pool_lock;
+static dt_bilateral_pooled_t _pool[DT_COMMON_BILATERAL_POOL_SIZE];
+
+// returns a zeroed buffer of at least size floats and its actual size
+static float *_pool_get(const size_t size, size_t *allocated)
+{
+  float *buf = NULL;
+  g_mutex_lock(&_pool_lock);
+  int best = -1;
+  for(int k = 0; k < DT_COMMON_BILATERAL_POOL_SIZE; k++)
+    if(_pool[k].buf && _pool[k].size >= size && (best < 0 || _pool[k].size < _pool[best].size)) best = k;
+  if(best >= 0)
+  {
+    buf = _pool[best].buf;
+    *allocated = _pool[best].size;
+    _pool[best].buf = NULL;
+  }
+  g_mutex_unlock(&_pool_lock);
+
+  if(buf)
+    memset(buf, 0, sizeof(float) * size);
+  else
+  {
+    buf = dt_calloc_align_float(size);
+    *allocated = size;
+  }
+  return buf;
+}
+
+static void _pool_put(float *buf, const size_t size)
+{
+  if(!buf) return;
+  if(sizeof(float) * size <= DT_COMMON_BILATERAL_POOL_MAX_BYTES)
+  {
+    g_mutex_lock(&_pool_lock);
+    // take an empty slot or replace the smallest grid
+    int slot = 0;
+    for(int k = 1; k < DT_COMMON_BILATERAL_POOL_SIZE && _pool[slot].buf; k++)
+      if(!_pool[k].buf || _pool[k].size < _pool[slot].size) slot = k;
+    if(!_pool[slot].buf || _pool[slot].size < size)
+    {
+      float *const evicted = _pool[slot].buf;
+      _pool[slot].buf = buf;
+      _pool[slot].size = size;
+      buf = evicted;
+    }
+    g_mutex_unlock(&_pool_lock);
+  }
+  dt_free_align(buf);
+}
+
+void dt_bilateral_pool_cleanup()
+{
+  g_mutex_lock(&_pool_lock);
+  for(int k = 0; k < DT_COMMON_BILATERAL_POOL_SIZE; k++)
+  {
+    dt_free_align(_pool[k].buf);
+    _pool[k].buf = NULL;
+  }
+  g_mutex_unlock(&_pool_lock);
+}
 
 void dt_bilateral_grid_size(dt_bilateral_t *b, const int width, const int height, const float L_range,
                             float sigma_s, const float sigma_r)
@@ -109,30 +184,117 @@ size_t dt_bilateral_singlebuffer_size2(const int width,
 }
 #endif /* !HAVE_OPENCL */
 
-static size_t image_to_grid(const dt_bilateral_t *const b, const int i, const int j, const float L,
-                            float *xf, float *yf, float *zf)
+// the grid column, times size_z, and the fraction towards the next one for every image column. they are the
+// same for all rows, so splat and slice look them up instead of dividing for every pixel
+static gboolean _grid_columns(const dt_bilateral_t *const b, int **xoffset, float **xfrac)
 {
-  float x = CLAMPS(i / b->sigma_s, 0, b->size_x - 1);
-  float y = CLAMPS(j / b->sigma_s, 0, b->size_y - 1);
-  float z = CLAMPS(L / b->sigma_r, 0, b->size_z - 1);
-  const int xi = MIN((int)x, b->size_x - 2);
-  const int yi = MIN((int)y, b->size_y - 2);
-  const int zi = MIN((int)z, b->size_z - 2);
-  *xf = x - xi;
-  *yf = y - yi;
-  *zf = z - zi;
-  return ((xi + yi * b->size_x) * b->size_z) + zi;
+  *xoffset = dt_alloc_align(64, sizeof(int) * b->width);
+  *xfrac = dt_alloc_align_float(b->width);
+  if(!*xoffset || !*xfrac)
+  {
+    dt_free_align(*xoffset);
+    dt_free_align(*xfrac);
+    return FALSE;
+  }
+  for(int i = 0; i < b->width; i++)
+  {
+    const float x = CLAMPS(i / b->sigma_s, 0, b->size_x - 1);
+    const int xi = MIN((int)x, b->size_x - 2);
+    (*xoffset)[i] = xi * b->size_z;
+    (*xfrac)[i] = x - xi;
+  }
+  return TRUE;
 }
 
-static size_t image_to_relgrid(const dt_bilateral_t *const b, const int i, const float L, float *xf, float *zf)
+// Trilinear lookup of one row of pixels in the blurred grid. The loop gathers from the grid, so it's compiled
+// once more for AVX2 and AVX-512 to get vector gathers, like the image kernels in imagebuf.c. in and out may
+// be the same buffer.
+#define DT_BILATERAL_INLINE static inline __attribute__((always_inline))
+
+DT_BILATERAL_INLINE void _slice_row(const float *const buf, const float *const in, float *const out,
+                                    const int width, const int *const xoffset, const float *const xfrac,
+                                    const size_t rowbase, const float yf, const int ox, const int oy,
+                                    const int size_z, const float sigma_r, const float norm,
+                                    const gboolean to_output)
+{
+  const int oz = 1;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int i = 0; i < width; i++)
+  {
+    const size_t index = (size_t)4 * i;
+    const float L = in[index];
+    const float z = CLAMPS(L / sigma_r, 0, size_z - 1);
+    const int zi = MIN((int)z, size_z - 2);
+    const float zf = z - zi;
+    const float xf = xfrac[i];
+    const size_t gi = rowbase + xoffset[i] + zi;
+    const float Lout = norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
+                               + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
+                               + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
+                               + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
+                               + buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
+                               + buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
+                               + buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
+                               + buf[gi + ox + oy + oz] * (xf) * (yf) * (zf));
+    if(to_output)
+      out[index] = MAX(0.0f, out[index] + Lout);
+    else
+    {
+      out[index] = fmaxf(0.0f, L + Lout);
+      // and copy color and mask
+      out[index + 1] = in[index + 1];
+      out[index + 2] = in[index + 2];
+      out[index + 3] = in[index + 3];
+    }
+  }
+}
+
+typedef void(dt_bilateral_slice_row_t)(const float *const buf, const float *const in, float *const out,
+                                       const int width, const int *const xoffset, const float *const xfrac,
+                                       const size_t rowbase, const float yf, const int ox, const int oy,
+                                       const int size_z, const float sigma_r, const float norm);
+
+typedef struct dt_bilateral_kernels_t
+{
+  dt_bilateral_slice_row_t *slice;
+  dt_bilateral_slice_row_t *slice_to_output;
+} dt_bilateral_kernels_t;
+
+// stamp out one set of kernels for the given target attribute
+#define DT_BILATERAL_KERNELS(suffix, target)                                                                        \
+  static target void _slice_row_##suffix(const float *const buf, const float *const in, float *const out,          \
+                                         const int width, const int *const xoffset, const float *const xfrac,      \
+                                         const size_t rowbase, const float yf, const int ox, const int oy,         \
+                                         const int size_z, const float sigma_r, const float norm)                  \
+  {                                                                                                                 \
+    _slice_row(buf, in, out, width, xoffset, xfrac, rowbase, yf, ox, oy, size_z, sigma_r, norm, FALSE);             \
+  }                                                                                                                 \
+  static target void _slice_row_to_output_##suffix(const float *const buf, const float *const in,                 \
+                                                   float *const out, const int width, const int *const xoffset,    \
+                                                   const float *const xfrac, const size_t rowbase, const float yf, \
+                                                   const int ox, const int oy, const int size_z,                   \
+                                                   const float sigma_r, const float norm)                          \
+  {                                                                                                                 \
+    _slice_row(buf, in, out, width, xoffset, xfrac, rowbase, yf, ox, oy, size_z, sigma_r, norm, TRUE);              \
+  }                                                                                                                 \
+  static const dt_bilateral_kernels_t _bilateral_kernels_##suffix = { _slice_row_##suffix,                         \
+                                                                      _slice_row_to_output_##suffix };
+
+DT_BILATERAL_KERNELS(plain, )
+#ifdef DT_HAVE_X86_DISPATCH
+DT_BILATERAL_KERNELS(avx2, __DT_TARGET_AVX2__)
+DT_BILATERAL_KERNELS(avx512, __DT_TARGET_AVX512__)
+#endif
+
+static const dt_bilateral_kernels_t *_bilateral_kernels()
 {
-  float x = CLAMPS(i / b->sigma_s, 0, b->size_x - 1);
-  float z = CLAMPS(L / b->sigma_r, 0, b->size_z - 1);
-  const int xi = MIN((int)x, b->size_x - 2);
-  const int zi = MIN((int)z, b->size_z - 2);
-  *xf = x - xi;
-  *zf = z - zi;
-  return (xi * b->size_z) + zi;
+#ifdef DT_HAVE_X86_DISPATCH
+  if(darktable.codepath.AVX512) return &_bilateral_kernels_avx512;
+  if(darktable.codepath.AVX2) return &_bilateral_kernels_avx2;
+#endif
+  return &_bilateral_kernels_plain;
 }
 
 dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
@@ -148,7 +310,9 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   b->numslices = darktable.num_openmp_threads;
   b->sliceheight = (height + b->numslices - 1) / b->numslices;
   b->slicerows = (b->size_y + b->numslices - 1) / b->numslices + 2;
-  b->buf = dt_calloc_align_float(b->size_x * b->size_z * b->numslices * b->slicerows);
+  size_t buf_size = 0;
+  b->buf = _pool_get(b->size_x * b->size_z * b->numslices * b->slicerows, &buf_size);
+  b->buf_size = buf_size;
   if(!b->buf)
   {
     fprintf(stderr,"[bilateral] unable to allocate buffer for %zux%zux%zu grid\n",b->size_x,b->size_y,b->size_z);
@@ -172,6 +336,11 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
   float *const buf = b->buf;
 
   if(!buf) return;
+  int *xoffset = NULL;
+  float *xfrac = NULL;
+  if(!_grid_columns(b, &xoffset, &xfrac)) return;
+  const int size_z = b->size_z;
+  const float sigma_r = b->sigma_r;
   // splat into downsampled grid
   const int nthreads = darktable.num_openmp_threads;
   const size_t offsets[8] =
@@ -188,7 +357,7 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, oy, oz, ox, sigma_s, buf, offsets) \
+  dt_omp_firstprivate(in, oy, oz, ox, sigma_s, buf, offsets, xoffset, xfrac, size_z, sigma_r) \
   shared(b)
 #endif
   for(int slice = 0; slice < b->numslices; slice++)
@@ -207,11 +376,14 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
       const size_t base = (size_t)(yi + slice_offset) * oy;
       for(int i = 0; i < b->width; i++)
       {
-        size_t index = 4 * (j * b->width + i);
-        float xf, zf;
+        size_t index = 4 * ((size_t)j * b->width + i);
         const float L = in[index];
+        const float z = CLAMPS(L / sigma_r, 0, size_z - 1);
+        const int zi = MIN((int)z, size_z - 2);
+        const float zf = z - zi;
+        const float xf = xfrac[i];
         // nearest neighbour splatting:
-        const size_t grid_index = base + image_to_relgrid(b, i, L, &xf, &zf);
+        const size_t grid_index = base + xoffset[i] + zi;
         // sum up payload here
         const dt_aligned_pixel_t contrib =
         {
@@ -253,6 +425,9 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
         memset(buf + j*oy, '\0', sizeof(float) * oy);
     }
   }
+
+  dt_free_align(xoffset);
+  dt_free_align(xfrac);
 }
 
 #ifdef _OPENMP
@@ -297,46 +472,64 @@ static void blur_line_z(float *buf, const int offset1, const int offset2, const
   }
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(buf:64)
-#endif
-static void blur_line(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
-                      const int size2, const int size3)
+// gaussian up to 3 sigma along nlines lines of count grid points, step floats apart. all size_z planes of a
+// line are filtered at once, they are contiguous in the grid so the filter is vectorized across them.
+static void blur_lines(float *buf, const int line_stride, const int step, const int nlines, const int count,
+                       const int size_z)
 {
   const float w0 = 6.f / 16.f;
   const float w1 = 4.f / 16.f;
   const float w2 = 1.f / 16.f;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(size1, size2, size3, offset1, offset2, offset3, w0, w1, w2) \
-    shared(buf)
+  dt_omp_firstprivate(line_stride, step, nlines, count, size_z, w0, w1, w2) \
+  shared(buf) schedule(static)
 #endif
-  for(int k = 0; k < size1; k++)
+  for(int k = 0; k < nlines; k++)
   {
-    size_t index = (size_t)k * offset1;
-    for(int j = 0; j < size2; j++)
+    float DT_ALIGNED_ARRAY tmp1[DT_COMMON_BILATERAL_MAX_SIZE_Z];
+    float DT_ALIGNED_ARRAY tmp2[DT_COMMON_BILATERAL_MAX_SIZE_Z];
+    float *p = buf + (size_t)k * line_stride;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int z = 0; z < size_z; z++)
     {
-      float tmp1 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * buf[index + offset3] + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      float tmp2 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * (buf[index + offset3] + tmp1) + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      for(int i = 2; i < size3 - 2; i++)
+      tmp1[z] = p[z];
+      p[z] = p[z] * w0 + w1 * p[step + z] + w2 * p[2 * step + z];
+    }
+    p += step;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int z = 0; z < size_z; z++)
+    {
+      tmp2[z] = p[z];
+      p[z] = p[z] * w0 + w1 * (p[step + z] + tmp1[z]) + w2 * p[2 * step + z];
+    }
+    p += step;
+    for(int i = 2; i < count - 2; i++)
+    {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int z = 0; z < size_z; z++)
       {
-        const float tmp3 = buf[index];
-        buf[index]
-            = buf[index] * w0 + w1 * (buf[index + offset3] + tmp2) + w2 * (buf[index + 2 * offset3] + tmp1);
-        index += offset3;
-        tmp1 = tmp2;
-        tmp2 = tmp3;
+        const float tmp3 = p[z];
+        p[z] = p[z] * w0 + w1 * (p[step + z] + tmp2[z]) + w2 * (p[2 * step + z] + tmp1[z]);
+        tmp1[z] = tmp2[z];
+        tmp2[z] = tmp3;
       }
-      const float tmp3 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * (buf[index + offset3] + tmp2) + w2 * tmp1;
-      index += offset3;
-      buf[index] = buf[index] * w0 + w1 * tmp3 + w2 * tmp2;
-      index += offset3;
-      index += offset2 - offset3 * size3;
+      p += step;
+    }
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int z = 0; z < size_z; z++)
+    {
+      const float tmp3 = p[z];
+      p[z] = p[z] * w0 + w1 * (p[step + z] + tmp2[z]) + w2 * tmp1[z];
+      p[step + z] = p[step + z] * w0 + w1 * tmp3 + w2 * tmp2[z];
     }
   }
 }
@@ -349,10 +542,10 @@ void dt_bilateral_blur(const dt_bilateral_t *b)
   const int ox = b->size_z;
   const int oy = b->size_x * b->size_z;
   const int oz = 1;
-  // gaussian up to 3 sigma
-  blur_line(b->buf, oz, oy, ox, b->size_z, b->size_y, b->size_x);
-  // gaussian up to 3 sigma
-  blur_line(b->buf, oz, ox, oy, b->size_z, b->size_x, b->size_y);
+  // gaussian up to 3 sigma along x
+  blur_lines(b->buf, oy, ox, b->size_y, b->size_x, b->size_z);
+  // gaussian up to 3 sigma along y
+  blur_lines(b->buf, ox, oy, b->size_x, b->size_y, b->size_z);
   // -2 derivative of the gaussian up to 3 sigma: x*exp(-x*x)
   blur_line_z(b->buf, ox, oy, oz, b->size_x, b->size_y, b->size_z);
 }
@@ -367,42 +560,38 @@ void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, fl
   const float norm = -detail * b->sigma_r * 0.04f;
   const int ox = b->size_z;
   const int oy = b->size_x * b->size_z;
-  const int oz = 1;
   float *const buf = b->buf;
   const int width = b->width;
   const int height = b->height;
 
   if(!buf) return;
+  int *xoffset = NULL;
+  float *xfrac = NULL;
+  if(!_grid_columns(b, &xoffset, &xfrac)) return;
+  dt_bilateral_slice_row_t *const slice_row = _bilateral_kernels()->slice;
+  const int size_y = b->size_y;
+  const int size_z = b->size_z;
+  const float sigma_s = b->sigma_s;
+  const float sigma_r = b->sigma_r;
+
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(b, in, norm, ox, oy, oz, height, width, buf) \
-    shared(out) collapse(2)
+  dt_omp_firstprivate(in, out, norm, ox, oy, height, width, buf, xoffset, xfrac, slice_row, size_y, size_z, \
+                      sigma_s, sigma_r) \
+  schedule(static)
 #endif
   for(int j = 0; j < height; j++)
   {
-    for(int i = 0; i < width; i++)
-    {
-      size_t index = 4 * (j * width + i);
-      float xf, yf, zf;
-      const float L = in[index];
-      // trilinear lookup:
-      const size_t gi = image_to_grid(b, i, j, L, &xf, &yf, &zf);
-      const float Lout = fmaxf( 0.0f, L
-                         + norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
-                                   + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
-                                   + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
-                                   + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
-                                   + buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
-                                   + buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
-                                   + buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
-                                   + buf[gi + ox + oy + oz] * (xf) * (yf) * (zf)));
-      out[index] = Lout;
-      // and copy color and mask
-      out[index + 1] = in[index + 1];
-      out[index + 2] = in[index + 2];
-      out[index + 3] = in[index + 3];
-    }
+    const float y = CLAMPS(j / sigma_s, 0, size_y - 1);
+    const int yi = MIN((int)y, size_y - 2);
+    const float yf = y - yi;
+    const size_t index = (size_t)4 * j * width;
+    slice_row(buf, in + index, out + index, width, xoffset, xfrac, (size_t)yi * oy, yf, ox, oy, size_z, sigma_r,
+              norm);
   }
+
+  dt_free_align(xoffset);
+  dt_free_align(xfrac);
 }
 
 #ifdef _OPENMP
@@ -415,43 +604,44 @@ void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *co
   const float norm = -detail * b->sigma_r * 0.04f;
   const int ox = b->size_z;
   const int oy = b->size_x * b->size_z;
-  const int oz = 1;
   float *const buf = b->buf;
   const int width = b->width;
   const int height = b->height;
 
   if(!buf) return;
+  int *xoffset = NULL;
+  float *xfrac = NULL;
+  if(!_grid_columns(b, &xoffset, &xfrac)) return;
+  dt_bilateral_slice_row_t *const slice_row = _bilateral_kernels()->slice_to_output;
+  const int size_y = b->size_y;
+  const int size_z = b->size_z;
+  const float sigma_s = b->sigma_s;
+  const float sigma_r = b->sigma_r;
+
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(b, in, norm, oy, oz, ox, buf, width, height) \
-  shared(out) collapse(2)
+  dt_omp_firstprivate(in, out, norm, ox, oy, height, width, buf, xoffset, xfrac, slice_row, size_y, size_z, \
+                      sigma_s, sigma_r) \
+  schedule(static)
 #endif
   for(int j = 0; j < height; j++)
   {
-    for(int i = 0; i < width; i++)
-    {
-      size_t index = 4 * (j * width + i);
-      float xf, yf, zf;
-      const float L = in[index];
-      // trilinear lookup:
-      const size_t gi = image_to_grid(b, i, j, L, &xf, &yf, &zf);
-      const float Lout = norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
-                                 + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
-                                 + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
-                                 + buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
-                                 + buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
-                                 + buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
-                                 + buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
-                                 + buf[gi + ox + oy + oz] * (xf) * (yf) * (zf));
-      out[index] = MAX(0.0f, out[index] + Lout);
-    }
+    const float y = CLAMPS(j / sigma_s, 0, size_y - 1);
+    const int yi = MIN((int)y, size_y - 2);
+    const float yf = y - yi;
+    const size_t index = (size_t)4 * j * width;
+    slice_row(buf, in + index, out + index, width, xoffset, xfrac, (size_t)yi * oy, yf, ox, oy, size_z, sigma_r,
+              norm);
   }
+
+  dt_free_align(xoffset);
+  dt_free_align(xfrac);
 }
 
 void dt_bilateral_free(dt_bilateral_t *b)
 {
   if(!b) return;
-  dt_free_align(b->buf);
+  _pool_put(b->buf, b->buf_size);
   free(b);
 }
 
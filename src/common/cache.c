@@ -26,55 +26,166 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-// this implements a concurrent LRU cache
+// this implements a concurrent LRU cache, optionally split into independently locked shards
 
-void dt_cache_init(
+static inline dt_cache_shard_t *_shard(dt_cache_t *cache, const uint32_t key)
+{
+  // fibonacci hashing, so consecutive image ids and mip levels end up in different shards
+  const uint32_t h = key * 2654435769u;
+  return cache->shard + (cache->num_shards > 1 ? (h >> 16) & (cache->num_shards - 1) : 0);
+}
+
+// unlink an entry from the lru list of its shard
+static inline void _lru_remove(dt_cache_shard_t *shard, dt_cache_entry_t *entry)
+{
+  if(entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+  else                shard->lru = entry->lru_next;
+  if(entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+  else                shard->lru_tail = entry->lru_prev;
+  entry->lru_prev = entry->lru_next = NULL;
+}
+
+// put an entry at the most recently used end of the lru list
+static inline void _lru_append(dt_cache_shard_t *shard, dt_cache_entry_t *entry)
+{
+  entry->lru_next = NULL;
+  entry->lru_prev = shard->lru_tail;
+  if(shard->lru_tail) shard->lru_tail->lru_next = entry;
+  else                shard->lru = entry;
+  shard->lru_tail = entry;
+}
+
+static inline void _lru_touch(dt_cache_shard_t *shard, dt_cache_entry_t *entry, const double now)
+{
+  entry->used = now;
+  if(shard->lru_tail == entry) return;
+  _lru_remove(shard, entry);
+  _lru_append(shard, entry);
+}
+
+// the shard lock has to be held by the caller
+static inline void _cost_add(dt_cache_t *cache, dt_cache_shard_t *shard, const size_t cost)
+{
+  shard->cost += cost;
+  dt_pthread_mutex_lock(&cache->cost_lock);
+  cache->cost += cost;
+  dt_pthread_mutex_unlock(&cache->cost_lock);
+}
+
+static inline void _cost_sub(dt_cache_t *cache, dt_cache_shard_t *shard, const size_t cost)
+{
+  shard->cost -= cost;
+  dt_pthread_mutex_lock(&cache->cost_lock);
+  cache->cost -= cost;
+  dt_pthread_mutex_unlock(&cache->cost_lock);
+}
+
+static inline gboolean _cost_below(dt_cache_t *cache, const float fill_ratio)
+{
+  dt_pthread_mutex_lock(&cache->cost_lock);
+  const gboolean below = cache->cost < cache->cost_quota * fill_ratio;
+  dt_pthread_mutex_unlock(&cache->cost_lock);
+  return below;
+}
+
+void dt_cache_init_sharded(
     dt_cache_t *cache,
     size_t entry_size,
-    size_t cost_quota)
+    size_t cost_quota,
+    uint32_t num_shards)
 {
-  cache->cost = 0;
-  cache->lru = 0;
+  uint32_t shards = 1;
+  while(shards * 2 <= MIN(num_shards, DT_CACHE_MAX_SHARDS)) shards *= 2;
+
   cache->entry_size = entry_size;
   cache->cost_quota = cost_quota;
-  dt_pthread_mutex_init(&cache->lock, 0);
+  cache->cost = 0;
+  dt_pthread_mutex_init(&cache->cost_lock, 0);
+  cache->num_shards = shards;
+  for(uint32_t k = 0; k < shards; k++)
+  {
+    dt_cache_shard_t *shard = cache->shard + k;
+    shard->cost = 0;
+    shard->lru = shard->lru_tail = NULL;
+    shard->hits = shard->misses = shard->evictions = 0;
+    dt_pthread_mutex_init(&shard->lock, 0);
+    shard->hashtable = g_hash_table_new(0, 0);
+  }
   cache->allocate = 0;
   cache->allocate_data = 0;
   cache->cleanup = 0;
   cache->cleanup_data = 0;
-  cache->hashtable = g_hash_table_new(0, 0);
+}
+
+void dt_cache_init(
+    dt_cache_t *cache,
+    size_t entry_size,
+    size_t cost_quota)
+{
+  dt_cache_init_sharded(cache, entry_size, cost_quota, 1);
 }
 
 void dt_cache_cleanup(dt_cache_t *cache)
 {
-  g_hash_table_destroy(cache->hashtable);
-  for(GList *l = cache->lru; l; l = g_list_next(l))
+  for(uint32_t k = 0; k < cache->num_shards; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
-
-    if(cache->cleanup)
+    dt_cache_shard_t *shard = cache->shard + k;
+    g_hash_table_destroy(shard->hashtable);
+    for(dt_cache_entry_t *entry = shard->lru, *next; entry; entry = next)
     {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+      next = entry->lru_next;
 
-      cache->cleanup(cache->cleanup_data, entry);
+      if(cache->cleanup)
+      {
+        assert(entry->data_size);
+        ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+
+        cache->cleanup(cache->cleanup_data, entry);
+      }
+      else
+        dt_free_align(entry->data);
+
+      dt_pthread_rwlock_destroy(&entry->lock);
+      g_slice_free1(sizeof(*entry), entry);
     }
-    else
-      dt_free_align(entry->data);
+    shard->lru = shard->lru_tail = NULL;
+    dt_pthread_mutex_destroy(&shard->lock);
+  }
+  dt_pthread_mutex_destroy(&cache->cost_lock);
+}
 
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+size_t dt_cache_get_cost(dt_cache_t *cache)
+{
+  dt_pthread_mutex_lock(&cache->cost_lock);
+  const size_t cost = cache->cost;
+  dt_pthread_mutex_unlock(&cache->cost_lock);
+  return cost;
+}
+
+void dt_cache_get_stats(dt_cache_t *cache, dt_cache_stats_t *stats)
+{
+  memset(stats, 0, sizeof(dt_cache_stats_t));
+  for(uint32_t k = 0; k < cache->num_shards; k++)
+  {
+    dt_cache_shard_t *shard = cache->shard + k;
+    dt_pthread_mutex_lock(&shard->lock);
+    stats->hits += shard->hits;
+    stats->misses += shard->misses;
+    stats->evictions += shard->evictions;
+    stats->entries += g_hash_table_size(shard->hashtable);
+    stats->cost += shard->cost;
+    dt_pthread_mutex_unlock(&shard->lock);
   }
-  g_list_free(cache->lru);
-  dt_pthread_mutex_destroy(&cache->lock);
 }
 
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  int32_t result = g_hash_table_contains(cache->hashtable, GINT_TO_POINTER(key));
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_cache_shard_t *shard = _shard(cache, key);
+  dt_pthread_mutex_lock(&shard->lock);
+  int32_t result = g_hash_table_contains(shard->hashtable, GINT_TO_POINTER(key));
+  dt_pthread_mutex_unlock(&shard->lock);
   return result;
 }
 
@@ -83,22 +194,26 @@ int dt_cache_for_all(
     int (*process)(const uint32_t key, const void *data, void *user_data),
     void *user_data)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  GHashTableIter iter;
-  gpointer key, value;
-
-  g_hash_table_iter_init (&iter, cache->hashtable);
-  while(g_hash_table_iter_next (&iter, &key, &value))
+  for(uint32_t k = 0; k < cache->num_shards; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
-    const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
-    if(err)
+    dt_cache_shard_t *shard = cache->shard + k;
+    dt_pthread_mutex_lock(&shard->lock);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init (&iter, shard->hashtable);
+    while(g_hash_table_iter_next (&iter, &key, &value))
     {
-      dt_pthread_mutex_unlock(&cache->lock);
-      return err;
+      dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
+      const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
+      if(err)
+      {
+        dt_pthread_mutex_unlock(&shard->lock);
+        return err;
+      }
     }
+    dt_pthread_mutex_unlock(&shard->lock);
   }
-  dt_pthread_mutex_unlock(&cache->lock);
   return 0;
 }
 
@@ -109,9 +224,10 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
   gpointer orig_key, value;
   gboolean res;
   double start = dt_get_wtime();
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_cache_shard_t *shard = _shard(cache, key);
+  dt_pthread_mutex_lock(&shard->lock);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   {
     dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
@@ -121,13 +237,13 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       return 0;
     }
     // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    _lru_touch(shard, entry, start);
+    shard->hits++;
+    dt_pthread_mutex_unlock(&shard->lock);
     double end = dt_get_wtime();
     if(end - start > 0.1)
       fprintf(stderr, "try+ wait time %.06fs mode %c \n", end - start, mode);
@@ -142,13 +258,15 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
 
     return entry;
   }
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "try- wait time %.06fs\n", end - start);
   return 0;
 }
 
+static void _cache_gc(dt_cache_t *cache, dt_cache_shard_t *locked, const float fill_ratio);
+
 // if found, the data void* is returned. if not, it is set to be
 // the given *data and a new hash table entry is created, which can be
 // found using the given key later on.
@@ -158,10 +276,11 @@ dt_cache_entry_t *dt_cache_get_with_caller(dt_cache_t *cache, const uint32_t key
   gboolean res;
   int result;
   double start = dt_get_wtime();
+  dt_cache_shard_t *shard = _shard(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_pthread_mutex_lock(&shard->lock);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   { // yay, found. read lock and pass on.
     dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
@@ -170,14 +289,14 @@ restart:
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       g_usleep(5);
       goto restart;
     }
     // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    _lru_touch(shard, entry, start);
+    shard->hits++;
+    dt_pthread_mutex_unlock(&shard->lock);
 
 #ifdef _DEBUG
     const pthread_t writer = dt_pthread_rwlock_get_writer(&entry->lock);
@@ -206,10 +325,10 @@ restart:
 
   // first try to clean up.
   // also wait if we can't free more than the requested fill ratio.
-  if(cache->cost > 0.8f * cache->cost_quota)
+  if(!_cost_below(cache, 0.8f))
   {
     // need to roll back all the way to get a consistent lock state:
-    dt_cache_gc(cache, 0.8f);
+    _cache_gc(cache, shard, 0.8f);
   }
 
   // here dies your 32-bit system:
@@ -219,11 +338,12 @@ restart:
   entry->data = 0;
   entry->data_size = cache->entry_size;
   entry->cost = 1;
-  entry->link = g_list_append(0, entry);
+  entry->lru_prev = entry->lru_next = NULL;
+  entry->used = start;
   entry->key = key;
   entry->_lock_demoting = 0;
 
-  g_hash_table_insert(cache->hashtable, GINT_TO_POINTER(key), entry);
+  g_hash_table_insert(shard->hashtable, GINT_TO_POINTER(key), entry);
 
   assert(cache->allocate || entry->data_size);
 
@@ -242,12 +362,13 @@ restart:
   if(write) dt_pthread_rwlock_wrlock_with_caller(&entry->lock, file, line);
   else      dt_pthread_rwlock_rdlock_with_caller(&entry->lock, file, line);
 
-  cache->cost += entry->cost;
+  _cost_add(cache, shard, entry->cost);
+  shard->misses++;
 
   // put at end of lru list (most recently used):
-  cache->lru = g_list_concat(cache->lru, entry->link);
+  _lru_append(shard, entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "wait time %.06fs\n", end - start);
@@ -263,22 +384,23 @@ int dt_cache_remove(dt_cache_t *cache, const uint32_t key)
   gboolean res;
   int result;
   dt_cache_entry_t *entry;
+  dt_cache_shard_t *shard = _shard(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_pthread_mutex_lock(&shard->lock);
 
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   entry = (dt_cache_entry_t *)value;
   if(!res)
   { // not found in cache, not deleting.
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     return 1;
   }
   // need write lock to be able to delete:
   result = dt_pthread_rwlock_trywrlock(&entry->lock);
   if(result)
   {
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
@@ -287,15 +409,15 @@ restart:
   {
     // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
     dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
 
-  gboolean removed = g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(key));
+  gboolean removed = g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(key));
   (void)removed; // make non-assert compile happy
   assert(removed);
-  cache->lru = g_list_delete_link(cache->lru, entry->link);
+  _lru_remove(shard, entry);
 
   if(cache->cleanup)
   {
@@ -309,23 +431,41 @@ restart:
 
   dt_pthread_rwlock_unlock(&entry->lock);
   dt_pthread_rwlock_destroy(&entry->lock);
-  cache->cost -= entry->cost;
+  _cost_sub(cache, shard, entry->cost);
   g_slice_free1(sizeof(*entry), entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   return 0;
 }
 
-// best-effort garbage collection. never blocks, never fails. well, sometimes it just doesn't free anything.
-void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
+// best-effort garbage collection over all shards, in lru order. the caller holds the lock of the shard
+// `locked`, if any. the others are only tried, so this never waits for a lock and skips the busy shards.
+static void _cache_gc(dt_cache_t *cache, dt_cache_shard_t *locked, const float fill_ratio)
 {
-  GList *l = cache->lru;
-  while(l)
+  dt_cache_shard_t *shards[DT_CACHE_MAX_SHARDS];
+  dt_cache_entry_t *next[DT_CACHE_MAX_SHARDS];
+  uint32_t n = 0;
+  for(uint32_t k = 0; k < cache->num_shards; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
-    assert(entry->link->data == entry);
-    l = g_list_next(l); // we might remove this element, so walk to the next one while we still have the pointer..
-    if(cache->cost < cache->cost_quota * fill_ratio) break;
+    dt_cache_shard_t *shard = cache->shard + k;
+    if(shard != locked && dt_pthread_mutex_trylock(&shard->lock)) continue;
+    shards[n] = shard;
+    next[n] = shard->lru;
+    n++;
+  }
+
+  while(!_cost_below(cache, fill_ratio))
+  {
+    // every lru list is ordered by the time of use (up to threads racing for the shard lock), so the least
+    // recently used entry is one of their heads
+    int oldest = -1;
+    for(uint32_t k = 0; k < n; k++)
+      if(next[k] && (oldest < 0 || next[k]->used < next[oldest]->used)) oldest = k;
+    if(oldest < 0) break;
+
+    dt_cache_shard_t *shard = shards[oldest];
+    dt_cache_entry_t *entry = next[oldest];
+    next[oldest] = entry->lru_next; // we might remove this element, so walk to the next one while we still have the pointer..
 
     // if still locked by anyone else give up:
     if(dt_pthread_rwlock_trywrlock(&entry->lock)) continue;
@@ -338,9 +478,10 @@ void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
     }
 
     // delete!
-    g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(entry->key));
-    cache->lru = g_list_delete_link(cache->lru, entry->link);
-    cache->cost -= entry->cost;
+    g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(entry->key));
+    _lru_remove(shard, entry);
+    _cost_sub(cache, shard, entry->cost);
+    shard->evictions++;
 
     if(cache->cleanup)
     {
@@ -356,6 +497,15 @@ void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
     dt_pthread_rwlock_destroy(&entry->lock);
     g_slice_free1(sizeof(*entry), entry);
   }
+
+  for(uint32_t k = 0; k < n; k++)
+    if(shards[k] != locked) dt_pthread_mutex_unlock(&shards[k]->lock);
+}
+
+// best-effort garbage collection. never blocks, never fails. well, sometimes it just doesn't free anything.
+void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
+{
+  _cache_gc(cache, NULL, fill_ratio);
 }
 
 void dt_cache_release_with_caller(dt_cache_t *cache, dt_cache_entry_t *entry, const char *file, int line)
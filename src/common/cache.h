@@ -28,7 +28,10 @@ typedef struct dt_cache_entry_t
   void *data;
   size_t data_size;
   size_t cost;
-  GList *link;
+  // intrusive lru list of the shard, so touching and evicting an entry is O(1)
+  struct dt_cache_entry_t *lru_prev, *lru_next;
+  // time of the last use, orders the lru lists of all shards against each other
+  double used;
   dt_pthread_rwlock_t lock;
   int _lock_demoting;
   uint32_t key;
@@ -38,16 +41,45 @@ dt_cache_entry_t;
 typedef void((*dt_cache_allocate_t)(void *userdata, dt_cache_entry_t *entry));
 typedef void((*dt_cache_cleanup_t)(void *userdata, dt_cache_entry_t *entry));
 
-typedef struct dt_cache_t
+// upper limit for the number of independently locked parts of a cache
+#define DT_CACHE_MAX_SHARDS 16
+
+// one independently locked part of a cache. keys are distributed over the shards by a hash,
+// each shard has its own lru list. the cost quota is shared, the garbage collection evicts the
+// least recently used entries over all shards.
+typedef struct dt_cache_shard_t
 {
-  dt_pthread_mutex_t lock; // big fat lock. we're only expecting a couple hand full of cpu threads to use this concurrently.
+  dt_pthread_mutex_t lock; // protects everything in this shard
 
+  size_t cost; // user supplied cost per cache line (bytes?)
+
+  GHashTable *hashtable; // stores (key, entry) pairs
+  dt_cache_entry_t *lru;      // first element, about to be kicked from cache.
+  dt_cache_entry_t *lru_tail; // last element, most recently used.
+
+  // statistics, see dt_cache_get_stats()
+  uint64_t hits, misses, evictions;
+} __attribute__((aligned(64))) dt_cache_shard_t;
+
+typedef struct dt_cache_stats_t
+{
+  uint64_t hits;      // dt_cache_get() and dt_cache_testget() calls finding the entry
+  uint64_t misses;    // dt_cache_get() calls that had to allocate
+  uint64_t evictions; // entries dropped by the garbage collection
+  size_t entries;     // entries currently in the cache
+  size_t cost;        // their cost (usually bytes)
+} dt_cache_stats_t;
+
+typedef struct dt_cache_t
+{
   size_t entry_size; // cache line allocation
-  size_t cost;       // user supplied cost per cache line (bytes?)
   size_t cost_quota; // quota to try and meet. but don't use as hard limit.
 
-  GHashTable *hashtable; // stores (key, entry) pairs
-  GList *lru;            // last element is most recently used, first is about to be kicked from cache.
+  dt_pthread_mutex_t cost_lock; // only protects cost, taken inside the shard locks
+  size_t cost;                  // of all shards
+
+  uint32_t num_shards; // power of two, at most DT_CACHE_MAX_SHARDS
+  dt_cache_shard_t shard[DT_CACHE_MAX_SHARDS];
 
   // callback functions for cache misses/garbage collection
   dt_cache_allocate_t allocate;
@@ -59,6 +91,9 @@ dt_cache_t;
 
 // entry size is only used if alloc callback is 0
 void dt_cache_init(dt_cache_t *cache, size_t entry_size, size_t cost_quota);
+// same, but split into num_shards (rounded down to a power of two) independently locked parts
+// to reduce lock contention. the quota and the lru order stay those of the whole cache.
+void dt_cache_init_sharded(dt_cache_t *cache, size_t entry_size, size_t cost_quota, uint32_t num_shards);
 void dt_cache_cleanup(dt_cache_t *cache);
 
 static inline void dt_cache_set_allocate_callback(dt_cache_t *cache, dt_cache_allocate_t allocate_cb,
@@ -93,6 +128,11 @@ int32_t dt_cache_remove(dt_cache_t *cache, const uint32_t key);
 // is locked)
 void dt_cache_gc(dt_cache_t *cache, const float fill_ratio);
 
+// current cost of all entries in the cache
+size_t dt_cache_get_cost(dt_cache_t *cache);
+// sum of the statistics of all shards
+void dt_cache_get_stats(dt_cache_t *cache, dt_cache_stats_t *stats);
+
 // iterate over all currently contained data blocks.
 // not thread safe! only use this for init/cleanup!
 // returns non zero the first time process() returns non zero.
@@ -71,6 +71,8 @@ const dt_collection_t *dt_collection_new(const dt_collection_t *clone)
     collection->where_ext = g_strdupv(clone->where_ext);
     collection->query = g_strdup(clone->query);
     collection->query_no_group = g_strdup(clone->query_no_group);
+    collection->where = g_strdup(clone->where);
+    collection->where_no_group = g_strdup(clone->where_no_group);
     collection->clone = 1;
     collection->count = clone->count;
     collection->count_no_group = clone->count_no_group;
@@ -106,6 +108,8 @@ void dt_collection_free(const dt_collection_t *collection)
 
   g_free(collection->query);
   g_free(collection->query_no_group);
+  g_free(collection->where);
+  g_free(collection->where_no_group);
   g_strfreev(collection->where_ext);
   g_free((dt_collection_t *)collection);
 }
@@ -197,7 +201,7 @@ static void _dt_collection_set_selq_pre_sort(const dt_collection_t *collection,
   // clang-format on
 }
 
-int dt_collection_update(const dt_collection_t *collection)
+static int _dt_collection_update(const dt_collection_t *collection, const gboolean recount)
 {
   uint32_t result;
   gchar *wq, *wq_no_group, *sq, *selq_pre, *selq_post, *query, *query_no_group;
@@ -442,10 +446,24 @@ int dt_collection_update(const dt_collection_t *collection)
                         (collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT) ? " " LIMIT_QUERY : "");
   result = _dt_collection_store(collection, query, query_no_group);
 
+  /* keep the filtering part to count and to check single images against it */
+  dt_collection_t *col = (dt_collection_t *)collection;
+  g_free(col->where);
+  g_free(col->where_no_group);
+  if(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT)
+  {
+    col->where = col->where_no_group = NULL;
+    g_free(wq);
+    g_free(wq_no_group);
+  }
+  else
+  {
+    col->where = wq;
+    col->where_no_group = wq_no_group;
+  }
+
   /* free memory used */
   g_free(sq);
-  g_free(wq);
-  g_free(wq_no_group);
   g_free(selq_pre);
   g_free(selq_post);
   g_free(query);
@@ -453,15 +471,23 @@ int dt_collection_update(const dt_collection_t *collection)
 
   /* update the cached count. collection isn't a real const anyway, we are writing to it in
    * _dt_collection_store, too. */
-  ((dt_collection_t *)collection)->count = _dt_collection_compute_count(collection, FALSE);
-  ((dt_collection_t *)collection)->count_no_group = _dt_collection_compute_count(collection, TRUE);
-  dt_collection_hint_message(collection);
+  if(recount)
+  {
+    col->count = _dt_collection_compute_count(collection, FALSE);
+    col->count_no_group = _dt_collection_compute_count(collection, TRUE);
+    dt_collection_hint_message(collection);
+  }
 
   _collection_update_aspect_ratio(collection);
 
   return result;
 }
 
+int dt_collection_update(const dt_collection_t *collection)
+{
+  return _dt_collection_update(collection, TRUE);
+}
+
 void dt_collection_reset(const dt_collection_t *collection)
 {
   dt_collection_params_t *params = (dt_collection_params_t *)&collection->params;
@@ -932,8 +958,14 @@ static uint32_t _dt_collection_compute_count(const dt_collection_t *collection,
   const gchar *query = no_group ? dt_collection_get_query_no_group(collection) : dt_collection_get_query(collection);
   gchar *count_query = NULL;
 
+  const gchar *where = no_group ? collection->where_no_group : collection->where;
   gchar *fq = g_strstr_len(query, strlen(query), "FROM");
-  if((collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
+  if(where)
+  {
+    // the joins of the query are only there for sorting, no need to sort or to count distinct ids
+    count_query = g_strdup_printf("SELECT COUNT(*) FROM main.images AS mi WHERE %s", where);
+  }
+  else if((collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
   {
     gchar *where_ext = dt_collection_get_extended_where(collection, -1);
     count_query = g_strdup_printf("SELECT COUNT(DISTINCT main.images.id) FROM main.images AS mi %s", where_ext);
@@ -943,7 +975,7 @@ static uint32_t _dt_collection_compute_count(const dt_collection_t *collection,
     count_query = g_strdup_printf("SELECT COUNT(DISTINCT mi.id) %s", fq);
 
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), count_query, -1, &stmt, NULL);
-  if((collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
+  if(!where && (collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
      && !(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
   {
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
@@ -2256,6 +2288,162 @@ void dt_collection_deserialize(const char *buf, gboolean filtering)
   dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_NEW_QUERY, DT_COLLECTION_PROP_UNDEF, NULL);
 }
 
+static gchar *_collection_list_to_ids(GList *list)
+{
+  gchar *txt = NULL;
+  for(GList *l = list; l; l = g_list_next(l))
+  {
+    const int id = GPOINTER_TO_INT(l->data);
+    txt = dt_util_dstrcat(txt, txt ? ",%d" : "%d", id);
+  }
+  return txt;
+}
+
+// TRUE if the order of the collection depends on the given property of the images
+static gboolean _collection_sort_depends_on(const dt_collection_t *collection,
+                                            const dt_collection_properties_t property)
+{
+  const gboolean *sorts = collection->params.sorts;
+  if(property == DT_COLLECTION_PROP_RATING || property == DT_COLLECTION_PROP_RATING_RANGE)
+    return sorts[DT_COLLECTION_SORT_RATING];
+  if(property == DT_COLLECTION_PROP_COLORLABEL)
+    return sorts[DT_COLLECTION_SORT_COLOR];
+  if(property >= DT_COLLECTION_PROP_METADATA && property < DT_COLLECTION_PROP_METADATA + DT_METADATA_NUMBER)
+    return sorts[DT_COLLECTION_SORT_TITLE] || sorts[DT_COLLECTION_SORT_DESCRIPTION];
+  // everything else isn't handled in place
+  return TRUE;
+}
+
+/* apply a change of some images to the collected images without running the whole query again. images which
+ * don't match anymore are dropped, the others keep their order as long as the sort doesn't depend on the
+ * changed property. returns FALSE if the collected images have to be rebuilt. */
+static gboolean _collection_memory_update_images(const dt_collection_t *collection,
+                                                 const dt_collection_properties_t changed_property, GList *list)
+{
+  if(!collection->where || _collection_sort_depends_on(collection, changed_property)) return FALSE;
+
+  sqlite3 *db = dt_database_get(darktable.db);
+  sqlite3_stmt *stmt = NULL;
+  gchar *ids = _collection_list_to_ids(list);
+  // with grouping the representative image of a group may change, so all images of the groups are checked
+  gchar *images = (darktable.gui && darktable.gui->grouping)
+                      ? g_strdup_printf("SELECT id FROM main.images"
+                                        " WHERE group_id IN (SELECT group_id FROM main.images WHERE id IN (%s))",
+                                        ids)
+                      : g_strdup(ids);
+  g_free(ids);
+
+  // images which match now but aren't collected yet can't be put in place, their position is unknown
+  // clang-format off
+  gchar *query = g_strdup_printf("SELECT 1 FROM main.images AS mi"
+                                 " WHERE mi.id IN (%s) AND (%s)"
+                                 "   AND NOT EXISTS (SELECT 1 FROM memory.collected_images AS c"
+                                 "                   WHERE c.imgid = mi.id)"
+                                 " LIMIT 1",
+                                 images, collection->where);
+  // clang-format on
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query, -1, &stmt, NULL);
+  const gboolean added = sqlite3_step(stmt) == SQLITE_ROW;
+  sqlite3_finalize(stmt);
+  g_free(query);
+  if(added)
+  {
+    g_free(images);
+    return FALSE;
+  }
+
+  // the positions of the images which don't match anymore
+  GArray *rows = g_array_new(FALSE, FALSE, sizeof(int));
+  // clang-format off
+  query = g_strdup_printf("SELECT rowid FROM memory.collected_images"
+                          " WHERE imgid IN (%s)"
+                          "   AND imgid NOT IN (SELECT mi.id FROM main.images AS mi WHERE mi.id IN (%s) AND (%s))"
+                          " ORDER BY rowid",
+                          images, images, collection->where);
+  // clang-format on
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query, -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int rowid = sqlite3_column_int(stmt, 0);
+    g_array_append_val(rows, rowid);
+  }
+  sqlite3_finalize(stmt);
+  g_free(query);
+
+  if(rows->len)
+  {
+    DT_DEBUG_SQLITE3_PREPARE_V2(db, "DELETE FROM memory.collected_images WHERE rowid = ?1", -1, &stmt, NULL);
+    for(guint i = 0; i < rows->len; i++)
+    {
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, g_array_index(rows, int, i));
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+
+    // close the gaps, the rowid is the position in the collection. the moved rows go to negative rowids
+    // first so they never collide with the ones not moved yet.
+    // clang-format off
+    DT_DEBUG_SQLITE3_PREPARE_V2(db,
+                                "UPDATE memory.collected_images SET rowid = -(rowid - ?1)"
+                                " WHERE rowid > ?2 AND rowid < ?3",
+                                -1, &stmt, NULL);
+    // clang-format on
+    for(guint i = 0; i < rows->len; i++)
+    {
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, i + 1);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, g_array_index(rows, int, i));
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, i + 1 < rows->len ? g_array_index(rows, int, i + 1) : G_MAXINT);
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    // clang-format off
+    DT_DEBUG_SQLITE3_EXEC(db, "UPDATE memory.collected_images SET rowid = -rowid WHERE rowid < 0",
+                          NULL, NULL, NULL);
+    DT_DEBUG_SQLITE3_EXEC(db, "UPDATE memory.sqlite_sequence"
+                              " SET seq = (SELECT IFNULL(MAX(rowid), 0) FROM memory.collected_images)"
+                              " WHERE name = 'collected_images'",
+                          NULL, NULL, NULL);
+    // clang-format on
+  }
+
+  // the same for the selection, hidden images of groups included
+  // clang-format off
+  query = g_strdup_printf("DELETE FROM main.selected_images"
+                          " WHERE imgid IN (%s)"
+                          "   AND imgid NOT IN (SELECT mi.id FROM main.images AS mi WHERE mi.id IN (%s) AND (%s))",
+                          images, images, collection->where_no_group);
+  // clang-format on
+  DT_DEBUG_SQLITE3_EXEC(db, query, NULL, NULL, NULL);
+  g_free(query);
+  if(sqlite3_changes(db) > 0) DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_SELECTION_CHANGED);
+
+  dt_print(DT_DEBUG_SQL, "[collection] %u images dropped from the collection in place\n", rows->len);
+
+  // the aggregates follow the change
+  dt_collection_t *col = (dt_collection_t *)collection;
+  col->count -= MIN(col->count, rows->len);
+  col->count_no_group = (darktable.gui && darktable.gui->grouping) ? _dt_collection_compute_count(collection, TRUE)
+                                                                   : col->count;
+  g_array_free(rows, TRUE);
+  g_free(images);
+  return TRUE;
+}
+
+// count the collected images instead of running the query again
+static void _collection_count_from_memory(const dt_collection_t *collection)
+{
+  dt_collection_t *col = (dt_collection_t *)collection;
+  sqlite3_stmt *stmt = NULL;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT COUNT(*) FROM memory.collected_images", -1,
+                              &stmt, NULL);
+  col->count = (sqlite3_step(stmt) == SQLITE_ROW) ? sqlite3_column_int(stmt, 0) : 0;
+  sqlite3_finalize(stmt);
+  col->count_no_group = (darktable.gui && darktable.gui->grouping) ? _dt_collection_compute_count(collection, TRUE)
+                                                                   : col->count;
+}
+
 void dt_collection_update_query(const dt_collection_t *collection, dt_collection_change_t query_change,
                                 dt_collection_properties_t changed_property, GList *list)
 {
@@ -2274,17 +2462,7 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
       // we do this here
 
       // 1. create a string with all the imgids of the list to be used inside IN sql query
-      gchar *txt = NULL;
-      int i = 0;
-      for(GList *l = list; l; l = g_list_next(l))
-      {
-        const int id = GPOINTER_TO_INT(l->data);
-        if(i == 0)
-          txt = dt_util_dstrcat(txt, "%d", id);
-        else
-          txt = dt_util_dstrcat(txt, ",%d", id);
-        i++;
-      }
+      gchar *txt = _collection_list_to_ids(list);
       // 2. search the first imgid not in the list but AFTER the list (or in a gap inside the list)
       // we need to be carefull that some images in the list may not be present on screen (collapsed groups)
       // clang-format off
@@ -2433,13 +2611,20 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
   dt_collection_set_filter_flags(collection,
                                  (dt_collection_get_filter_flags(collection) & ~COLLECTION_FILTER_FILM_ID));
 
-  /* update query and at last the visual */
-  dt_collection_update(collection);
+  /* update query and at last the visual. the original is counted from the collected images below */
+  gchar *old_query = g_strdup(collection->query);
+  _dt_collection_update(collection, collection->clone);
+
+  // a change of some images which leaves the query as it is can be applied in place
+  const gboolean in_place = !collection->clone && list && query_change == DT_COLLECTION_CHANGE_RELOAD
+                            && !g_strcmp0(old_query, collection->query)
+                            && _collection_memory_update_images(collection, changed_property, list);
+  g_free(old_query);
 
   // remove from selected images where not in this query.
   sqlite3_stmt *stmt = NULL;
   const gchar *cquery = dt_collection_get_query_no_group(collection);
-  if(cquery && cquery[0] != '\0')
+  if(!in_place && cquery && cquery[0] != '\0')
   {
     gchar *complete_query = g_strdup_printf("DELETE FROM main.selected_images WHERE imgid NOT IN (%s)", cquery);
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), complete_query, -1, &stmt, NULL);
@@ -2460,7 +2645,12 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
   /* raise signal of collection change, only if this is an original */
   if(!collection->clone)
   {
-    dt_collection_memory_update();
+    if(!in_place)
+    {
+      dt_collection_memory_update();
+      _collection_count_from_memory(collection);
+    }
+    dt_collection_hint_message(collection);
     DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED, query_change, changed_property,
                                   list, next);
   }
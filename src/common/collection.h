@@ -142,6 +142,8 @@ typedef struct dt_collection_t
 {
   int clone;
   gchar *query, *query_no_group;
+  // the filtering part of the queries, NULL when only the extended where is used
+  gchar *where, *where_no_group;
   gchar **where_ext;
   unsigned int count, count_no_group;
   unsigned int tagid;
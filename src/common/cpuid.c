@@ -35,6 +35,14 @@
 #endif
 
 #if defined(HAVE___GET_CPUID)
+// the register state the os saves on context switches
+static guint64 _xgetbv()
+{
+  guint32 ax, dx;
+  __asm__ volatile("xgetbv" : "=a"(ax), "=d"(dx) : "c"(0));
+  return ((guint64)dx << 32) | ax;
+}
+
 dt_cpu_flags_t dt_detect_cpu_features()
 {
   guint32 ax, bx, cx, dx;
@@ -44,6 +52,10 @@ dt_cpu_flags_t dt_detect_cpu_features()
   g_mutex_lock(&lock);
   if(__get_cpuid(0x00000000,&ax,&bx,&cx,&dx))
   {
+    const guint32 max_leaf = ax;
+    // the ymm and zmm registers are only usable if the os saves them
+    gboolean os_avx = FALSE, os_avx512 = FALSE;
+
     /* Request for standard features */
     if(__get_cpuid(0x00000001,&ax,&bx,&cx,&dx))
     {
@@ -57,7 +69,29 @@ dt_cpu_flags_t dt_detect_cpu_features()
       if(cx & 0x00040000) cpuflags |= CPU_FLAG_SSE4_1;
       if(cx & 0x00080000) cpuflags |= CPU_FLAG_SSE4_2;
 
-      if(cx & 0x08000000) cpuflags |= CPU_FLAG_AVX;
+      // osxsave
+      if(cx & 0x08000000)
+      {
+        const guint64 xcr0 = _xgetbv();
+        os_avx = (xcr0 & 0x06) == 0x06;
+        os_avx512 = os_avx && (xcr0 & 0xe0) == 0xe0;
+      }
+      if(os_avx && (cx & 0x10000000)) cpuflags |= CPU_FLAG_AVX;
+      if(os_avx && (cx & 0x00001000)) cpuflags |= CPU_FLAG_FMA;
+    }
+
+    /* Request for extended features */
+    if(max_leaf >= 7)
+    {
+      __cpuid_count(0x00000007, 0, ax, bx, cx, dx);
+      if(os_avx && (bx & 0x00000020)) cpuflags |= CPU_FLAG_AVX2;
+      if(os_avx512)
+      {
+        if(bx & 0x00010000) cpuflags |= CPU_FLAG_AVX512F;
+        if(bx & 0x00020000) cpuflags |= CPU_FLAG_AVX512DQ;
+        if(bx & 0x40000000) cpuflags |= CPU_FLAG_AVX512BW;
+        if(bx & 0x80000000) cpuflags |= CPU_FLAG_AVX512VL;
+      }
     }
 
     /* Are there extensions? */
@@ -28,6 +28,7 @@
 #include <sys/malloc.h>
 #endif
 
+#include "common/bilateral.h"
 #include "common/collection.h"
 #include "common/colorspaces.h"
 #include "common/darktable.h"
@@ -47,8 +48,10 @@
 #include "common/grealpath.h"
 #include "common/image.h"
 #include "common/image_cache.h"
+#include "common/imagebuf.h"
 #include "common/iop_order.h"
 #include "common/l10n.h"
+#include "common/locallaplacian.h"
 #include "common/mipmap_cache.h"
 #include "common/noiseprofiles.h"
 #include "common/opencl.h"
@@ -315,16 +318,30 @@ static void dt_codepaths_init()
 #else
     dt_cpu_flags_t flags = dt_detect_cpu_features();
     darktable.codepath.SSE2 = ((flags & (CPU_FLAG_SSE)) && (flags & (CPU_FLAG_SSE2)));
+#endif
+#ifdef DT_HAVE_X86_DISPATCH
+    // the extended features and whether the os saves the wide registers come from our own cpuid check
+    const dt_cpu_flags_t ext = dt_detect_cpu_features();
+    const dt_cpu_flags_t avx512 = CPU_FLAG_AVX512F | CPU_FLAG_AVX512DQ | CPU_FLAG_AVX512BW | CPU_FLAG_AVX512VL;
+    darktable.codepath.AVX2 = (ext & CPU_FLAG_AVX2) && (ext & CPU_FLAG_FMA);
+    darktable.codepath.AVX512 = darktable.codepath.AVX2 && (ext & avx512) == avx512;
 #endif
   }
 
   // second, apply overrides from conf
   // NOTE: all intrinsics sets can only be overridden to OFF
   if(!dt_conf_get_bool("codepaths/sse2")) darktable.codepath.SSE2 = 0;
+  if(!dt_conf_get_bool("codepaths/avx2")) darktable.codepath.AVX2 = darktable.codepath.AVX512 = 0;
+  if(!dt_conf_get_bool("codepaths/avx512")) darktable.codepath.AVX512 = 0;
 
   // last: do we have any intrinsics sets enabled?
   darktable.codepath._no_intrinsics = !(darktable.codepath.SSE2);
 
+  // the kernels of the shared image primitives are picked once, here
+  dt_iop_image_dispatch_init();
+  dt_print(DT_DEBUG_PERF, "[dt_codepaths_init] sse2 %d, avx2 %d, avx512 %d\n", darktable.codepath.SSE2,
+           darktable.codepath.AVX2, darktable.codepath.AVX512);
+
 // if there is no SSE, we must enable plain codepath by default,
 // else, enable it conditionally.
 #if defined(__SSE__)
@@ -1470,6 +1487,8 @@ void dt_cleanup()
   darktable.iop_order_rules = NULL;
   dt_opencl_cleanup(darktable.opencl);
   free(darktable.opencl);
+  dt_bilateral_pool_cleanup();
+  local_laplacian_arena_cleanup();
 #ifdef HAVE_GPHOTO2
   dt_camctl_destroy((dt_camctl_t *)darktable.camctl);
   darktable.camctl = NULL;
@@ -1533,10 +1552,10 @@ void dt_cleanup()
   dt_pthread_mutex_destroy(&(darktable.plugin_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.dev_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.capabilities_threadsafe));
+  // the xmp toolkit locks exiv2_threadsafe, shut it down first
+  dt_exif_cleanup();
   dt_pthread_mutex_destroy(&(darktable.exiv2_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.readFile_mutex));
-
-  dt_exif_cleanup();
 }
 
 /* The dt_print variations can be used with a combination of DT_DEBUG_ flags.
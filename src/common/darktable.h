@@ -140,6 +140,14 @@ typedef unsigned int u_int;
 #define __DT_CLONE_TARGETS__
 #endif
 
+/* Compile a function for a given instruction set. Unlike the clones above, the variant is not picked by the
+ * loader but by the caller, from darktable.codepath, so the codepaths/ settings can turn it off. */
+#if __has_attribute(target) && (defined(__amd64__) || defined(__amd64) || defined(__x86_64__) || defined(__x86_64))
+#define DT_HAVE_X86_DISPATCH 1
+#define __DT_TARGET_AVX2__ __attribute__((target("avx2,fma")))
+#define __DT_TARGET_AVX512__ __attribute__((target("avx512f,avx512dq,avx512bw,avx512vl,avx2,fma")))
+#endif
+
 /* Helper to force stack vectors to be aligned on 64 bits blocks to enable AVX2 */
 #define DT_IS_ALIGNED(x) __builtin_assume_aligned(x, 64)
 
@@ -281,6 +289,8 @@ typedef enum dt_debug_thread_t
 typedef struct dt_codepath_t
 {
   unsigned int SSE2 : 1;
+  unsigned int AVX2 : 1;   // together with FMA
+  unsigned int AVX512 : 1; // F, DQ, BW and VL
   unsigned int _no_intrinsics : 1;
   unsigned int OPENMP_SIMD : 1; // always stays the last one
 } dt_codepath_t;
@@ -49,13 +49,16 @@
 
 // whenever _create_*_schema() gets changed you HAVE to bump this version and add an update path to
 // _upgrade_*_schema_step()!
-#define CURRENT_DATABASE_VERSION_LIBRARY 38
+#define CURRENT_DATABASE_VERSION_LIBRARY 40
 #define CURRENT_DATABASE_VERSION_DATA    10
 
-// #define USE_NESTED_TRANSACTIONS
-#define MAX_NESTED_TRANSACTIONS 0
+#define MAX_NESTED_TRANSACTIONS 8
 /* transaction id */
 static dt_atomic_int _trxid;
+// held by the thread owning the transaction from its outermost start until the matching release
+static GRecMutex _trx_lock;
+// threads blocked in dt_database_start_transaction() on _trx_lock
+static dt_atomic_int _trx_waiting;
 
 typedef struct dt_database_t
 {
@@ -72,8 +75,35 @@ typedef struct dt_database_t
 
   gchar *error_message, *error_dbfilename;
   int error_other_pid;
+
+  /* prepared statements not in use, by sql text */
+  dt_pthread_mutex_t stmt_mutex;
+  GHashTable *stmt_cache;
+  uint64_t stmt_hits, stmt_misses;
+
+  /* with -d sql: statements slower than this are logged and collected by sql text, their plans are
+     logged with the summary at shutdown */
+  sqlite3_int64 slow_ns;
+  dt_pthread_mutex_t slow_mutex;
+  GHashTable *slow;
 } dt_database_t;
 
+typedef struct dt_database_slow_t
+{
+  uint32_t count;
+  sqlite3_int64 total_ns, max_ns;
+} dt_database_slow_t;
+
+// idle statements kept per sql text, more are only needed while that many threads run it at once
+#define DT_DATABASE_STMT_CACHE_IDLE 4
+
+static void _statement_cache_free_idle(gpointer data)
+{
+  GPtrArray *idle = (GPtrArray *)data;
+  for(guint k = 0; k < idle->len; k++) sqlite3_finalize((sqlite3_stmt *)g_ptr_array_index(idle, k));
+  g_ptr_array_free(idle, TRUE);
+}
+
 
 /* migrates database from old place to new */
 static void _database_migrate_to_xdg_structure();
@@ -2166,6 +2196,33 @@ static int _upgrade_library_schema_step(dt_database_t *db, int version)
              "[init] can't set multi_name_hand_edited column\n");
     new_version = 38;
   }
+  else if(version == 38)
+  {
+    // the rating and color label filters of the collection
+    TRY_EXEC("CREATE INDEX IF NOT EXISTS main.images_rating_index ON images ((flags & 7))",
+             "[init] can't create images_rating_index\n");
+    TRY_EXEC("CREATE INDEX IF NOT EXISTS main.color_labels_color_index ON color_labels (color, imgid)",
+             "[init] can't create color_labels_color_index\n");
+    new_version = 39;
+  }
+  else if(version == 39)
+  {
+    // the range filters and sorts of the collection
+    TRY_EXEC("CREATE INDEX IF NOT EXISTS main.images_exposure_index ON images (exposure)",
+             "[init] can't create images_exposure_index\n");
+    TRY_EXEC("CREATE INDEX IF NOT EXISTS main.images_aperture_index ON images (aperture)",
+             "[init] can't create images_aperture_index\n");
+    TRY_EXEC("CREATE INDEX IF NOT EXISTS main.images_iso_index ON images (iso)",
+             "[init] can't create images_iso_index\n");
+    TRY_EXEC("CREATE INDEX IF NOT EXISTS main.images_focal_length_index ON images (focal_length)",
+             "[init] can't create images_focal_length_index\n");
+    // the tag filters only need the image ids of a tag, no need to visit the table
+    TRY_EXEC("DROP INDEX IF EXISTS main.tagged_images_tagid_index",
+             "[init] can't drop tagged_images_tagid_index\n");
+    TRY_EXEC("CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid, imgid)",
+             "[init] can't create tagged_images_tagid_index\n");
+    new_version = 40;
+  }
   else
     new_version = version; // should be the fallback so that calling code sees that we are in an infinite loop
 
@@ -2516,17 +2573,25 @@ static void _create_library_schema(dt_database_t *db)
 
   sqlite3_exec(db->handle, "CREATE INDEX main.images_latlong_index ON images (latitude DESC, longitude DESC)",
       NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.images_rating_index ON images ((flags & 7))", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.images_exposure_index ON images (exposure)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.images_aperture_index ON images (aperture)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.images_iso_index ON images (iso)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.images_focal_length_index ON images (focal_length)", NULL, NULL, NULL);
 
   ////////////////////////////// tagged_images
   sqlite3_exec(db->handle, "CREATE TABLE main.tagged_images (imgid INTEGER, tagid INTEGER, position INTEGER, "
                            "PRIMARY KEY (imgid, tagid),"
                            "FOREIGN KEY(imgid) REFERENCES images(id) ON UPDATE CASCADE ON DELETE CASCADE)", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid, imgid)", NULL, NULL,
+               NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.tagged_images_position_index ON tagged_images (position)", NULL, NULL, NULL);
   ////////////////////////////// color_labels
   sqlite3_exec(db->handle, "CREATE TABLE main.color_labels (imgid INTEGER, color INTEGER)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE UNIQUE INDEX main.color_labels_idx ON color_labels (imgid, color)", NULL, NULL,
                NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.color_labels_color_index ON color_labels (color, imgid)", NULL, NULL,
+               NULL);
   ////////////////////////////// meta_data
   sqlite3_exec(db->handle, "CREATE TABLE main.meta_data (id INTEGER, key INTEGER, value VARCHAR)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE UNIQUE INDEX main.metadata_index ON meta_data (id, key, value)", NULL, NULL, NULL);
@@ -2611,6 +2676,8 @@ static void _create_memory_schema(dt_database_t *db)
       db->handle,
       "CREATE TABLE memory.collected_images (rowid INTEGER PRIMARY KEY AUTOINCREMENT, imgid INTEGER)", NULL,
       NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX memory.collected_images_imgid_index ON collected_images (imgid)", NULL,
+               NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.tmp_selection (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.taglist "
                            "(tmpid INTEGER PRIMARY KEY, id INTEGER UNIQUE ON CONFLICT IGNORE, "
@@ -3077,6 +3144,93 @@ gchar* _get_pragma_string_val(sqlite3 *db, const char* pragma)
   return val;
 }
 
+// journal mode and synchronous setting of both databases. the in-memory journal without syncs is the
+// fastest but a crash in the middle of a write can leave the database corrupt, the write-ahead log with
+// normal syncs is nearly as fast for the many small writes of an import and keeps the database intact.
+static void _set_journal_pragmas(const dt_database_t *db)
+{
+  const char *journal = dt_conf_get_string_const("database/journal_mode");
+  const char *sync = dt_conf_get_string_const("database/synchronous");
+  if(!g_strcmp0(journal, "write-ahead log"))
+    journal = "WAL";
+  else if(!g_strcmp0(journal, "on disk"))
+    journal = "DELETE";
+  else
+    journal = "MEMORY";
+  if(g_strcmp0(sync, "normal") && g_strcmp0(sync, "full")) sync = "off";
+
+  gchar *query = g_strdup_printf("PRAGMA journal_mode = %s", journal);
+  sqlite3_exec(db->handle, query, NULL, NULL, NULL);
+  g_free(query);
+  query = g_strdup_printf("PRAGMA synchronous = %s", sync);
+  sqlite3_exec(db->handle, query, NULL, NULL, NULL);
+  g_free(query);
+
+  dt_print(DT_DEBUG_SQL, "[init] journal mode %s, synchronous %s\n", journal, sync);
+}
+
+// called by sqlite when a statement is done, with the connection locked. it may not run statements itself,
+// so it only takes note of the slow ones
+static int _trace_slow_statement(unsigned type, void *ctx, void *p, void *x)
+{
+  dt_database_t *db = (dt_database_t *)ctx;
+  if(type != SQLITE_TRACE_PROFILE) return 0;
+
+  const sqlite3_int64 ns = *(const sqlite3_int64 *)x;
+  if(ns < db->slow_ns) return 0;
+
+  sqlite3_stmt *stmt = (sqlite3_stmt *)p;
+  char *sql = sqlite3_expanded_sql(stmt);
+  dt_print(DT_DEBUG_SQL, "[sql] slow statement, %.3f ms: %s\n", ns * 1e-6, sql ? sql : sqlite3_sql(stmt));
+  sqlite3_free(sql);
+
+  const char *text = sqlite3_sql(stmt);
+  if(!text) return 0;
+  dt_pthread_mutex_lock(&db->slow_mutex);
+  dt_database_slow_t *slow = (dt_database_slow_t *)g_hash_table_lookup(db->slow, text);
+  if(!slow)
+  {
+    slow = g_new0(dt_database_slow_t, 1);
+    g_hash_table_insert(db->slow, g_strdup(text), slow);
+  }
+  slow->count++;
+  slow->total_ns += ns;
+  slow->max_ns = MAX(slow->max_ns, ns);
+  dt_pthread_mutex_unlock(&db->slow_mutex);
+  return 0;
+}
+
+// log the slow statements with how sqlite runs them
+static void _slow_statements_summary(dt_database_t *db)
+{
+  if(!g_hash_table_size(db->slow)) return;
+
+  // the plans are statements as well, don't trace them
+  sqlite3_trace_v2(db->handle, 0, NULL, NULL);
+
+  dt_print(DT_DEBUG_SQL, "[sql] %u slow statements:\n", g_hash_table_size(db->slow));
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, db->slow);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    const char *sql = (const char *)key;
+    const dt_database_slow_t *slow = (dt_database_slow_t *)value;
+    dt_print(DT_DEBUG_SQL, "[sql]   %u times, %.3f ms in total, %.3f ms at most: %s\n", slow->count,
+             slow->total_ns * 1e-6, slow->max_ns * 1e-6, sql);
+
+    gchar *query = g_strdup_printf("EXPLAIN QUERY PLAN %s", sql);
+    sqlite3_stmt *stmt;
+    if(sqlite3_prepare_v2(db->handle, query, -1, &stmt, NULL) == SQLITE_OK)
+    {
+      while(sqlite3_step(stmt) == SQLITE_ROW)
+        dt_print(DT_DEBUG_SQL, "[sql]     plan: %s\n", (const char *)sqlite3_column_text(stmt, 3));
+      sqlite3_finalize(stmt);
+    }
+    g_free(query);
+  }
+}
+
 dt_database_t *dt_database_init(const char *alternative, const gboolean load_data, const gboolean has_gui)
 {
   /*  set the threading mode to Serialized */
@@ -3133,6 +3287,10 @@ start:
   dt_database_t *db = (dt_database_t *)g_malloc0(sizeof(dt_database_t));
   db->dbfilename_data = g_strdup(dbfilename_data);
   db->dbfilename_library = g_strdup(dbfilename_library);
+  dt_pthread_mutex_init(&db->stmt_mutex, NULL);
+  db->stmt_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _statement_cache_free_idle);
+  dt_pthread_mutex_init(&db->slow_mutex, NULL);
+  db->slow = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
   dt_atomic_set_int(&_trxid, 0);
 
@@ -3209,8 +3367,12 @@ start:
   sqlite3_finalize(stmt);
 
   // some sqlite3 config
-  sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
+  _set_journal_pragmas(db);
+  if(darktable.unmuted & DT_DEBUG_SQL)
+  {
+    db->slow_ns = (sqlite3_int64)dt_conf_get_int("database/slow_statement_ms") * 1000000;
+    sqlite3_trace_v2(db->handle, SQLITE_TRACE_PROFILE, _trace_slow_statement, db);
+  }
   sqlite3_exec(db->handle, "PRAGMA page_size = 32768", NULL, NULL, NULL);
 
   // WARNING: the foreign_keys pragma must not be used, the integrity of the
@@ -3651,8 +3813,25 @@ error:
   return db;
 }
 
+static void _statement_cache_flush(const dt_database_t *db)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  dt_pthread_mutex_lock(&d->stmt_mutex);
+  g_hash_table_remove_all(d->stmt_cache);
+  dt_pthread_mutex_unlock(&d->stmt_mutex);
+}
+
 void dt_database_destroy(const dt_database_t *db)
 {
+  if(db->stmt_hits + db->stmt_misses)
+    dt_print(DT_DEBUG_SQL, "[sql] statement cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses\n",
+             (guint64)db->stmt_hits, (guint64)db->stmt_misses);
+  _slow_statements_summary((dt_database_t *)db);
+  _statement_cache_flush(db);
+  g_hash_table_destroy(db->stmt_cache);
+  g_hash_table_destroy(db->slow);
+  dt_pthread_mutex_destroy(&((dt_database_t *)db)->stmt_mutex);
+  dt_pthread_mutex_destroy(&((dt_database_t *)db)->slow_mutex);
   sqlite3_close(db->handle);
   if(db->lockfile_data)
   {
@@ -3676,6 +3855,69 @@ sqlite3 *dt_database_get(const dt_database_t *db)
   return db ? db->handle : NULL;
 }
 
+sqlite3_stmt *dt_database_prepare_cached(const struct dt_database_t *db, const char *sql)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  sqlite3_stmt *stmt = NULL;
+
+  dt_pthread_mutex_lock(&d->stmt_mutex);
+  GPtrArray *idle = g_hash_table_lookup(d->stmt_cache, sql);
+  if(idle && idle->len)
+  {
+    stmt = (sqlite3_stmt *)g_ptr_array_index(idle, idle->len - 1);
+    g_ptr_array_set_size(idle, idle->len - 1);
+    d->stmt_hits++;
+  }
+  else
+    d->stmt_misses++;
+  dt_pthread_mutex_unlock(&d->stmt_mutex);
+
+  if(!stmt && sqlite3_prepare_v2(db->handle, sql, -1, &stmt, NULL) != SQLITE_OK)
+  {
+    fprintf(stderr, "[dt_database_prepare_cached] query \"%s\": %s\n", sql, sqlite3_errmsg(db->handle));
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+  }
+  return stmt;
+}
+
+void dt_database_release_statement(const struct dt_database_t *db, sqlite3_stmt *stmt)
+{
+  if(!stmt) return;
+  dt_database_t *d = (dt_database_t *)db;
+
+  // an idle statement must not hold on to a read transaction or the previous values
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+
+  // sqlite keeps the text the statement was prepared from, the same as the key it was asked for with
+  const char *sql = sqlite3_sql(stmt);
+  dt_pthread_mutex_lock(&d->stmt_mutex);
+  GPtrArray *idle = g_hash_table_lookup(d->stmt_cache, sql);
+  if(!idle)
+  {
+    idle = g_ptr_array_new();
+    g_hash_table_insert(d->stmt_cache, g_strdup(sql), idle);
+  }
+  if(idle->len < DT_DATABASE_STMT_CACHE_IDLE)
+  {
+    g_ptr_array_add(idle, stmt);
+    stmt = NULL;
+  }
+  dt_pthread_mutex_unlock(&d->stmt_mutex);
+
+  if(stmt) sqlite3_finalize(stmt);
+}
+
+void dt_database_statement_cache_stats(const struct dt_database_t *db, uint64_t *hits, uint64_t *misses)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  dt_pthread_mutex_lock(&d->stmt_mutex);
+  *hits = d->stmt_hits;
+  *misses = d->stmt_misses;
+  dt_pthread_mutex_unlock(&d->stmt_mutex);
+}
+
 const gchar *dt_database_get_path(const struct dt_database_t *db)
 {
   return db->dbfilename_library;
@@ -3738,6 +3980,9 @@ gboolean dt_database_get_lock_acquired(const dt_database_t *db)
 
 void dt_database_cleanup_busy_statements(const struct dt_database_t *db)
 {
+  // the cached ones are no leftovers
+  _statement_cache_flush(db);
+
   sqlite3_stmt *stmt = NULL;
   while( (stmt = sqlite3_next_stmt(db->handle, NULL)) != NULL)
   {
@@ -4563,37 +4808,36 @@ gchar *dt_database_get_most_recent_snap(const char* db_filename)
 
 // Nested transactions support
 //
-// NOTE: the nested support is actually not activated (see || TRUE below). This current
-//       implementation is just a refactoring of the previous code using:
-//          - dt_database_start_transaction()
-//          - dt_database_release_transaction()
-//          - dt_database_rollback_transaction()
-//
-//       With this refactoring we can count and check for nested transaction and unmatched
-//       transaction routines. And it has been done to help further implementation for
-//       proper threading and nested transaction support.
+// all threads share one connection and so one transaction. the outermost
+// dt_database_start_transaction() opens it, nested ones, say the sidecar read during an import
+// batch, use a savepoint. the transaction belongs to one thread at a time: _trx_lock is taken
+// by every start and given back by the matching release or rollback, so other threads wait for
+// the outermost release (or the next cycle) instead of nesting their work into somebody else's
+// transaction. long running jobs cycle their transaction as soon as somebody waits for it.
 //
 void dt_database_start_transaction(const struct dt_database_t *db)
 {
+  if(!g_rec_mutex_trylock(&_trx_lock))
+  {
+    dt_atomic_add_int(&_trx_waiting, 1);
+    g_rec_mutex_lock(&_trx_lock);
+    dt_atomic_sub_int(&_trx_waiting, 1);
+  }
   const int trxid = dt_atomic_add_int(&_trxid, 1);
 
   // if top level a simple unamed transaction is used BEGIN / COMMIT / ROLLBACK
   // otherwise we use a savepoint (named transaction).
 
-  if(trxid == 0 || TRUE)
+  if(trxid == 0)
   {
     // In theads application it may be safer to use an IMMEDIATE transaction:
     // "BEGIN IMMEDIATE TRANSACTION"
     DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), "BEGIN TRANSACTION", NULL, NULL, NULL);
   }
-#ifdef USE_NESTED_TRANSACTIONS
   else
   {
-    char SQLTRX[32] = { 0 };
-    g_snprintf(SQLTRX, sizeof(SQLTRX), "SAVEPOINT trx%d", trxid);
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), SQLTRX, NULL, NULL, NULL);
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), "SAVEPOINT dt_nested", NULL, NULL, NULL);
   }
-#endif
 
   if(trxid > MAX_NESTED_TRANSACTIONS)
     fprintf(stderr, "[dt_database_start_transaction] more than %d nested transaction\n", MAX_NESTED_TRANSACTIONS);
@@ -4604,20 +4848,21 @@ void dt_database_release_transaction(const struct dt_database_t *db)
   const int trxid = dt_atomic_sub_int(&_trxid, 1);
 
   if(trxid <= 0)
+  {
     fprintf(stderr, "[dt_database_release_transaction] COMMIT outside a transaction\n");
+    dt_atomic_set_int(&_trxid, 0);
+    return;
+  }
 
-  if(trxid == 1 || TRUE)
+  if(trxid == 1)
   {
     DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), "COMMIT TRANSACTION", NULL, NULL, NULL);
   }
-#ifdef USE_NESTED_TRANSACTIONS
   else
   {
-    char SQLTRX[64] = { 0 };
-    g_snprintf(SQLTRX, sizeof(SQLTRX), "RELEASE SAVEPOINT trx%d", trxid - 1);
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), SQLTRX, NULL, NULL, NULL);
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), "RELEASE SAVEPOINT dt_nested", NULL, NULL, NULL);
   }
-#endif
+  g_rec_mutex_unlock(&_trx_lock);
 }
 
 void dt_database_rollback_transaction(const struct dt_database_t *db)
@@ -4625,20 +4870,43 @@ void dt_database_rollback_transaction(const struct dt_database_t *db)
   const int trxid = dt_atomic_sub_int(&_trxid, 1);
 
   if(trxid <= 0)
+  {
     fprintf(stderr, "[dt_database_rollback_transaction] ROLLBACK outside a transaction\n");
+    dt_atomic_set_int(&_trxid, 0);
+    return;
+  }
 
-  if(trxid == 1 || TRUE)
+  if(trxid == 1)
   {
     DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), "ROLLBACK TRANSACTION", NULL, NULL, NULL);
   }
-#ifdef USE_NESTED_TRANSACTIONS
   else
   {
-    char SQLTRX[64] = { 0 };
-    g_snprintf(SQLTRX, sizeof(SQLTRX), "ROLLBACK TRANSACTION TO SAVEPOINT trx%d", trxid - 1);
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), SQLTRX, NULL, NULL, NULL);
+    // rolling back to a savepoint keeps it open
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), "ROLLBACK TRANSACTION TO SAVEPOINT dt_nested", NULL, NULL, NULL);
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(db), "RELEASE SAVEPOINT dt_nested", NULL, NULL, NULL);
   }
-#endif
+  g_rec_mutex_unlock(&_trx_lock);
+}
+
+void dt_database_cycle_transaction(const struct dt_database_t *db)
+{
+  // only the outermost transaction can be committed, with others open inside it just keep going.
+  // the owner of the transaction holds _trx_lock, so nobody else can be nested in it, and a thread
+  // failing to take it has no transaction to cycle.
+  if(!g_rec_mutex_trylock(&_trx_lock)) return;
+  const gboolean outermost = dt_atomic_get_int(&_trxid) == 1;
+  g_rec_mutex_unlock(&_trx_lock);
+  if(!outermost) return;
+  dt_database_release_transaction(db);
+  // the mutex isn't fair, give the threads waiting for the database a moment to take it
+  for(int i = 0; i < 100 && dt_atomic_get_int(&_trx_waiting) > 0; i++) g_usleep(100);
+  dt_database_start_transaction(db);
+}
+
+void dt_database_yield_transaction(const struct dt_database_t *db)
+{
+  if(dt_atomic_get_int(&_trx_waiting) > 0) dt_database_cycle_transaction(db);
 }
 
 // clang-format off
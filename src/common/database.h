@@ -19,6 +19,7 @@
 #pragma once
 
 #include <glib.h>
+#include <stdint.h>
 
 struct dt_database_t;
 
@@ -28,6 +29,14 @@ struct dt_database_t *dt_database_init(const char *alternative, const gboolean l
 void dt_database_destroy(const struct dt_database_t *);
 /** get handle */
 struct sqlite3 *dt_database_get(const struct dt_database_t *);
+/** get a prepared statement for sql from the statement cache, preparing it the first time. the statement is
+ * the caller's alone until handed back with dt_database_release_statement(), so threads running the same sql
+ * at once get one each. returns NULL if sql can't be prepared. */
+struct sqlite3_stmt *dt_database_prepare_cached(const struct dt_database_t *db, const char *sql);
+/** reset the statement, clear its bindings and put it back into the cache */
+void dt_database_release_statement(const struct dt_database_t *db, struct sqlite3_stmt *stmt);
+/** statement cache lookups served from the cache and those that had to prepare */
+void dt_database_statement_cache_stats(const struct dt_database_t *db, uint64_t *hits, uint64_t *misses);
 /** Returns database path */
 const gchar *dt_database_get_path(const struct dt_database_t *db);
 /** test if database was already locked by another instance */
@@ -56,6 +65,13 @@ gchar *dt_database_get_most_recent_snap(const char* db_filename);
 void dt_database_start_transaction(const struct dt_database_t *db);
 void dt_database_release_transaction(const struct dt_database_t *db);
 void dt_database_rollback_transaction(const struct dt_database_t *db);
+/** commit the outermost transaction and open a new one, for jobs writing many rows in batches.
+ * threads waiting to start a transaction get their turn in between. does nothing while nested
+ * transactions are open. */
+void dt_database_cycle_transaction(const struct dt_database_t *db);
+/** cycle the transaction only if another thread waits to start one. batches call it before slow
+ * work such as file reads, so nobody waits for the database behind them. */
+void dt_database_yield_transaction(const struct dt_database_t *db);
 
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
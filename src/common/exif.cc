@@ -40,6 +40,9 @@ extern "C" {
 #include <cmath>
 #include <fstream>
 #include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <string>
 
@@ -317,9 +320,17 @@ static const char *_exif_get_exiv2_tag_type(const char *tagname)
   return NULL;
 }
 
+#if EXIV2_TEST_VERSION(0,27,0)
+// from 0.27 on, only the xmp toolkit behind readMetadata needs to be serialized. exiv2 does that itself
+// through the lock function handed to XmpParser::initialize() in dt_exif_init(), so metadata of
+// different files can be read concurrently.
+#define read_metadata_threadsafe(image)                       \
+{                                                             \
+  image->readMetadata();                                      \
+}
+#else
 // exiv2's readMetadata is not thread safe in 0.26. so we lock it. since readMetadata might throw an exception we
 // wrap it into some c++ magic to make sure we unlock in all cases. well, actually not magic but basic raii.
-// FIXME: check again once we rely on 0.27
 class Lock
 {
 public:
@@ -332,6 +343,46 @@ public:
   Lock lock;                                                  \
   image->readMetadata();                                      \
 }
+#endif
+
+// metadata parsed by dt_exif_read_ahead(), waiting for dt_exif_read() of the same file. an entry is made by
+// dt_exif_read_ahead_reserve() and has no image until the parsing is done. the oldest entries go first.
+#define DT_EXIF_READ_AHEAD_MAX 64
+typedef struct dt_exif_read_ahead_t
+{
+  std::unique_ptr<Exiv2::Image> image;
+  std::list<std::string>::iterator order;
+} dt_exif_read_ahead_t;
+static std::map<std::string, dt_exif_read_ahead_t> _read_ahead;
+static std::list<std::string> _read_ahead_order; // oldest first
+static std::mutex _read_ahead_mutex;
+
+// _read_ahead_mutex has to be held by the caller
+static void _read_ahead_erase(std::map<std::string, dt_exif_read_ahead_t>::iterator it)
+{
+  _read_ahead_order.erase(it->second.order);
+  _read_ahead.erase(it);
+}
+
+static std::unique_ptr<Exiv2::Image> _open_and_read_metadata(const char *path)
+{
+  {
+    std::lock_guard<std::mutex> lock(_read_ahead_mutex);
+    auto it = _read_ahead.find(path);
+    if(it != _read_ahead.end())
+    {
+      // still being parsed: do it ourselves, and the read ahead will drop its result
+      std::unique_ptr<Exiv2::Image> image = std::move(it->second.image);
+      _read_ahead_erase(it);
+      if(image) return image;
+    }
+  }
+
+  std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
+  assert(image.get() != 0);
+  read_metadata_threadsafe(image);
+  return image;
+}
 
 static void _exif_import_tags(dt_image_t *img, Exiv2::XmpData::iterator &pos);
 static void read_xmp_timestamps(Exiv2::XmpData &xmpData, dt_image_t *img, const int xmp_version);
@@ -1724,9 +1775,7 @@ int dt_exif_read(dt_image_t *img, const char *path)
 
   try
   {
-    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
-    assert(image.get() != 0);
-    read_metadata_threadsafe(image);
+    std::unique_ptr<Exiv2::Image> image = _open_and_read_metadata(path);
     bool res = true;
 
     // EXIF metadata
@@ -4610,6 +4659,52 @@ static void dt_exif_log_handler(int log_level, const char *message)
   }
 }
 
+void dt_exif_read_ahead_reserve(const char *path)
+{
+  std::lock_guard<std::mutex> lock(_read_ahead_mutex);
+  if(_read_ahead.count(path)) return;
+  // nobody came for the oldest one, make room
+  if(_read_ahead.size() >= DT_EXIF_READ_AHEAD_MAX) _read_ahead_erase(_read_ahead.find(_read_ahead_order.front()));
+  dt_exif_read_ahead_t &entry = _read_ahead[path];
+  entry.order = _read_ahead_order.insert(_read_ahead_order.end(), path);
+}
+
+void dt_exif_read_ahead(const char *path)
+{
+  try
+  {
+    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
+    assert(image.get() != 0);
+    read_metadata_threadsafe(image);
+
+    std::lock_guard<std::mutex> lock(_read_ahead_mutex);
+    // the entry is gone when dt_exif_read() got there first, or it was forgotten or pushed out
+    auto it = _read_ahead.find(path);
+    if(it != _read_ahead.end()) it->second.image = std::move(image);
+  }
+  catch(Exiv2::AnyError &)
+  {
+    // dt_exif_read() will run into this again and report it
+  }
+}
+
+void dt_exif_read_ahead_forget(const char *path)
+{
+  std::lock_guard<std::mutex> lock(_read_ahead_mutex);
+  auto it = _read_ahead.find(path);
+  if(it != _read_ahead.end()) _read_ahead_erase(it);
+}
+
+#if EXIV2_TEST_VERSION(0,27,0)
+static void _exif_xmp_lock(void *data, bool lock)
+{
+  if(lock)
+    dt_pthread_mutex_lock((dt_pthread_mutex_t *)data);
+  else
+    dt_pthread_mutex_unlock((dt_pthread_mutex_t *)data);
+}
+#endif
+
 void dt_exif_init()
 {
   // preface the exiv2 messages with "[exiv2] "
@@ -4619,7 +4714,11 @@ void dt_exif_init()
   Exiv2::enableBMFF();
   #endif
 
+#if EXIV2_TEST_VERSION(0,27,0)
+  Exiv2::XmpParser::initialize(_exif_xmp_lock, &darktable.exiv2_threadsafe);
+#else
   Exiv2::XmpParser::initialize();
+#endif
   // this has to stay with the old url (namespace already propagated outside dt)
   Exiv2::XmpProperties::registerNs("http://darktable.sf.net/", "darktable");
   // check is Exiv2 version already knows these prefixes
@@ -4645,6 +4744,11 @@ void dt_exif_init()
 
 void dt_exif_cleanup()
 {
+  {
+    std::lock_guard<std::mutex> lock(_read_ahead_mutex);
+    _read_ahead.clear();
+    _read_ahead_order.clear();
+  }
   Exiv2::XmpParser::terminate();
 }
 
@@ -64,6 +64,14 @@ const GList* dt_exif_get_exiv2_taglist();
  * struct. returns 0 on success. */
 int dt_exif_read(dt_image_t *img, const char *path);
 
+/** make room for a dt_exif_read_ahead() of path. until then, dt_exif_read() and dt_exif_read_ahead_forget()
+ * of path make it drop its result. */
+void dt_exif_read_ahead_reserve(const char *path);
+/** parse the metadata of path, possibly in another thread, and keep it for the next dt_exif_read() of it. */
+void dt_exif_read_ahead(const char *path);
+/** drop what dt_exif_read_ahead() kept for path, if dt_exif_read() didn't take it. */
+void dt_exif_read_ahead_forget(const char *path);
+
 /** read exif data to image struct from given data blob, wherever you got it from. */
 int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size);
 
@@ -29,7 +29,6 @@ typedef enum dt_gaussian_order_t
   DT_IOP_GAUSSIAN_TWO = 2   // $DESCRIPTION: "order 2"
 } dt_gaussian_order_t;
 
-
 typedef struct dt_gaussian_t
 {
   int width, height, channels;
@@ -54,6 +53,9 @@ void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
 
 void dt_gaussian_blur_4c(dt_gaussian_t *g, const float *const in, float *const out);
 
+// the former column by column implementation, only kept as the reference for src/tests/gaussian.c
+void dt_gaussian_blur_columns(dt_gaussian_t *g, const float *const in, float *const out);
+
 void dt_gaussian_free(dt_gaussian_t *g);
 
 
@@ -1551,13 +1551,12 @@ static uint32_t _image_import_internal(const int32_t film_id, const char *filena
 
   //insert a v0 record (which may be updated later if no v0 xmp exists)
   // clang-format off
-  DT_DEBUG_SQLITE3_PREPARE_V2
-    (dt_database_get(darktable.db),
+  DT_DEBUG_SQLITE3_PREPARE_CACHED
+    (darktable.db,
      "INSERT INTO main.images (id, film_id, filename, license, sha1sum, flags, version, "
      "                         max_version, history_end, position, import_timestamp)"
      " SELECT NULL, ?1, ?2, '', '', ?3, 0, 0, 0, (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000)  + (1 << 32), ?4 "
-     " FROM images",
-     -1, &stmt, NULL);
+     " FROM images", &stmt);
   // clang-format on
 
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
@@ -1567,7 +1566,7 @@ static uint32_t _image_import_internal(const int32_t film_id, const char *filena
 
   rc = sqlite3_step(stmt);
   if(rc != SQLITE_DONE) fprintf(stderr, "sqlite3 error %d\n", rc);
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
 
   id = dt_image_get_id(film_id, imgfname);
 
@@ -1668,6 +1667,9 @@ static uint32_t _image_import_internal(const int32_t film_id, const char *filena
 
   // printf("[image_import] importing `%s' to img id %d\n", imgfname, id);
 
+  // the exif and sidecar reads below are slow, don't keep other threads waiting behind a batched import
+  dt_database_yield_transaction(darktable.db);
+
   // lock as shortly as possible:
   dt_image_t *img = dt_image_cache_get(darktable.image_cache, id, 'w');
   img->group_id = group_id;
@@ -1773,13 +1775,12 @@ int32_t dt_image_get_id(uint32_t film_id, const gchar *filename)
 {
   int32_t id = -1;
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id FROM main.images WHERE film_id = ?1 AND filename = ?2",
-                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db,
+                                  "SELECT id FROM main.images WHERE film_id = ?1 AND filename = ?2", &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, filename, -1, SQLITE_TRANSIENT);
   if(sqlite3_step(stmt) == SQLITE_ROW) id=sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
   return id;
 }
 
@@ -38,16 +38,15 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
   // load stuff from db and store in cache:
   sqlite3_stmt *stmt;
   // clang-format off
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(
+      darktable.db,
       "SELECT id, group_id, film_id, width, height, filename, maker, model, lens, exposure,"
       "       aperture, iso, focal_length, datetime_taken, flags, crop, orientation,"
       "       focus_distance, raw_parameters, longitude, latitude, altitude, color_matrix,"
       "       colorspace, version, raw_black, raw_maximum, aspect_ratio, exposure_bias,"
       "       import_timestamp, change_timestamp, export_timestamp, print_timestamp, output_width, output_height"
       "  FROM main.images"
-      "  WHERE id = ?1",
-      -1, &stmt, NULL);
+      "  WHERE id = ?1", &stmt);
   // clang-format on
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, entry->key);
   if(sqlite3_step(stmt) == SQLITE_ROW)
@@ -158,7 +157,7 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
     fprintf(stderr, "[image_cache_allocate] failed to open image %" PRIu32 " from database: %s\n", entry->key,
             sqlite3_errmsg(dt_database_get(darktable.db)));
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
   img->cache_entry = entry; // init backref
   // could downgrade lock write->read on entry->lock if we were using concurrencykit..
   dt_image_refresh_makermodel(img);
@@ -182,7 +181,8 @@ void dt_image_cache_init(dt_image_cache_t *cache)
   //       can we get away with a fixed size?
   const uint32_t max_mem = 50 * 1024 * 1024;
   const uint32_t num = (uint32_t)(1.5f * max_mem / sizeof(dt_image_t));
-  dt_cache_init(&cache->cache, sizeof(dt_image_t), max_mem);
+  // every thumbnail and every job goes through here, so spread the lock over several shards
+  dt_cache_init_sharded(&cache->cache, sizeof(dt_image_t), max_mem, DT_CACHE_MAX_SHARDS);
   dt_cache_set_allocate_callback(&cache->cache, &dt_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &dt_image_cache_deallocate, cache);
 
@@ -196,9 +196,13 @@ void dt_image_cache_cleanup(dt_image_cache_t *cache)
 
 void dt_image_cache_print(dt_image_cache_t *cache)
 {
-  printf("[image cache] fill %.2f/%.2f MB (%.2f%%)\n", cache->cache.cost / (1024.0 * 1024.0),
+  dt_cache_stats_t stats;
+  dt_cache_get_stats(&cache->cache, &stats);
+  printf("[image cache] fill %.2f/%.2f MB (%.2f%%)\n", stats.cost / (1024.0 * 1024.0),
          cache->cache.cost_quota / (1024.0 * 1024.0),
-         (float)cache->cache.cost / (float)cache->cache.cost_quota);
+         (float)stats.cost / (float)cache->cache.cost_quota);
+  printf("[image cache] %zu entries, %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " evictions\n",
+         stats.entries, stats.hits, stats.misses, stats.evictions);
 }
 
 dt_image_t *dt_image_cache_get(dt_image_cache_t *cache, const int32_t imgid, char mode)
@@ -250,19 +254,18 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
 
   sqlite3_stmt *stmt;
   // clang-format off
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "UPDATE main.images"
-                              " SET width = ?1, height = ?2, filename = ?3, maker = ?4, model = ?5,"
-                              "     lens = ?6, exposure = ?7, aperture = ?8, iso = ?9, focal_length = ?10,"
-                              "     focus_distance = ?11, film_id = ?12, datetime_taken = ?13, flags = ?14,"
-                              "     crop = ?15, orientation = ?16, raw_parameters = ?17, group_id = ?18,"
-                              "     longitude = ?19, latitude = ?20, altitude = ?21, color_matrix = ?22,"
-                              "     colorspace = ?23, raw_black = ?24, raw_maximum = ?25,"
-                              "     aspect_ratio = ROUND(?26,1), exposure_bias = ?27,"
-                              "     import_timestamp = ?28, change_timestamp = ?29, export_timestamp = ?30,"
-                              "     print_timestamp = ?31, output_width = ?32, output_height = ?33"
-                              " WHERE id = ?34",
-                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db,
+                                  "UPDATE main.images"
+                                  " SET width = ?1, height = ?2, filename = ?3, maker = ?4, model = ?5,"
+                                  "     lens = ?6, exposure = ?7, aperture = ?8, iso = ?9, focal_length = ?10,"
+                                  "     focus_distance = ?11, film_id = ?12, datetime_taken = ?13, flags = ?14,"
+                                  "     crop = ?15, orientation = ?16, raw_parameters = ?17, group_id = ?18,"
+                                  "     longitude = ?19, latitude = ?20, altitude = ?21, color_matrix = ?22,"
+                                  "     colorspace = ?23, raw_black = ?24, raw_maximum = ?25,"
+                                  "     aspect_ratio = ROUND(?26,1), exposure_bias = ?27,"
+                                  "     import_timestamp = ?28, change_timestamp = ?29, export_timestamp = ?30,"
+                                  "     print_timestamp = ?31, output_width = ?32, output_height = ?33"
+                                  " WHERE id = ?34", &stmt);
   // clang-format on
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->width);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, img->height);
@@ -306,7 +309,7 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 34, img->id);
   const int rc = sqlite3_step(stmt);
   if(rc != SQLITE_DONE) fprintf(stderr, "[image_cache_write_release] sqlite3 error %d\n", rc);
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
 
   // TODO: make this work in relaxed mode, too.
   if(mode == DT_IMAGE_CACHE_SAFE)
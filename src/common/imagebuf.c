@@ -194,10 +194,189 @@ void dt_iop_copy_image_roi(float *const __restrict__ out, const float *const __r
   }
 }
 
+// The elementwise kernels behind the functions below. Each one is compiled for the baseline and, on x86-64,
+// once more for AVX2 and AVX-512. dt_iop_image_dispatch_init() picks one set from darktable.codepath.
+typedef struct dt_imagebuf_kernels_t
+{
+  void (*scaled_copy)(float *const restrict buf, const float *const restrict src, const float scale,
+                      const size_t n);
+  void (*fill)(float *const restrict buf, const float value, const size_t n);
+  void (*add_const)(float *const restrict buf, const float value, const size_t n);
+  void (*add_image)(float *const restrict buf, const float *const restrict other, const size_t n);
+  void (*sub_image)(float *const restrict buf, const float *const restrict other, const size_t n);
+  void (*invert)(float *const restrict buf, const float max_value, const size_t n);
+  void (*mul_const)(float *const restrict buf, const float value, const size_t n);
+  void (*div_const)(float *const restrict buf, const float value, const size_t n);
+  void (*linear_blend)(float *const restrict buf, const float lambda, const float *const restrict other,
+                       const size_t n);
+  const char *name;
+} dt_imagebuf_kernels_t;
+
+#define DT_IMAGEBUF_INLINE static inline __attribute__((always_inline))
+
+DT_IMAGEBUF_INLINE void _scaled_copy(float *const restrict buf, const float *const restrict src, const float scale,
+                                     const size_t n)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(buf, src : 16)
+#endif
+  for(size_t k = 0; k < n; k++)
+    buf[k] = scale * src[k];
+}
+
+DT_IMAGEBUF_INLINE void _fill(float *const restrict buf, const float value, const size_t n)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(buf : 16)
+#endif
+  for(size_t k = 0; k < n; k++)
+    buf[k] = value;
+}
+
+DT_IMAGEBUF_INLINE void _add_const(float *const restrict buf, const float value, const size_t n)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(buf : 16)
+#endif
+  for(size_t k = 0; k < n; k++)
+    buf[k] += value;
+}
+
+DT_IMAGEBUF_INLINE void _add_image(float *const restrict buf, const float *const restrict other, const size_t n)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(buf, other : 16)
+#endif
+  for(size_t k = 0; k < n; k++)
+    buf[k] += other[k];
+}
+
+DT_IMAGEBUF_INLINE void _sub_image(float *const restrict buf, const float *const restrict other, const size_t n)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(buf, other : 16)
+#endif
+  for(size_t k = 0; k < n; k++)
+    buf[k] -= other[k];
+}
+
+DT_IMAGEBUF_INLINE void _invert(float *const restrict buf, const float max_value, const size_t n)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(buf : 16)
+#endif
+  for(size_t k = 0; k < n; k++)
+    buf[k] = max_value - buf[k];
+}
+
+DT_IMAGEBUF_INLINE void _mul_const(float *const restrict buf, const float value, const size_t n)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(buf : 16)
+#endif
+  for(size_t k = 0; k < n; k++)
+    buf[k] *= value;
+}
+
+DT_IMAGEBUF_INLINE void _div_const(float *const restrict buf, const float value, const size_t n)
+{
+#ifdef _OPENMP
+#pragma omp simd aligned(buf : 16)
+#endif
+  for(size_t k = 0; k < n; k++)
+    buf[k] /= value;
+}
+
+DT_IMAGEBUF_INLINE void _linear_blend(float *const restrict buf, const float lambda, const float *const restrict other,
+                                      const size_t n)
+{
+  const float lambda_1 = 1.0f - lambda;
+#ifdef _OPENMP
+#pragma omp simd aligned(buf : 16)
+#endif
+  for(size_t k = 0; k < n; k++)
+    buf[k] = lambda * buf[k] + lambda_1 * other[k];
+}
+
+// stamp out one set of kernels for the given target attribute
+#define DT_IMAGEBUF_KERNELS(suffix, target)                                                                         \
+  static target void _scaled_copy_##suffix(float *const restrict buf, const float *const restrict src,              \
+                                           const float scale, const size_t n)                                     \
+  {                                                                                                                 \
+    _scaled_copy(buf, src, scale, n);                                                                               \
+  }                                                                                                                 \
+  static target void _fill_##suffix(float *const restrict buf, const float value, const size_t n)                  \
+  {                                                                                                                 \
+    _fill(buf, value, n);                                                                                           \
+  }                                                                                                                 \
+  static target void _add_const_##suffix(float *const restrict buf, const float value, const size_t n)             \
+  {                                                                                                                 \
+    _add_const(buf, value, n);                                                                                      \
+  }                                                                                                                 \
+  static target void _add_image_##suffix(float *const restrict buf, const float *const restrict other,              \
+                                         const size_t n)                                                            \
+  {                                                                                                                 \
+    _add_image(buf, other, n);                                                                                      \
+  }                                                                                                                 \
+  static target void _sub_image_##suffix(float *const restrict buf, const float *const restrict other,              \
+                                         const size_t n)                                                            \
+  {                                                                                                                 \
+    _sub_image(buf, other, n);                                                                                      \
+  }                                                                                                                 \
+  static target void _invert_##suffix(float *const restrict buf, const float max_value, const size_t n)            \
+  {                                                                                                                 \
+    _invert(buf, max_value, n);                                                                                     \
+  }                                                                                                                 \
+  static target void _mul_const_##suffix(float *const restrict buf, const float value, const size_t n)             \
+  {                                                                                                                 \
+    _mul_const(buf, value, n);                                                                                      \
+  }                                                                                                                 \
+  static target void _div_const_##suffix(float *const restrict buf, const float value, const size_t n)             \
+  {                                                                                                                 \
+    _div_const(buf, value, n);                                                                                      \
+  }                                                                                                                 \
+  static target void _linear_blend_##suffix(float *const restrict buf, const float lambda,                          \
+                                            const float *const restrict other, const size_t n)                     \
+  {                                                                                                                 \
+    _linear_blend(buf, lambda, other, n);                                                                           \
+  }                                                                                                                 \
+  static const dt_imagebuf_kernels_t _kernels_##suffix                                                              \
+      = { _scaled_copy_##suffix, _fill_##suffix,      _add_const_##suffix, _add_image_##suffix,                   \
+          _sub_image_##suffix,   _invert_##suffix,    _mul_const_##suffix, _div_const_##suffix,                   \
+          _linear_blend_##suffix, #suffix };
+
+DT_IMAGEBUF_KERNELS(plain, )
+#ifdef DT_HAVE_X86_DISPATCH
+DT_IMAGEBUF_KERNELS(avx2, __DT_TARGET_AVX2__)
+DT_IMAGEBUF_KERNELS(avx512, __DT_TARGET_AVX512__)
+#endif
+
+static const dt_imagebuf_kernels_t *_kernels = &_kernels_plain;
+
+void dt_iop_image_dispatch_init()
+{
+  _kernels = &_kernels_plain;
+#ifdef DT_HAVE_X86_DISPATCH
+  if(darktable.codepath.AVX512)
+    _kernels = &_kernels_avx512;
+  else if(darktable.codepath.AVX2)
+    _kernels = &_kernels_avx2;
+#endif
+  dt_print(DT_DEBUG_PERF, "[dt_iop_image_dispatch_init] using the %s image kernels\n", _kernels->name);
+}
+
+// split the buffer into one chunk per thread, keeping the chunks on cache line boundaries
+static inline size_t _chunk_size(const size_t nfloats, const size_t nthreads)
+{
+  return (((nfloats + nthreads - 1) / nthreads) + 15) & ~(size_t)15;
+}
+
 void dt_iop_image_scaled_copy(float *const restrict buf, const float *const restrict src, const float scale,
                               const size_t width, const size_t height, const size_t ch)
 {
   const size_t nfloats = width * height * ch;
+  void (*const kernel)(float *const restrict, const float *const restrict, const float, const size_t)
+      = _kernels->scaled_copy;
 #ifdef _OPENMP
   if(nfloats > parallel_imgop_minimum)	// is the copy big enough to outweigh threading overhead?
   {
@@ -205,39 +384,32 @@ void dt_iop_image_scaled_copy(float *const restrict buf, const float *const rest
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
     const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
-#pragma omp parallel for simd aligned(buf, src : 16) default(none) \
-  dt_omp_firstprivate(buf, src, scale, nfloats) schedule(simd:static) num_threads(nthreads)
-    for(size_t k = 0; k < nfloats; k++)
-      buf[k] = scale * src[k];
+    const size_t chunk = _chunk_size(nfloats, nthreads);
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, src, scale, nfloats, chunk, kernel) schedule(static) num_threads(nthreads)
+    for(size_t k = 0; k < nfloats; k += chunk)
+      kernel(buf + k, src + k, scale, MIN(chunk, nfloats - k));
     return;
   }
 #endif // _OPENMP
   // no OpenMP, or image too small to bother parallelizing
-#ifdef _OPENMP
-#pragma simd aligned(buf, src : 16)
-#endif
-  for(size_t k = 0; k < nfloats; k++)
-    buf[k] = scale * src[k];
+  kernel(buf, src, scale, nfloats);
 }
 
 void dt_iop_image_fill(float *const buf, const float fill_value, const size_t width, const size_t height,
                        const size_t ch)
 {
   const size_t nfloats = width * height * ch;
+  void (*const kernel)(float *const restrict, const float, const size_t) = _kernels->fill;
 #ifdef _OPENMP
   if(nfloats > parallel_imgop_minimum)	// is the copy big enough to outweigh threading overhead?
   {
     const size_t nthreads = MIN(16,darktable.num_openmp_threads);
-    // determine the number of 4-float vectors to be processed by each thread
-    const size_t chunksize = (((nfloats + nthreads - 1) / nthreads) + 3) / 4;
+    const size_t chunk = _chunk_size(nfloats, nthreads);
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(buf, fill_value, nfloats, nthreads, chunksize) schedule(static) num_threads(nthreads)
-    for(size_t chunk = 0; chunk < nthreads; chunk++)
-    {
-#pragma omp simd aligned(buf:16)
-      for(size_t k = 4 * chunk * chunksize; k < MIN(4*(chunk+1)*chunksize, nfloats); k++)
-        buf[k] = fill_value;
-    }
+  dt_omp_firstprivate(buf, fill_value, nfloats, chunk, kernel) schedule(static) num_threads(nthreads)
+    for(size_t k = 0; k < nfloats; k += chunk)
+      kernel(buf + k, fill_value, MIN(chunk, nfloats - k));
     return;
   }
 #endif // _OPENMP
@@ -248,169 +420,151 @@ void dt_iop_image_fill(float *const buf, const float fill_value, const size_t wi
     memset(buf, 0, sizeof(float) * nfloats);
   }
   else
-  {
-#ifdef _OPENMP
-#pragma simd aligned(buf:16)
-#endif
-    for(size_t k = 0; k < nfloats; k++)
-      buf[k] = fill_value;
-  }
+    kernel(buf, fill_value, nfloats);
 }
 
 void dt_iop_image_add_const(float *const buf, const float add_value, const size_t width, const size_t height,
                             const size_t ch)
 {
   const size_t nfloats = width * height * ch;
+  void (*const kernel)(float *const restrict, const float, const size_t) = _kernels->add_const;
 #ifdef _OPENMP
-  if(nfloats > parallel_imgop_minimum)	// is the copy big enough to outweigh threading overhead?
+  if(nfloats > parallel_imgop_minimum)	// is the task big enough to outweigh threading overhead?
   {
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
     const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
-#pragma omp parallel for simd aligned(buf:16) default(none) \
-  dt_omp_firstprivate(buf, add_value, nfloats) schedule(simd:static) num_threads(nthreads)
-    for(size_t k = 0; k < nfloats; k++)
-      buf[k] += add_value;
+    const size_t chunk = _chunk_size(nfloats, nthreads);
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, add_value, nfloats, chunk, kernel) schedule(static) num_threads(nthreads)
+    for(size_t k = 0; k < nfloats; k += chunk)
+      kernel(buf + k, add_value, MIN(chunk, nfloats - k));
     return;
   }
 #endif // _OPENMP
   // no OpenMP, or image too small to bother parallelizing
-#ifdef _OPENMP
-#pragma simd aligned(buf:16)
-#endif
-  for(size_t k = 0; k < nfloats; k++)
-    buf[k] += add_value;
+  kernel(buf, add_value, nfloats);
 }
 
 void dt_iop_image_add_image(float *const buf, const float* const other_image,
                             const size_t width, const size_t height, const size_t ch)
 {
   const size_t nfloats = width * height * ch;
+  void (*const kernel)(float *const restrict, const float *const restrict, const size_t) = _kernels->add_image;
 #ifdef _OPENMP
-  if(nfloats > parallel_imgop_minimum)	// is the copy big enough to outweigh threading overhead?
+  if(nfloats > parallel_imgop_minimum)	// is the task big enough to outweigh threading overhead?
   {
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
     const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
-#pragma omp parallel for simd aligned(buf, other_image : 16) default(none) \
-  dt_omp_firstprivate(buf, other_image, nfloats) schedule(simd:static) num_threads(nthreads)
-    for(size_t k = 0; k < nfloats; k++)
-      buf[k] += other_image[k];
+    const size_t chunk = _chunk_size(nfloats, nthreads);
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, other_image, nfloats, chunk, kernel) schedule(static) num_threads(nthreads)
+    for(size_t k = 0; k < nfloats; k += chunk)
+      kernel(buf + k, other_image + k, MIN(chunk, nfloats - k));
     return;
   }
 #endif // _OPENMP
   // no OpenMP, or image too small to bother parallelizing
-#ifdef _OPENMP
-#pragma simd aligned(buf, other_image : 16)
-#endif
-  for(size_t k = 0; k < nfloats; k++)
-    buf[k] += other_image[k];
+  kernel(buf, other_image, nfloats);
 }
 
 void dt_iop_image_sub_image(float *const buf, const float* const other_image,
                             const size_t width, const size_t height, const size_t ch)
 {
   const size_t nfloats = width * height * ch;
+  void (*const kernel)(float *const restrict, const float *const restrict, const size_t) = _kernels->sub_image;
 #ifdef _OPENMP
-  if(nfloats > parallel_imgop_minimum)	// is the copy big enough to outweigh threading overhead?
+  if(nfloats > parallel_imgop_minimum)	// is the task big enough to outweigh threading overhead?
   {
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
     const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
-#pragma omp parallel for simd aligned(buf, other_image : 16) default(none) \
-  dt_omp_firstprivate(buf, other_image, nfloats) schedule(simd:static) num_threads(nthreads)
-    for(size_t k = 0; k < nfloats; k++)
-      buf[k] -= other_image[k];
+    const size_t chunk = _chunk_size(nfloats, nthreads);
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, other_image, nfloats, chunk, kernel) schedule(static) num_threads(nthreads)
+    for(size_t k = 0; k < nfloats; k += chunk)
+      kernel(buf + k, other_image + k, MIN(chunk, nfloats - k));
     return;
   }
 #endif // _OPENMP
   // no OpenMP, or image too small to bother parallelizing
-#ifdef _OPENMP
-#pragma simd aligned(buf, other_image : 16)
-#endif
-  for(size_t k = 0; k < nfloats; k++)
-    buf[k] -= other_image[k];
+  kernel(buf, other_image, nfloats);
 }
 
 void dt_iop_image_invert(float *const buf, const float max_value, const size_t width, const size_t height,
                          const size_t ch)
 {
   const size_t nfloats = width * height * ch;
+  void (*const kernel)(float *const restrict, const float, const size_t) = _kernels->invert;
 #ifdef _OPENMP
-  if(nfloats > parallel_imgop_minimum)	// is the copy big enough to outweigh threading overhead?
+  if(nfloats > parallel_imgop_minimum)	// is the task big enough to outweigh threading overhead?
   {
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
     const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
-#pragma omp parallel for simd aligned(buf:16) default(none) \
-  dt_omp_firstprivate(buf, max_value, nfloats) schedule(simd:static) num_threads(nthreads)
-    for(size_t k = 0; k < nfloats; k++)
-      buf[k] = max_value - buf[k];
+    const size_t chunk = _chunk_size(nfloats, nthreads);
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, max_value, nfloats, chunk, kernel) schedule(static) num_threads(nthreads)
+    for(size_t k = 0; k < nfloats; k += chunk)
+      kernel(buf + k, max_value, MIN(chunk, nfloats - k));
     return;
   }
 #endif // _OPENMP
   // no OpenMP, or image too small to bother parallelizing
-#ifdef _OPENMP
-#pragma simd aligned(buf:16)
-#endif
-  for(size_t k = 0; k < nfloats; k++)
-    buf[k] = max_value - buf[k];
+  kernel(buf, max_value, nfloats);
 }
 
 void dt_iop_image_mul_const(float *const buf, const float mul_value, const size_t width, const size_t height,
                             const size_t ch)
 {
   const size_t nfloats = width * height * ch;
+  void (*const kernel)(float *const restrict, const float, const size_t) = _kernels->mul_const;
 #ifdef _OPENMP
-  if(nfloats > parallel_imgop_minimum)	// is the copy big enough to outweigh threading overhead?
+  if(nfloats > parallel_imgop_minimum)	// is the task big enough to outweigh threading overhead?
   {
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
     const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
-#pragma omp parallel for simd aligned(buf:16) default(none) \
-  dt_omp_firstprivate(buf, mul_value, nfloats) schedule(simd:static) num_threads(nthreads)
-    for(size_t k = 0; k < nfloats; k++)
-      buf[k] *= mul_value;
+    const size_t chunk = _chunk_size(nfloats, nthreads);
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, mul_value, nfloats, chunk, kernel) schedule(static) num_threads(nthreads)
+    for(size_t k = 0; k < nfloats; k += chunk)
+      kernel(buf + k, mul_value, MIN(chunk, nfloats - k));
     return;
   }
 #endif // _OPENMP
   // no OpenMP, or image too small to bother parallelizing
-#ifdef _OPENMP
-#pragma simd aligned(buf:16)
-#endif
-  for(size_t k = 0; k < nfloats; k++)
-    buf[k] *= mul_value;
+  kernel(buf, mul_value, nfloats);
 }
 
 void dt_iop_image_div_const(float *const buf, const float div_value, const size_t width, const size_t height,
                             const size_t ch)
 {
   const size_t nfloats = width * height * ch;
+  void (*const kernel)(float *const restrict, const float, const size_t) = _kernels->div_const;
 #ifdef _OPENMP
-  if(nfloats > parallel_imgop_minimum)	// is the copy big enough to outweigh threading overhead?
+  if(nfloats > parallel_imgop_minimum)	// is the task big enough to outweigh threading overhead?
   {
     // we can gain a little by using a small number of threads in parallel, but not much since the memory bus
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
     const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
-#pragma omp parallel for simd aligned(buf:16) default(none) \
-  dt_omp_firstprivate(buf, div_value, nfloats) schedule(simd:static) num_threads(nthreads)
-    for(size_t k = 0; k < nfloats; k++)
-      buf[k] /= div_value;
+    const size_t chunk = _chunk_size(nfloats, nthreads);
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, div_value, nfloats, chunk, kernel) schedule(static) num_threads(nthreads)
+    for(size_t k = 0; k < nfloats; k += chunk)
+      kernel(buf + k, div_value, MIN(chunk, nfloats - k));
     return;
   }
 #endif // _OPENMP
   // no OpenMP, or image too small to bother parallelizing
-#ifdef _OPENMP
-#pragma simd aligned(buf:16)
-#endif
-  for(size_t k = 0; k < nfloats; k++)
-    buf[k] /= div_value;
+  kernel(buf, div_value, nfloats);
 }
 
 // elementwise: buf = lammda*buf + (1-lambda)*other
@@ -418,7 +572,8 @@ void dt_iop_image_linear_blend(float *const restrict buf, const float lambda, co
                                const size_t width, const size_t height, const size_t ch)
 {
   const size_t nfloats = width * height * ch;
-  const float lambda_1 = 1.0f - lambda;
+  void (*const kernel)(float *const restrict, const float, const float *const restrict, const size_t)
+      = _kernels->linear_blend;
 #ifdef _OPENMP
   if(nfloats > parallel_imgop_minimum/2) // is the task big enough to outweigh threading overhead?
   {
@@ -426,20 +581,16 @@ void dt_iop_image_linear_blend(float *const restrict buf, const float lambda, co
     // quickly saturates (basically, each core can saturate a memory channel, so a system with quad-channel
     // memory won't be able to take advantage of more than four cores).
     const int nthreads = MIN(darktable.num_openmp_threads,parallel_imgop_maxthreads);
-#pragma omp parallel for simd aligned(buf:16) default(none) \
-  dt_omp_firstprivate(buf, lambda, lambda_1,  nfloats) \
-  dt_omp_sharedconst(other) schedule(simd:static) num_threads(nthreads)
-    for(size_t k = 0; k < nfloats; k++)
-      buf[k] = lambda*buf[k] + lambda_1*other[k];
+    const size_t chunk = _chunk_size(nfloats, nthreads);
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, lambda, other, nfloats, chunk, kernel) schedule(static) num_threads(nthreads)
+    for(size_t k = 0; k < nfloats; k += chunk)
+      kernel(buf + k, lambda, other + k, MIN(chunk, nfloats - k));
     return;
   }
 #endif // _OPENMP
   // no OpenMP, or image too small to bother parallelizing
-#ifdef _OPENMP
-#pragma simd aligned(buf:16)
-#endif
-  for(size_t k = 0; k < nfloats; k++)
-    buf[k] = lambda*buf[k] + lambda_1*other[k];
+  kernel(buf, lambda, other, nfloats);
 }
 
 // perform timings to determine the optimal threshold for switching to parallel operations, as well as the
@@ -137,6 +137,9 @@ void dt_iop_image_copy_benchmark();
 // load configurable settings from darktablerc
 void dt_iop_image_copy_configure();
 
+// pick the kernels of the functions above for the instruction sets enabled in darktable.codepath
+void dt_iop_image_dispatch_init();
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
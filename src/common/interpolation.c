@@ -1707,6 +1707,263 @@ exit:
 }
 #endif
 
+/* --------------------------------------------------------------------------
+ * Separable resampling
+ * ------------------------------------------------------------------------*/
+
+/* The resampling kernels are separable, so instead of applying the full 2D kernel for every output pixel,
+ * input rows are filtered horizontally into a small ring of rows, which is then filtered vertically. Output
+ * is produced in blocks of columns so the ring stays in L2, and each thread works through a band of output
+ * rows, filtering every input row of its band only once.
+ *
+ * The two passes are compiled for the baseline and, on x86-64, once more for AVX2 and AVX-512 like the
+ * image kernels in imagebuf.c */
+
+// output columns per block, 8kB of output row and a ring of up to a few hundred kB
+#define RESAMPLING_BLOCK_WIDTH 512
+
+typedef struct dt_resampling_kernels_t
+{
+  void (*horizontal)(float *const restrict out, const float *const restrict in, const int *const restrict length,
+                     const int *const restrict index, const float *const restrict kernel, const int width);
+  void (*vertical)(float *const restrict out, const float *const restrict ring, const size_t ring_stride,
+                   const int *const restrict slots, const float *const restrict kernel, const int taps,
+                   const size_t n);
+  const char *name;
+} dt_resampling_kernels_t;
+
+#define RESAMPLING_INLINE static inline __attribute__((always_inline))
+
+// filter one input row into width output pixels
+RESAMPLING_INLINE void _resample_horizontal(float *const restrict out, const float *const restrict in,
+                                            const int *const restrict length, const int *const restrict index,
+                                            const float *const restrict kernel, const int width)
+{
+  int tap = 0;
+  for(int ox = 0; ox < width; ox++)
+  {
+    dt_aligned_pixel_t acc = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for(int ix = 0; ix < length[ox]; ix++, tap++)
+    {
+      const float *const pixel = in + (size_t)4 * index[tap];
+      const float htap = kernel[tap];
+      for_each_channel(c, aligned(acc : 16)) acc[c] += htap * pixel[c];
+    }
+    for_each_channel(c, aligned(acc : 16)) out[(size_t)4 * ox + c] = acc[c];
+  }
+}
+
+// weighted sum of the ring rows listed in slots into n floats of output
+RESAMPLING_INLINE void _resample_vertical(float *const restrict out, const float *const restrict ring,
+                                          const size_t ring_stride, const int *const restrict slots,
+                                          const float *const restrict kernel, const int taps, const size_t n)
+{
+  const float *const restrict first = ring + slots[0] * ring_stride;
+  const float vtap = kernel[0];
+#ifdef _OPENMP
+#pragma omp simd aligned(first : 16)
+#endif
+  for(size_t k = 0; k < n; k++)
+    out[k] = vtap * first[k];
+
+  for(int iy = 1; iy < taps; iy++)
+  {
+    const float *const restrict row = ring + slots[iy] * ring_stride;
+    const float w = kernel[iy];
+#ifdef _OPENMP
+#pragma omp simd aligned(row : 16)
+#endif
+    for(size_t k = 0; k < n; k++)
+      out[k] += w * row[k];
+  }
+
+  // Clip negative RGB that may be produced by Lanczos undershooting
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(size_t k = 0; k < n; k++)
+    out[k] = fmaxf(out[k], 0.f);
+}
+
+// stamp out one set of kernels for the given target attribute
+#define RESAMPLING_KERNELS(suffix, target)                                                                          \
+  static target void _resample_horizontal_##suffix(float *const restrict out, const float *const restrict in,      \
+                                                   const int *const restrict length,                               \
+                                                   const int *const restrict index,                                \
+                                                   const float *const restrict kernel, const int width)            \
+  {                                                                                                                 \
+    _resample_horizontal(out, in, length, index, kernel, width);                                                    \
+  }                                                                                                                 \
+  static target void _resample_vertical_##suffix(float *const restrict out, const float *const restrict ring,      \
+                                                 const size_t ring_stride, const int *const restrict slots,        \
+                                                 const float *const restrict kernel, const int taps,               \
+                                                 const size_t n)                                                    \
+  {                                                                                                                 \
+    _resample_vertical(out, ring, ring_stride, slots, kernel, taps, n);                                             \
+  }                                                                                                                 \
+  static const dt_resampling_kernels_t _resampling_kernels_##suffix                                                 \
+      = { _resample_horizontal_##suffix, _resample_vertical_##suffix, #suffix };
+
+RESAMPLING_KERNELS(plain, )
+#ifdef DT_HAVE_X86_DISPATCH
+RESAMPLING_KERNELS(avx2, __DT_TARGET_AVX2__)
+RESAMPLING_KERNELS(avx512, __DT_TARGET_AVX512__)
+#endif
+
+static const dt_resampling_kernels_t *_resampling_kernels()
+{
+#ifdef DT_HAVE_X86_DISPATCH
+  if(darktable.codepath.AVX512) return &_resampling_kernels_avx512;
+  if(darktable.codepath.AVX2) return &_resampling_kernels_avx2;
+#endif
+  return &_resampling_kernels_plain;
+}
+
+static void dt_interpolation_resample_separable(const struct dt_interpolation *itor, float *out,
+                                                const dt_iop_roi_t *const roi_out, const int32_t out_stride,
+                                                const float *const in, const dt_iop_roi_t *const roi_in,
+                                                const int32_t in_stride)
+{
+  // nothing to do, and the block and band sizes below would be 0
+  if(roi_out->width <= 0 || roi_out->height <= 0) return;
+
+  // the 1:1 copy needs no plans, the direct code has it already
+  if(roi_out->scale == 1.f)
+    return dt_interpolation_resample_plain(itor, out, roi_out, out_stride, in, roi_in, in_stride);
+
+  int *hindex = NULL;
+  int *hlength = NULL;
+  float *hkernel = NULL;
+  int *hmeta = NULL;
+  int *vindex = NULL;
+  int *vlength = NULL;
+  float *vkernel = NULL;
+  int *vmeta = NULL;
+  float *ring_buf = NULL;
+  int *slot_buf = NULL;
+
+  const size_t in_stride_floats = in_stride / sizeof(float);
+  const size_t out_stride_floats = out_stride / sizeof(float);
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+
+  debug_info("resampling %p (%dx%d@%dx%d scale %f) -> %p (%dx%d@%dx%d scale %f)\n", in, roi_in->width,
+             roi_in->height, roi_in->x, roi_in->y, roi_in->scale, out, roi_out->width, roi_out->height,
+             roi_out->x, roi_out->y, roi_out->scale);
+
+#if DEBUG_RESAMPLING_TIMING
+  int64_t ts_plan = getts();
+#endif
+
+  // Prepare resampling plans once and for all, the blocks of columns start anywhere in the horizontal one
+  if(prepare_resampling_plan(itor, roi_in->width, roi_in->x, width, roi_out->x, roi_out->scale, &hlength,
+                             &hkernel, &hindex, &hmeta)
+     || prepare_resampling_plan(itor, roi_in->height, roi_in->y, height, roi_out->y, roi_out->scale, &vlength,
+                                &vkernel, &vindex, &vmeta))
+  {
+    goto exit;
+  }
+
+  // all the input rows feeding one output row have to be in the ring at the same time
+  int ring_rows = 1;
+  int max_taps = 1;
+  for(int oy = 0; oy < height; oy++)
+  {
+    const int vl = vlength[vmeta[3 * oy + 0]];
+    const int *const rows = vindex + vmeta[3 * oy + 2];
+    int first = rows[0];
+    int last = rows[0];
+    for(int iy = 1; iy < vl; iy++)
+    {
+      first = MIN(first, rows[iy]);
+      last = MAX(last, rows[iy]);
+    }
+    ring_rows = MAX(ring_rows, last - first + 1);
+    max_taps = MAX(max_taps, vl);
+  }
+
+  const int block_width = MIN(width, RESAMPLING_BLOCK_WIDTH);
+  const int nblocks = (width + block_width - 1) / block_width;
+  // a couple of tasks per thread, every band has to fill its ring first so don't make them too short
+  const int nthreads = dt_get_num_threads();
+  const int nbands_wanted = MAX(1, (2 * nthreads + nblocks - 1) / nblocks);
+  const int band_rows = MAX(MIN(height, 16), (height + nbands_wanted - 1) / nbands_wanted);
+  const int nbands = (height + band_rows - 1) / band_rows;
+
+  const size_t ring_stride = (size_t)4 * block_width;
+  size_t ring_padded = 0;
+  size_t slot_padded = 0;
+  ring_buf = dt_alloc_perthread_float(ring_stride * ring_rows, &ring_padded);
+  slot_buf = dt_alloc_perthread(ring_rows + max_taps, sizeof(int), &slot_padded);
+  if(!ring_buf || !slot_buf)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[dt_interpolation_resample] out of memory, falling back to direct resampling\n");
+    dt_interpolation_resample_direct(itor, out, roi_out, out_stride, in, roi_in, in_stride);
+    goto exit;
+  }
+
+  const dt_resampling_kernels_t *const kernels = _resampling_kernels();
+
+#if DEBUG_RESAMPLING_TIMING
+  ts_plan = getts() - ts_plan;
+  int64_t ts_resampling = getts();
+#endif
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(dynamic) \
+  dt_omp_firstprivate(in, in_stride_floats, out_stride_floats, width, height, block_width, nblocks, band_rows, \
+                      nbands, ring_rows, ring_stride, ring_padded, slot_padded, kernels) \
+  shared(out, hindex, hlength, hkernel, hmeta, vindex, vlength, vkernel, vmeta, ring_buf, slot_buf)
+#endif
+  for(int task = 0; task < nbands * nblocks; task++)
+  {
+    const int oy0 = (task / nblocks) * band_rows;
+    const int oy1 = MIN(height, oy0 + band_rows);
+    const int ox0 = (task % nblocks) * block_width;
+    const int bw = MIN(block_width, width - ox0);
+
+    float *const ring = dt_get_perthread(ring_buf, ring_padded);
+    // the input row held by each ring slot, followed by the slots used for the current output row
+    int *const ring_row = dt_get_perthread(slot_buf, slot_padded);
+    int *const slots = ring_row + ring_rows;
+    for(int s = 0; s < ring_rows; s++) ring_row[s] = -1;
+
+    const int *const hl = hlength + hmeta[3 * ox0 + 0];
+    const float *const hk = hkernel + hmeta[3 * ox0 + 1];
+    const int *const hi = hindex + hmeta[3 * ox0 + 2];
+
+    for(int oy = oy0; oy < oy1; oy++)
+    {
+      const int vl = vlength[vmeta[3 * oy + 0]];
+      const int *const rows = vindex + vmeta[3 * oy + 2];
+      for(int iy = 0; iy < vl; iy++)
+      {
+        const int s = rows[iy] % ring_rows;
+        if(ring_row[s] != rows[iy])
+        {
+          kernels->horizontal(ring + s * ring_stride, in + (size_t)rows[iy] * in_stride_floats, hl, hi, hk, bw);
+          ring_row[s] = rows[iy];
+        }
+        slots[iy] = s;
+      }
+      kernels->vertical(out + (size_t)oy * out_stride_floats + (size_t)4 * ox0, ring, ring_stride, slots,
+                        vkernel + vmeta[3 * oy + 1], vl, (size_t)4 * bw);
+    }
+  }
+
+#if DEBUG_RESAMPLING_TIMING
+  ts_resampling = getts() - ts_resampling;
+  fprintf(stderr, "resampling %p plan:%" PRId64 "us resampling:%" PRId64 "us (%s)\n", in, ts_plan,
+          ts_resampling, kernels->name);
+#endif
+
+exit:
+  dt_free_align(ring_buf);
+  dt_free_align(slot_buf);
+  dt_free_align(hlength);
+  dt_free_align(vlength);
+}
+
 /** Applies resampling (re-scaling) on *full* input and output buffers.
  *  roi_in and roi_out define the part of the buffers that is affected.
  */
@@ -1721,6 +1978,20 @@ void dt_interpolation_resample(const struct dt_interpolation *itor, float *out,
     return;
   }
 
+  dt_interpolation_resample_separable(itor, out, roi_out, out_stride, in, roi_in, in_stride);
+}
+
+void dt_interpolation_resample_direct(const struct dt_interpolation *itor, float *out,
+                                      const dt_iop_roi_t *const roi_out, const int32_t out_stride,
+                                      const float *const in, const dt_iop_roi_t *const roi_in,
+                                      const int32_t in_stride)
+{
+  if(out == NULL)
+  {
+    dt_print(DT_DEBUG_MEMORY, "[dt_interpolation_resample_direct] no valid output buffer\n");
+    return;
+  }
+
   if(darktable.codepath.OPENMP_SIMD)
     return dt_interpolation_resample_plain(itor, out, roi_out, out_stride, in, roi_in, in_stride);
 #if defined(__SSE2__)
@@ -149,6 +149,14 @@ void dt_interpolation_resample_roi(const struct dt_interpolation *itor, float *o
                                    const float *const in, const dt_iop_roi_t *const roi_in,
                                    const int32_t in_stride);
 
+/** Same as dt_interpolation_resample(), but applies the full 2D kernel for every output pixel instead of
+ * filtering separably. Slower, only kept as the reference for src/tests/resample.c
+ */
+void dt_interpolation_resample_direct(const struct dt_interpolation *itor, float *out,
+                                      const dt_iop_roi_t *const roi_out, const int32_t out_stride,
+                                      const float *const in, const dt_iop_roi_t *const roi_in,
+                                      const int32_t in_stride);
+
 #ifdef HAVE_OPENCL
 typedef struct dt_interpolation_cl_global_t
 {
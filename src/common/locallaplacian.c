@@ -23,16 +23,22 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include <assert.h>
 #include <stdio.h>
-#if defined(__SSE2__)
-#include <xmmintrin.h>
-#endif
 
 // the maximum number of levels for the gaussian pyramid
 #define max_levels 30
 // the number of segments for the piecewise linear interpolation
 #define num_gamma 6
+// coarse rows per task when reducing the remapped input, so the fine rows of a
+// band stay in cache while the curves of all brightness samples are applied
+#define LL_BAND_ROWS 16
+// fine pixels per tile when collapsing the pyramids
+#define LL_TILE_WIDTH 512
+// blocks of finished runs kept for the next one, usually the full and the preview pipe
+// come back with the same sizes while a slider is dragged. tiling doesn't know about the
+// kept blocks, so all of them together stay below a small fixed size
+#define LL_ARENA_SLOTS 2
+#define LL_ARENA_MAX_BYTES ((size_t)64 << 20)
 
 //#define DEBUG_DUMP
 
@@ -60,50 +66,6 @@ static void dump_PFM(const char *filename, const float* out, const uint32_t w, c
 #define debug_dump_PFM(f,b,w,h)
 #endif
 
-// needs a boundary of 1 or 2px around i,j or else it will crash.
-// (translates to a 1px boundary around the corresponding pixel in the coarse buffer)
-// more precisely, 1<=i<wd-1 for even wd and
-//                 1<=i<wd-2 for odd wd (j likewise with ht)
-static inline float ll_expand_gaussian(
-    const float *const coarse,
-    const int i,
-    const int j,
-    const int wd,
-    const int ht)
-{
-  assert(i > 0);
-  assert(i < wd-1);
-  assert(j > 0);
-  assert(j < ht-1);
-  assert(j/2 + 1 < (ht-1)/2+1);
-  assert(i/2 + 1 < (wd-1)/2+1);
-  const int cw = (wd-1)/2+1;
-  const int ind = (j/2)*cw+i/2;
-  // case 0:     case 1:     case 2:     case 3:
-  //  x . x . x   x . x . x   x . x . x   x . x . x
-  //  . . . . .   . . . . .   . .[.]. .   .[.]. . .
-  //  x .[x]. x   x[.]x . x   x . x . x   x . x . x
-  //  . . . . .   . . . . .   . . . . .   . . . . .
-  //  x . x . x   x . x . x   x . x . x   x . x . x
-  switch((i&1) + 2*(j&1))
-  {
-    case 0: // both are even, 3x3 stencil
-      return 4./256. * (
-          6.0f*(coarse[ind-cw] + coarse[ind-1] + 6.0f*coarse[ind] + coarse[ind+1] + coarse[ind+cw])
-          + coarse[ind-cw-1] + coarse[ind-cw+1] + coarse[ind+cw-1] + coarse[ind+cw+1]);
-    case 1: // i is odd, 2x3 stencil
-      return 4./256. * (
-          24.0*(coarse[ind] + coarse[ind+1]) +
-          4.0*(coarse[ind-cw] + coarse[ind-cw+1] + coarse[ind+cw] + coarse[ind+cw+1]));
-    case 2: // j is odd, 3x2 stencil
-      return 4./256. * (
-          24.0*(coarse[ind] + coarse[ind+cw]) +
-          4.0*(coarse[ind-1] + coarse[ind+1] + coarse[ind+cw-1] + coarse[ind+cw+1]));
-    default: // case 3: // both are odd, 2x2 stencil
-      return .25f * (coarse[ind] + coarse[ind+1] + coarse[ind+cw] + coarse[ind+cw+1]);
-  }
-}
-
 // helper to fill in one pixel boundary by copying it
 static inline void ll_fill_boundary1(
     float *const input,
@@ -116,20 +78,6 @@ static inline void ll_fill_boundary1(
   memcpy(input+wd*(ht-1), input+wd*(ht-2), sizeof(float)*wd);
 }
 
-// helper to fill in two pixels boundary by copying it
-static inline void ll_fill_boundary2(
-    float *const input,
-    const int wd,
-    const int ht)
-{
-  for(int j=1;j<ht-1;j++) input[j*wd] = input[j*wd+1];
-  if(wd & 1) for(int j=1;j<ht-1;j++) input[j*wd+wd-1] = input[j*wd+wd-2];
-  else       for(int j=1;j<ht-1;j++) input[j*wd+wd-1] = input[j*wd+wd-2] = input[j*wd+wd-3];
-  memcpy(input, input+wd, sizeof(float)*wd);
-  if(!(ht & 1)) memcpy(input+wd*(ht-2), input+wd*(ht-3), sizeof(float)*wd);
-  memcpy(input+wd*(ht-1), input+wd*(ht-2), sizeof(float)*wd);
-}
-
 static void pad_by_replication(
     float *buf,			// the buffer to be padded
     const uint32_t w,		// width of a line
@@ -148,154 +96,117 @@ static void pad_by_replication(
   }
 }
 
-static inline void gauss_expand(
-    const float *const input, // coarse input
-    float *const fine,        // upsampled, blurry output
-    const int wd,             // fine res
-    const int ht)
+// all pyramids and scratch rows of a run are carved out of one block,
+// which goes back to this arena when the run is done
+typedef struct ll_arena_t
 {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(fine, input, wd, ht) \
-  schedule(static) \
-  collapse(2)
-#endif
-  for(int j=1;j<((ht-1)&~1);j++)  // even ht: two px boundary. odd ht: one px.
-    for(int i=1;i<((wd-1)&~1);i++)
-      fine[j*wd+i] = ll_expand_gaussian(input, i, j, wd, ht);
-  ll_fill_boundary2(fine, wd, ht);
+  float *buf;
+  size_t size; // in floats
 }
+ll_arena_t;
 
-#if defined(__SSE2__)
-static inline __m128 convolve14641_vert(const float *in, const int wd)
+static GMutex _arena_lock;
+static ll_arena_t _arena[LL_ARENA_SLOTS];
+
+// returns an uninitialised block of at least size floats and its actual size
+static float *ll_arena_get(const size_t size, size_t *allocated)
 {
-  const dt_aligned_pixel_t four = { 4.f, 4.f, 4.f, 4.f };
-  __m128 r0 = _mm_loadu_ps(in);
-  __m128 r1 = _mm_loadu_ps(in + wd);
-  __m128 r2 = _mm_loadu_ps(in + 2*wd);
-  __m128 r3 = _mm_loadu_ps(in + 3*wd);
-  __m128 r4 = _mm_loadu_ps(in + 4*wd);
-  _mm_prefetch(in+4,_MM_HINT_NTA);		// prefetch next column, which won't be used again afterwards
-  r0 = _mm_add_ps(r0, r4);                      // r0 = r0+r4
-  _mm_prefetch(in+4+wd,_MM_HINT_NTA);		// prefetch next column, which won't be used again afterwards
-  r1 = _mm_add_ps(_mm_add_ps(r1,r3), r2);       // r1 = r1+r2+r3
-  _mm_prefetch(in+4+2*wd,_MM_HINT_T0);
-  r0 = _mm_add_ps(r0, _mm_add_ps(r2, r2));     // r0 = r0+2*r2+r4
-  _mm_prefetch(in+4+3*wd, _MM_HINT_T0);
-  __m128 t = _mm_mul_ps(r1, _mm_load_ps(four)); // t= 4*r1+4*r2+4*r3
-  _mm_prefetch(in+4+4*wd, _MM_HINT_T0);
-  return _mm_add_ps(r0, t);                   // r0+4*r1+6*r2+4*r3+r4
+  float *buf = NULL;
+  g_mutex_lock(&_arena_lock);
+  int best = -1;
+  for(int k=0;k<LL_ARENA_SLOTS;k++)
+    if(_arena[k].buf && _arena[k].size >= size && (best < 0 || _arena[k].size < _arena[best].size)) best = k;
+  if(best >= 0)
+  {
+    buf = _arena[best].buf;
+    *allocated = _arena[best].size;
+    _arena[best].buf = NULL;
+  }
+  g_mutex_unlock(&_arena_lock);
+
+  if(!buf)
+  {
+    buf = dt_alloc_align_float(size);
+    *allocated = size;
+  }
+  return buf;
 }
-#endif
 
-#if defined(__SSE2__)
-static inline void gauss_reduce_sse2(
-    const float *const input, // fine input buffer
-    float *const coarse,      // coarse scale, blurred input buf
-    const int wd,             // fine res
-    const int ht)
+// blocks which would take the arena beyond LL_ARENA_MAX_BYTES go back to the system
+static void ll_arena_put(float *buf, const size_t size)
 {
-  // blur, store only coarse res
-  const int cw = (wd-1)/2+1, ch = (ht-1)/2+1;
+  if(!buf) return;
+  g_mutex_lock(&_arena_lock);
+  // take an empty slot or replace the smallest block
+  int slot = 0;
+  for(int k=1;k<LL_ARENA_SLOTS && _arena[slot].buf;k++)
+    if(!_arena[k].buf || _arena[k].size < _arena[slot].size) slot = k;
+  size_t kept = size;
+  for(int k=0;k<LL_ARENA_SLOTS;k++)
+    if(k != slot && _arena[k].buf) kept += _arena[k].size;
+  if((!_arena[slot].buf || _arena[slot].size < size) && sizeof(float) * kept <= LL_ARENA_MAX_BYTES)
+  {
+    float *const evicted = _arena[slot].buf;
+    _arena[slot].buf = buf;
+    _arena[slot].size = size;
+    buf = evicted;
+  }
+  g_mutex_unlock(&_arena_lock);
+  dt_free_align(buf);
+}
 
-#ifdef _OPENMP
-  // DON'T parallelize the very smallest levels of the pyramid, as the threading overhead
-  // is greater than the time needed to do it sequentially
-#pragma omp parallel for default(none) if(ch*cw>1000)  \
-      dt_omp_firstprivate(cw, ch, input, wd, coarse) \
-      schedule(static)
-#endif
-  for(int j=1;j<ch-1;j++)
+void local_laplacian_arena_cleanup()
+{
+  g_mutex_lock(&_arena_lock);
+  for(int k=0;k<LL_ARENA_SLOTS;k++)
   {
-    const float *base = input + 2*(j-1)*wd;
-    float *const out = coarse + j*cw + 1;
-    // prime the vertical axis
-    const __m128 kernel = _mm_setr_ps(1.f, 4.f, 6.f, 4.f);
-    __m128 left = convolve14641_vert(base,wd);
-    for(int col=0; col<cw-3; col+=2)
-    {
-      // convolve the next four pixel wide vertical slice
-      base += 4;
-      __m128 right = convolve14641_vert(base,wd);
-      // horizontal pass, generate two output values from convolving with 1 4 6 4 1
-      // the first uses pixels 0-4, the second uses 2-6
-      __m128 conv = _mm_mul_ps(left,kernel);
-      out[col] = (conv[0] + conv[1] + conv[2] + conv[3] + right[0]) / 256.f;
-      out[col+1] = (left[2] + 4*(left[3]+right[1]) + 6*right[0] + right[2]) / 256.f;
-      // shift to next pair of output columns (four input columns)
-      left = right;
-    }
-    // handle the left-over pixel if the output size is odd
-    if(cw % 2)
-    {
-      base += 4;
-      float right = base[0] + 4*(base[wd]+base[3*wd]) + 6*base[2*wd] + base[4*wd];
-      __m128 conv = _mm_mul_ps(left,kernel);
-      out[cw-3] = (conv[0] + conv[1] + conv[2] + conv[3] + right) / 256.f;
-    }
+    dt_free_align(_arena[k].buf);
+    _arena[k].buf = NULL;
   }
-  ll_fill_boundary1(coarse, cw, ch);
+  g_mutex_unlock(&_arena_lock);
 }
-#endif
 
-static inline void gauss_reduce(
-    const float *const input, // fine input buffer
-    float *const coarse,      // coarse scale, blurred input buf
-    const int wd,             // fine res
-    const int ht)
+// carve n floats off the block, or only count them while there is no block yet
+static inline float *ll_carve(float *const base, size_t *const used, const size_t n)
 {
-  // blur, store only coarse res
-  const int cw = (wd-1)/2+1, ch = (ht-1)/2+1;
+  float *const buf = base ? base + *used : NULL;
+  *used += (n + 15) & ~(size_t)15; // start every buffer on a fresh cache line
+  return buf;
+}
 
-  // this is the scalar (non-simd) code:
-  const float w[5] = { 1.f/16.f, 4.f/16.f, 6.f/16.f, 4.f/16.f, 1.f/16.f };
-  memset(coarse, 0, sizeof(float)*cw*ch);
-  // direct 5x5 stencil only on required pixels:
-#ifdef _OPENMP
-  // DON'T parallelize the very smallest levels of the pyramid, as the threading overhead
-  // is greater than the time needed to do it sequentially
-#pragma omp parallel for default(none) if(ch*cw>500)  \
-  dt_omp_firstprivate(coarse, cw, ch, input, w, wd) \
-  schedule(static) \
-  collapse(2)
-#endif
-  for(int j=1;j<ch-1;j++)
-    for(int i=1;i<cw-1;i++)
-    {
-      for(int jj=-2;jj<=2;jj++)
-        for(int ii=-2;ii<=2;ii++)
-          coarse[j*cw+i] += input[(2*j+jj)*wd+2*i+ii] * w[ii+2] * w[jj+2];
-    }
-  ll_fill_boundary1(coarse, cw, ch);
+// floats each thread needs: five remapped rows and their vertical sums to reduce a band,
+// or one coarse row and three tiles to collapse a level
+static inline size_t ll_scratch_size(const int w)
+{
+  const size_t band = (size_t)6 * w;
+  const size_t tiles = (((w-1)/2+1 + 15) & ~(size_t)15) + 3 * LL_TILE_WIDTH;
+  return (MAX(band, tiles) + 15) & ~(size_t)15;
 }
 
-// allocate output buffer with monochrome brightness channel from input, padded
-// up by max_supp on all four sides, dimensions written to wd2 ht2
-static inline float *ll_pad_input(
+// fill out with the monochrome brightness channel from input, padded
+// up by max_supp on all four sides to dimensions wd2 ht2
+static inline void ll_pad_input(
     const float *const input,
     const int wd,
     const int ht,
     const int max_supp,
-    int *wd2,
-    int *ht2,
+    const int wd2,
+    const int ht2,
+    float *const out,
     local_laplacian_boundary_t *b)
 {
   const int stride = 4;
-  *wd2 = 2*max_supp + wd;
-  *ht2 = 2*max_supp + ht;
-  float *const out = dt_alloc_align_float((size_t) *wd2 * *ht2);
 
   if(b && b->mode == 2)
   { // pad by preview buffer
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-    dt_omp_firstprivate(ht, input, max_supp, out, wd, stride) \
-    shared(wd2, ht2) \
+    dt_omp_firstprivate(ht, input, max_supp, out, wd, wd2, stride) \
     schedule(static) \
     collapse(2)
 #endif // fill regular pixels:
     for(int j=0;j<ht;j++) for(int i=0;i<wd;i++)
-      out[(j+max_supp)**wd2+i+max_supp] = input[stride*(wd*j+i)] * 0.01f; // L -> [0,1]
+      out[(j+max_supp)*wd2+i+max_supp] = input[stride*(wd*j+i)] * 0.01f; // L -> [0,1]
 
     // for all out of roi pixels on the boundary we wish to pad:
     // compute coordinate in full image.
@@ -308,95 +219,95 @@ static inline float *ll_pad_input(
     float isy = ((j - max_supp) + b->roi->y)/b->roi->scale;\
     if(isx < 0 || isy >= b->buf->width\
     || isy < 0 || isy >= b->buf->height)\
-      out[*wd2*j+i] = (fallback);\
+      out[wd2*j+i] = (fallback);\
     else\
     {\
       int px = CLAMP(isx / (float)b->buf->width  * b->wd + (b->pwd-b->wd)/2, 0, b->pwd-1);\
       int py = CLAMP(isy / (float)b->buf->height * b->ht + (b->pht-b->ht)/2, 0, b->pht-1);\
       /* TODO: linear interpolation?*/\
-      out[*wd2*j+i] = b->pad0[b->pwd*py+px];\
+      out[wd2*j+i] = b->pad0[b->pwd*py+px];\
     } } while(0)
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-    dt_omp_firstprivate(input, max_supp, out, wd, stride) \
-    shared(wd2, ht2, b) \
+    dt_omp_firstprivate(input, max_supp, out, wd, wd2, ht2, stride) \
+    shared(b) \
     schedule(static) \
     collapse(2)
 #endif // left border
-    for(int j=max_supp;j<*ht2-max_supp;j++) for(int i=0;i<max_supp;i++)
+    for(int j=max_supp;j<ht2-max_supp;j++) for(int i=0;i<max_supp;i++)
       LL_FILL(input[stride*wd*(j-max_supp)]* 0.01f);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-    dt_omp_firstprivate(input, max_supp, out, stride, wd) \
-    shared(wd2, ht2, b) \
+    dt_omp_firstprivate(input, max_supp, out, stride, wd, wd2, ht2) \
+    shared(b) \
     schedule(static) \
     collapse(2)
 #endif // right border
-    for(int j=max_supp;j<*ht2-max_supp;j++) for(int i=wd+max_supp;i<*wd2;i++)
+    for(int j=max_supp;j<ht2-max_supp;j++) for(int i=wd+max_supp;i<wd2;i++)
       LL_FILL(input[stride*((j-max_supp)*wd+wd-1)] * 0.01f);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-    dt_omp_firstprivate(max_supp, out) \
-    shared(wd2, ht2, b) \
+    dt_omp_firstprivate(max_supp, out, wd2) \
+    shared(b) \
     schedule(static) \
     collapse(2)
 #endif // top border
-    for(int j=0;j<max_supp;j++) for(int i=0;i<*wd2;i++)
-      LL_FILL(out[*wd2*max_supp+i]);
+    for(int j=0;j<max_supp;j++) for(int i=0;i<wd2;i++)
+      LL_FILL(out[wd2*max_supp+i]);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-    dt_omp_firstprivate(ht, max_supp, out) \
-    shared(wd2, ht2, b) \
+    dt_omp_firstprivate(ht, max_supp, out, wd2, ht2) \
+    shared(b) \
     schedule(static) \
     collapse(2)
 #endif // bottom border
-    for(int j=max_supp+ht;j<*ht2;j++) for(int i=0;i<*wd2;i++)
-      LL_FILL(out[*wd2*(max_supp+ht-1)+i]);
+    for(int j=max_supp+ht;j<ht2;j++) for(int i=0;i<wd2;i++)
+      LL_FILL(out[wd2*(max_supp+ht-1)+i]);
 #undef LL_FILL
   }
   else
   { // pad by replication:
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-    dt_omp_firstprivate(input, ht, max_supp, out, wd, stride) \
-    shared(wd2, ht2) \
+    dt_omp_firstprivate(input, ht, max_supp, out, wd, wd2, ht2, stride) \
     schedule(static)
 #endif
     for(int j=0;j<ht;j++)
     {
       for(int i=0;i<max_supp;i++)
-        out[(j+max_supp)**wd2+i] = input[stride*wd*j]* 0.01f; // L -> [0,1]
+        out[(j+max_supp)*wd2+i] = input[stride*wd*j]* 0.01f; // L -> [0,1]
       for(int i=0;i<wd;i++)
-        out[(j+max_supp)**wd2+i+max_supp] = input[stride*(wd*j+i)] * 0.01f; // L -> [0,1]
-      for(int i=wd+max_supp;i<*wd2;i++)
-        out[(j+max_supp)**wd2+i] = input[stride*(j*wd+wd-1)] * 0.01f; // L -> [0,1]
+        out[(j+max_supp)*wd2+i+max_supp] = input[stride*(wd*j+i)] * 0.01f; // L -> [0,1]
+      for(int i=wd+max_supp;i<wd2;i++)
+        out[(j+max_supp)*wd2+i] = input[stride*(j*wd+wd-1)] * 0.01f; // L -> [0,1]
     }
-    pad_by_replication(out, *wd2, *ht2, max_supp);
+    pad_by_replication(out, wd2, ht2, max_supp);
   }
 #ifdef DEBUG_DUMP
   if(b && b->mode == 2)
   {
-    dump_PFM("/tmp/padded.pfm",out,*wd2,*ht2);
+    dump_PFM("/tmp/padded.pfm",out,wd2,ht2);
   }
 #endif
-  return out;
 }
 
 
-static inline float ll_laplacian(
-    const float *const coarse,   // coarse res gaussian
-    const float *const fine,     // fine res gaussian
-    const int i,                 // fine index
-    const int j,
-    const int wd,                // fine width
-    const int ht)                // fine height
+#define LL_INLINE static inline __attribute__((always_inline))
+
+// expf() for x <= 0 which, unlike the libm one, vectorizes with our compiler flags: 2^n set in the
+// exponent bits times a polynomial for the remainder, within a few ulp of expf()
+LL_INLINE float ll_expf(const float x)
 {
-  const float c = ll_expand_gaussian(coarse,
-      CLAMPS(i, 1, ((wd-1)&~1)-1), CLAMPS(j, 1, ((ht-1)&~1)-1), wd, ht);
-  return fine[j*wd+i] - c;
+  // clamp the exponent, not x: a clamped x gets constant folded into a branch gcc won't vectorise
+  const int n = (int)(MAX(x * 1.44269504088896341f, -126.0f) - 0.5f); // round to nearest, x <= 0
+  const float r = x - n * 0.693359375f + n * 2.12194440e-4f;
+  const float p = ((((1.9875691500e-4f * r + 1.3981999507e-3f) * r + 8.3334519073e-3f) * r
+                    + 4.1665795894e-2f) * r + 1.6666665459e-1f) * r + 5.0000001201e-1f;
+  union { float f; int32_t i; } scale = { .i = (n + 127) << 23 };
+  return x > -87.0f ? (p * r * r + r + 1.0f) * scale.f : 0.0f;
 }
 
-static inline float curve_scalar(
+LL_INLINE float curve_scalar(
     const float x,
     const float g,
     const float sigma,
@@ -405,159 +316,435 @@ static inline float curve_scalar(
     const float clarity)
 {
   const float c = x-g;
-  float val;
+  // shadow contrast for c > 0, highlight contrast below, mirrored
+  const float ssigma = c > 0.0f ? sigma : -sigma;
+  const float shadhi = c > 0.0f ? shadows : highlights;
   // blend in via quadratic bezier
-  if     (c >  2*sigma) val = g + sigma + shadows    * (c-sigma);
-  else if(c < -2*sigma) val = g - sigma + highlights * (c+sigma);
-  else if(c > 0.0f)
-  { // shadow contrast
-    const float t = CLAMPS(c / (2.0f*sigma), 0.0f, 1.0f);
-    const float t2 = t * t;
-    const float mt = 1.0f-t;
-    val = g + sigma * 2.0f*mt*t + t2*(sigma + sigma*shadows);
-  }
-  else
-  { // highlight contrast
-    const float t = CLAMPS(-c / (2.0f*sigma), 0.0f, 1.0f);
-    const float t2 = t * t;
-    const float mt = 1.0f-t;
-    val = g - sigma * 2.0f*mt*t + t2*(- sigma - sigma*highlights);
-  }
+  const float t = CLAMPS(fabsf(c) / (2.0f*sigma), 0.0f, 1.0f);
+  const float t2 = t * t;
+  const float mt = 1.0f-t;
+  const float mid = g + ssigma * 2.0f*mt*t + t2*(ssigma + ssigma*shadhi);
+  // linear further out than 2 sigma
+  const float lin = g + ssigma + shadhi * (c-ssigma);
+  float val = fabsf(c) > 2*sigma ? lin : mid;
   // midtone local contrast
-  val += clarity * c * expf(-c*c/(2.0*sigma*sigma/3.0f));
+  val += clarity * c * ll_expf(-c*c/(2.0f*sigma*sigma/3.0f));
   return val;
 }
 
-#if defined(__SSE2__)
-static inline __m128 curve_vec4(
-    const __m128 x,
-    const __m128 g,
-    const __m128 sigma,
-    const __m128 shadows,
-    const __m128 highlights,
-    const __m128 clarity)
+// everything one row of a level needs to be collapsed
+typedef struct ll_level_t
 {
-  // TODO: pull these non-data dependent constants out of the loop to see
-  // whether the compiler fail to do so
-  const __m128 const0 = _mm_set_ps1(0x3f800000u);
-  const __m128 const1 = _mm_set_ps1((float)0x402DF854u); // for e^x
-  const __m128 sign_mask = _mm_set1_ps(-0.f); // -0.f = 1 << 31
-  const __m128 one = _mm_set1_ps(1.0f);
-  const __m128 two = _mm_set1_ps(2.0f);
-  const __m128 twothirds = _mm_set1_ps(2.0f/3.0f);
-  const __m128 twosig = _mm_mul_ps(two, sigma);
-  const __m128 sigma2 = _mm_mul_ps(sigma, sigma);
-  const __m128 s22 = _mm_mul_ps(twothirds, sigma2);
-
-  const __m128 c = _mm_sub_ps(x, g);
-  const __m128 select = _mm_cmplt_ps(c, _mm_setzero_ps());
-  // select shadows or highlights as multiplier for linear part, based on c < 0
-  const __m128 shadhi = _mm_or_ps(_mm_andnot_ps(select, shadows), _mm_and_ps(select, highlights));
-  // flip sign bit of sigma based on c < 0 (c < 0 ? - sigma : sigma)
-  const __m128 ssigma = _mm_xor_ps(sigma, _mm_and_ps(select, sign_mask));
-  // this contains the linear parts valid for c > 2*sigma or c < - 2*sigma
-  const __m128 vlin = _mm_add_ps(g, _mm_add_ps(ssigma, _mm_mul_ps(shadhi, _mm_sub_ps(c, ssigma))));
-
-  const __m128 t = _mm_min_ps(one, _mm_max_ps(_mm_setzero_ps(),
-        _mm_div_ps(c, _mm_mul_ps(two, ssigma))));
-  const __m128 t2 = _mm_mul_ps(t, t);
-  const __m128 mt = _mm_sub_ps(one, t);
-
-  // midtone value fading over to linear part, without local contrast:
-  const __m128 vmid = _mm_add_ps(g,
-      _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ssigma, two), _mm_mul_ps(mt, t)),
-        _mm_mul_ps(t2, _mm_add_ps(ssigma, _mm_mul_ps(ssigma, shadhi)))));
-
-  // c > 2*sigma?
-  const __m128 linselect = _mm_cmpgt_ps(_mm_andnot_ps(sign_mask, c), twosig);
-  const __m128 val = _mm_or_ps(_mm_and_ps(linselect, vlin), _mm_andnot_ps(linselect, vmid));
-
-  // midtone local contrast
-  // dt_fast_expf in sse:
-  const __m128 arg = _mm_xor_ps(sign_mask, _mm_div_ps(_mm_mul_ps(c, c), s22));
-  const __m128 k0 = _mm_add_ps(const0, _mm_mul_ps(arg, _mm_sub_ps(const1, const0)));
-  const __m128 k = _mm_max_ps(k0, _mm_setzero_ps());
-  const __m128i ki = _mm_cvtps_epi32(k);
-  const __m128 gauss = _mm_load_ps((float*)&ki);
-  const __m128 vcon = _mm_mul_ps(clarity, _mm_mul_ps(c, gauss));
-  return _mm_add_ps(val, vcon);
+  const float *padded;            // brightness of the padded input at this level
+  const float *coarse_output;     // output pyramid one level up
+  const float *fine[num_gamma];   // remapped pyramids at this level, NULL to remap the padded input in place
+  const float *coarse[num_gamma]; // remapped pyramids one level up
+  float *output;                  // output pyramid at this level
+  int pw, ph;                     // size of this level
+  int cw;                         // width of the coarser one
+  int ng;                         // number of brightness samples
+  int max_supp;                   // padding around the input, for remapping in place
+  float sigma, shadows, highlights, clarity;
 }
+ll_level_t;
 
-// sse (4-wide)
-void apply_curve_sse2(
-    float *const out,
+LL_INLINE void ll_curve_row(
     const float *const in,
-    const uint32_t w,
-    const uint32_t h,
-    const uint32_t padding,
+    float *const out,
+    const int n,
     const float g,
     const float sigma,
     const float shadows,
     const float highlights,
     const float clarity)
 {
-  // TODO: do all this in avx2 8-wide (should be straight forward):
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(clarity, g, h, highlights, in, out, padding, shadows, sigma, w) \
+#pragma omp simd
+#endif
+  for(int i=0;i<n;i++)
+    out[i] = curve_scalar(in[i], g, sigma, shadows, highlights, clarity);
+}
+
+// one row of the next coarser level from the five fine rows r0..r4 around it,
+// 1 4 6 4 1 vertically into tmp, then horizontally at every other column
+LL_INLINE void ll_reduce_row(
+    const float *const r0,
+    const float *const r1,
+    const float *const r2,
+    const float *const r3,
+    const float *const r4,
+    float *const coarse,
+    const int cw,
+    float *const tmp)
+{
+  const int n = 2*cw-1;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int i=0;i<n;i++)
+    tmp[i] = r0[i] + 4.0f*(r1[i] + r3[i]) + 6.0f*r2[i] + r4[i];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int i=1;i<cw-1;i++)
+    coarse[i] = (tmp[2*i-2] + 4.0f*(tmp[2*i-1] + tmp[2*i+1]) + 6.0f*tmp[2*i] + tmp[2*i+2]) * (1.0f/256.0f);
+  coarse[0] = coarse[1];
+  coarse[cw-1] = coarse[cw-2];
+}
+
+// upsample the coarse level to the columns i0..i1-1 of fine row j. only 1<=i<=ie and 1<=j<=je
+// are interpolated, the boundary outside repeats them. v takes the vertically interpolated coarse row.
+LL_INLINE void ll_expand_tile(
+    const float *const coarse,
+    const int cw,
+    const int j,
+    const int je,
+    const int i0,
+    const int i1,
+    const int ie,
+    float *const v,
+    float *const fine)
+{
+  // even rows and columns sit on the coarse grid and take 1 6 1 around it,
+  // odd ones lie half way between two coarse samples
+  const int jj = CLAMPS(j, 1, je);
+  const float *const r1 = coarse + (size_t)(jj/2)*cw;
+  const float *const r0 = (jj & 1) ? r1 : r1 - cw;
+  const float *const r2 = r1 + cw;
+  const float w0 = (jj & 1) ? 0.0f : 0.125f;
+  const float w1 = (jj & 1) ? 0.5f : 0.75f;
+  const float w2 = (jj & 1) ? 0.5f : 0.125f;
+  const int c0 = MAX(CLAMPS(i0, 1, ie)/2 - 1, 0);
+  const int c1 = MIN(CLAMPS(i1-1, 1, ie)/2 + 1, cw-1);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int c=c0;c<=c1;c++)
+    v[c] = w0*r0[c] + w1*r1[c] + w2*r2[c];
+
+  const int beg = MAX(i0, 1), end = MIN(i1, ie+1);
+  if(beg >= end)
+  { // the whole tile lies in the boundary, which repeats an odd column
+    const int c = CLAMPS(i0, 1, ie)/2;
+    const float val = 0.5f*(v[c] + v[c+1]);
+    for(int i=0;i<i1-i0;i++) fine[i] = val;
+    return;
+  }
+  int i = beg;
+  if(i & 1)
+  {
+    fine[i-i0] = 0.5f*(v[i/2] + v[i/2+1]);
+    i++;
+  }
+  const int pairs = (end-i)/2;
+  const int cs = i/2;
+  float *const f = fine + (i-i0);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int p=0;p<pairs;p++)
+  {
+    const int c = cs + p;
+    f[2*p]   = 0.125f*(v[c-1] + v[c+1]) + 0.75f*v[c];
+    f[2*p+1] = 0.5f*(v[c] + v[c+1]);
+  }
+  i += 2*pairs;
+  if(i < end) fine[i-i0] = 0.125f*(v[i/2-1] + v[i/2+1]) + 0.75f*v[i/2];
+  for(int k=i0;k<beg;k++) fine[k-i0] = fine[beg-i0];
+  for(int k=end;k<i1;k++) fine[k-i0] = fine[end-1-i0];
+}
+
+// one row of the output pyramid: the upsampled coarser output plus the laplacian coefficients of the
+// remapped pyramids, blended by the brightness of the pixel. the weight of sample k is a hat function
+// around k, so a tile only visits the samples its pixels reach.
+LL_INLINE void ll_assemble_row(
+    const ll_level_t *const lv,
+    const int j,
+    float *const scratch)
+{
+  const int pw = lv->pw, cw = lv->cw, ng = lv->ng, max_supp = lv->max_supp;
+  const int ie = ((pw-1)&~1)-1, je = ((lv->ph-1)&~1)-1;
+  const float sigma = lv->sigma, shadows = lv->shadows, highlights = lv->highlights, clarity = lv->clarity;
+  float *const v = scratch;
+  float *const lap = v + ((cw + 15) & ~15);
+  float *const t = lap + LL_TILE_WIDTH;
+  float *const x = t + LL_TILE_WIDTH;
+  const float *const p = lv->padded + (size_t)j*pw;
+  float *const out = lv->output + (size_t)j*pw;
+  const int remap = lv->fine[0] == NULL;
+  const float *const xrow = lv->padded + (size_t)CLAMPS(j, max_supp, lv->ph-max_supp-1)*pw;
+
+  for(int i0=0;i0<pw;i0+=LL_TILE_WIDTH)
+  {
+    const int i1 = MIN(i0+LL_TILE_WIDTH, pw);
+    const int n = i1-i0;
+    float *const o = out + i0;
+    ll_expand_tile(lv->coarse_output, cw, j, je, i0, i1, ie, v, o);
+
+    // position of the brightness between the samples, (k+.5)/ng is sample k
+    float tmin = ng, tmax = 0.0f;
+#ifdef _OPENMP
+#pragma omp simd reduction(min:tmin) reduction(max:tmax)
+#endif
+    for(int i=0;i<n;i++)
+    {
+      t[i] = CLAMPS(p[i0+i]*ng - 0.5f, 0.0f, ng-1.0f);
+      tmin = MIN(tmin, t[i]);
+      tmax = MAX(tmax, t[i]);
+    }
+
+    if(remap)
+    { // the finest remapped levels are not stored, apply the curves of the two closest samples here.
+      // as on the coarser levels the remapped input repeats its interior on the padding.
+      const float *xs = xrow + i0;
+      if(i0 < max_supp || i1 > pw-max_supp)
+      {
+        for(int i=0;i<n;i++) x[i] = xrow[CLAMPS(i0+i, max_supp, pw-max_supp-1)];
+        xs = x;
+      }
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int i=0;i<n;i++)
+      {
+        const int lo = MIN((int)t[i], ng-2);
+        const float a = t[i] - lo;
+        o[i] += (1.0f-a) * curve_scalar(xs[i], (lo+.5f)/ng, sigma, shadows, highlights, clarity)
+                     + a * curve_scalar(xs[i], (lo+1.5f)/ng, sigma, shadows, highlights, clarity);
+      }
+    }
+
+    const int kmin = (int)tmin, kmax = MIN((int)tmax+1, ng-1);
+    for(int k=kmin;k<=kmax;k++)
+    {
+      ll_expand_tile(lv->coarse[k], cw, j, je, i0, i1, ie, v, lap);
+      if(remap)
+      {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int i=0;i<n;i++)
+          o[i] -= MAX(0.0f, 1.0f - fabsf(t[i]-k)) * lap[i];
+      }
+      else
+      {
+        const float *const f = lv->fine[k] + (size_t)j*pw + i0;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int i=0;i<n;i++)
+          o[i] += MAX(0.0f, 1.0f - fabsf(t[i]-k)) * (f[i] - lap[i]);
+      }
+    }
+  }
+}
+
+typedef void(ll_curve_row_t)(const float *const in, float *const out, const int n, const float g,
+                             const float sigma, const float shadows, const float highlights, const float clarity);
+typedef void(ll_reduce_row_t)(const float *const r0, const float *const r1, const float *const r2,
+                              const float *const r3, const float *const r4, float *const coarse, const int cw,
+                              float *const tmp);
+typedef void(ll_assemble_row_t)(const ll_level_t *const lv, const int j, float *const scratch);
+
+typedef struct ll_kernels_t
+{
+  ll_curve_row_t *curve;
+  ll_reduce_row_t *reduce;
+  ll_assemble_row_t *assemble;
+}
+ll_kernels_t;
+
+// stamp out one set of kernels for the given target attribute
+#define LL_KERNELS(suffix, target)                                                                             \
+  static target void ll_curve_row_##suffix(const float *const in, float *const out, const int n,              \
+                                           const float g, const float sigma, const float shadows,             \
+                                           const float highlights, const float clarity)                       \
+  {                                                                                                            \
+    ll_curve_row(in, out, n, g, sigma, shadows, highlights, clarity);                                          \
+  }                                                                                                            \
+  static target void ll_reduce_row_##suffix(const float *const r0, const float *const r1,                     \
+                                            const float *const r2, const float *const r3,                     \
+                                            const float *const r4, float *const coarse, const int cw,         \
+                                            float *const tmp)                                                  \
+  {                                                                                                            \
+    ll_reduce_row(r0, r1, r2, r3, r4, coarse, cw, tmp);                                                        \
+  }                                                                                                            \
+  static target void ll_assemble_row_##suffix(const ll_level_t *const lv, const int j, float *const scratch)  \
+  {                                                                                                            \
+    ll_assemble_row(lv, j, scratch);                                                                           \
+  }                                                                                                            \
+  static const ll_kernels_t ll_kernels_##suffix = { ll_curve_row_##suffix, ll_reduce_row_##suffix,            \
+                                                    ll_assemble_row_##suffix };
+
+LL_KERNELS(plain, )
+#ifdef DT_HAVE_X86_DISPATCH
+LL_KERNELS(avx2, __DT_TARGET_AVX2__)
+LL_KERNELS(avx512, __DT_TARGET_AVX512__)
+#endif
+
+static const ll_kernels_t *ll_kernels()
+{
+#ifdef DT_HAVE_X86_DISPATCH
+  if(darktable.codepath.AVX512) return &ll_kernels_avx512;
+  if(darktable.codepath.AVX2) return &ll_kernels_avx2;
+#endif
+  return &ll_kernels_plain;
+}
+
+// reduce nplanes fine levels of the same size to their next coarser level
+static void ll_reduce(
+    const ll_kernels_t *const kernels,
+    const float *const *const fine,
+    float *const *const coarse,
+    const int nplanes,
+    const int wd,             // fine res
+    const int ht,
+    float *const scratch,
+    const size_t stride)
+{
+  const int cw = (wd-1)/2+1, ch = (ht-1)/2+1;
+  const int rows = ch-2;
+  ll_reduce_row_t *const reduce_row = kernels->reduce;
+#ifdef _OPENMP
+  // DON'T parallelize the very smallest levels of the pyramid, as the threading overhead
+  // is greater than the time needed to do it sequentially
+#pragma omp parallel for default(none) if(nplanes*ch*cw>1000) \
+  dt_omp_firstprivate(fine, coarse, nplanes, rows, wd, cw, reduce_row, scratch, stride) \
   schedule(static)
 #endif
-  for(uint32_t j=padding;j<h-padding;j++)
+  for(int task=0;task<nplanes*rows;task++)
   {
-    const float *in2  = in  + j*w + padding;
-    float *out2 = out + j*w + padding;
-    // find 4-byte aligned block in the middle:
-    const float *const beg = (float *)((size_t)(out2+3)&(size_t)0x10ul);
-    const float *const end = (float *)((size_t)(out2+w-padding)&(size_t)0x10ul);
-    const float *const fin = out2+w-padding;
-    const __m128 g4 = _mm_set1_ps(g);
-    const __m128 sig4 = _mm_set1_ps(sigma);
-    const __m128 shd4 = _mm_set1_ps(shadows);
-    const __m128 hil4 = _mm_set1_ps(highlights);
-    const __m128 clr4 = _mm_set1_ps(clarity);
-    for(;out2<beg;out2++,in2++)
-      *out2 = curve_scalar(*in2, g, sigma, shadows, highlights, clarity);
-    for(;out2<end;out2+=4,in2+=4)
-      _mm_stream_ps(out2, curve_vec4(_mm_load_ps(in2), g4, sig4, shd4, hil4, clr4));
-    for(;out2<fin;out2++,in2++)
-      *out2 = curve_scalar(*in2, g, sigma, shadows, highlights, clarity);
-    out2 = out + j*w;
-    for(int i=0;i<padding;i++)   out2[i] = out2[padding];
-    for(int i=w-padding;i<w;i++) out2[i] = out2[w-padding-1];
+    const int p = task / rows, j = task % rows + 1;
+    const float *const r = fine[p] + (size_t)(2*j-2)*wd;
+    reduce_row(r, r+wd, r+2*wd, r+3*wd, r+4*wd, coarse[p] + (size_t)j*cw, cw, dt_get_perthread(scratch, stride));
   }
-  pad_by_replication(out, w, h, padding);
+  for(int p=0;p<nplanes;p++) ll_fill_boundary1(coarse[p], cw, ch);
 }
+
+// first coarse level of the remapped pyramids, reduced straight from the padded input. the curves are
+// applied to the fine rows of a band only as they are needed, so the finest remapped levels are never
+// stored. like before, the remapped interior is repeated on the padding.
+static void ll_reduce_remapped(
+    const ll_kernels_t *const kernels,
+    const float *const padded,
+    float *const *const coarse,
+    const int ng,
+    const int w,
+    const int h,
+    const int max_supp,
+    const float sigma,
+    const float shadows,
+    const float highlights,
+    const float clarity,
+    float *const scratch,
+    const size_t stride)
+{
+  const int cw = (w-1)/2+1, ch = (h-1)/2+1;
+  const int bands = (ch-2 + LL_BAND_ROWS-1) / LL_BAND_ROWS;
+  ll_curve_row_t *const curve_row = kernels->curve;
+  ll_reduce_row_t *const reduce_row = kernels->reduce;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(padded, coarse, ng, w, h, cw, ch, bands, max_supp, sigma, shadows, highlights, clarity, \
+                      curve_row, reduce_row, scratch, stride) \
+  schedule(static)
 #endif
+  for(int band=0;band<bands;band++)
+  {
+    float *const ring = dt_get_perthread(scratch, stride); // the last five remapped rows
+    float *const tmp = ring + (size_t)5*w;
+    const int j0 = 1 + band*LL_BAND_ROWS, j1 = MIN(j0+LL_BAND_ROWS, ch-1);
+    for(int k=0;k<ng;k++)
+    {
+      const float g = (k+.5f)/(float)ng;
+      int next = 2*j0-2; // next fine row to remap
+      for(int j=j0;j<j1;j++)
+      {
+        for(;next<=2*j+2;next++)
+        {
+          float *const r = ring + (size_t)(next%5)*w;
+          curve_row(padded + (size_t)CLAMPS(next, max_supp, h-max_supp-1)*w + max_supp, r + max_supp,
+                    w-2*max_supp, g, sigma, shadows, highlights, clarity);
+          for(int i=0;i<max_supp;i++)   r[i] = r[max_supp];
+          for(int i=w-max_supp;i<w;i++) r[i] = r[w-max_supp-1];
+        }
+        reduce_row(ring + (size_t)((2*j-2)%5)*w, ring + (size_t)((2*j-1)%5)*w, ring + (size_t)((2*j)%5)*w,
+                   ring + (size_t)((2*j+1)%5)*w, ring + (size_t)((2*j+2)%5)*w, coarse[k] + (size_t)j*cw, cw, tmp);
+      }
+    }
+  }
+  for(int k=0;k<ng;k++) ll_fill_boundary1(coarse[k], cw, ch);
+}
 
-// scalar version
-void apply_curve(
-    float *const out,
+// remap a whole level, for the approximate mode which starts the remapped pyramids one level up
+static void ll_remap(
+    const ll_kernels_t *const kernels,
     const float *const in,
-    const uint32_t w,
-    const uint32_t h,
-    const uint32_t padding,
-    const float g,
+    float *const *const out,
+    const int ng,
+    const int wd,
+    const int ht,
     const float sigma,
     const float shadows,
     const float highlights,
     const float clarity)
 {
+  ll_curve_row_t *const curve_row = kernels->curve;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(clarity, g, h, highlights, in, out, padding, sigma, shadows, w) \
+  dt_omp_firstprivate(in, out, ng, wd, ht, sigma, shadows, highlights, clarity, curve_row) \
   schedule(static)
 #endif
-  for(uint32_t j=padding;j<h-padding;j++)
+  for(int task=0;task<ng*ht;task++)
   {
-    const float *in2  = in  + j*w + padding;
-    float *out2 = out + j*w + padding;
-    for(uint32_t i=padding;i<w-padding;i++)
-      (*out2++) = curve_scalar(*(in2++), g, sigma, shadows, highlights, clarity);
-    out2 = out + j*w;
-    for(int i=0;i<padding;i++)   out2[i] = out2[padding];
-    for(int i=w-padding;i<w;i++) out2[i] = out2[w-padding-1];
+    const int k = task / ht, j = task % ht;
+    curve_row(in + (size_t)j*wd, out[k] + (size_t)j*wd, wd, (k+.5f)/(float)ng, sigma, shadows, highlights, clarity);
   }
-  pad_by_replication(out, w, h, padding);
+}
+
+static void ll_collapse(
+    const ll_kernels_t *const kernels,
+    const ll_level_t *const lv,
+    float *const scratch,
+    const size_t stride)
+{
+  ll_assemble_row_t *const assemble_row = kernels->assemble;
+  const int ph = lv->ph;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(lv, ph, assemble_row, scratch, stride) \
+  schedule(static)
+#endif
+  for(int j=0;j<ph;j++)
+    assemble_row(lv, j, dt_get_perthread(scratch, stride));
+}
+
+// place all pyramids and the scratch rows of every thread in base, or only count the floats if base is NULL.
+// when collecting for a later full resolution run, the padded input and the output pyramid are handed on
+// and are allocated separately.
+static size_t ll_layout(
+    float *const base,
+    const int w,
+    const int h,
+    const int last_level,
+    const int ng,
+    const int collect,
+    const size_t stride,
+    float *padded[max_levels],
+    float *output[max_levels],
+    float *buf[num_gamma][max_levels],
+    float **scratch)
+{
+  size_t used = 0;
+  for(int l=0;l<=last_level;l++)
+  {
+    const size_t size = (size_t)dl(w,l) * dl(h,l);
+    if(l < last_level && (l || !collect)) padded[l] = ll_carve(base, &used, size);
+    if(!collect) output[l] = ll_carve(base, &used, size);
+    if(l) for(int k=0;k<ng;k++) buf[k][l] = ll_carve(base, &used, size);
+  }
+  *scratch = ll_carve(base, &used, stride * dt_get_num_threads());
+  return used;
 }
 
 void local_laplacian_internal(
@@ -569,10 +756,15 @@ void local_laplacian_internal(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
-    const int use_sse2,         // flag whether to use SSE version
+    const gboolean approximate, // remap at half resolution, finest level from the input
     local_laplacian_boundary_t *b)
 {
-  if(wd <= 1 || ht <= 1) return;
+  // the pyramids need a second level, smaller images pass through
+  if(wd < 4 || ht < 4)
+  {
+    memcpy(out, input, sizeof(float) * 4 * wd * ht);
+    return;
+  }
 
   // don't divide by 2 more often than we can:
   const int num_levels = MIN(max_levels, 31-__builtin_clz(MIN(wd,ht)));
@@ -580,68 +772,62 @@ void local_laplacian_internal(
   if(b && b->mode == 2) // higher number here makes it less prone to aliasing and slower.
     last_level = num_levels > 4 ? 4 : num_levels-1;
   const int max_supp = 1<<last_level;
-  int w, h;
-  float *padded[max_levels] = {0};
-  if(b && b->mode == 2)
-    padded[0] = ll_pad_input(input, wd, ht, max_supp, &w, &h, b);
-  else
-    padded[0] = ll_pad_input(input, wd, ht, max_supp, &w, &h, 0);
-
-  // allocate pyramid pointers for padded input
-  for(int l=1;l<=last_level;l++)
-    padded[l] = dt_alloc_align_float((size_t)dl(w,l) * dl(h,l));
+  const int w = 2*max_supp + wd, h = 2*max_supp + ht;
+  const int ng = num_gamma;
+  const int collect = b && b->mode == 1;
 
-  // allocate pyramid pointers for output
+  float *padded[max_levels] = {0};
   float *output[max_levels] = {0};
-  for(int l=0;l<=last_level;l++)
-    output[l] = dt_alloc_align_float((size_t)dl(w,l) * dl(h,l));
-
-  // create gauss pyramid of padded input, write coarse directly to output
-#if defined(__SSE2__)
-  if(use_sse2)
+  float *buf[num_gamma][max_levels] = {{0}};
+  float *scratch = NULL;
+  const size_t stride = ll_scratch_size(w);
+  size_t allocated = 0;
+  float *const block = ll_arena_get(ll_layout(NULL, w, h, last_level, ng, collect, stride, padded, output, buf,
+                                              &scratch), &allocated);
+  if(!block)
   {
-    for(int l=1;l<last_level;l++)
-      gauss_reduce_sse2(padded[l-1], padded[l], dl(w,l-1), dl(h,l-1));
-    gauss_reduce_sse2(padded[last_level-1], output[last_level], dl(w,last_level-1), dl(h,last_level-1));
+    fprintf(stderr, "[local laplacian] unable to allocate pyramids for %dx%d\n", wd, ht);
+    memcpy(out, input, sizeof(float) * 4 * wd * ht);
+    return;
   }
-  else
-#endif
+  ll_layout(block, w, h, last_level, ng, collect, stride, padded, output, buf, &scratch);
+  if(collect)
   {
-    for(int l=1;l<last_level;l++)
-      gauss_reduce(padded[l-1], padded[l], dl(w,l-1), dl(h,l-1));
-    gauss_reduce(padded[last_level-1], output[last_level], dl(w,last_level-1), dl(h,last_level-1));
+    padded[0] = dt_alloc_align_float((size_t)w * h);
+    for(int l=0;l<=last_level;l++)
+      output[l] = dt_alloc_align_float((size_t)dl(w,l) * dl(h,l));
   }
+  ll_pad_input(input, wd, ht, max_supp, w, h, padded[0], b && b->mode == 2 ? b : 0);
 
-  // evenly sample brightness [0,1]:
-  float gamma[num_gamma] = {0.0f};
-  for(int k=0;k<num_gamma;k++) gamma[k] = (k+.5f)/(float)num_gamma;
-  // for(int k=0;k<num_gamma;k++) gamma[k] = k/(num_gamma-1.0f);
+  const ll_kernels_t *const kernels = ll_kernels();
 
-  // allocate memory for intermediate laplacian pyramids
-  float *buf[num_gamma][max_levels] = {{0}};
-  for(int k=0;k<num_gamma;k++) for(int l=0;l<=last_level;l++)
-    buf[k][l] = dt_alloc_align_float((size_t)dl(w,l)*dl(h,l));
+  // create gauss pyramid of padded input, write coarse directly to output
+  for(int l=1;l<last_level;l++)
+    ll_reduce(kernels, (const float *const *)&padded[l-1], &padded[l], 1, dl(w,l-1), dl(h,l-1), scratch, stride);
+  ll_reduce(kernels, (const float *const *)&padded[last_level-1], &output[last_level], 1,
+            dl(w,last_level-1), dl(h,last_level-1), scratch, stride);
 
+  // gaussian pyramids of the remapped input, evenly sampling brightness [0,1].
   // the paper says remapping only level 3 not 0 does the trick, too
   // (but i really like the additional octave of sharpness we get,
-  // willing to pay the cost).
-  for(int k=0;k<num_gamma;k++)
-  { // process images
-#if defined(__SSE2__)
-    if(use_sse2)
-      apply_curve_sse2(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
-    else // brackets in next line needed for silly gcc warning:
-#endif
-    {apply_curve(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);}
-
-    // create gaussian pyramids
-    for(int l=1;l<=last_level;l++)
-#if defined(__SSE2__)
-      if(use_sse2)
-        gauss_reduce_sse2(buf[k][l-1], buf[k][l], dl(w,l-1), dl(h,l-1));
-      else
-#endif
-        gauss_reduce(buf[k][l-1], buf[k][l], dl(w,l-1), dl(h,l-1));
+  // willing to pay the cost). the approximate mode saves it.
+  float *level[num_gamma] = {0};
+  for(int k=0;k<ng;k++) level[k] = buf[k][1];
+  const float *const padded1 = last_level > 1 ? padded[1] : output[1];
+  if(approximate)
+    ll_remap(kernels, padded1, level, ng, dl(w,1), dl(h,1), sigma, shadows, highlights, clarity);
+  else
+    ll_reduce_remapped(kernels, padded[0], level, ng, w, h, max_supp, sigma, shadows, highlights, clarity,
+                       scratch, stride);
+  for(int l=2;l<=last_level;l++)
+  {
+    const float *fine[num_gamma] = {0};
+    for(int k=0;k<ng;k++)
+    {
+      fine[k] = buf[k][l-1];
+      level[k] = buf[k][l];
+    }
+    ll_reduce(kernels, fine, level, ng, dl(w,l-1), dl(h,l-1), scratch, stride);
   }
 
   // resample output[last_level] from preview
@@ -705,38 +891,27 @@ void local_laplacian_internal(
   // assemble output pyramid coarse to fine
   for(int l=last_level-1;l >= 0; l--)
   {
-    const int pw = dl(w,l), ph = dl(h,l);
-
-    gauss_expand(output[l+1], output[l], pw, ph);
-    // go through all coefficients in the upsampled gauss buffer:
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(ph, pw) \
-    shared(w,h,buf,output,l,gamma,padded) \
-    schedule(static) \
-    collapse(2)
-#endif
-    for(int j=0;j<ph;j++) for(int i=0;i<pw;i++)
-    {
-      const float v = padded[l][j*pw+i];
-      int hi = 1;
-      for(;hi<num_gamma-1 && gamma[hi] <= v;hi++);
-      int lo = hi-1;
-      const float a = CLAMPS((v - gamma[lo])/(gamma[hi]-gamma[lo]), 0.0f, 1.0f);
-      const float l0 = ll_laplacian(buf[lo][l+1], buf[lo][l], i, j, pw, ph);
-      const float l1 = ll_laplacian(buf[hi][l+1], buf[hi][l], i, j, pw, ph);
-      output[l][j*pw+i] += l0 * (1.0f-a) + l1 * a;
-      // we could do this to save on memory (no need for finest buf[][]).
-      // unfortunately it results in a quite noticeable loss of sharpness, i think
-      // the extra level is worth it.
-      // else if(l == 0) // use finest scale from input to not amplify noise (and use less memory)
-      //   output[l][j*pw+i] += ll_laplacian(padded[l+1], padded[l], i, j, pw, ph);
+    ll_level_t lv = {
+      .padded = padded[l], .coarse_output = output[l+1], .output = output[l],
+      .pw = dl(w,l), .ph = dl(h,l), .cw = dl(w,l+1), .ng = ng, .max_supp = max_supp,
+      .sigma = sigma, .shadows = shadows, .highlights = highlights, .clarity = clarity };
+    if(l == 0 && approximate)
+    { // keep the finest coefficients of the input
+      lv.ng = 1;
+      lv.fine[0] = padded[0];
+      lv.coarse[0] = padded1;
     }
+    else for(int k=0;k<ng;k++)
+    { // no fine level remaps the input in place
+      lv.fine[k] = l ? buf[k][l] : NULL;
+      lv.coarse[k] = buf[k][l+1];
+    }
+    ll_collapse(kernels, &lv, scratch, stride);
   }
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ht, input, max_supp, out, wd) \
-  shared(w,output,buf) \
+  dt_omp_firstprivate(ht, input, max_supp, out, wd, w) \
+  shared(output) \
   schedule(static) \
   collapse(2)
 #endif
@@ -756,13 +931,7 @@ void local_laplacian_internal(
     b->num_levels = num_levels;
     for(int l=0;l<num_levels;l++) b->output[l] = output[l];
   }
-  // free all buffers except the ones passed out for preview rendering
-  for(int l=0;l<max_levels;l++)
-  {
-    if(!b || b->mode != 1 || l)   dt_free_align(padded[l]);
-    if(!b || b->mode != 1)        dt_free_align(output[l]);
-    for(int k=0; k<num_gamma;k++) dt_free_align(buf[k][l]);
-  }
+  ll_arena_put(block, allocated);
 }
 
 
@@ -776,8 +945,10 @@ size_t local_laplacian_memory_use(const int width,     // width of input image
 
   size_t memory_use = 0;
 
+  // padded input and output, the remapped pyramids start one level up
   for(int l=0;l<num_levels;l++)
-    memory_use += sizeof(float) * (2 + num_gamma) * dl(paddwd, l) * dl(paddht, l);
+    memory_use += sizeof(float) * (2 + (l ? num_gamma : 0)) * dl(paddwd, l) * dl(paddht, l);
+  memory_use += sizeof(float) * ll_scratch_size(paddwd) * dt_get_num_threads();
 
   return memory_use;
 }
@@ -37,7 +37,7 @@ typedef struct local_laplacian_boundary_t
 }
 local_laplacian_boundary_t;
 
-void local_laplacian_boundary_free(
+static inline void local_laplacian_boundary_free(
     local_laplacian_boundary_t *b)
 {
   dt_free_align(b->pad0);
@@ -54,11 +54,11 @@ void local_laplacian_internal(
     const float shadows,        // user param: lift shadows
     const float highlights,     // user param: compress highlights
     const float clarity,        // user param: increase clarity/local contrast
-    const int use_sse2,         // switch on sse optimised version, if available
+    const gboolean approximate, // remap at half resolution, finest level from the input
     // the following is just needed for clipped roi with boundary conditions from coarse buffer (can be 0)
     local_laplacian_boundary_t *b);
 
-void local_laplacian(
+static inline void local_laplacian(
     const float *const input,   // input buffer in some Labx or yuvx format
     float *const out,           // output buffer with colour
     const int wd,               // width and
@@ -69,19 +69,11 @@ void local_laplacian(
     const float clarity,        // user param: increase clarity/local contrast
     local_laplacian_boundary_t *b) // can be 0
 {
-  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 0, b);
+  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, FALSE, b);
 }
 
-size_t local_laplacian_memory_use(const int width,      // width of input image
-                                  const int height);    // height of input image
-
-
-size_t local_laplacian_singlebuffer_size(const int width,       // width of input image
-                                         const int height);     // height of input image
-
-
-#if defined(__SSE2__)
-void local_laplacian_sse2(
+// faster and close to local_laplacian(), for the darkroom while a slider is dragged
+static inline void local_laplacian_approx(
     const float *const input,   // input buffer in some Labx or yuvx format
     float *const out,           // output buffer with colour
     const int wd,               // width and
@@ -92,9 +84,32 @@ void local_laplacian_sse2(
     const float clarity,        // user param: increase clarity/local contrast
     local_laplacian_boundary_t *b) // can be 0
 {
-  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, 1, b);
+  local_laplacian_internal(input, out, wd, ht, sigma, shadows, highlights, clarity, TRUE, b);
 }
-#endif
+
+// the former implementation, only kept as the reference for src/tests/locallaplacian.c
+void local_laplacian_reference(
+    const float *const input,   // input buffer in some Labx or yuvx format
+    float *const out,           // output buffer with colour
+    const int wd,               // width and
+    const int ht,               // height of the input buffer
+    const float sigma,          // user param: separate shadows/mid-tones/highlights
+    const float shadows,        // user param: lift shadows
+    const float highlights,     // user param: compress highlights
+    const float clarity,        // user param: increase clarity/local contrast
+    local_laplacian_boundary_t *b); // can be 0
+
+// free the pyramid buffers kept for reuse between runs
+void local_laplacian_arena_cleanup();
+
+size_t local_laplacian_memory_use(const int width,      // width of input image
+                                  const int height);    // height of input image
+
+
+size_t local_laplacian_singlebuffer_size(const int width,       // width of input image
+                                         const int height);     // height of input image
+
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -214,100 +214,47 @@ static GList *_list_find_custom(GList *list, gpointer data)
   return NULL;
 }
 
-static gchar *_get_tb_removed_metadata_string_values(GList *before, GList *after)
+// setting metadata on many images runs this once per image, the statements come from the cache
+static void _pop_undo_execute(const int imgid, GList *before, GList *after)
 {
-  GList *b = before;
-  GList *a = after;
-  gchar *metadata_list = NULL;
+  if(imgid <= 0) return;
 
-  while(b)
+  sqlite3_stmt *stmt;
+  // the keys which are gone, got another value or an empty one
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "DELETE FROM main.meta_data WHERE id = ?1 AND key = ?2", &stmt);
+  for(GList *b = before; b; b = g_list_next(g_list_next(b)))
   {
-    GList *same_key = _list_find_custom(a, b->data);
-    GList *b2 = g_list_next(b);
-    gboolean different_value = FALSE;
-    const char *value = (char *)b2->data; // if empty we can remove it
-    if(same_key)
-    {
-      GList *same2 = g_list_next(same_key);
-      different_value = g_strcmp0(same2->data, b2->data);
-    }
+    GList *same_key = _list_find_custom(after, b->data);
+    const char *value = (char *)g_list_next(b)->data; // if empty we can remove it
+    const gboolean different_value = same_key && g_strcmp0(g_list_next(same_key)->data, value);
     if(!same_key || different_value || !value[0])
     {
-      metadata_list = dt_util_dstrcat(metadata_list, "%d,", atoi(b->data));
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, atoi(b->data));
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
     }
-    b = g_list_next(b);
-    b = g_list_next(b);
   }
-  if(metadata_list) metadata_list[strlen(metadata_list) - 1] = '\0';
-  return metadata_list;
-}
+  dt_database_release_statement(darktable.db, stmt);
 
-static gchar *_get_tb_added_metadata_string_values(const int img, GList *before, GList *after)
-{
-  GList *b = before;
-  GList *a = after;
-  gchar *metadata_list = NULL;
-
-  while(a)
+  // the keys which are new or got another value, empty ones don't go into the database
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "INSERT INTO main.meta_data (id, key, value) VALUES (?1, ?2, ?3)",
+                                  &stmt);
+  for(GList *a = after; a; a = g_list_next(g_list_next(a)))
   {
-    GList *same_key = _list_find_custom(b, a->data);
-    GList *a2 = g_list_next(a);
-    gboolean different_value = FALSE;
-    const char *value = (char *)a2->data; // if empty we don't add it to database
-    if(same_key)
-    {
-      GList *same2 = g_list_next(same_key);
-      different_value = g_strcmp0(same2->data, a2->data);
-    }
+    GList *same_key = _list_find_custom(before, a->data);
+    const char *value = (char *)g_list_next(a)->data;
+    const gboolean different_value = same_key && g_strcmp0(g_list_next(same_key)->data, value);
     if((!same_key || different_value) && value[0])
     {
-      char *escaped_text = sqlite3_mprintf("%q", value);
-      metadata_list = dt_util_dstrcat(metadata_list, "(%d,%d,'%s'),", GPOINTER_TO_INT(img), atoi(a->data), escaped_text);
-      sqlite3_free(escaped_text);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, atoi(a->data));
+      DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, value, -1, SQLITE_STATIC);
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
     }
-    a = g_list_next(a);
-    a = g_list_next(a);
   }
-  if(metadata_list) metadata_list[strlen(metadata_list) - 1] = '\0';
-  return metadata_list;
-}
-
-static void _bulk_remove_metadata(const int img, const gchar *metadata_list)
-{
-  if(img > 0 && metadata_list)
-  {
-    sqlite3_stmt *stmt;
-    gchar *query = g_strdup_printf("DELETE FROM main.meta_data WHERE id = %d AND key IN (%s)", img, metadata_list);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    g_free(query);
-  }
-}
-
-static void _bulk_add_metadata(gchar *metadata_list)
-{
-  if(metadata_list)
-  {
-    sqlite3_stmt *stmt;
-    gchar *query = g_strdup_printf("INSERT INTO main.meta_data (id, key, value) VALUES %s", metadata_list);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    g_free(query);
-  }
-}
-
-static void _pop_undo_execute(const int imgid, GList *before, GList *after)
-{
-  gchar *tobe_removed_list = _get_tb_removed_metadata_string_values(before, after);
-  gchar *tobe_added_list = _get_tb_added_metadata_string_values(imgid, before, after);
-
-  _bulk_remove_metadata(imgid, tobe_removed_list);
-  _bulk_add_metadata(tobe_added_list);
-
-  g_free(tobe_removed_list);
-  g_free(tobe_added_list);
+  dt_database_release_statement(darktable.db, stmt);
 }
 
 static void _pop_undo(gpointer user_data, const dt_undo_type_t type, dt_undo_data_t data, const dt_undo_action_t action, GList **imgs)
@@ -332,8 +279,8 @@ GList *dt_metadata_get_list_id(const int id)
 {
   GList *metadata = NULL;
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT key, value FROM main.meta_data WHERE id=?1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db,
+                                  "SELECT key, value FROM main.meta_data WHERE id=?1", &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -343,7 +290,7 @@ GList *dt_metadata_get_list_id(const int id)
     metadata = g_list_append(metadata, (gpointer)ckey);
     metadata = g_list_append(metadata, (gpointer)cvalue);
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
   return metadata;
 }
 
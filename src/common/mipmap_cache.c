@@ -23,9 +23,11 @@
 #include "common/file_location.h"
 #include "common/grealpath.h"
 #include "common/image_cache.h"
+#include "common/mipmap_pack.h"
 #include "control/conf.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
+#include "develop/tiling.h"
 #include "imageio/imageio_common.h"
 #include "imageio/imageio_jpeg.h"
 #include "imageio/imageio_module.h"
@@ -88,6 +90,8 @@ struct dt_mipmap_buffer_dsc
   size_t size;
   dt_mipmap_buffer_dsc_flags flags;
   dt_colorspaces_color_profile_type_t color_space;
+  // digest of the history the thumbnail was made with, for the packed disk backend
+  uint64_t history_hash;
 
 #if __has_feature(address_sanitizer) || defined(__SANITIZE_ADDRESS__)
   // do not touch!
@@ -241,7 +245,14 @@ static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *buf, uint32_t *width,
                     const uint32_t imgid);
 static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *iscale,
                     dt_colorspaces_color_profile_type_t *color_space, const uint32_t imgid,
-                    const dt_mipmap_size_t size);
+                    const dt_mipmap_size_t size, const uint64_t history_hash);
+
+// thumbnails of this level are kept on disk
+static inline gboolean _disk_backend(const dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip)
+{
+  return cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
+                                || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8));
+}
 
 // callback for the imageio core to allocate memory.
 // only needed for _F and _FULL buffers, as they change size
@@ -307,6 +318,66 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
   return dsc + 1;
 }
 
+// load the thumbnail made with dsc->history_hash from the packed disk backend into the entry, returns TRUE
+// on success
+static gboolean _read_packed(dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip, const uint32_t imgid,
+                             struct dt_mipmap_buffer_dsc *dsc)
+{
+  size_t len = 0;
+  dt_colorspaces_color_profile_type_t color_space = DT_COLORSPACE_NONE;
+  uint8_t *blob = dt_mipmap_pack_get(cache->pack[mip], imgid, dsc->history_hash, &len, &color_space);
+  if(!blob) return FALSE;
+
+  dt_imageio_jpeg_t jpg;
+  const gboolean ok = !dt_imageio_jpeg_decompress_header(blob, len, &jpg)
+                      && jpg.width <= cache->max_width[mip] && jpg.height <= cache->max_height[mip]
+                      && !dt_imageio_jpeg_decompress(&jpg, (uint8_t *)(dsc + 1));
+  g_free(blob);
+
+  if(!ok)
+  {
+    fprintf(stderr, "[mipmap_cache] failed to decompress packed thumbnail for image %" PRIu32 "!\n", imgid);
+    dt_mipmap_pack_remove(cache->pack[mip], imgid);
+    return FALSE;
+  }
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_cache] grab mip %d for image %" PRIu32 " from disk pack\n", mip, imgid);
+  dsc->width = jpg.width;
+  dsc->height = jpg.height;
+  dsc->iscale = 1.0f;
+  dsc->color_space = color_space;
+  return TRUE;
+}
+
+// store a thumbnail in the packed disk backend, if it's not there already. this runs when the entry is
+// evicted, with the cache locked, so it takes the history digest recorded when the thumbnail was made
+static void _write_packed(dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip, const uint32_t imgid,
+                          const struct dt_mipmap_buffer_dsc *dsc)
+{
+  const uint64_t hash = dsc->history_hash;
+  // as with the files, don't rewrite what's there already
+  if(!hash || dt_mipmap_pack_contains(cache->pack[mip], imgid, hash)) return;
+
+  char dirname[PATH_MAX] = { 0 };
+  snprintf(dirname, sizeof(dirname), "%s.d", cache->cachedir);
+  struct statvfs vfsbuf;
+  if(statvfs(dirname, &vfsbuf) || ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20) < 100)
+  {
+    fprintf(stderr, "Aborting thumbnail write as there is not enough space available in %s\n", dirname);
+    return;
+  }
+
+  // the compressed thumbnail is smaller than the pixels, give some room for the headers
+  const size_t max_len = (size_t)dsc->width * dsc->height * 4 + 4096;
+  uint8_t *blob = dt_alloc_align(64, max_len);
+  if(!blob) return;
+  const int cache_quality = dt_conf_get_int("database_cache_quality");
+  const int len = dt_imageio_jpeg_compress((const uint8_t *)(dsc + 1), blob, dsc->width, dsc->height,
+                                           MIN(100, MAX(10, cache_quality)));
+  if(len > 0) dt_mipmap_pack_put(cache->pack[mip], imgid, hash, dsc->color_space, blob, len);
+  dt_free_align(blob);
+}
+
 // callback for the cache backend to initialize payload pointers
 void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
@@ -353,6 +424,7 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
       dsc->iscale = 1.0f;
       dsc->size = entry->data_size;
       dsc->color_space = DT_COLORSPACE_NONE;
+      dsc->history_hash = 0;
     }
     else
     {
@@ -361,6 +433,7 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
       dsc->iscale = 0.0f;
       dsc->color_space = DT_COLORSPACE_NONE;
       dsc->size = entry->data_size;
+      dsc->history_hash = 0;
     }
   }
 
@@ -369,15 +442,16 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   int loaded_from_disk = 0;
   if(mip < DT_MIPMAP_F)
   {
-    if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                              || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+    // the packed backend is read when the thumbnail is generated, outside of the cache lock, as checking the
+    // history of the record queries the database
+    if(!cache->pack[mip] && _disk_backend(cache, mip))
     {
       // try and load from disk, if successful set flag
       char filename[PATH_MAX] = {0};
       snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip,
                get_imgid(entry->key));
-      FILE *f = g_fopen(filename, "rb");
-      if(f)
+      FILE *f = NULL;
+      if((f = g_fopen(filename, "rb")))
       {
         uint8_t *blob = 0;
         fseek(f, 0, SEEK_END);
@@ -444,6 +518,7 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, uint32_t imgid,
     snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
     g_unlink(filename);
   }
+  if(mip < DT_MIPMAP_F && cache->pack[mip]) dt_mipmap_pack_remove(cache->pack[mip], imgid);
 }
 
 void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
@@ -460,9 +535,15 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
       {
         dt_mipmap_cache_unlink_ondisk_thumbnail(data, get_imgid(entry->key), mip);
       }
-      else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                                     || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+      else if(_disk_backend(cache, mip))
       {
+        if(cache->pack[mip])
+        {
+          _write_packed(cache, mip, get_imgid(entry->key), dsc);
+          dt_free_align(entry->data);
+          return;
+        }
+
         // serialize to disk
         char filename[PATH_MAX] = {0};
         snprintf(filename, sizeof(filename), "%s.d/%d", cache->cachedir, mip);
@@ -562,6 +643,23 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
     cache->buffer_size[k] = sizeof(struct dt_mipmap_buffer_dsc)
                                 + (size_t)cache->max_width[k] * cache->max_height[k] * 4;
 
+  // one pack file per level replaces the directories of jpegs
+  for(int k = 0; k < DT_MIPMAP_F; k++) cache->pack[k] = NULL;
+  if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend_packed"))
+  {
+    char dirname[PATH_MAX] = { 0 };
+    snprintf(dirname, sizeof(dirname), "%s.d", cache->cachedir);
+    if(!g_mkdir_with_parents(dirname, 0750))
+    {
+      for(int k = 0; k < DT_MIPMAP_F; k++)
+      {
+        char filename[PATH_MAX] = { 0 };
+        snprintf(filename, sizeof(filename), "%s.d/%d.pack", cache->cachedir, k);
+        cache->pack[k] = dt_mipmap_pack_open(filename);
+      }
+    }
+  }
+
   // clear stats:
   cache->mip_thumbs.stats_requests = 0;
   cache->mip_thumbs.stats_near_match = 0;
@@ -579,7 +677,9 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->mip_full.stats_fetches = 0;
   cache->mip_full.stats_standin = 0;
 
-  dt_cache_init(&cache->mip_thumbs.cache, 0, max_mem);
+  // the thumbnail cache is hit by all thumbtable and worker threads at once. the shards share the quota
+  // and evict in lru order over all of them, so their number only depends on the threads.
+  dt_cache_init_sharded(&cache->mip_thumbs.cache, 0, max_mem, 2 * dt_worker_threads());
   dt_cache_set_allocate_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_deallocate_dynamic, cache);
 
@@ -608,20 +708,35 @@ void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+
+  // after the caches, which write back their thumbnails on cleanup
+  for(int k = 0; k < DT_MIPMAP_F; k++)
+  {
+    dt_mipmap_pack_close(cache->pack[k]);
+    cache->pack[k] = NULL;
+  }
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
 {
+  const size_t thumbs_cost = dt_cache_get_cost(&cache->mip_thumbs.cache);
+  const size_t f_cost = dt_cache_get_cost(&cache->mip_f.cache);
+  const size_t full_cost = dt_cache_get_cost(&cache->mip_full.cache);
   printf("[mipmap_cache] thumbs fill %.2f/%.2f MB (%.2f%%)\n",
-         cache->mip_thumbs.cache.cost / (1024.0 * 1024.0),
+         thumbs_cost / (1024.0 * 1024.0),
          cache->mip_thumbs.cache.cost_quota / (1024.0 * 1024.0),
-         100.0f * (float)cache->mip_thumbs.cache.cost / (float)cache->mip_thumbs.cache.cost_quota);
+         100.0f * (float)thumbs_cost / (float)cache->mip_thumbs.cache.cost_quota);
   printf("[mipmap_cache] float fill %"PRIu32"/%"PRIu32" slots (%.2f%%)\n",
-         (uint32_t)cache->mip_f.cache.cost, (uint32_t)cache->mip_f.cache.cost_quota,
-         100.0f * (float)cache->mip_f.cache.cost / (float)cache->mip_f.cache.cost_quota);
+         (uint32_t)f_cost, (uint32_t)cache->mip_f.cache.cost_quota,
+         100.0f * (float)f_cost / (float)cache->mip_f.cache.cost_quota);
   printf("[mipmap_cache] full  fill %"PRIu32"/%"PRIu32" slots (%.2f%%)\n",
-         (uint32_t)cache->mip_full.cache.cost, (uint32_t)cache->mip_full.cache.cost_quota,
-         100.0f * (float)cache->mip_full.cache.cost / (float)cache->mip_full.cache.cost_quota);
+         (uint32_t)full_cost, (uint32_t)cache->mip_full.cache.cost_quota,
+         100.0f * (float)full_cost / (float)cache->mip_full.cache.cost_quota);
+
+  dt_cache_stats_t stats;
+  dt_cache_get_stats(&cache->mip_thumbs.cache, &stats);
+  printf("[mipmap_cache] thumbs %zu entries, %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " evictions\n",
+         stats.entries, stats.hits, stats.misses, stats.evictions);
 
   uint64_t sum = 0;
   uint64_t sum_fetches = 0;
@@ -816,7 +931,13 @@ void dt_mipmap_cache_get_with_caller(
       {
         // 8-bit thumbs
         ASAN_UNPOISON_MEMORY_REGION(dsc + 1, dsc->size - sizeof(struct dt_mipmap_buffer_dsc));
-        _init_8((uint8_t *)(dsc + 1), &dsc->width, &dsc->height, &dsc->iscale, &buf->color_space, imgid, mip);
+        // only the entry is locked here, so the database can be asked for the history
+        if(cache->pack[DT_MIPMAP_0]) dsc->history_hash = dt_mipmap_pack_history_hash(imgid);
+        if(cache->pack[mip] && _disk_backend(cache, mip) && _read_packed(cache, mip, imgid, dsc))
+          buf->color_space = dsc->color_space;
+        else
+          _init_8((uint8_t *)(dsc + 1), &dsc->width, &dsc->height, &dsc->iscale, &buf->color_space, imgid, mip,
+                  dsc->history_hash);
       }
       dsc->color_space = buf->color_space;
       dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
@@ -1029,6 +1150,18 @@ void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid)
   }
 }
 
+gboolean dt_mipmap_cache_is_on_disk(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                    const dt_mipmap_size_t mip)
+{
+  if(mip >= DT_MIPMAP_F || !cache->cachedir[0]) return FALSE;
+  if(cache->pack[mip])
+    return dt_mipmap_pack_contains(cache->pack[mip], imgid, dt_mipmap_pack_history_hash(imgid));
+
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip, imgid);
+  return dt_util_test_image_file(filename);
+}
+
 static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width, uint32_t *height, float *iscale,
                     const uint32_t imgid)
 {
@@ -1153,9 +1286,58 @@ static int _write_image(dt_imageio_module_data_t *data, const char *filename, co
   return 0;
 }
 
+// fill the missing thumbnails of imgid below level mip from the one just generated there, each
+// from the next larger one, so every step only about halves the size and the box filter of
+// dt_iop_flip_and_zoom_8() doesn't skip pixels. levels below lowest are left alone.
+static void _init_smaller_mips(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip,
+                               const uint8_t *buf, const uint32_t width, const uint32_t height,
+                               const dt_colorspaces_color_profile_type_t color_space, const uint64_t history_hash,
+                               const int lowest)
+{
+  const uint8_t *in = buf;
+  uint32_t iw = width, ih = height;
+  dt_cache_entry_t *prev = NULL;
+  dt_cache_t *prev_cache = NULL;
+
+  for(int k = (int)mip - 1; k >= lowest; k--)
+  {
+    dt_cache_t *c = &_get_cache(cache, k)->cache;
+    const uint32_t key = get_key(imgid, k);
+    // somebody else has it, or is generating it right now
+    if(dt_cache_contains(c, key)) continue;
+
+    // this allocates the buffer and tries the disk files, with the entry write locked
+    dt_cache_entry_t *entry = dt_cache_get(c, key, 'w');
+    ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
+    struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+    ASAN_UNPOISON_MEMORY_REGION(dsc + 1, dsc->size - sizeof(struct dt_mipmap_buffer_dsc));
+    if(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE)
+    {
+      dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %" PRIu32 " from level %d\n", k, imgid,
+               k + 1);
+      dt_iop_flip_and_zoom_8(in, iw, ih, (uint8_t *)(dsc + 1), cache->max_width[k], cache->max_height[k],
+                             ORIENTATION_NONE, &dsc->width, &dsc->height);
+      dsc->iscale = 1.0f;
+      dsc->color_space = color_space;
+      dsc->history_hash = history_hash;
+      dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
+    }
+
+    // whichever way it was filled, the next smaller level is taken from here
+    if(prev) dt_cache_release(prev_cache, prev);
+    prev = entry;
+    prev_cache = c;
+    in = (const uint8_t *)(dsc + 1);
+    iw = dsc->width;
+    ih = dsc->height;
+    if(iw <= 8 || ih <= 8) break;
+  }
+  if(prev) dt_cache_release(prev_cache, prev);
+}
+
 static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *iscale,
                     dt_colorspaces_color_profile_type_t *color_space, const uint32_t imgid,
-                    const dt_mipmap_size_t size)
+                    const dt_mipmap_size_t size, const uint64_t history_hash)
 {
   *iscale = 1.0f;
   const uint32_t wd = *width, ht = *height;
@@ -1202,6 +1384,8 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
       dt_imageio_jpeg_t jpg;
       if(!dt_imageio_jpeg_read_header(filename, &jpg))
       {
+        // the long side has to cover the box whichever way the image is oriented
+        dt_imageio_jpeg_decompress_scale(&jpg, MAX(wd, ht), MAX(wd, ht));
         uint8_t *tmp = (uint8_t *)malloc(sizeof(uint8_t) * jpg.width * jpg.height * 4);
         *color_space = dt_imageio_jpeg_read_color_space(&jpg);
         if(!dt_imageio_jpeg_read(&jpg, tmp))
@@ -1218,7 +1402,8 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     {
       uint8_t *tmp = 0;
       int32_t thumb_width, thumb_height;
-      res = dt_imageio_large_thumbnail(filename, &tmp, &thumb_width, &thumb_height, color_space);
+      res = dt_imageio_large_thumbnail_scaled(filename, &tmp, &thumb_width, &thumb_height, color_space,
+                                              MAX(wd, ht), MAX(wd, ht));
       if(!res)
       {
         // if the thumbnail is not large enough, we compute one
@@ -1241,6 +1426,9 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     }
   }
 
+  // the smaller levels can be taken from here just as well as from the embedded thumbnail again
+  const gboolean from_embedded = !res;
+  gboolean from_larger = FALSE;
   if(res)
   {
     //try to generate mip from larger mip
@@ -1257,6 +1445,7 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
 
       dt_mipmap_cache_release(darktable.mipmap_cache, &tmp);
       res = 0;
+      from_larger = TRUE;
       break;
     }
   }
@@ -1301,8 +1490,13 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     return;
   }
 
+  // the smaller sizes are about to be requested too when zooming the lighttable, don't run
+  // the pipe or decode the embedded thumbnail again for them.
+  if(!from_larger)
+    _init_smaller_mips(darktable.mipmap_cache, imgid, size, buf, *width, *height, *color_space, history_hash,
+                       (from_embedded || altered || incompatible) ? DT_MIPMAP_0 : (int)min_s + 1);
+
   // TODO: various speed optimizations:
-  // TODO: also init all smaller mips!
   // TODO: use mipf, but:
   // TODO: if output is cropped, don't use mipf!
 }
@@ -1320,6 +1514,19 @@ void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint3
   {
     for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
     {
+      if(cache->pack[mip])
+      {
+        size_t len = 0;
+        dt_colorspaces_color_profile_type_t color_space;
+        uint8_t *blob = dt_mipmap_pack_get(cache->pack[mip], src_imgid, dt_mipmap_pack_history_hash(src_imgid),
+                                           &len, &color_space);
+        if(blob)
+          dt_mipmap_pack_put(cache->pack[mip], dst_imgid, dt_mipmap_pack_history_hash(dst_imgid), color_space,
+                             blob, len);
+        g_free(blob);
+        continue;
+      }
+
       // try and load from disk, if successful set flag
       char srcpath[PATH_MAX] = {0};
       char dstpath[PATH_MAX] = {0};
@@ -1337,6 +1544,77 @@ void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint3
   }
 }
 
+struct dt_mipmap_prefetch_t
+{
+  dt_mipmap_cache_t *cache;
+  int32_t imgid;
+  pthread_t thread;
+};
+
+static void *_prefetch_full_thread(void *arg)
+{
+  dt_mipmap_prefetch_t *p = (dt_mipmap_prefetch_t *)arg;
+#ifdef _OPENMP // need to do this in every thread
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+  dt_pthread_setname("prefetch");
+
+  const double start = dt_get_wtime();
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(p->cache, &buf, p->imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  dt_print(DT_DEBUG_CACHE, "[mipmap_cache] prefetched full buffer of image %d (%dx%d) in %.3fs\n", p->imgid,
+           buf.width, buf.height, dt_get_wtime() - start);
+  dt_mipmap_cache_release(p->cache, &buf);
+  return NULL;
+}
+
+dt_mipmap_prefetch_t *dt_mipmap_cache_prefetch_full(dt_mipmap_cache_t *cache, const int32_t imgid)
+{
+  if(imgid <= 0) return NULL;
+
+  // nothing to do if it's decoded already
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_TESTLOCK, 'r');
+  if(buf.buf)
+  {
+    dt_mipmap_cache_release(cache, &buf);
+    return NULL;
+  }
+
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  if(!img) return NULL;
+  const size_t width = img->width, height = img->height;
+  // raw buffers are single channel, everything else might be 4 channel float
+  const unsigned bpp = dt_image_is_raw(img) ? sizeof(float) : 4 * sizeof(float);
+  dt_image_cache_read_release(darktable.image_cache, img);
+
+  // the image being processed right now needs the memory more than we do
+  if(width == 0 || height == 0 || !dt_tiling_piece_fits_host_memory(width, height, bpp, 1.0f, 0))
+  {
+    dt_print(DT_DEBUG_CACHE, "[mipmap_cache] not prefetching image %d, %zux%zu doesn't fit into memory\n", imgid,
+             width, height);
+    return NULL;
+  }
+
+  dt_mipmap_prefetch_t *p = (dt_mipmap_prefetch_t *)calloc(1, sizeof(dt_mipmap_prefetch_t));
+  if(!p) return NULL;
+  p->cache = cache;
+  p->imgid = imgid;
+  if(dt_pthread_create(&p->thread, _prefetch_full_thread, p))
+  {
+    free(p);
+    return NULL;
+  }
+  return p;
+}
+
+void dt_mipmap_cache_prefetch_finish(dt_mipmap_prefetch_t *prefetch)
+{
+  if(!prefetch) return;
+  pthread_join(prefetch->thread, NULL);
+  free(prefetch);
+}
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -147,6 +147,10 @@ void dt_mipmap_cache_remove_at_size(dt_mipmap_cache_t *cache, const uint32_t img
 void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid);
 void dt_mipmap_cache_evict_at_size(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip);
 
+// TRUE if a valid thumbnail of this size is stored by the disk backend
+gboolean dt_mipmap_cache_is_on_disk(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                    const dt_mipmap_size_t mip);
+
 // return the closest mipmap size
 // for the given window you wish to draw.
 // a dt_mipmap_size_t has always a fixed resolution associated with it,
@@ -162,11 +166,18 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(
 dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace();
 
 // copy over thumbnails. used by file operation that copies raw files, to speed up thumbnail generation.
-// only copies over the jpg backend on disk, doesn't directly affect the in-memory cache.
+// only copies over the disk backend, doesn't directly affect the in-memory cache.
 void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
 
 // return the mipmap corresponding to text value saved in prefs
 dt_mipmap_size_t dt_mipmap_cache_get_min_mip_from_pref(const char *value);
+
+// decode the full buffer of an image on a helper thread while the caller is still busy with the previous one.
+// read-ahead is one image per handle and is skipped if the buffer wouldn't fit into host memory.
+// returns NULL if nothing was started. _finish() waits for the decode and frees the handle, it accepts NULL.
+typedef struct dt_mipmap_prefetch_t dt_mipmap_prefetch_t;
+dt_mipmap_prefetch_t *dt_mipmap_cache_prefetch_full(dt_mipmap_cache_t *cache, const int32_t imgid);
+void dt_mipmap_cache_prefetch_finish(dt_mipmap_prefetch_t *prefetch);
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -0,0 +1,560 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2026 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/mipmap_pack.h"
+#include "common/atomic.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include "common/history.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DT_MIPMAP_PACK_MAGIC 0x4b50544du // "MTPK"
+#define DT_MIPMAP_PACK_INDEX_MAGIC 0x4950544du // "MTPI"
+#define DT_MIPMAP_PACK_INDEX_VERSION 1
+// packs are compacted once more than half of them is dead and this size is exceeded
+#define DT_MIPMAP_PACK_COMPACT_MIN ((uint64_t)64 << 20)
+// the entry of a removal not yet written to the pack
+#define DT_MIPMAP_PACK_PENDING G_MAXUINT64
+
+typedef struct dt_mipmap_pack_record_t
+{
+  uint32_t magic;
+  int32_t imgid;
+  uint64_t hash;
+  uint32_t color_space;
+  uint32_t length; // of the data following the header, 0 marks a removed thumbnail
+} dt_mipmap_pack_record_t;
+
+// the index is saved next to the pack on close, so opening only has to scan what was
+// appended after that, say before a crash
+typedef struct dt_mipmap_pack_index_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t covered; // size of the pack the index describes
+  uint64_t count;
+} dt_mipmap_pack_index_header_t;
+
+typedef struct dt_mipmap_pack_index_record_t
+{
+  int32_t imgid;
+  uint32_t color_space;
+  uint64_t offset;
+  uint64_t hash;
+  uint32_t length;
+  uint32_t reserved;
+} dt_mipmap_pack_index_record_t;
+
+typedef struct dt_mipmap_pack_entry_t
+{
+  uint64_t offset; // of the data
+  uint64_t hash;
+  uint32_t length; // 0 for a removal while the pack is scanned
+  uint32_t color_space;
+} dt_mipmap_pack_entry_t;
+
+struct dt_mipmap_pack_t
+{
+  dt_pthread_mutex_t mutex;
+  char *filename;
+  char *indexname;
+  FILE *f;           // records are only ever appended. NULL until the pack is scanned
+  FILE *rf;          // reads records written after the file was mapped
+  uint64_t size;     // end of the last record
+  GMappedFile *map;  // remapped once the file has grown to twice its length
+  GHashTable *index; // imgid -> dt_mipmap_pack_entry_t
+  pthread_t worker;  // scans and compacts in the background
+  gboolean worker_running;
+  dt_atomic_int stop;
+};
+
+uint64_t dt_mipmap_pack_history_hash(const int32_t imgid)
+{
+  dt_history_hash_values_t hash;
+  dt_history_hash_read(imgid, &hash);
+  uint64_t h = 5381;
+  for(int i = 0; i < hash.current_len; i++) h = ((h << 5) + h) ^ hash.current[i];
+  g_free(hash.basic);
+  g_free(hash.auto_apply);
+  g_free(hash.current);
+  return h;
+}
+
+static gboolean _remap(dt_mipmap_pack_t *pack)
+{
+  if(pack->map) g_mapped_file_unref(pack->map);
+  pack->map = g_mapped_file_new(pack->filename, FALSE, NULL);
+  return pack->map != NULL;
+}
+
+static size_t _map_length(const dt_mipmap_pack_t *pack)
+{
+  return pack->map ? g_mapped_file_get_length(pack->map) : 0;
+}
+
+static dt_mipmap_pack_entry_t *_entry_new(const uint64_t offset, const uint64_t hash, const uint32_t length,
+                                          const uint32_t color_space)
+{
+  dt_mipmap_pack_entry_t *e = g_malloc(sizeof(dt_mipmap_pack_entry_t));
+  e->offset = offset;
+  e->hash = hash;
+  e->length = length;
+  e->color_space = color_space;
+  return e;
+}
+
+static uint64_t _live_bytes(dt_mipmap_pack_t *pack)
+{
+  uint64_t live = 0;
+  GHashTableIter it;
+  gpointer key, value;
+  g_hash_table_iter_init(&it, pack->index);
+  while(g_hash_table_iter_next(&it, &key, &value))
+  {
+    const dt_mipmap_pack_entry_t *e = (dt_mipmap_pack_entry_t *)value;
+    if(e->length) live += sizeof(dt_mipmap_pack_record_t) + e->length;
+  }
+  return live;
+}
+
+// load the saved index if it matches the pack, returns the size of the pack it covers or 0
+static uint64_t _index_load(dt_mipmap_pack_t *pack, const uint8_t *data, const uint64_t length)
+{
+  gchar *contents = NULL;
+  gsize len = 0;
+  if(!g_file_get_contents(pack->indexname, &contents, &len, NULL)) return 0;
+
+  uint64_t covered = 0;
+  dt_mipmap_pack_index_header_t header;
+  if(len < sizeof(header)) goto done;
+  memcpy(&header, contents, sizeof(header));
+  if(header.magic != DT_MIPMAP_PACK_INDEX_MAGIC || header.version != DT_MIPMAP_PACK_INDEX_VERSION
+     || header.count > len / sizeof(dt_mipmap_pack_index_record_t)
+     || len != sizeof(header) + header.count * sizeof(dt_mipmap_pack_index_record_t) || header.covered > length)
+    goto done;
+  // whatever was appended since has to start with a record
+  if(header.covered + sizeof(dt_mipmap_pack_record_t) <= length)
+  {
+    uint32_t magic;
+    memcpy(&magic, data + header.covered, sizeof(magic));
+    if(magic != DT_MIPMAP_PACK_MAGIC) goto done;
+  }
+
+  const dt_mipmap_pack_index_record_t *recs
+      = (const dt_mipmap_pack_index_record_t *)(contents + sizeof(header));
+  for(uint64_t k = 0; k < header.count; k++)
+  {
+    if(recs[k].length == 0 || recs[k].offset + recs[k].length > header.covered)
+    {
+      g_hash_table_remove_all(pack->index);
+      goto done;
+    }
+    g_hash_table_insert(pack->index, GINT_TO_POINTER(recs[k].imgid),
+                        _entry_new(recs[k].offset, recs[k].hash, recs[k].length, recs[k].color_space));
+  }
+  covered = header.covered;
+
+done:
+  g_free(contents);
+  return covered;
+}
+
+static void _index_save(dt_mipmap_pack_t *pack)
+{
+  GHashTableIter it;
+  gpointer key, value;
+  gchar *tmpname = g_strdup_printf("%s.tmp", pack->indexname);
+  FILE *f = g_fopen(tmpname, "wb");
+  if(!f)
+  {
+    g_free(tmpname);
+    return;
+  }
+
+  const dt_mipmap_pack_index_header_t header
+      = { DT_MIPMAP_PACK_INDEX_MAGIC, DT_MIPMAP_PACK_INDEX_VERSION, pack->size, g_hash_table_size(pack->index) };
+  gboolean ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  g_hash_table_iter_init(&it, pack->index);
+  while(ok && g_hash_table_iter_next(&it, &key, &value))
+  {
+    const dt_mipmap_pack_entry_t *e = (dt_mipmap_pack_entry_t *)value;
+    const dt_mipmap_pack_index_record_t rec
+        = { GPOINTER_TO_INT(key), e->color_space, e->offset, e->hash, e->length, 0 };
+    ok = fwrite(&rec, sizeof(rec), 1, f) == 1;
+  }
+  ok = (fclose(f) == 0) && ok;
+#ifdef _WIN32
+  if(ok) g_unlink(pack->indexname);
+#endif
+  if(!ok || g_rename(tmpname, pack->indexname)) g_unlink(tmpname);
+  g_free(tmpname);
+}
+
+// read the record headers in [from, length) into scanned, imgid -> entry of the last record.
+// returns the end of the last complete record.
+static uint64_t _scan(dt_mipmap_pack_t *pack, const uint8_t *data, const uint64_t from, const uint64_t length,
+                      GHashTable *scanned)
+{
+  uint64_t pos = from;
+  while(pos + sizeof(dt_mipmap_pack_record_t) <= length && !dt_atomic_get_int(&pack->stop))
+  {
+    dt_mipmap_pack_record_t rec;
+    memcpy(&rec, data + pos, sizeof(rec));
+    // a torn write at the end, everything after it is dropped
+    if(rec.magic != DT_MIPMAP_PACK_MAGIC || pos + sizeof(rec) + rec.length > length) break;
+
+    g_hash_table_insert(scanned, GINT_TO_POINTER(rec.imgid),
+                        _entry_new(pos + sizeof(rec), rec.hash, rec.length, rec.color_space));
+    pos += sizeof(rec) + rec.length;
+  }
+  return pos;
+}
+
+// a record copied by _compact()
+typedef struct dt_mipmap_pack_moved_t
+{
+  uint64_t from, to; // offsets of the data in the old and the new file
+  uint32_t length;
+} dt_mipmap_pack_moved_t;
+
+// rewrite the live records into a fresh file. the pack isn't written to meanwhile, but lookups
+// go on from the old file until the new one replaces it.
+static gboolean _compact(dt_mipmap_pack_t *pack)
+{
+  GHashTableIter it;
+  gpointer key, value;
+  gchar *tmpname = g_strdup_printf("%s.tmp", pack->filename);
+  FILE *f = g_fopen(tmpname, "wb");
+  if(!f)
+  {
+    g_free(tmpname);
+    return FALSE;
+  }
+
+  // imgid -> dt_mipmap_pack_moved_t
+  dt_pthread_mutex_lock(&pack->mutex);
+  GMappedFile *map = g_mapped_file_ref(pack->map);
+  GHashTable *moved = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  g_hash_table_iter_init(&it, pack->index);
+  while(g_hash_table_iter_next(&it, &key, &value))
+  {
+    const dt_mipmap_pack_entry_t *e = (dt_mipmap_pack_entry_t *)value;
+    if(!e->length) continue;
+    dt_mipmap_pack_moved_t *m = g_malloc(sizeof(dt_mipmap_pack_moved_t));
+    m->from = e->offset;
+    m->length = e->length;
+    g_hash_table_insert(moved, key, m);
+  }
+  dt_pthread_mutex_unlock(&pack->mutex);
+
+  const uint8_t *data = (const uint8_t *)g_mapped_file_get_contents(map);
+  uint64_t pos = 0;
+  gboolean ok = TRUE;
+  g_hash_table_iter_init(&it, moved);
+  while(ok && g_hash_table_iter_next(&it, &key, &value) && !dt_atomic_get_int(&pack->stop))
+  {
+    dt_mipmap_pack_moved_t *m = (dt_mipmap_pack_moved_t *)value;
+    const size_t len = sizeof(dt_mipmap_pack_record_t) + m->length;
+    ok = fwrite(data + m->from - sizeof(dt_mipmap_pack_record_t), 1, len, f) == len;
+    m->to = pos + sizeof(dt_mipmap_pack_record_t);
+    pos += len;
+  }
+  ok = (fclose(f) == 0) && ok && !dt_atomic_get_int(&pack->stop);
+
+  dt_pthread_mutex_lock(&pack->mutex);
+  g_mapped_file_unref(map);
+  if(ok)
+  {
+    // the old file must not be mapped or open to be replaced on all platforms
+    g_mapped_file_unref(pack->map);
+    pack->map = NULL;
+    if(pack->rf) fclose(pack->rf);
+    pack->rf = NULL;
+    g_unlink(pack->indexname);
+#ifdef _WIN32
+    g_unlink(pack->filename);
+#endif
+    ok = g_rename(tmpname, pack->filename) == 0;
+  }
+  if(ok)
+  {
+    // removals since the snapshot stay pending, everything else has moved
+    g_hash_table_iter_init(&it, pack->index);
+    while(g_hash_table_iter_next(&it, &key, &value))
+    {
+      dt_mipmap_pack_entry_t *e = (dt_mipmap_pack_entry_t *)value;
+      const dt_mipmap_pack_moved_t *m = g_hash_table_lookup(moved, key);
+      if(e->length && m) e->offset = m->to;
+    }
+    pack->size = pos;
+  }
+  _remap(pack);
+  dt_pthread_mutex_unlock(&pack->mutex);
+
+  if(!ok) g_unlink(tmpname);
+  g_free(tmpname);
+  g_hash_table_destroy(moved);
+  return ok;
+}
+
+// start appending, and write the removals that came in while the pack was scanned
+static void _open_writer(dt_mipmap_pack_t *pack)
+{
+  GHashTableIter it;
+  gpointer key, value;
+  pack->f = g_fopen(pack->filename, "ab");
+  g_hash_table_iter_init(&it, pack->index);
+  while(g_hash_table_iter_next(&it, &key, &value))
+  {
+    const dt_mipmap_pack_entry_t *e = (dt_mipmap_pack_entry_t *)value;
+    if(e->length) continue;
+    if(pack->f)
+    {
+      const dt_mipmap_pack_record_t rec = { DT_MIPMAP_PACK_MAGIC, GPOINTER_TO_INT(key), 0, 0, 0 };
+      if(fwrite(&rec, sizeof(rec), 1, pack->f) == 1) pack->size += sizeof(rec);
+    }
+    g_hash_table_iter_remove(&it);
+  }
+  if(pack->f && fflush(pack->f))
+  {
+    fclose(pack->f);
+    pack->f = NULL;
+  }
+  if(!pack->f)
+    dt_print(DT_DEBUG_ALWAYS, "[mipmap_pack] can't write to `%s', disabling writes\n", pack->filename);
+}
+
+static void *_worker(void *arg)
+{
+  dt_mipmap_pack_t *pack = (dt_mipmap_pack_t *)arg;
+  dt_pthread_setname("mipmap_pack");
+
+  dt_pthread_mutex_lock(&pack->mutex);
+  GMappedFile *map = pack->map ? g_mapped_file_ref(pack->map) : NULL;
+  const uint64_t from = pack->size;
+  dt_pthread_mutex_unlock(&pack->mutex);
+
+  const uint64_t length = map ? g_mapped_file_get_length(map) : 0;
+  GHashTable *scanned = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  const uint64_t end
+      = map ? _scan(pack, (const uint8_t *)g_mapped_file_get_contents(map), from, length, scanned) : from;
+  if(map) g_mapped_file_unref(map);
+  if(dt_atomic_get_int(&pack->stop))
+  {
+    g_hash_table_destroy(scanned);
+    return NULL;
+  }
+
+  // records of the scanned tail replace the saved ones, removals that came in meanwhile win over both
+  dt_pthread_mutex_lock(&pack->mutex);
+  GHashTableIter it;
+  gpointer key, value;
+  g_hash_table_iter_init(&it, scanned);
+  while(g_hash_table_iter_next(&it, &key, &value))
+  {
+    const dt_mipmap_pack_entry_t *old = g_hash_table_lookup(pack->index, key);
+    if(old && old->offset == DT_MIPMAP_PACK_PENDING) continue;
+    g_hash_table_iter_steal(&it);
+    if(((dt_mipmap_pack_entry_t *)value)->length)
+      g_hash_table_insert(pack->index, key, value);
+    else
+    {
+      g_hash_table_remove(pack->index, key);
+      g_free(value);
+    }
+  }
+  pack->size = end;
+  const uint64_t live = _live_bytes(pack);
+  dt_pthread_mutex_unlock(&pack->mutex);
+  g_hash_table_destroy(scanned);
+
+  const gboolean torn = end < length;
+  if(torn || (end > DT_MIPMAP_PACK_COMPACT_MIN && live < end / 2))
+  {
+    dt_print(DT_DEBUG_CACHE, "[mipmap_pack] compacting `%s' (%" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+             " bytes in use)\n", pack->filename, (guint64)live, (guint64)length);
+    // nothing can be appended behind a broken tail
+    if(!_compact(pack) && torn)
+    {
+      dt_print(DT_DEBUG_ALWAYS, "[mipmap_pack] can't repair `%s', disabling writes\n", pack->filename);
+      return NULL;
+    }
+  }
+
+  dt_pthread_mutex_lock(&pack->mutex);
+  if(!dt_atomic_get_int(&pack->stop)) _open_writer(pack);
+  dt_print(DT_DEBUG_CACHE, "[mipmap_pack] scanned `%s', %u thumbnails\n", pack->filename,
+           g_hash_table_size(pack->index));
+  dt_pthread_mutex_unlock(&pack->mutex);
+  return NULL;
+}
+
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *filename)
+{
+  // make sure the file exists so it can be mapped
+  FILE *f = g_fopen(filename, "ab");
+  if(!f) return NULL;
+  fclose(f);
+
+  dt_mipmap_pack_t *pack = g_malloc0(sizeof(dt_mipmap_pack_t));
+  pack->filename = g_strdup(filename);
+  pack->indexname = g_strdup_printf("%s.idx", filename);
+  pack->index = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  dt_pthread_mutex_init(&pack->mutex, NULL);
+  dt_atomic_set_int(&pack->stop, 0);
+
+  _remap(pack);
+  const uint64_t length = _map_length(pack);
+  if(length) pack->size = _index_load(pack, (const uint8_t *)g_mapped_file_get_contents(pack->map), length);
+
+  // with the index of a clean shutdown there is nothing to scan. otherwise thumbnails of the part
+  // not scanned yet are simply missing until the worker is done, and nothing is appended before.
+  const uint64_t live = _live_bytes(pack);
+  if(pack->size == length && !(length > DT_MIPMAP_PACK_COMPACT_MIN && live < length / 2))
+    _open_writer(pack);
+  else if(!dt_pthread_create(&pack->worker, _worker, pack))
+    pack->worker_running = TRUE;
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_pack] opened `%s' with %u indexed thumbnails, %" G_GUINT64_FORMAT
+           " bytes to scan\n", filename, g_hash_table_size(pack->index), (guint64)(length - pack->size));
+  return pack;
+}
+
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack)
+{
+  if(!pack) return;
+  dt_atomic_set_int(&pack->stop, 1);
+  if(pack->worker_running) pthread_join(pack->worker, NULL);
+  // an interrupted scan leaves the saved index as it is, it's still valid for the part it covers
+  if(pack->f)
+  {
+    fclose(pack->f);
+    _index_save(pack);
+  }
+  if(pack->rf) fclose(pack->rf);
+  if(pack->map) g_mapped_file_unref(pack->map);
+  g_hash_table_destroy(pack->index);
+  dt_pthread_mutex_destroy(&pack->mutex);
+  g_free(pack->filename);
+  g_free(pack->indexname);
+  g_free(pack);
+}
+
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const int32_t imgid, const uint64_t hash)
+{
+  dt_pthread_mutex_lock(&pack->mutex);
+  const dt_mipmap_pack_entry_t *e = g_hash_table_lookup(pack->index, GINT_TO_POINTER(imgid));
+  const gboolean found = e && e->length && e->hash == hash;
+  dt_pthread_mutex_unlock(&pack->mutex);
+  return found;
+}
+
+uint8_t *dt_mipmap_pack_get(dt_mipmap_pack_t *pack, const int32_t imgid, const uint64_t hash, size_t *length,
+                            dt_colorspaces_color_profile_type_t *color_space)
+{
+  uint8_t *out = NULL;
+  dt_pthread_mutex_lock(&pack->mutex);
+  const dt_mipmap_pack_entry_t *e = g_hash_table_lookup(pack->index, GINT_TO_POINTER(imgid));
+  if(e && e->length && e->hash == hash)
+  {
+    // written after the file was mapped. map it again once it has doubled, read directly until then
+    if(e->offset + e->length > _map_length(pack) && pack->size > 2 * _map_length(pack)) _remap(pack);
+    if(e->offset + e->length <= _map_length(pack))
+    {
+      out = g_malloc(e->length);
+      memcpy(out, g_mapped_file_get_contents(pack->map) + e->offset, e->length);
+    }
+    else
+    {
+      if(!pack->rf) pack->rf = g_fopen(pack->filename, "rb");
+      out = pack->rf ? g_malloc(e->length) : NULL;
+      if(out && (fseek(pack->rf, e->offset, SEEK_SET) || fread(out, e->length, 1, pack->rf) != 1))
+      {
+        g_free(out);
+        out = NULL;
+      }
+    }
+    if(out)
+    {
+      *length = e->length;
+      *color_space = e->color_space;
+    }
+  }
+  dt_pthread_mutex_unlock(&pack->mutex);
+  return out;
+}
+
+static int _append(dt_mipmap_pack_t *pack, const dt_mipmap_pack_record_t *rec, const uint8_t *data)
+{
+  if(fwrite(rec, sizeof(*rec), 1, pack->f) != 1 || (rec->length && fwrite(data, rec->length, 1, pack->f) != 1)
+     || fflush(pack->f))
+  {
+    // the torn record is dropped when the pack is opened next time, but nothing can follow it
+    dt_print(DT_DEBUG_ALWAYS, "[mipmap_pack] failed to write to `%s', disabling writes\n", pack->filename);
+    fclose(pack->f);
+    pack->f = NULL;
+    return 1;
+  }
+  pack->size += sizeof(*rec) + rec->length;
+  return 0;
+}
+
+int dt_mipmap_pack_put(dt_mipmap_pack_t *pack, const int32_t imgid, const uint64_t hash,
+                       const dt_colorspaces_color_profile_type_t color_space, const uint8_t *data,
+                       const size_t length)
+{
+  if(length == 0 || length > UINT32_MAX) return 1;
+
+  const dt_mipmap_pack_record_t rec = { DT_MIPMAP_PACK_MAGIC, imgid, hash, color_space, length };
+  int res = 1;
+  dt_pthread_mutex_lock(&pack->mutex);
+  const uint64_t offset = pack->size + sizeof(rec);
+  // nothing is appended while the pack is scanned
+  if(pack->f && !_append(pack, &rec, data))
+  {
+    g_hash_table_insert(pack->index, GINT_TO_POINTER(imgid), _entry_new(offset, hash, length, color_space));
+    res = 0;
+  }
+  dt_pthread_mutex_unlock(&pack->mutex);
+  return res;
+}
+
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const int32_t imgid)
+{
+  dt_pthread_mutex_lock(&pack->mutex);
+  if(!pack->f && pack->worker_running)
+  {
+    // the thumbnail may be in the part still being scanned, remember to remove it once that's done
+    g_hash_table_insert(pack->index, GINT_TO_POINTER(imgid), _entry_new(DT_MIPMAP_PACK_PENDING, 0, 0, 0));
+  }
+  else if(g_hash_table_remove(pack->index, GINT_TO_POINTER(imgid)) && pack->f)
+  {
+    const dt_mipmap_pack_record_t rec = { DT_MIPMAP_PACK_MAGIC, imgid, 0, 0, 0 };
+    _append(pack, &rec, NULL);
+  }
+  dt_pthread_mutex_unlock(&pack->mutex);
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,55 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2026 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/colorspaces.h"
+
+#include <glib.h>
+#include <stdint.h>
+
+// packed on-disk thumbnail store: one append-only file per mip level holding the compressed
+// thumbnails of all images. the index by image id is saved next to the pack on close. opening
+// loads it and leaves records appended after it, and compaction, to a background thread. reads
+// go through a memory mapping of the file. every record carries a digest of the image history
+// so thumbnails of edited images are never served.
+typedef struct dt_mipmap_pack_t dt_mipmap_pack_t;
+
+// open or create the pack, returns NULL on failure
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *filename);
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack);
+
+// digest of the current history of imgid, to be stored with and checked against the records
+uint64_t dt_mipmap_pack_history_hash(const int32_t imgid);
+
+// TRUE if a record for imgid with the given history digest is stored
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const int32_t imgid, const uint64_t hash);
+// returns a copy of the stored data, to be freed with g_free(), or NULL if there is no valid record
+uint8_t *dt_mipmap_pack_get(dt_mipmap_pack_t *pack, const int32_t imgid, const uint64_t hash, size_t *length,
+                            dt_colorspaces_color_profile_type_t *color_space);
+// append a record replacing any previous one for imgid, returns non-zero on failure
+int dt_mipmap_pack_put(dt_mipmap_pack_t *pack, const int32_t imgid, const uint64_t hash,
+                       const dt_colorspaces_color_profile_type_t color_space, const uint8_t *data,
+                       const size_t length);
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const int32_t imgid);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -36,80 +36,44 @@ typedef struct dt_undo_tags_t
   GList *after; // list of tagid after
 } dt_undo_tags_t;
 
-static gchar *_get_tb_removed_tag_string_values(GList *before, GList *after)
+// attaching a tag to many images runs these once per image, the statements come from the cache
+static void _pop_undo_execute(const int imgid, GList *before, GList *after)
 {
-  GList *a = after;
-  gchar *tag_list = NULL;
+  if(imgid <= 0) return;
+
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db,
+                                  "DELETE FROM main.tagged_images WHERE imgid = ?1 AND tagid = ?2", &stmt);
   for(GList *b = before; b; b = g_list_next(b))
   {
-    if(!g_list_find(a, b->data))
+    if(!g_list_find(after, b->data))
     {
-      tag_list = dt_util_dstrcat(tag_list, "%d,", GPOINTER_TO_INT(b->data));
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, GPOINTER_TO_INT(b->data));
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
     }
   }
-  if(tag_list) tag_list[strlen(tag_list) - 1] = '\0';
-  return tag_list;
-}
+  dt_database_release_statement(darktable.db, stmt);
 
-static gchar *_get_tb_added_tag_string_values(const int img, GList *before, GList *after)
-{
-  GList *b = before;
-  gchar *tag_list = NULL;
+  // clang-format off
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db,
+                                  "INSERT INTO main.tagged_images (imgid, tagid, position)"
+                                  " VALUES (?1, ?2,"
+                                  "  (SELECT (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000) + (1 << 32)"
+                                  "    FROM main.tagged_images))", &stmt);
+  // clang-format on
   for(GList *a = after; a; a = g_list_next(a))
   {
-    if(!g_list_find(b, a->data))
+    if(!g_list_find(before, a->data))
     {
-      // clang-format off
-      tag_list = dt_util_dstrcat(tag_list,
-                                 "(%d,%d,"
-                                 "  (SELECT (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000) + (1 << 32)"
-                                 "    FROM main.tagged_images)"
-                                 "),",
-                                 GPOINTER_TO_INT(img),
-                                 GPOINTER_TO_INT(a->data));
-      // clang-format on
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, GPOINTER_TO_INT(a->data));
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
     }
   }
-  if(tag_list) tag_list[strlen(tag_list) - 1] = '\0';
-  return tag_list;
-}
-
-static void _bulk_remove_tags(const int img, const gchar *tag_list)
-{
-  if(img > 0 && tag_list)
-  {
-    sqlite3_stmt *stmt;
-    gchar *query = g_strdup_printf("DELETE FROM main.tagged_images WHERE imgid = %d AND tagid IN (%s)", img, tag_list);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    g_free(query);
-  }
-}
-
-static void _bulk_add_tags(const gchar *tag_list)
-{
-  if(tag_list)
-  {
-    sqlite3_stmt *stmt;
-    gchar *query = g_strdup_printf("INSERT INTO main.tagged_images (imgid, tagid, position) VALUES %s", tag_list);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    g_free(query);
-  }
-}
-
-static void _pop_undo_execute(const int imgid, GList *before, GList *after)
-{
-  gchar *tobe_removed_list = _get_tb_removed_tag_string_values(before, after);
-  gchar *tobe_added_list = _get_tb_added_tag_string_values(imgid, before, after);
-
-  _bulk_remove_tags(imgid, tobe_removed_list);
-  _bulk_add_tags(tobe_added_list);
-
-  g_free(tobe_removed_list);
-  g_free(tobe_added_list);
+  dt_database_release_statement(darktable.db, stmt);
 }
 
 static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t data, dt_undo_action_t action, GList **imgs)
@@ -151,18 +115,17 @@ gboolean dt_tag_new(const char *name, guint *tagid)
 
   if(!name || name[0] == '\0') return FALSE; // no tagid name.
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT id FROM data.tags WHERE name = ?1", -1, &stmt,
-                              NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT id FROM data.tags WHERE name = ?1", &stmt);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, name, -1, SQLITE_TRANSIENT);
   rt = sqlite3_step(stmt);
   if(rt == SQLITE_ROW)
   {
     // tagid already exists.
     if(tagid != NULL) *tagid = sqlite3_column_int64(stmt, 0);
-    sqlite3_finalize(stmt);
+    dt_database_release_statement(darktable.db, stmt);
     return TRUE;
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
 
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "INSERT INTO data.tags (id, name) VALUES (NULL, ?1)",
                               -1, &stmt, NULL);
@@ -171,11 +134,10 @@ gboolean dt_tag_new(const char *name, guint *tagid)
   sqlite3_finalize(stmt);
 
   guint id = 0;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT id FROM data.tags WHERE name = ?1", -1,
-                              &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT id FROM data.tags WHERE name = ?1", &stmt);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, name, -1, SQLITE_TRANSIENT);
   if(sqlite3_step(stmt) == SQLITE_ROW) id = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
 
   if(id && g_strstr_len(name, -1, "darktable|") == name)
   {
@@ -296,12 +258,11 @@ gchar *dt_tag_get_name(const guint tagid)
   int rt;
   char *name = NULL;
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT name FROM data.tags WHERE id= ?1", -1, &stmt,
-                              NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT name FROM data.tags WHERE id= ?1", &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, tagid);
   rt = sqlite3_step(stmt);
   if(rt == SQLITE_ROW) name = g_strdup((const char *)sqlite3_column_text(stmt, 0));
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
 
   return name;
 }
@@ -326,20 +287,19 @@ gboolean dt_tag_exists(const char *name, guint *tagid)
 {
   int rt;
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT id FROM data.tags WHERE name = ?1", -1, &stmt,
-                              NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT id FROM data.tags WHERE name = ?1", &stmt);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, name, -1, SQLITE_TRANSIENT);
   rt = sqlite3_step(stmt);
 
   if(rt == SQLITE_ROW)
   {
     if(tagid != NULL) *tagid = sqlite3_column_int64(stmt, 0);
-    sqlite3_finalize(stmt);
+    dt_database_release_statement(darktable.db, stmt);
     return TRUE;
   }
 
   if(tagid != NULL) *tagid = -1;
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
   return FALSE;
 }
 
@@ -820,16 +780,38 @@ GList *dt_tag_get_hierarchical(gint imgid)
 static GList *_tag_get_tags(const gint imgid, const dt_tag_type_t type)
 {
   GList *tags = NULL;
-  char *images = NULL;
+  sqlite3_stmt *stmt;
+
+  // a single image is what tagging many images asks for over and over, keep that one prepared
   if(imgid > 0)
-    images = g_strdup_printf("%d", imgid);
-  else
   {
-    // we get the query used to retrieve the list of select images
-    images = dt_selection_get_list_query(darktable.selection, FALSE, FALSE);
+    // clang-format off
+    const char *query = type == DT_TAG_TYPE_ALL
+                        ? "SELECT DISTINCT T.id"
+                          "  FROM main.tagged_images AS I"
+                          "  JOIN data.tags T on T.id = I.tagid"
+                          "  WHERE I.imgid = ?1"
+                        : type == DT_TAG_TYPE_DT
+                        ? "SELECT DISTINCT T.id"
+                          "  FROM main.tagged_images AS I"
+                          "  JOIN data.tags T on T.id = I.tagid"
+                          "  WHERE I.imgid = ?1 AND T.id IN memory.darktable_tags"
+                        : "SELECT DISTINCT T.id"
+                          "  FROM main.tagged_images AS I"
+                          "  JOIN data.tags T on T.id = I.tagid"
+                          "  WHERE I.imgid = ?1 AND NOT T.id IN memory.darktable_tags";
+    // clang-format on
+    DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, query, &stmt);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    while(sqlite3_step(stmt) == SQLITE_ROW)
+      tags = g_list_prepend(tags, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+    dt_database_release_statement(darktable.db, stmt);
+    return tags;
   }
 
-  sqlite3_stmt *stmt;
+  // we get the query used to retrieve the list of select images
+  char *images = dt_selection_get_list_query(darktable.selection, FALSE, FALSE);
+
   char query[256] = { 0 };
   // clang-format off
   snprintf(query, sizeof(query), "SELECT DISTINCT T.id"
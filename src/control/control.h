@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "common/atomic.h"
 #include "common/darktable.h"
 #include "common/dtpthread.h"
 #include "common/action.h"
@@ -187,8 +188,15 @@ typedef struct dt_control_t
   pthread_t *thread, kick_on_workers_thread, update_gphoto_thread;
   dt_job_t **job;
 
+  // shared queue: only exports (serialised) use it
   GList *queues[DT_JOB_QUEUE_MAX];
   size_t queue_length[DT_JOB_QUEUE_MAX];
+  // all other classes, the deduped system foreground stack included, live in
+  // per worker deques that idle workers steal from, see jobs.c
+  struct dt_control_deque_t *deque;
+  dt_atomic_int deque_pending[DT_JOB_QUEUE_MAX];
+  dt_atomic_int deque_next;
+  int32_t queue_passed[DT_JOB_QUEUE_MAX];
 
   dt_pthread_mutex_t res_mutex;
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
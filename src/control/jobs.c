@@ -54,6 +54,29 @@ typedef struct _dt_job_t
   char description[DT_CONTROL_DESCRIPTION_LEN];
 } _dt_job_t;
 
+/* every worker owns one of these. jobs of all classes but exports are pushed to
+   the deque of the worker that created them (or round robin when added from the
+   gui thread) and idle workers steal from the others. the system foreground class
+   is a stack, its newest job sits at the head. queue_mutex only guards the class
+   priorities and the export queue, so adding and taking jobs never waits on it. */
+typedef struct dt_control_deque_t
+{
+  dt_pthread_mutex_t mutex;
+  GQueue jobs[DT_JOB_QUEUE_MAX];
+  // the system foreground job this worker runs, for job deduping
+  _dt_job_t *running;
+} __attribute__((aligned(64))) dt_control_deque_t;
+
+static inline gboolean _queue_is_local(const dt_job_queue_t queue_id)
+{
+  return queue_id != DT_JOB_QUEUE_USER_EXPORT;
+}
+
+static inline int _queue_base_priority(const dt_job_queue_t queue_id)
+{
+  return (queue_id == DT_JOB_QUEUE_USER_FG || queue_id == DT_JOB_QUEUE_SYSTEM_FG) ? DT_CONTROL_FG_PRIORITY : 0;
+}
+
 /** check if two jobs are to be considered equal. a simple memcmp won't work since the mutexes probably won't
    match
     we don't want to compare result, priority or state since these will change during the course of
@@ -224,67 +247,170 @@ static int32_t dt_control_run_job_res(dt_control_t *control, int32_t res)
   return 0;
 }
 
+static _dt_job_t *_deque_pop(dt_control_t *control, const int worker, const dt_job_queue_t queue_id)
+{
+  dt_control_deque_t *d = &control->deque[worker];
+  dt_pthread_mutex_lock(&d->mutex);
+  _dt_job_t *job = (_dt_job_t *)g_queue_pop_head(&d->jobs[queue_id]);
+  if(job) dt_atomic_sub_int(&control->deque_pending[queue_id], 1);
+  dt_pthread_mutex_unlock(&d->mutex);
+  return job;
+}
+
+// take the next job of a class from our own deque, or steal it from another worker. that is the oldest one of
+// the fifo classes and the newest one of the system foreground stack
+static _dt_job_t *_deque_take(dt_control_t *control, const int worker, const dt_job_queue_t queue_id)
+{
+  if(dt_atomic_get_int(&control->deque_pending[queue_id]) <= 0) return NULL;
+
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    const int victim = (worker + k) % control->num_threads;
+    _dt_job_t *job = _deque_pop(control, victim, queue_id);
+    if(job)
+    {
+      if(victim != worker)
+        dt_print(DT_DEBUG_CONTROL, "[schedule_job] worker %d stole job of queue %d from worker %d\n", worker,
+                 queue_id, victim);
+      if(queue_id == DT_JOB_QUEUE_SYSTEM_FG)
+      {
+        dt_control_deque_t *d = &control->deque[worker];
+        dt_pthread_mutex_lock(&d->mutex);
+        d->running = job;
+        dt_pthread_mutex_unlock(&d->mutex);
+      }
+      return job;
+    }
+  }
+  return NULL;
+}
+
+// the system foreground stack is limited in size: drop the oldest job of the longest deque, but never the one
+// that was just added
+static void _deque_trim(dt_control_t *control, const dt_job_queue_t queue_id, const _dt_job_t *keep)
+{
+  int victim = 0;
+  guint longest = 0;
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    dt_control_deque_t *d = &control->deque[k];
+    dt_pthread_mutex_lock(&d->mutex);
+    const guint length = g_queue_get_length(&d->jobs[queue_id]);
+    dt_pthread_mutex_unlock(&d->mutex);
+    if(length > longest)
+    {
+      longest = length;
+      victim = k;
+    }
+  }
+
+  dt_control_deque_t *d = &control->deque[victim];
+  dt_pthread_mutex_lock(&d->mutex);
+  _dt_job_t *job = (_dt_job_t *)g_queue_peek_tail(&d->jobs[queue_id]);
+  if(job && job != keep)
+  {
+    g_queue_pop_tail(&d->jobs[queue_id]);
+    dt_atomic_sub_int(&control->deque_pending[queue_id], 1);
+  }
+  else
+    job = NULL;
+  dt_pthread_mutex_unlock(&d->mutex);
+
+  dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
+  dt_control_job_dispose(job);
+}
+
+static inline gboolean _queue_has_work(dt_control_t *control, const int i)
+{
+  if(_queue_is_local(i)) return dt_atomic_get_int(&control->deque_pending[i]) > 0;
+  if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) return FALSE;
+  return control->queues[i] != NULL;
+}
+
+static inline int _queue_priority(dt_control_t *control, const int i)
+{
+  // the deques have no single head, so their classes age as a whole
+  if(_queue_is_local(i)) return _queue_base_priority(i) + control->queue_passed[i];
+  return ((_dt_job_t *)control->queues[i]->data)->priority;
+}
+
 static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
 {
   /*
    * job scheduling works like this:
-   * - when there is a single job in the queue head with a maximal priority -> pick it
+   * - when there is a single queue with a maximal priority -> pick from it
    * - otherwise pick among the ones with the maximal priority in the following order:
    *   * user foreground
    *   * system foreground
    *   * user background
    *   * system background
-   * - the jobs that didn't get picked this round get their priority incremented
+   * - the queues that didn't get picked this round get their priority incremented
+   * only the choice of the class happens under queue_mutex, the job itself is then taken from our own
+   * deque or stolen from another worker.
    */
-
-  dt_pthread_mutex_lock(&control->queue_mutex);
-
-  // find the job
+  const int worker = dt_control_get_threadid();
   _dt_job_t *job = NULL;
-  int winner_queue = DT_JOB_QUEUE_MAX;
-  int max_priority = -1;
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+
+  while(TRUE)
   {
-    if(control->queues[i] == NULL) continue;
-    if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
-    _dt_job_t *_job = (_dt_job_t *)control->queues[i]->data;
-    if(_job->priority > max_priority)
+    dt_pthread_mutex_lock(&control->queue_mutex);
+
+    int winner_queue = DT_JOB_QUEUE_MAX;
+    int max_priority = -1;
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
     {
-      max_priority = _job->priority;
-      job = _job;
-      winner_queue = i;
+      if(!_queue_has_work(control, i)) continue;
+      const int priority = _queue_priority(control, i);
+      if(priority > max_priority)
+      {
+        max_priority = priority;
+        winner_queue = i;
+      }
     }
-  }
 
-  if(!job)
-  {
-    dt_pthread_mutex_unlock(&control->queue_mutex);
-    return NULL;
-  }
-
-  // the order of the queues in control->queues matches our priority, and we only update job when the priority
-  // is strictly bigger
-  // invariant -> job is the one we are looking for
+    if(winner_queue == DT_JOB_QUEUE_MAX)
+    {
+      dt_pthread_mutex_unlock(&control->queue_mutex);
+      return NULL;
+    }
 
-  // remove the to be scheduled job from its queue
-  GList **queue = &control->queues[winner_queue];
-  *queue = g_list_delete_link(*queue, *queue);
-  control->queue_length[winner_queue]--;
-  if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
+    // the order of the queues matches our priority, and we only update winner_queue when the priority
+    // is strictly bigger
+    // invariant -> winner_queue is the one we are looking for
 
-  // and place it in scheduled job array (for job deduping)
-  control->job[dt_control_get_threadid()] = job;
+    // increment the priorities of the others
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+    {
+      if(i == winner_queue || !_queue_has_work(control, i)) continue;
+      if(_queue_is_local(i))
+        control->queue_passed[i]++;
+      else
+        ((_dt_job_t *)control->queues[i]->data)->priority++;
+    }
 
-  // increment the priorities of the others
-  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
-  {
-    if(i == winner_queue || control->queues[i] == NULL) continue;
-    ((_dt_job_t *)control->queues[i]->data)->priority++;
-  }
+    if(!_queue_is_local(winner_queue))
+    {
+      // remove the to be scheduled job from its queue
+      GList **queue = &control->queues[winner_queue];
+      job = (_dt_job_t *)(*queue)->data;
+      *queue = g_list_delete_link(*queue, *queue);
+      control->queue_length[winner_queue]--;
+      if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
+
+      // and place it in scheduled job array (for job deduping)
+      control->job[worker] = job;
+
+      dt_pthread_mutex_unlock(&control->queue_mutex);
+      return job;
+    }
 
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+    control->queue_passed[winner_queue] = 0;
+    dt_pthread_mutex_unlock(&control->queue_mutex);
 
-  return job;
+    job = _deque_take(control, worker, winner_queue);
+    if(job) return job;
+    // another worker was faster, look again
+  }
 }
 
 static void dt_control_job_execute(_dt_job_t *job)
@@ -321,10 +447,20 @@ static int32_t dt_control_run_job(dt_control_t *control)
   dt_pthread_mutex_unlock(&job->wait_mutex);
 
   // remove the job from scheduled job array (for job deduping)
-  dt_pthread_mutex_lock(&control->queue_mutex);
-  control->job[dt_control_get_threadid()] = NULL;
-  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = FALSE;
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+  if(job->queue == DT_JOB_QUEUE_SYSTEM_FG)
+  {
+    dt_control_deque_t *d = &control->deque[dt_control_get_threadid()];
+    dt_pthread_mutex_lock(&d->mutex);
+    d->running = NULL;
+    dt_pthread_mutex_unlock(&d->mutex);
+  }
+  else if(!_queue_is_local(job->queue))
+  {
+    dt_pthread_mutex_lock(&control->queue_mutex);
+    control->job[dt_control_get_threadid()] = NULL;
+    control->export_scheduled = FALSE;
+    dt_pthread_mutex_unlock(&control->queue_mutex);
+  }
 
   // and free it
   dt_control_job_dispose(job);
@@ -388,89 +524,102 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
 
   job->queue = queue_id;
 
-  _dt_job_t *job_for_disposal = NULL;
-
-  dt_pthread_mutex_lock(&control->queue_mutex);
-
-  GList **queue = &control->queues[queue_id];
-  size_t length = control->queue_length[queue_id];
+  if(_queue_is_local(queue_id))
+  {
+    // jobs go to the deque of the calling worker, jobs from other threads are spread round robin
+    int worker = dt_control_get_threadid();
+    if(worker >= control->num_threads)
+      worker = (unsigned int)dt_atomic_add_int(&control->deque_next, 1) % control->num_threads;
 
-  dt_print(DT_DEBUG_CONTROL, "[add_job] %zu | ", length);
-  dt_control_job_print(job);
-  dt_print(DT_DEBUG_CONTROL, "\n");
+    job->priority = _queue_base_priority(queue_id);
 
-  if(queue_id == DT_JOB_QUEUE_SYSTEM_FG)
-  {
-    // this is a stack with limited size and bubble up and all that stuff
-    job->priority = DT_CONTROL_FG_PRIORITY;
+    _dt_job_t *job_for_disposal = NULL;
 
-    // check if we have already scheduled the job
-    for(int k = 0; k < control->num_threads; k++)
+    if(queue_id == DT_JOB_QUEUE_SYSTEM_FG)
     {
-      _dt_job_t *other_job = (_dt_job_t *)control->job[k];
-      if(dt_control_job_equal(job, other_job))
+      // this is a stack with limited size and bubble up and all that stuff
+      for(int k = 0; k < control->num_threads && !job_for_disposal; k++)
       {
-        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in scheduled: ");
-        dt_control_job_print(other_job);
-        dt_print(DT_DEBUG_CONTROL, "\n");
-
-        dt_pthread_mutex_unlock(&control->queue_mutex);
-
-        dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
-        dt_control_job_dispose(job);
-
-        return 0; // there can't be any further copy
+        dt_control_deque_t *d = &control->deque[k];
+        dt_pthread_mutex_lock(&d->mutex);
+
+        // check if we have already scheduled the job
+        if(dt_control_job_equal(job, d->running))
+        {
+          dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in scheduled: ");
+          dt_control_job_print(d->running);
+          dt_print(DT_DEBUG_CONTROL, "\n");
+
+          dt_pthread_mutex_unlock(&d->mutex);
+
+          dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
+          dt_control_job_dispose(job);
+
+          return 0; // there can't be any further copy
+        }
+
+        // if the job is already in a queue -> move it to the top of ours
+        for(GList *iter = d->jobs[queue_id].head; iter; iter = g_list_next(iter))
+        {
+          _dt_job_t *other_job = (_dt_job_t *)iter->data;
+          if(dt_control_job_equal(job, other_job))
+          {
+            dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
+            dt_control_job_print(other_job);
+            dt_print(DT_DEBUG_CONTROL, "\n");
+
+            g_queue_delete_link(&d->jobs[queue_id], iter);
+            dt_atomic_sub_int(&control->deque_pending[queue_id], 1);
+
+            job_for_disposal = job;
+
+            job = other_job;
+            break; // there can't be any further copy in the queues
+          }
+        }
+        dt_pthread_mutex_unlock(&d->mutex);
       }
     }
 
-    // if the job is already in the queue -> move it to the top
-    for(GList *iter = *queue; iter; iter = g_list_next(iter))
-    {
-      _dt_job_t *other_job = (_dt_job_t *)iter->data;
-      if(dt_control_job_equal(job, other_job))
-      {
-        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
-        dt_control_job_print(other_job);
-        dt_print(DT_DEBUG_CONTROL, "\n");
-
-        *queue = g_list_delete_link(*queue, iter);
-        length--;
+    dt_control_deque_t *d = &control->deque[worker];
+    dt_pthread_mutex_lock(&d->mutex);
 
-        job_for_disposal = job;
-
-        job = other_job;
-        break; // there can't be any further copy in the list
-      }
-    }
+    dt_print(DT_DEBUG_CONTROL, "[add_job] %u (worker %d) | ", g_queue_get_length(&d->jobs[queue_id]), worker);
+    dt_control_job_print(job);
+    dt_print(DT_DEBUG_CONTROL, "\n");
 
-    // now we can add the new job to the list
-    *queue = g_list_prepend(*queue, job);
-    length++;
+    dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
+    if(queue_id == DT_JOB_QUEUE_SYSTEM_FG)
+      g_queue_push_head(&d->jobs[queue_id], job);
+    else
+      g_queue_push_tail(&d->jobs[queue_id], job);
+    const int pending = dt_atomic_add_int(&control->deque_pending[queue_id], 1) + 1;
+    dt_pthread_mutex_unlock(&d->mutex);
 
     // and take care of the maximal queue size
-    if(length > DT_CONTROL_MAX_JOBS)
-    {
-      GList *last = g_list_last(*queue);
-      dt_control_job_set_state((_dt_job_t *)last->data, DT_JOB_STATE_DISCARDED);
-      dt_control_job_dispose((_dt_job_t *)last->data);
-      *queue = g_list_delete_link(*queue, last);
-      length--;
-    }
+    if(queue_id == DT_JOB_QUEUE_SYSTEM_FG && pending > DT_CONTROL_MAX_JOBS) _deque_trim(control, queue_id, job);
 
-    control->queue_length[queue_id] = length;
-  }
-  else
-  {
-    // the rest are FIFOs
-    if(queue_id == DT_JOB_QUEUE_USER_BG ||
-       queue_id == DT_JOB_QUEUE_USER_EXPORT ||
-       queue_id == DT_JOB_QUEUE_SYSTEM_BG)
-      job->priority = 0;
-    else
-      job->priority = DT_CONTROL_FG_PRIORITY;
-    *queue = g_list_append(*queue, job);
-    control->queue_length[queue_id]++;
+    // notify workers
+    dt_pthread_mutex_lock(&control->cond_mutex);
+    pthread_cond_broadcast(&control->cond);
+    dt_pthread_mutex_unlock(&control->cond_mutex);
+
+    // dispose of dropped job, if any
+    dt_control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
+    dt_control_job_dispose(job_for_disposal);
+    return 0;
   }
+
+  dt_pthread_mutex_lock(&control->queue_mutex);
+
+  dt_print(DT_DEBUG_CONTROL, "[add_job] %zu | ", control->queue_length[queue_id]);
+  dt_control_job_print(job);
+  dt_print(DT_DEBUG_CONTROL, "\n");
+
+  // exports are a FIFO
+  job->priority = 0;
+  control->queues[queue_id] = g_list_append(control->queues[queue_id], job);
+  control->queue_length[queue_id]++;
   dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
   dt_pthread_mutex_unlock(&control->queue_mutex);
 
@@ -479,10 +628,6 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
   pthread_cond_broadcast(&control->cond);
   dt_pthread_mutex_unlock(&control->cond_mutex);
 
-  // dispose of dropped job, if any
-  dt_control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
-  dt_control_job_dispose(job_for_disposal);
-
   return 0;
 }
 
@@ -608,6 +753,18 @@ void dt_control_jobs_init(dt_control_t *control)
   control->num_threads = dt_worker_threads();
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
   control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  control->deque = (dt_control_deque_t *)dt_calloc_align(64, sizeof(dt_control_deque_t) * control->num_threads);
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    dt_pthread_mutex_init(&control->deque[k].mutex, NULL);
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++) g_queue_init(&control->deque[k].jobs[i]);
+  }
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  {
+    dt_atomic_set_int(&control->deque_pending[i], 0);
+    control->queue_passed[i] = 0;
+  }
+  dt_atomic_set_int(&control->deque_next, 0);
   dt_pthread_mutex_lock(&control->run_mutex);
   control->running = 1;
   dt_pthread_mutex_unlock(&control->run_mutex);
@@ -641,6 +798,12 @@ void dt_control_jobs_init(dt_control_t *control)
 
 void dt_control_jobs_cleanup(dt_control_t *control)
 {
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++) g_queue_clear(&control->deque[k].jobs[i]);
+    dt_pthread_mutex_destroy(&control->deque[k].mutex);
+  }
+  dt_free_align(control->deque);
   free(control->job);
   free(control->thread);
 }
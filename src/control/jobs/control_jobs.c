@@ -35,6 +35,7 @@
 #include "common/datetime.h"
 #include "control/conf.h"
 #include "develop/imageop_math.h"
+#include "develop/tiling.h"
 #include "imageio/imageio_common.h"
 #include "imageio/imageio_dng.h"
 #include "imageio/imageio_module.h"
@@ -1319,6 +1320,152 @@ static int32_t dt_control_refresh_exif_run(dt_job_t *job)
 }
 
 
+// per image memory estimate for one export pipe, in multiples of the full size 4 channel float buffer
+#define DT_CONTROL_EXPORT_PIPE_FACTOR 3.0f
+// don't split the cpu into pipes having less than this many openmp threads each
+#define DT_CONTROL_EXPORT_MIN_THREADS_PER_PIPE 4
+
+// state shared by all the pipes of one export job. everything below mutex may only be touched with it held.
+typedef struct dt_control_export_state_t
+{
+  dt_job_t *job;
+  dt_control_export_t *settings;
+  dt_imageio_module_format_t *mformat;
+  dt_imageio_module_storage_t *mstorage;
+  dt_imageio_module_data_t *sdata;
+  dt_export_metadata_t *metadata;
+  int omp_threads;
+
+  dt_pthread_mutex_t mutex;
+  int pipes; // running concurrently
+  GList *t;
+  guint total, num, done;
+  guint tagid, etagid;
+  gboolean tag_change;
+} dt_control_export_state_t;
+
+typedef struct dt_control_export_worker_t
+{
+  dt_control_export_state_t *state;
+  dt_imageio_module_data_t *fdata;
+  dt_mipmap_prefetch_t *prefetch;
+  pthread_t thread;
+} dt_control_export_worker_t;
+
+// decide how many export pipes to run concurrently. the storage has to support concurrent store()
+// calls, and all pipes together have to fit into the host memory budget for the largest image of the batch.
+static int _control_export_num_pipes(GList *images, const guint total, dt_imageio_module_storage_t *mstorage)
+{
+  if(total < 2 || !mstorage->parallel_store || !mstorage->parallel_store(mstorage)) return 1;
+
+  // 1 means the classic one image at a time export, 0 lets darktable decide
+  const int requested = dt_conf_get_int("plugins/lighttable/export/parallel_pipes");
+  int pipes = requested > 0 ? requested : MAX(1, dt_get_num_threads() / DT_CONTROL_EXPORT_MIN_THREADS_PER_PIPE);
+  pipes = MIN(pipes, total);
+  if(pipes < 2) return 1;
+
+  size_t width = 0, height = 0;
+  for(GList *l = images; l; l = g_list_next(l))
+  {
+    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, GPOINTER_TO_INT(l->data), 'r');
+    if(!image) continue;
+    width = MAX(width, (size_t)image->width);
+    height = MAX(height, (size_t)image->height);
+    dt_image_cache_read_release(darktable.image_cache, image);
+  }
+
+  while(pipes > 1
+        && !dt_tiling_piece_fits_host_memory(width, height, 4 * sizeof(float),
+                                             DT_CONTROL_EXPORT_PIPE_FACTOR * pipes, 0))
+    pipes--;
+
+  dt_print(DT_DEBUG_CONTROL | DT_DEBUG_MEMORY, "[export_job] using %d concurrent pipes for %d images (max %zux%zu)\n",
+           pipes, total, width, height);
+  return pipes;
+}
+
+static void *_control_export_worker(void *arg)
+{
+  dt_control_export_worker_t *w = (dt_control_export_worker_t *)arg;
+  dt_control_export_state_t *s = w->state;
+  dt_control_export_t *settings = s->settings;
+  dt_imageio_module_storage_t *mstorage = s->mstorage;
+#ifdef _OPENMP
+  // share the cores between the pipes instead of oversubscribing them
+  omp_set_num_threads(s->omp_threads);
+#endif
+
+  while(TRUE)
+  {
+    // images are handed out in list order, together with their sequence number and the tag and
+    // timestamp updates, so the database and the generated file names don't depend on thread timing.
+    dt_pthread_mutex_lock(&s->mutex);
+    if(!s->t || dt_control_job_get_state(s->job) == DT_JOB_STATE_CANCELLED)
+    {
+      dt_pthread_mutex_unlock(&s->mutex);
+      break;
+    }
+    const int imgid = GPOINTER_TO_INT(s->t->data);
+    s->t = g_list_next(s->t);
+    // the other pipes take the images up to there before this one comes back for another
+    const GList *next = g_list_nth(s->t, s->pipes - 1);
+    const int next_imgid = next ? GPOINTER_TO_INT(next->data) : -1;
+    const guint num = ++s->num;
+    const guint total = s->total;
+
+    // progress message
+    char message[512] = { 0 };
+    snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, mstorage->name(mstorage));
+    // update the message. initialize_store() might have changed the number of images
+    dt_control_job_set_progress_message(s->job, message);
+
+    // remove 'changed' tag from image
+    if(dt_tag_detach(s->tagid, imgid, FALSE, FALSE)) s->tag_change = TRUE;
+    // make sure the 'exported' tag is set on the image
+    if(dt_tag_attach(s->etagid, imgid, FALSE, FALSE)) s->tag_change = TRUE;
+
+    /* register export timestamp in cache */
+    dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
+    dt_pthread_mutex_unlock(&s->mutex);
+
+    // decode the image this pipe will likely get next while this one goes through it
+    dt_mipmap_cache_prefetch_finish(w->prefetch);
+    w->prefetch = dt_mipmap_cache_prefetch_full(darktable.mipmap_cache, next_imgid);
+
+    // check if image still exists:
+    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
+    if(image)
+    {
+      char imgfilename[PATH_MAX] = { 0 };
+      gboolean from_cache = TRUE;
+      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
+      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
+      {
+        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
+        fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
+        // dt_image_remove(imgid);
+        dt_image_cache_read_release(darktable.image_cache, image);
+      }
+      else
+      {
+        dt_image_cache_read_release(darktable.image_cache, image);
+        if(mstorage->store(mstorage, s->sdata, imgid, s->mformat, w->fdata, num, total, settings->high_quality,
+                           settings->upscale, settings->export_masks, settings->icc_type, settings->icc_filename,
+                           settings->icc_intent, s->metadata) != 0)
+          dt_control_job_cancel(s->job);
+      }
+    }
+
+    dt_pthread_mutex_lock(&s->mutex);
+    s->done++;
+    dt_control_job_set_progress(s->job, MIN(1.0, (double)s->done / total));
+    dt_pthread_mutex_unlock(&s->mutex);
+  }
+  dt_mipmap_cache_prefetch_finish(w->prefetch);
+  w->prefetch = NULL;
+  return NULL;
+}
+
 static int32_t dt_control_export_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
@@ -1368,8 +1515,6 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   else
     dt_control_log(_("no image to export"));
 
-  double fraction = 0;
-
   fdata->max_width =
     (settings->max_width != 0 && w != 0)
     ? MIN(w, settings->max_width)
@@ -1396,54 +1541,59 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
     metadata.list = g_list_remove(metadata.list, metadata.list->data);
   }
 
-  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
-  {
-    const int imgid = GPOINTER_TO_INT(t->data);
-    t = g_list_next(t);
-    const guint num = total - g_list_length(t);
-
-    // progress message
-    char message[512] = { 0 };
-    snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, mstorage->name(mstorage));
-    // update the message. initialize_store() might have changed the number of images
-    dt_control_job_set_progress_message(job, message);
-
-    // remove 'changed' tag from image
-    if(dt_tag_detach(tagid, imgid, FALSE, FALSE)) tag_change = TRUE;
-    // make sure the 'exported' tag is set on the image
-    if(dt_tag_attach(etagid, imgid, FALSE, FALSE)) tag_change = TRUE;
-
-    /* register export timestamp in cache */
-    dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
-
-    // check if image still exists:
-    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
-    if(image)
+  dt_control_export_state_t state = { .job = job,
+                                      .settings = settings,
+                                      .mformat = mformat,
+                                      .mstorage = mstorage,
+                                      .sdata = sdata,
+                                      .metadata = &metadata,
+                                      .t = t,
+                                      .total = total,
+                                      .tagid = tagid,
+                                      .etagid = etagid };
+  dt_pthread_mutex_init(&state.mutex, NULL);
+
+  const int pipes = _control_export_num_pipes(t, total, mstorage);
+  state.omp_threads = MAX(1, darktable.num_openmp_threads / pipes);
+  state.pipes = pipes;
+
+  // the first pipe runs in this thread with the job's fdata, every other one gets its own thread and
+  // its own copy of the format parameters.
+  dt_control_export_worker_t *workers = calloc(pipes, sizeof(dt_control_export_worker_t));
+  workers[0].state = &state;
+  workers[0].fdata = fdata;
+  int started = 1;
+  for(; started < pipes; started++)
+  {
+    dt_control_export_worker_t *wk = &workers[started];
+    wk->state = &state;
+    wk->fdata = mformat->get_params(mformat);
+    if(!wk->fdata) break;
+    // the whole format parameters, initialize_store() may have changed more than the common header
+    memcpy(wk->fdata, fdata, mformat->params_size(mformat));
+    if(dt_pthread_create(&wk->thread, _control_export_worker, wk))
     {
-      char imgfilename[PATH_MAX] = { 0 };
-      gboolean from_cache = TRUE;
-      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
-      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
-      {
-        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
-        fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
-        // dt_image_remove(imgid);
-        dt_image_cache_read_release(darktable.image_cache, image);
-      }
-      else
-      {
-        dt_image_cache_read_release(darktable.image_cache, image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata, num, total, settings->high_quality, settings->upscale,
-                           settings->export_masks, settings->icc_type, settings->icc_filename, settings->icc_intent,
-                           &metadata) != 0)
-          dt_control_job_cancel(job);
-      }
+      mformat->free_params(mformat, wk->fdata);
+      break;
     }
+  }
+  dt_pthread_mutex_lock(&state.mutex);
+  state.pipes = started;
+  dt_pthread_mutex_unlock(&state.mutex);
 
-    fraction += 1.0 / total;
-    if(fraction > 1.0) fraction = 1.0;
-    dt_control_job_set_progress(job, fraction);
+  _control_export_worker(&workers[0]);
+
+  for(int k = 1; k < started; k++)
+  {
+    pthread_join(workers[k].thread, NULL);
+    mformat->free_params(mformat, workers[k].fdata);
   }
+  free(workers);
+#ifdef _OPENMP
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+  dt_pthread_mutex_destroy(&state.mutex);
+  tag_change = state.tag_change;
   g_list_free_full(metadata.list, g_free);
 
   if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
@@ -2205,6 +2355,55 @@ static GList *_apply_lua_filter(GList *images)
 }
 #endif
 
+// the metadata of the images ahead of the import is parsed by a few threads while the import itself,
+// writing to the database, stays serial. at most this many images are parsed ahead.
+#define DT_IMPORT_READ_AHEAD 32
+
+typedef struct dt_control_import_read_ahead_t
+{
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  GList *next;    // next image to parse
+  int handed_out; // images given to the threads so far
+  int imported;   // images the import is done with
+  gboolean stop;
+} dt_control_import_read_ahead_t;
+
+static void *_control_import_read_ahead_worker(void *arg)
+{
+  dt_control_import_read_ahead_t *ra = (dt_control_import_read_ahead_t *)arg;
+  dt_pthread_setname("import_exif");
+
+  dt_pthread_mutex_lock(&ra->mutex);
+  while(!ra->stop && ra->next)
+  {
+    // the import caught up with us, skip what it's done with
+    if(ra->handed_out < ra->imported)
+    {
+      ra->next = g_list_next(ra->next);
+      ra->handed_out++;
+      continue;
+    }
+    if(ra->handed_out - ra->imported >= DT_IMPORT_READ_AHEAD)
+    {
+      dt_pthread_cond_wait(&ra->cond, &ra->mutex);
+      continue;
+    }
+    const char *filename = (const char *)ra->next->data;
+    ra->next = g_list_next(ra->next);
+    ra->handed_out++;
+    // under our mutex, so the import either has not forgotten this image yet or we skipped it above
+    dt_exif_read_ahead_reserve(filename);
+    dt_pthread_mutex_unlock(&ra->mutex);
+
+    dt_exif_read_ahead(filename);
+
+    dt_pthread_mutex_lock(&ra->mutex);
+  }
+  dt_pthread_mutex_unlock(&ra->mutex);
+  return NULL;
+}
+
 static int32_t _control_import_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
@@ -2234,10 +2433,36 @@ static int32_t _control_import_job_run(dt_job_t *job)
   double update_interval = INIT_UPDATE_INTERVAL;
   char *prev_filename = NULL;
   char *prev_output = NULL;
+
+  // copied images are read from their new place, only in place imports can read ahead
+  dt_control_import_read_ahead_t ra = { 0 };
+  const int ra_threads = (!data->session && total > 1) ? MIN(dt_worker_threads(), (int)total - 1) : 0;
+  pthread_t *ra_workers = ra_threads ? calloc(ra_threads, sizeof(pthread_t)) : NULL;
+  int ra_started = 0;
+  if(ra_workers)
+  {
+    dt_pthread_mutex_init(&ra.mutex, NULL);
+    pthread_cond_init(&ra.cond, NULL);
+    // the first image is imported right away
+    ra.next = g_list_next(t);
+    ra.handed_out = 1;
+    for(; ra_started < ra_threads; ra_started++)
+      if(dt_pthread_create(&ra_workers[ra_started], _control_import_read_ahead_worker, &ra)) break;
+  }
+
+  // the rows of many images go into one transaction, a commit per statement is what makes imports slow.
+  // a batch is bounded in time, and ends early when another thread waits for the database
+  const double batch_time = MAX(1, dt_conf_get_int("database/import_batch_time")) / 1000.0;
+  double batch_start = dt_get_wtime();
+  const double start_time = dt_get_wtime();
+  dt_database_start_transaction(darktable.db);
+
   for(GList *img = t; img; img = g_list_next(img))
   {
     if(data->session)
     {
+      // don't copy the file with other threads waiting for the database
+      dt_database_yield_transaction(darktable.db);
       filmid = _control_import_image_copy((char *)img->data, &prev_filename, &prev_output, data->session, &imgs);
       if(filmid != -1 && first_filmid == -1)
       {
@@ -2253,6 +2478,20 @@ static int32_t _control_import_job_run(dt_job_t *job)
       filmid = _control_import_image_insitu((char *)img->data, &imgs, &last_coll_update, &update_interval);
     if(filmid != -1)
       cntr++;
+    if(dt_get_wtime() - batch_start >= batch_time)
+    {
+      dt_database_cycle_transaction(darktable.db);
+      batch_start = dt_get_wtime();
+    }
+    if(ra_workers)
+    {
+      dt_pthread_mutex_lock(&ra.mutex);
+      // a thread still parsing this image drops its result
+      dt_exif_read_ahead_forget((char *)img->data);
+      ra.imported++;
+      pthread_cond_broadcast(&ra.cond);
+      dt_pthread_mutex_unlock(&ra.mutex);
+    }
     fraction += 1.0 / total;
     const double currtime  = dt_get_wtime();
     if(currtime - last_prog_update > PROGRESS_UPDATE_INTERVAL)
@@ -2265,6 +2504,23 @@ static int32_t _control_import_job_run(dt_job_t *job)
     }
   }
   g_free(prev_output);
+  dt_database_release_transaction(darktable.db);
+
+  const double import_time = dt_get_wtime() - start_time;
+  dt_print(DT_DEBUG_PERF, "[import] %d images in %.3f secs, %.1f images/s\n", cntr, import_time,
+           import_time > 0.0 ? cntr / import_time : 0.0);
+
+  if(ra_workers)
+  {
+    dt_pthread_mutex_lock(&ra.mutex);
+    ra.stop = TRUE;
+    pthread_cond_broadcast(&ra.cond);
+    dt_pthread_mutex_unlock(&ra.mutex);
+    for(int k = 0; k < ra_started; k++) pthread_join(ra_workers[k], NULL);
+    free(ra_workers);
+    pthread_cond_destroy(&ra.cond);
+    dt_pthread_mutex_destroy(&ra.mutex);
+  }
 
   dt_control_log(ngettext("imported %d image", "imported %d images", cntr), cntr);
   dt_control_queue_redraw_center();
@@ -19,6 +19,7 @@
 #include "common/darktable.h"
 #include "common/collection.h"
 #include "common/film.h"
+#include "control/conf.h"
 #include <stdlib.h>
 
 typedef struct dt_film_import1_t
@@ -304,6 +305,14 @@ static void _film_import1(dt_job_t *job, dt_film_t *film, GList *images)
   dt_film_t *cfr = film;
   int pending = 0;
   double last_update = dt_get_wtime();
+  const double start_time = last_update;
+
+  // the rows of many images go into one transaction, a commit per statement is what makes imports slow.
+  // a batch is bounded in time, and ends early when another thread waits for the database
+  const double batch_time = MAX(1, dt_conf_get_int("database/import_batch_time")) / 1000.0;
+  double batch_start = dt_get_wtime();
+  dt_database_start_transaction(darktable.db);
+
   for(GList *image = images; image; image = g_list_next(image))
   {
     gchar *cdn = g_path_get_dirname((const gchar *)image->data);
@@ -335,6 +344,11 @@ static void _film_import1(dt_job_t *job, dt_film_t *film, GList *images)
 
     /* import image */
     const int32_t imgid = dt_image_import(cfr->id, (const gchar *)image->data, FALSE, FALSE);
+    if(dt_get_wtime() - batch_start >= batch_time)
+    {
+      dt_database_cycle_transaction(darktable.db);
+      batch_start = dt_get_wtime();
+    }
     pending++;  // we have another image which hasn't been reported yet
     fraction += 1.0 / total;
     dt_control_job_set_progress(job, fraction);
@@ -356,6 +370,12 @@ static void _film_import1(dt_job_t *job, dt_film_t *film, GList *images)
     }
   }
 
+  dt_database_release_transaction(darktable.db);
+
+  const double import_time = dt_get_wtime() - start_time;
+  dt_print(DT_DEBUG_PERF, "[film_import] %u images in %.3f secs, %.1f images/s\n", total, import_time,
+           import_time > 0.0 ? total / import_time : 0.0);
+
   g_list_free_full(images, g_free);
   all_imgs = g_list_reverse(all_imgs);
 
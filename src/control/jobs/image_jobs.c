@@ -62,6 +62,45 @@ dt_job_t *dt_image_load_job_create(int32_t id, dt_mipmap_size_t mip)
   return job;
 }
 
+typedef struct dt_image_prefetch_t
+{
+  int32_t imgid;
+  dt_mipmap_size_t mip;
+  int generation;
+  dt_atomic_int *current;
+} dt_image_prefetch_t;
+
+static int32_t dt_image_prefetch_job_run(dt_job_t *job)
+{
+  dt_image_prefetch_t *params = dt_control_job_get_params(job);
+
+  // the requester has moved on since
+  if(dt_atomic_get_int(params->current) != params->generation) return 0;
+
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgid, params->mip, DT_MIPMAP_BLOCKING, 'r');
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  return 0;
+}
+
+dt_job_t *dt_image_prefetch_job_create(int32_t id, dt_mipmap_size_t mip, dt_atomic_int *generation)
+{
+  dt_job_t *job = dt_control_job_create(&dt_image_prefetch_job_run, "prefetch image %d mip %d", id, mip);
+  if(!job) return NULL;
+  dt_image_prefetch_t *params = (dt_image_prefetch_t *)calloc(1, sizeof(dt_image_prefetch_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return NULL;
+  }
+  dt_control_job_set_params_with_size(job, params, sizeof(dt_image_prefetch_t), free);
+  params->imgid = id;
+  params->mip = mip;
+  params->generation = dt_atomic_get_int(generation);
+  params->current = generation;
+  return job;
+}
+
 typedef struct dt_image_import_t
 {
   uint32_t film_id;
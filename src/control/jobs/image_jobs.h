@@ -18,12 +18,16 @@
 
 #pragma once
 
+#include "common/atomic.h"
 #include "common/image.h"
 #include "common/mipmap_cache.h"
 #include "control/control.h"
 #include <inttypes.h>
 
 dt_job_t *dt_image_load_job_create(int32_t imgid, dt_mipmap_size_t mip);
+// like dt_image_load_job_create(), but the job does nothing if *generation has changed by the time it
+// runs. *generation must outlive the job.
+dt_job_t *dt_image_prefetch_job_create(int32_t imgid, dt_mipmap_size_t mip, dt_atomic_int *generation);
 
 dt_job_t *dt_image_import_job_create(uint32_t filmid, const char *filename);
 
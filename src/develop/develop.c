@@ -748,6 +748,76 @@ void dt_dev_load_image(dt_develop_t *dev, const uint32_t imgid)
   dt_dev_load_image_ext(dev, imgid, -1);
 }
 
+void dt_dev_change_image(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, const uint32_t imgid)
+{
+  // same as the darkroom does when changing image, without the gui
+  dt_lock_image(imgid);
+
+  dev->proxy.chroma_adaptation = NULL;
+  dev->proxy.wb_is_D65 = TRUE;
+  dev->proxy.wb_coeffs[0] = 0.f;
+
+  while(dev->history)
+  {
+    dt_dev_free_history_item((dt_dev_history_item_t *)dev->history->data);
+    dev->history = g_list_delete_link(dev->history, dev->history);
+  }
+
+  _dt_dev_load_raw(dev, imgid);
+  dev->image_loading = dev->first_load = TRUE;
+
+  dt_pthread_mutex_lock(&darktable.dev_threadsafe);
+
+  // keep the base instance of every module, the history of the new image adds the others again
+  for(GList *modules = dev->iop; modules;)
+  {
+    GList *next = g_list_next(modules);
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+
+    int base_multi_priority = module->multi_priority;
+    for(const GList *l = dev->iop; l; l = g_list_next(l))
+    {
+      const dt_iop_module_t *mod = (dt_iop_module_t *)l->data;
+      if(!strcmp(module->op, mod->op)) base_multi_priority = MIN(base_multi_priority, mod->multi_priority);
+    }
+
+    if(module->multi_priority == base_multi_priority)
+    {
+      module->multi_priority = 0;
+      module->multi_name[0] = '\0';
+      module->multi_name_hand_edited = FALSE;
+      module->enabled = module->default_enabled;
+    }
+    else
+    {
+      // the nodes of the pipe can't outlive the module they point to
+      if(pipe) dt_dev_pixelpipe_cleanup_nodes(pipe);
+      dt_iop_cleanup_module(module);
+      free(module);
+      dev->iop = g_list_delete_link(dev->iop, modules);
+    }
+    modules = next;
+  }
+
+  while(dev->alliop)
+  {
+    dt_iop_cleanup_module((dt_iop_module_t *)dev->alliop->data);
+    free(dev->alliop->data);
+    dev->alliop = g_list_delete_link(dev->alliop, dev->alliop);
+  }
+  g_list_free_full(dev->forms, (void (*)(void *))dt_masks_free_form);
+  dev->forms = NULL;
+  g_list_free_full(dev->allforms, (void (*)(void *))dt_masks_free_form);
+  dev->allforms = NULL;
+
+  dt_dev_read_history_ext(dev, imgid, FALSE, -1);
+  dt_pthread_mutex_unlock(&darktable.dev_threadsafe);
+
+  dev->first_load = FALSE;
+
+  dt_unlock_image(imgid);
+}
+
 void dt_dev_configure(dt_develop_t *dev, int wd, int ht)
 {
   // fixed border on every side
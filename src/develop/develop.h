@@ -350,6 +350,9 @@ void dt_dev_process_preview2(dt_develop_t *dev);
 
 void dt_dev_load_image(dt_develop_t *dev, const uint32_t imgid);
 void dt_dev_reload_image(dt_develop_t *dev, const uint32_t imgid);
+/** load another image into a develop without gui, keeping the modules loaded for the previous one.
+    instances which are not needed anymore are freed, and with them the nodes of pipe if given. */
+void dt_dev_change_image(dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe, const uint32_t imgid);
 /** checks if provided imgid is the image currently in develop */
 int dt_dev_is_current_image(dt_develop_t *dev, uint32_t imgid);
 const dt_dev_history_item_t *dt_dev_get_history_item(dt_develop_t *dev, const char *op);
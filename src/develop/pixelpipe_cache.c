@@ -17,13 +17,27 @@
 */
 
 #include "develop/pixelpipe_cache.h"
+#include "common/file_location.h"
+#include "common/image.h"
+#include "control/conf.h"
 #include "develop/format.h"
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
 #include "libs/colorpicker.h"
+#include <glib/gstdio.h>
+#include <limits.h>
 #include <stdlib.h>
 
 #define VERY_OLD_CACHE_WEIGHT 1000
+// pipes having a memlimit may grow up to this number of cachelines
+#define DT_PIPECACHE_MAX_ENTRIES 256
+// a line that took this long to compute ages at half the speed of a free one
+#define DT_PIPECACHE_COST_SCALE 0.05f
+// only module outputs that took at least that long (in seconds) are written to the disk tier
+#define DT_PIPECACHE_DISK_MIN_COST 0.1f
+// the disk tier is trimmed down to this fraction of its size limit once it is exceeded
+#define DT_PIPECACHE_DISK_TRIM 0.8
+#define DT_PIPECACHE_DISK_MAGIC "dtpipe02"
 // TODO: make cache global (needs to be thread safe then)
 
 static inline int _to_mb(size_t m)
@@ -31,31 +45,91 @@ static inline int _to_mb(size_t m)
   return (int)((m + 0x80000lu) / 0x400lu / 0x400lu);
 }
 
+// the age of a line is the number of queries since it was last stamped.
+// negative ages mark important lines, see dt_dev_pixelpipe_cache_get()
+static inline int _age(const dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  return (int)CLAMP(cache->tick - cache->stamp[k], INT_MIN, INT_MAX);
+}
+
+static inline void _set_age(dt_dev_pixelpipe_cache_t *cache, const int k, const int age)
+{
+  cache->stamp[k] = cache->tick - age;
+}
+
+// age of a line as seen by the replacement strategy, expensive lines get older slower
+static inline float _weighted_age(const dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  return _age(cache, k) / (1.0f + cache->cost[k] / DT_PIPECACHE_COST_SCALE);
+}
+
+static inline int _lookup(const dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
+{
+  if(hash == (uint64_t)-1) return -1;
+  return GPOINTER_TO_INT(g_hash_table_lookup(cache->index, &hash)) - 1;
+}
+
+static inline void _unindex(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  if(_lookup(cache, cache->hash[k]) == k)
+    g_hash_table_remove(cache->index, &cache->hash[k]);
+}
+
+static void _set_hash(dt_dev_pixelpipe_cache_t *cache, const int k, const uint64_t basichash, const uint64_t hash)
+{
+  _unindex(cache, k);
+  // the index holds exactly one line per hash, so drop a possible stale duplicate
+  const int other = _lookup(cache, hash);
+  if(other >= 0 && other != k)
+  {
+    _unindex(cache, other);
+    cache->hash[other] = cache->basichash[other] = -1;
+  }
+  cache->basichash[k] = basichash;
+  cache->hash[k] = hash;
+  cache->cost[k] = 0.0f;
+  // the key lives in the hash array which is never reallocated
+  if(hash != (uint64_t)-1)
+    g_hash_table_insert(cache->index, &cache->hash[k], GINT_TO_POINTER(k + 1));
+}
+
+static void _init_line(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  cache->size[k] = 0;
+  cache->data[k] = NULL;
+  cache->basichash[k] = -1;
+  cache->hash[k] = -1;
+  cache->cost[k] = 0.0f;
+  _set_age(cache, k, 1);
+  cache->modname[k] = NULL;
+}
+
 gboolean dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size, size_t limit)
 {
   cache->entries = entries;
-  cache->allmem = cache->queries = cache->misses = 0;
+  // only pipes with a memory limit are allowed to grow, the others keep their fixed number of lines
+  cache->maxentries = (limit && entries > 2) ? MAX(entries, DT_PIPECACHE_MAX_ENTRIES) : entries;
+  cache->allmem = cache->queries = cache->misses = cache->evictions = 0;
+  cache->disk_queries = cache->disk_hits = cache->disk_writes = 0;
+  cache->tick = 0;
   cache->memlimit = limit;
-  cache->data = (void **)calloc(entries, sizeof(void *));
-  cache->size = (size_t *)calloc(entries, sizeof(size_t));
-  cache->dsc = (dt_iop_buffer_dsc_t *)calloc(entries, sizeof(dt_iop_buffer_dsc_t));
+  // all arrays are allocated for maxentries lines so pointers into them (dsc, index keys) stay valid
+  const int maxentries = cache->maxentries;
+  cache->data = (void **)calloc(maxentries, sizeof(void *));
+  cache->size = (size_t *)calloc(maxentries, sizeof(size_t));
+  cache->dsc = (dt_iop_buffer_dsc_t *)calloc(maxentries, sizeof(dt_iop_buffer_dsc_t));
 #ifdef _DEBUG
-  memset(cache->dsc, 0x2c, sizeof(dt_iop_buffer_dsc_t) * entries);
+  memset(cache->dsc, 0x2c, sizeof(dt_iop_buffer_dsc_t) * maxentries);
 #endif
-  cache->basichash = (uint64_t *)calloc(entries, sizeof(uint64_t));
-  cache->hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
-  cache->used = (int32_t *)calloc(entries, sizeof(int32_t));
-  cache->modname = (char **)calloc(entries, sizeof(char *));
-
-  for(int k = 0; k < entries; k++)
-  {
-    cache->size[k] = 0;
-    cache->data[k] = NULL;
-    cache->basichash[k] = -1;
-    cache->hash[k] = -1;
-    cache->used[k] = 1;
-    cache->modname[k] = NULL;
-  }
+  cache->basichash = (uint64_t *)calloc(maxentries, sizeof(uint64_t));
+  cache->hash = (uint64_t *)calloc(maxentries, sizeof(uint64_t));
+  cache->stamp = (int64_t *)calloc(maxentries, sizeof(int64_t));
+  cache->cost = (float *)calloc(maxentries, sizeof(float));
+  cache->modname = (char **)calloc(maxentries, sizeof(char *));
+  cache->index = g_hash_table_new(g_int64_hash, g_int64_equal);
+
+  for(int k = 0; k < maxentries; k++)
+    _init_line(cache, k);
   if(!size) return TRUE;
 
   // some pixelpipes use preallocated cachelines, following code is special for those
@@ -94,6 +168,8 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
     dt_free_align(cache->data[k]);
     cache->data[k] = NULL;
   }
+  if(cache->index) g_hash_table_destroy(cache->index);
+  cache->index = NULL;
   free(cache->data);
   cache->data = NULL;
   free(cache->dsc);
@@ -102,8 +178,10 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
   cache->basichash = NULL;
   free(cache->hash);
   cache->hash = NULL;
-  free(cache->used);
-  cache->used = NULL;
+  free(cache->stamp);
+  cache->stamp = NULL;
+  free(cache->cost);
+  cache->cost = NULL;
   free(cache->size);
   cache->size = NULL;
   free(cache->modname);
@@ -194,22 +272,20 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_
 gboolean dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size)
 {
   // search for hash in cache and make the sizes are identical
-  for(int k = 0; k < cache->entries; k++)
-    if((cache->hash[k] == hash) && (cache->size[k] == size))
-      return TRUE;
-  return FALSE;
+  const int k = _lookup(cache, hash);
+  return (k >= 0) && (cache->size[k] == size);
 }
 
 static int _get_oldest_cacheline(dt_dev_pixelpipe_cache_t *cache)
 {
   // we never want the latest used cacheline! It was <= 0 and the weight has increased just now
-  int weight = 1;
+  float weight = -1.0f;
   int id = 0;
   for(int k = 0; k < cache->entries; k++)
   {
-    if(cache->used[k] > weight)
+    if(_age(cache, k) > 1 && _weighted_age(cache, k) > weight)
     {
-      weight = cache->used[k];
+      weight = _weighted_age(cache, k);
       id = k;
     }
   }
@@ -218,13 +294,13 @@ static int _get_oldest_cacheline(dt_dev_pixelpipe_cache_t *cache)
 
 static int _get_oldest_used_cacheline(dt_dev_pixelpipe_cache_t *cache, const int age)
 {
-  int weight = 0;
+  float weight = 0.0f;
   int id = -1;
   for(int k = 0; k < cache->entries; k++)
   {
-    if((cache->used[k] > weight) && (cache->data[k] != NULL) && (cache->used[k] > age))
+    if((cache->data[k] != NULL) && (_age(cache, k) > age) && (_weighted_age(cache, k) > weight))
     {
-      weight = cache->used[k];
+      weight = _weighted_age(cache, k);
       id = k;
     }
   }
@@ -238,9 +314,9 @@ static int _get_oldest_free_cacheline(dt_dev_pixelpipe_cache_t *cache)
   int id = -1;
   for(int k = 0; k < cache->entries; k++)
   {
-    if((cache->used[k] > weight) && (cache->data[k] == NULL))
+    if((_age(cache, k) > weight) && (cache->data[k] == NULL))
     {
-      weight = cache->used[k];
+      weight = _age(cache, k);
       id = k;
     }
   }
@@ -253,16 +329,16 @@ static int _get_oldest_highgrp_line(dt_dev_pixelpipe_cache_t *cache)
   int weight = -cache->entries / 4;
   for(int k = 0; k < cache->entries; k++)
   {
-    if((cache->used[k] < 0) && (cache->data[k] != NULL) && (cache->used[k] > weight))
+    if((_age(cache, k) < 0) && (cache->data[k] != NULL) && (_age(cache, k) > weight))
     {
       id = k;
-      weight = cache->used[k];
+      weight = _age(cache, k);
     }
   }
   return id;
 }
 
-static int _get_cacheline(dt_dev_pixelpipe_cache_t *cache)
+static int _get_cacheline(dt_dev_pixelpipe_cache_t *cache, const size_t size)
 {
   // Simplest case is some pipes we with only two cachelines, so we
   // can toggle between them.
@@ -274,6 +350,15 @@ static int _get_cacheline(dt_dev_pixelpipe_cache_t *cache)
   const int old_used = _get_oldest_used_cacheline(cache, 2);
   if(old_used >= 0) return old_used;
 
+  // all lines are in use and young. instead of dropping one of them take a new line
+  // if we are still within the memory limit.
+  if(cache->entries < cache->maxentries && cache->allmem + size <= cache->memlimit)
+  {
+    const int k = cache->entries++;
+    _init_line(cache, k);
+    return k;
+  }
+
   return _get_oldest_cacheline(cache);
 }
 
@@ -283,47 +368,41 @@ static gboolean _get_by_hash(struct dt_dev_pixelpipe_t *pipe,
 {
   dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
 
-  for(int k = 0; k < cache->entries; k++)
+  const int k = _lookup(cache, hash);
+  if(k < 0) return FALSE;
+
+  if(cache->size[k] != size)
   {
-    if(cache->hash[k] == hash)
-    {
-      if(cache->size[k] != size)
-      {
-        /* In rare sitations we might find an identical hash but the buffer sizes don't match.
-           This can happen because of "hash overlaps" or situations where the hash doesn't reflect the
-           complete status. (or we have a bug in dt)
-           In this case we don't want to simply realloc or alike as these data could possibly still
-           be used in the pipe.
-           Instead we make sure the cleanup can free it but it won't be taken in this pixelpipe process.
-           We do so by setting cache->used[k] to something lower than any possible age as a marker.
-        */ 
-        dt_print_pipe(DT_DEBUG_PIPE, "pixelpipe_cache_get", pipe, name, NULL, NULL,
-          "HIT ERROR     line%3i, age %4i at%p. size %iMB, requested %iMB\n",
-          k, cache->used[k], cache->data[k], _to_mb(cache->size[k]), _to_mb(size));
- 
-        cache->hash[k] = cache->basichash[k] = -1;
-        cache->used[k] = -1000000;
-      }
-      else
-      {
-        // we have a proper hit
-        *data = cache->data[k];
-        *dsc = &cache->dsc[k];
-        ASAN_POISON_MEMORY_REGION(*data, cache->size[k]);
-        ASAN_UNPOISON_MEMORY_REGION(*data, size);
-
-        dt_print_pipe(DT_DEBUG_PIPE, "pixelpipe_cache_get", pipe, name, NULL, NULL,
-          "HIT %s line%3i, age %4i at %p hash%22" PRIu64 ", basic%22" PRIu64 "\n",
-          (cache->used[k] < 0) ? "important" : "         ", k, cache->used[k], cache->data[k], cache->hash[k], cache->basichash[k]); 
-
-        // in case of a hit it's always good to further keep the cacheline as important
-        cache->used[k] = -cache->entries;
-        return TRUE;
-      }
-    }
+    /* In rare sitations we might find an identical hash but the buffer sizes don't match.
+       This can happen because of "hash overlaps" or situations where the hash doesn't reflect the
+       complete status. (or we have a bug in dt)
+       In this case we don't want to simply realloc or alike as these data could possibly still
+       be used in the pipe.
+       Instead we make sure the cleanup can free it but it won't be taken in this pixelpipe process.
+       We do so by setting the age of the line to something lower than any possible age as a marker.
+    */
+    dt_print_pipe(DT_DEBUG_PIPE, "pixelpipe_cache_get", pipe, name, NULL, NULL,
+      "HIT ERROR     line%3i, age %4i at%p. size %iMB, requested %iMB\n",
+      k, _age(cache, k), cache->data[k], _to_mb(cache->size[k]), _to_mb(size));
+
+    _set_hash(cache, k, -1, -1);
+    _set_age(cache, k, -1000000);
+    return FALSE;
   }
 
-  return FALSE;
+  // we have a proper hit
+  *data = cache->data[k];
+  *dsc = &cache->dsc[k];
+  ASAN_POISON_MEMORY_REGION(*data, cache->size[k]);
+  ASAN_UNPOISON_MEMORY_REGION(*data, size);
+
+  dt_print_pipe(DT_DEBUG_PIPE, "pixelpipe_cache_get", pipe, name, NULL, NULL,
+    "HIT %s line%3i, age %4i at %p hash%22" PRIu64 ", basic%22" PRIu64 "\n",
+    (_age(cache, k) < 0) ? "important" : "         ", k, _age(cache, k), cache->data[k], cache->hash[k], cache->basichash[k]);
+
+  // in case of a hit it's always good to further keep the cacheline as important
+  _set_age(cache, k, -cache->entries);
+  return TRUE;
 }
 
 gboolean dt_dev_pixelpipe_cache_get(struct dt_dev_pixelpipe_t *pipe, const uint64_t basichash, const uint64_t hash,
@@ -331,8 +410,7 @@ gboolean dt_dev_pixelpipe_cache_get(struct dt_dev_pixelpipe_t *pipe, const uint6
 {
   dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
   cache->queries++;
-  for(int k = 0; k < cache->entries; k++)
-    cache->used[k]++; // age all entries
+  cache->tick++; // age all entries
 
   // cache keeps history and we have a cache hit, so no new buffer
   if(cache->entries > 2 && _get_by_hash(pipe, hash, size, data, dsc, name))
@@ -347,7 +425,8 @@ gboolean dt_dev_pixelpipe_cache_get(struct dt_dev_pixelpipe_t *pipe, const uint6
   // Check both for free and non-matching (and grow or shrink buffer).
 
   // Can the module having used this cacheline before might still use the data with other dsc?
-  const int cline = _get_cacheline(&(pipe->cache));
+  const int cline = _get_cacheline(&(pipe->cache), size);
+  if(cache->data[cline] && cache->hash[cline] != (uint64_t)-1) cache->evictions++;
   gboolean newdata = FALSE;
   if(((cache->entries == 2) && (cache->size[cline] < size))
      || ((cache->entries > 2) && (cache->size[cline] != size)))
@@ -376,19 +455,18 @@ gboolean dt_dev_pixelpipe_cache_get(struct dt_dev_pixelpipe_t *pipe, const uint6
 
   dt_print_pipe(DT_DEBUG_PIPE | DT_DEBUG_VERBOSE, "pixelpipe_cache_get", pipe, name, NULL, NULL,
     "%s %s line%3i, age %4i at %p. hash%22" PRIu64 ", basic%22" PRIu64 "\n",
-     newdata ? "new" : "   ", important ? "important" : "         ", cline, cache->used[cline],
-     cache->data[cline], cache->hash[cline], cache->basichash[cline]); 
+     newdata ? "new" : "   ", important ? "important" : "         ", cline, _age(cache, cline),
+     cache->data[cline], cache->hash[cline], cache->basichash[cline]);
 
-  cache->basichash[cline] = basichash;
-  cache->hash[cline] = hash;
+  _set_hash(cache, cline, basichash, hash);
   if(pipe->mask_display & (DT_DEV_PIXELPIPE_DISPLAY_PASSTHRU | DT_DEV_PIXELPIPE_DISPLAY_ANY))
   {
     // avoid caching
-    cache->used[cline] = VERY_OLD_CACHE_WEIGHT;
+    _set_age(cache, cline, VERY_OLD_CACHE_WEIGHT);
   }
   else
   {
-    cache->used[cline] = important ? -cache->entries : 0;
+    _set_age(cache, cline, important ? -cache->entries : 0);
   }
   cache->modname[cline] = name;
   cache->misses++;
@@ -398,11 +476,14 @@ gboolean dt_dev_pixelpipe_cache_get(struct dt_dev_pixelpipe_t *pipe, const uint6
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
 {
   cache->queries = cache->misses = cache->queries & 1; // we don't use zero here for "swapping pipelines" having only two lines
+  cache->evictions = 0;
+  g_hash_table_remove_all(cache->index);
   for(int k = 0; k < cache->entries; k++)
   {
     cache->basichash[k] = -1;
     cache->hash[k] = -1;
-    cache->used[k] = VERY_OLD_CACHE_WEIGHT;
+    cache->cost[k] = 0.0f;
+    _set_age(cache, k, VERY_OLD_CACHE_WEIGHT);
     ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
   }
 }
@@ -413,9 +494,8 @@ void dt_dev_pixelpipe_cache_flush_all_but(dt_dev_pixelpipe_cache_t *cache, uint6
   {
     if(cache->basichash[k] == basichash)
       continue;
-    cache->basichash[k] = -1;
-    cache->hash[k] = -1;
-    cache->used[k] = VERY_OLD_CACHE_WEIGHT;
+    _set_hash(cache, k, -1, -1);
+    _set_age(cache, k, VERY_OLD_CACHE_WEIGHT);
     ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
   }
 }
@@ -430,22 +510,31 @@ void dt_dev_pixelpipe_cache_reweight(struct dt_dev_pixelpipe_t *pipe, void *data
   {
     if((cache->data[k] == data) && (size == cache->size[k]))
     {
-      cache->used[k] = -cache->entries;
+      _set_age(cache, k, -cache->entries);
       dt_print_pipe(DT_DEBUG_PIPE | DT_DEBUG_VERBOSE, "pipecache reweight", pipe, cache->modname[k], NULL, NULL,
-        "line%3i, age %4i, hash%22" PRIu64 ", basic%22" PRIu64 "\n", k, cache->used[k], cache->hash[k], cache->basichash[k]);
+        "line%3i, age %4i, hash%22" PRIu64 ", basic%22" PRIu64 "\n", k, _age(cache, k), cache->hash[k], cache->basichash[k]);
     }
   }
 }
 
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, void *data, const float seconds)
+{
+  if(!data) return;
+  for(int k = 0; k < cache->entries; k++)
+  {
+    if(cache->data[k] == data)
+      cache->cost[k] = MAX(0.0f, seconds);
+  }
+}
+
 void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data)
 {
   for(int k = 0; k < cache->entries; k++)
   {
     if(cache->data[k] == data)
     {
-      cache->basichash[k] = -1;
-      cache->hash[k] = -1;
-      cache->used[k] = VERY_OLD_CACHE_WEIGHT;
+      _set_hash(cache, k, -1, -1);
+      _set_age(cache, k, VERY_OLD_CACHE_WEIGHT);
       ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
     }
   }
@@ -455,16 +544,15 @@ static size_t _free_cacheline(dt_dev_pixelpipe_cache_t *cache, const int k, stru
 {
   const size_t removed = cache->size[k];
   dt_print_pipe(DT_DEBUG_PIPE | DT_DEBUG_VERBOSE, "free pipe cacheline", pipe, cache->modname[k], NULL, NULL,
-    "line%3i, age %4i, size=%iMB\n", k, cache->used[k], _to_mb(removed));
+    "line%3i, age %4i, cost %.3fs, size=%iMB\n", k, _age(cache, k), cache->cost[k], _to_mb(removed));
 
   dt_free_align(cache->data[k]);
   cache->allmem -= removed;
   cache->size[k] = 0;
   cache->data[k] = NULL;
-  cache->hash[k] = -1;
-  cache->basichash[k] = -1;
+  _set_hash(cache, k, -1, -1);
   cache->modname[k] = NULL;
-  cache->used[k] = VERY_OLD_CACHE_WEIGHT;
+  _set_age(cache, k, VERY_OLD_CACHE_WEIGHT);
   return removed;
 }
 
@@ -472,7 +560,7 @@ static int _important_lines(dt_dev_pixelpipe_cache_t *cache)
 {
   int important = 0;
   for(int k = 0; k < cache->entries; k++)
-    if(cache->used[k] < 0) important++;
+    if(_age(cache, k) < 0) important++;
   return important;
 }
 
@@ -499,7 +587,7 @@ void dt_dev_pixelpipe_cache_checkmem(struct dt_dev_pixelpipe_t *pipe)
   for(int k = 0; k < cache->entries; k++)
   {
     // **Always** remove the lines that have been reported having a hit-error
-    if(cache->used[k] < -cache->entries)
+    if(_age(cache, k) < -cache->entries)
     {
       freed += _free_cacheline(cache, k, pipe);
       bad_grp++;
@@ -508,7 +596,7 @@ void dt_dev_pixelpipe_cache_checkmem(struct dt_dev_pixelpipe_t *pipe)
 
   if(cache->memlimit != 0)
   {
-    // release unimportant lines first
+    // release unimportant lines first, cheap ones before expensive ones of the same age
     const int old_limit = MAX(2, cache->entries / 8);
 
     int oldest = _get_oldest_used_cacheline(cache, old_limit);
@@ -529,20 +617,284 @@ void dt_dev_pixelpipe_cache_checkmem(struct dt_dev_pixelpipe_t *pipe)
   }
 
   dt_print_pipe(DT_DEBUG_PIPE, "pixelpipe_cache_checkmem", pipe, "", NULL, NULL,
-    "%i lines (important=%i, used=%i). Cache: freed=%iMB (bad=%i low=%i high=%i). Now using %iMB, limit=%iMB\n",
-    cache->entries, _important_lines(cache), _used_lines(cache), _to_mb(freed),
+    "%i/%i lines (important=%i, used=%i). Cache: freed=%iMB (bad=%i low=%i high=%i). Now using %iMB, limit=%iMB\n",
+    cache->entries, cache->maxentries, _important_lines(cache), _used_lines(cache), _to_mb(freed),
     bad_grp, low_grp, high_grp, _to_mb(cache->allmem), _to_mb(cache->memlimit));
 }
 
+// header of a line in the disk tier, followed by size bytes of pixel data
+typedef struct dt_dev_pixelpipe_cache_disk_header_t
+{
+  char magic[8];
+  char version[64];
+  uint64_t basichash;
+  uint64_t hash;
+  uint64_t source;
+  uint64_t size;
+  dt_iop_buffer_dsc_t dsc;
+} dt_dev_pixelpipe_cache_disk_header_t;
+
+// total size of the disk tier, counted once by a directory scan and then kept up to date by
+// the writes and removals of all pipes
+static GMutex _disk_lock;
+static size_t _disk_total = 0;
+static gboolean _disk_counted = FALSE;
+
+static gboolean _disk_enabled(const dt_dev_pixelpipe_t *pipe)
+{
+  // the hashes include the image and all module parameters up to the line, so only full
+  // exports are worth keeping across runs
+  if(!(pipe->type & DT_DEV_PIXELPIPE_EXPORT) || !dt_conf_get_bool("cache_disk_pixelpipe")) return FALSE;
+
+  // a line read from disk skips the modules before it, so the raster and details masks they
+  // would have left in the pipe are missing for the modules after it
+  if(pipe->want_detail_mask || pipe->store_all_raster_masks) return FALSE;
+  for(const GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(piece->enabled && piece->module->raster_mask.sink.source) return FALSE;
+  }
+  return TRUE;
+}
+
+// the pipe hashes don't know the file behind the image, mix in its path, size and modification
+// time so a changed or replaced file never gets the pixels of the old one. 0 if it can't be read.
+static uint64_t _disk_source(const dt_dev_pixelpipe_t *pipe)
+{
+  char path[PATH_MAX] = { 0 };
+  gboolean from_cache = FALSE;
+  dt_image_full_path(pipe->image.id, path, sizeof(path), &from_cache);
+  GStatBuf st;
+  if(!path[0] || g_stat(path, &st)) return 0;
+
+  uint64_t source = 5381;
+  for(const char *c = path; *c; c++) source = ((source << 5) + source) ^ *c;
+  source = ((source << 5) + source) ^ (uint64_t)st.st_size;
+  source = ((source << 5) + source) ^ (uint64_t)st.st_mtime;
+  return source;
+}
+
+static void _disk_dirname(char *dirname, const size_t len)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(dirname, len, "%s" G_DIR_SEPARATOR_S "pixelpipe", cachedir);
+}
+
+static void _disk_filename(char *filename, const size_t len, const uint64_t hash, const uint64_t source)
+{
+  char dirname[PATH_MAX] = { 0 };
+  _disk_dirname(dirname, sizeof(dirname));
+  snprintf(filename, len, "%s" G_DIR_SEPARATOR_S "%016" PRIx64 "%016" PRIx64 ".dtpc", dirname, hash, source);
+}
+
+static void _disk_remove(const char *filename, const size_t size)
+{
+  if(g_unlink(filename)) return;
+  g_mutex_lock(&_disk_lock);
+  _disk_total -= MIN(_disk_total, size);
+  g_mutex_unlock(&_disk_lock);
+}
+
+typedef struct _disk_file_t
+{
+  gchar *path;
+  GTimeSpan mtime;
+  size_t size;
+} _disk_file_t;
+
+static gint _disk_file_older(gconstpointer a, gconstpointer b)
+{
+  const GTimeSpan ta = ((const _disk_file_t *)a)->mtime;
+  const GTimeSpan tb = ((const _disk_file_t *)b)->mtime;
+  return (ta > tb) - (ta < tb);
+}
+
+static void _disk_file_free(gpointer p)
+{
+  _disk_file_t *f = (_disk_file_t *)p;
+  g_free(f->path);
+  g_free(f);
+}
+
+// list the files of the disk tier, returns their total size. with trim set, drop the least
+// recently used ones until that is well below limit. called with _disk_lock held.
+static size_t _disk_scan(const gboolean trim, const size_t limit)
+{
+  char dirname[PATH_MAX] = { 0 };
+  _disk_dirname(dirname, sizeof(dirname));
+  GDir *dir = g_dir_open(dirname, 0, NULL);
+  if(!dir) return 0;
+
+  GList *files = NULL;
+  size_t total = 0;
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    if(!g_str_has_suffix(name, ".dtpc")) continue;
+    gchar *path = g_build_filename(dirname, name, NULL);
+    GStatBuf st;
+    if(g_stat(path, &st) == 0)
+    {
+      _disk_file_t *f = g_malloc(sizeof(_disk_file_t));
+      f->path = path;
+      f->mtime = st.st_mtime;
+      f->size = st.st_size;
+      total += f->size;
+      files = g_list_prepend(files, f);
+    }
+    else
+      g_free(path);
+  }
+  g_dir_close(dir);
+
+  if(trim && total > limit)
+  {
+    files = g_list_sort(files, _disk_file_older);
+    for(GList *l = files; l && total > DT_PIPECACHE_DISK_TRIM * limit; l = g_list_next(l))
+    {
+      _disk_file_t *f = (_disk_file_t *)l->data;
+      if(g_unlink(f->path) == 0) total -= f->size;
+    }
+  }
+  g_list_free_full(files, _disk_file_free);
+  return total;
+}
+
+// account for a newly written file, and only look at the directory again once the limit is exceeded
+static void _disk_added(const size_t size, const size_t limit)
+{
+  g_mutex_lock(&_disk_lock);
+  if(!_disk_counted)
+  {
+    // includes the file just written
+    _disk_total = _disk_scan(FALSE, limit);
+    _disk_counted = TRUE;
+  }
+  else
+    _disk_total += size;
+  if(_disk_total > limit) _disk_total = _disk_scan(TRUE, limit);
+  g_mutex_unlock(&_disk_lock);
+}
+
+gboolean dt_dev_pixelpipe_cache_get_disk(struct dt_dev_pixelpipe_t *pipe, const uint64_t basichash, const uint64_t hash,
+                                         const size_t size, void **data, dt_iop_buffer_dsc_t **dsc, char *name)
+{
+  if(!_disk_enabled(pipe)) return FALSE;
+  dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
+  cache->disk_queries++;
+
+  const uint64_t source = _disk_source(pipe);
+  if(!source) return FALSE;
+  char filename[PATH_MAX] = { 0 };
+  _disk_filename(filename, sizeof(filename), hash, source);
+  if(!g_file_test(filename, G_FILE_TEST_IS_REGULAR)) return FALSE;
+
+  GMappedFile *map = g_mapped_file_new(filename, FALSE, NULL);
+  if(!map) return FALSE;
+
+  const dt_dev_pixelpipe_cache_disk_header_t *header
+      = (const dt_dev_pixelpipe_cache_disk_header_t *)g_mapped_file_get_contents(map);
+  const size_t length = g_mapped_file_get_length(map);
+  if(length != sizeof(dt_dev_pixelpipe_cache_disk_header_t) + size
+     || memcmp(header->magic, DT_PIPECACHE_DISK_MAGIC, sizeof(header->magic))
+     || strncmp(header->version, darktable_package_version, sizeof(header->version))
+     || header->hash != hash || header->basichash != basichash || header->source != source
+     || header->size != size)
+  {
+    // stale or from another darktable version, don't try again
+    g_mapped_file_unref(map);
+    _disk_remove(filename, length);
+    return FALSE;
+  }
+
+  // the header dsc is taken as the line's description, just like for an in-memory hit
+  dt_iop_buffer_dsc_t line_dsc = header->dsc;
+  dt_iop_buffer_dsc_t *dscp = &line_dsc;
+  dt_dev_pixelpipe_cache_get(pipe, basichash, hash, size, data, &dscp, name, FALSE);
+  if(!*data)
+  {
+    g_mapped_file_unref(map);
+    return FALSE;
+  }
+  memcpy(*data, (const char *)header + sizeof(dt_dev_pixelpipe_cache_disk_header_t), size);
+  g_mapped_file_unref(map);
+  *dsc = dscp;
+
+  // touch the file so it's the most recently used one for trimming
+  g_utime(filename, NULL);
+  cache->disk_hits++;
+
+  dt_print_pipe(DT_DEBUG_PIPE, "pixelpipe_cache_get", pipe, name, NULL, NULL,
+    "HIT disk     %iMB hash%22" PRIu64 ", basic%22" PRIu64 "\n", _to_mb(size), hash, basichash);
+  return TRUE;
+}
+
+void dt_dev_pixelpipe_cache_write_disk(struct dt_dev_pixelpipe_t *pipe, const uint64_t basichash, const uint64_t hash,
+                                       void *data, const size_t size, const dt_iop_buffer_dsc_t *dsc,
+                                       const float cost)
+{
+  if(!data || !hash || cost < DT_PIPECACHE_DISK_MIN_COST || !_disk_enabled(pipe)) return;
+  const size_t limit = (size_t)MAX(0, dt_conf_get_int("cache_disk_pixelpipe_size")) * 1024lu * 1024lu;
+  if(size + sizeof(dt_dev_pixelpipe_cache_disk_header_t) > limit) return;
+
+  const uint64_t source = _disk_source(pipe);
+  if(!source) return;
+  char filename[PATH_MAX] = { 0 };
+  _disk_filename(filename, sizeof(filename), hash, source);
+  if(g_file_test(filename, G_FILE_TEST_IS_REGULAR)) return;
+
+  char dirname[PATH_MAX] = { 0 };
+  _disk_dirname(dirname, sizeof(dirname));
+  if(g_mkdir_with_parents(dirname, 0750)) return;
+
+  dt_dev_pixelpipe_cache_disk_header_t header = { { 0 } };
+  memcpy(header.magic, DT_PIPECACHE_DISK_MAGIC, sizeof(header.magic));
+  g_strlcpy(header.version, darktable_package_version, sizeof(header.version));
+  header.basichash = basichash;
+  header.hash = hash;
+  header.source = source;
+  header.size = size;
+  header.dsc = *dsc;
+
+  // write to a temporary file first, so other pipes never see half written lines
+  gchar *tmpname = g_strdup_printf("%s.%p.tmp", filename, (void *)pipe);
+  FILE *f = g_fopen(tmpname, "wb");
+  gboolean ok = FALSE;
+  if(f)
+  {
+    ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(data, size, 1, f) == 1;
+    ok &= fclose(f) == 0;
+  }
+  if(ok) ok = g_rename(tmpname, filename) == 0;
+  if(!ok) g_unlink(tmpname);
+  g_free(tmpname);
+  if(!ok) return;
+
+  pipe->cache.disk_writes++;
+  _disk_added(sizeof(header) + size, limit);
+}
+
 void dt_dev_pixelpipe_cache_report(struct dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_t *cache = &(pipe->cache);
   dt_print_pipe(DT_DEBUG_PIPE, "cache report", pipe, "", NULL, NULL,
-    "%i lines (important=%i, used=%i). Used %iMB, limit=%iMB. Hitrate=%.2f\n",
-    cache->entries, _important_lines(cache), _used_lines(cache),
-    _to_mb(cache->allmem), _to_mb(cache->memlimit), (cache->queries - cache->misses) / (float)cache->queries);
+    "%i/%i lines (important=%i, used=%i). Used %iMB, limit=%iMB. Hitrate=%.2f, evictions=%" PRIu64 "\n",
+    cache->entries, cache->maxentries, _important_lines(cache), _used_lines(cache),
+    _to_mb(cache->allmem), _to_mb(cache->memlimit), (cache->queries - cache->misses) / (float)cache->queries,
+    cache->evictions);
+  if(cache->disk_queries)
+    dt_print_pipe(DT_DEBUG_PIPE, "cache report", pipe, "", NULL, NULL,
+      "disk tier: %" PRIu64 " queries, %" PRIu64 " hits, %" PRIu64 " writes. Hitrate=%.2f\n",
+      cache->disk_queries, cache->disk_hits, cache->disk_writes,
+      cache->disk_hits / (float)cache->disk_queries);
 }
 
+#undef DT_PIPECACHE_DISK_MAGIC
+#undef DT_PIPECACHE_DISK_TRIM
+#undef DT_PIPECACHE_DISK_MIN_COST
+#undef DT_PIPECACHE_COST_SCALE
+#undef DT_PIPECACHE_MAX_ENTRIES
 #undef VERY_OLD_CACHE_WEIGHT
 
 // clang-format off
@@ -550,4 +902,3 @@ void dt_dev_pixelpipe_cache_report(struct dt_dev_pixelpipe_t *pipe)
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
 // clang-format on
-
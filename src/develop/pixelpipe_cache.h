@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include <glib.h>
 #include <inttypes.h>
 
 struct dt_dev_pixelpipe_t;
@@ -29,10 +30,16 @@ struct dt_iop_roi_t;
  * corresponding to history items and zoom/pan settings in the develop module.
  * correctness is secured via the hash so make sure everything is included here.
  * No caching if cl_mem, instead copied cache buffers are used.
+ *
+ * lines are found via a hashtable indexed by the full hash. ageing is done by a global
+ * tick so the age of a line is tick - stamp. when choosing lines to be dropped the age is
+ * weighted by the time it took to compute the line, so expensive modules stay longer.
+ * pipes with a memlimit may add more lines as long as they stay within the limit.
  */
 typedef struct dt_dev_pixelpipe_cache_t
 {
   int32_t entries;
+  int32_t maxentries;
   size_t allmem;
   size_t memlimit;
   void **data;
@@ -40,12 +47,19 @@ typedef struct dt_dev_pixelpipe_cache_t
   struct dt_iop_buffer_dsc_t *dsc;
   uint64_t *basichash;
   uint64_t *hash;
-  int32_t *used;
+  int64_t *stamp;
+  int64_t tick;
+  float *cost;
+  GHashTable *index; // &hash[k] -> k + 1
   // debugging helpers
-  char **modname; 
+  char **modname;
   // profiling:
   uint64_t queries;
   uint64_t misses;
+  uint64_t evictions;
+  uint64_t disk_queries;
+  uint64_t disk_hits;
+  uint64_t disk_writes;
 } dt_dev_pixelpipe_cache_t;
 
 /** constructs a new cache with given cache line count (entries) and float buffer entry size in bytes.
@@ -74,6 +88,19 @@ uint64_t dt_dev_pixelpipe_cache_basichash_prior(int imgid, struct dt_dev_pixelpi
 gboolean dt_dev_pixelpipe_cache_get(struct dt_dev_pixelpipe_t *pipe, const uint64_t basichash, const uint64_t hash,
                                const size_t size, void **data, struct dt_iop_buffer_dsc_t **dsc, char *modname, const gboolean important);
 
+/** second cache tier on disk (export pipes only, see cache_disk_pixelpipe):
+  if a line with the given hash and size has been written before from the same, unchanged image file,
+  it is loaded into a fresh cache line which is returned like in dt_dev_pixelpipe_cache_get().
+  Pipes using raster or details masks never use it. Returns TRUE on a hit.
+*/
+gboolean dt_dev_pixelpipe_cache_get_disk(struct dt_dev_pixelpipe_t *pipe, const uint64_t basichash, const uint64_t hash,
+                                         const size_t size, void **data, struct dt_iop_buffer_dsc_t **dsc, char *modname);
+
+/** write a cache line to the disk tier if that is enabled for the pipe and the line was expensive enough. */
+void dt_dev_pixelpipe_cache_write_disk(struct dt_dev_pixelpipe_t *pipe, const uint64_t basichash, const uint64_t hash,
+                                       void *data, const size_t size, const struct dt_iop_buffer_dsc_t *dsc,
+                                       const float cost);
+
 /** test availability of a cache line without destroying another, if it is not found. */
 gboolean dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size);
 
@@ -86,6 +113,9 @@ void dt_dev_pixelpipe_cache_flush_all_but(dt_dev_pixelpipe_cache_t *cache, uint6
 /** makes this buffer very important after it has been pulled from the cache. */
 void dt_dev_pixelpipe_cache_reweight(struct dt_dev_pixelpipe_t *pipe, void *data, const size_t size);
 
+/** remember how long it took to compute the given cache line, used to weight the line against others. */
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, void *data, const float seconds);
+
 /** mark the given cache line pointer as invalid. */
 void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data);
 
@@ -201,6 +201,7 @@ gboolean dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int
   pipe->backbuf_zoom_x = 0.0f;
   pipe->backbuf_zoom_y = 0.0f;
 
+  pipe->tiled_backbuf = NULL;
   pipe->output_backbuf = NULL;
   pipe->output_backbuf_width = 0;
   pipe->output_backbuf_height = 0;
@@ -284,6 +285,8 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   g_free(pipe->icc_filename);
   pipe->icc_filename = NULL;
 
+  dt_free_align(pipe->tiled_backbuf);
+  pipe->tiled_backbuf = NULL;
   g_free(pipe->output_backbuf);
   pipe->output_backbuf = NULL;
   pipe->output_backbuf_width = 0;
@@ -350,6 +353,11 @@ void dt_dev_pixelpipe_rebuild(dt_develop_t *dev)
   dt_dev_invalidate_all(dev);
 }
 
+static inline int _piece_colors(dt_dev_pixelpipe_t *pipe, dt_iop_module_t *module)
+{
+  return (module->default_colorspace(module, pipe, NULL) == IOP_CS_RAW) && dt_image_is_raw(&pipe->image) ? 1 : 4;
+}
+
 void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&pipe->busy_mutex); // block until pipe is idle
@@ -372,11 +380,7 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
     piece->histogram_params.bins_count = 256;
     piece->histogram_stats.bins_count = 0;
     piece->histogram_stats.pixels = 0;
-    piece->colors
-        = ((module->default_colorspace(module, pipe, NULL) == IOP_CS_RAW)
-           && (dt_image_is_raw(&pipe->image)))
-      ? 1
-      : 4;
+    piece->colors = _piece_colors(pipe, module);
     piece->iscale = pipe->iscale;
     piece->iwidth = pipe->iwidth;
     piece->iheight = pipe->iheight;
@@ -395,6 +399,44 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
   dt_pthread_mutex_unlock(&pipe->busy_mutex); // safe for others to use/mess with the pipe now
 }
 
+void dt_dev_pixelpipe_update_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
+{
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  gboolean same = g_list_length(pipe->nodes) == g_list_length(dev->iop);
+  const GList *modules = dev->iop;
+  for(const GList *nodes = pipe->nodes; same && nodes; nodes = g_list_next(nodes), modules = g_list_next(modules))
+  {
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    same = piece->module == module && piece->colors == _piece_colors(pipe, module);
+  }
+
+  if(same)
+  {
+    // same instances in the same order, only the input and the order list of the new image are taken over
+    g_list_free_full(pipe->iop_order_list, free);
+    pipe->iop_order_list = dt_ioppr_iop_order_copy_deep(dev->iop_order_list);
+    for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+    {
+      dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+      piece->iscale = pipe->iscale;
+      piece->iwidth = pipe->iwidth;
+      piece->iheight = pipe->iheight;
+      memset(&piece->processed_roi_in, 0, sizeof(piece->processed_roi_in));
+      memset(&piece->processed_roi_out, 0, sizeof(piece->processed_roi_out));
+    }
+  }
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+
+  if(!same)
+  {
+    dt_print(DT_DEBUG_PARAMS, "[pixelpipe] [%s] module instances changed, rebuilding the nodes\n",
+             dt_dev_pixelpipe_type_to_str(pipe->type));
+    dt_dev_pixelpipe_cleanup_nodes(pipe);
+    dt_dev_pixelpipe_create_nodes(pipe, dev);
+  }
+}
+
 // helper
 void dt_dev_pixelpipe_synch(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, GList *history)
 {
@@ -1143,6 +1185,14 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     // run these
     return 0;
   }
+  // export pipes may find the output of an earlier run in the disk tier
+  if(modules && hash
+     && dt_dev_pixelpipe_cache_get_disk(pipe, basichash, hash, bufsize, output, out_format, module ? module->so->op : NULL))
+  {
+    if(dt_atomic_get_int(&pipe->shutdown))
+      return 1;
+    return 0;
+  }
 
   // 2) if history changed or exit event, abort processing?
   // preview pipe: abort on all but zoom events (same buffer anyways)
@@ -1924,9 +1974,19 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   g_free(module_label);
   module_label = NULL;
 
+  // expensive modules get their output kept longer in the cache
+  const float cost = dt_get_wtime() - start.clock;
+  dt_dev_pixelpipe_cache_set_cost(&(pipe->cache), *output, cost);
+
   // in case we get this buffer from the cache in the future, cache some stuff:
   **out_format = piece->dsc_out = pipe->dsc;
 
+  // and keep it for later runs of the same export if the host buffer is valid
+#ifdef HAVE_OPENCL
+  if(*cl_mem_output == NULL)
+#endif
+    dt_dev_pixelpipe_cache_write_disk(pipe, basichash, hash, *output, bufsize, &piece->dsc_out, cost);
+
   if((module == darktable.develop->gui_module) || input_important)
   {
     // give the input buffer to the currently focused plugin more weight.
@@ -2288,6 +2348,122 @@ restart:
   return 0;
 }
 
+// strips overlap by the sum of the module overlaps, times this safety factor plus a few pixels to
+// account for distortions between a module and the output
+#define DT_PIPE_TILE_HALO_FACTOR 1.5f
+#define DT_PIPE_TILE_HALO_MIN 8
+
+// find the margin in output pixels the strips need. returns FALSE if a module has to see the whole image.
+static gboolean _pipe_tile_halo(dt_dev_pixelpipe_t *pipe, const float scale, int *halo)
+{
+  const dt_iop_roi_t roi = { 0, 0, pipe->iwidth, pipe->iheight, 1.0f };
+  float overlap = 0.0f;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!piece->enabled) continue;
+    dt_iop_module_t *module = piece->module;
+
+    // modules declare they cope with partial regions the same way as for tiling, gamma is per pixel
+    if(!piece->process_tiling_ready && strcmp(module->op, "gamma"))
+    {
+      dt_print_pipe(DT_DEBUG_PIPE, "tiled pipe", pipe, module->so->op, NULL, NULL,
+                    "needs the whole image, processing in one go\n");
+      return FALSE;
+    }
+
+    dt_develop_tiling_t tiling = { 0 };
+    tiling.factor_cl = tiling.maxbuf_cl = -1;
+    module->tiling_callback(module, piece, &roi, &roi, &tiling);
+    overlap += tiling.overlap;
+
+    const dt_develop_blend_params_t *bp = (const dt_develop_blend_params_t *)piece->blendop_data;
+    if(bp && bp->mask_mode != DEVELOP_MASK_DISABLED)
+      overlap += bp->feathering_radius + bp->blur_radius;
+  }
+  *halo = ceilf(DT_PIPE_TILE_HALO_FACTOR * overlap * fmaxf(scale, 1.0f)) + DT_PIPE_TILE_HALO_MIN;
+  return TRUE;
+}
+
+int dt_dev_pixelpipe_process_strips(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width,
+                                    int height, float scale, const gboolean no_gamma, const float tile_mpix,
+                                    dt_dev_pixelpipe_strip_callback_t callback, void *data)
+{
+  int halo = 0;
+  int rows = (tile_mpix > 0.0f && width > 0) ? MAX(1, (int)(tile_mpix * 1e6f / width)) : height;
+  // don't let the margins dominate the work
+  if(rows < height && _pipe_tile_halo(pipe, scale, &halo))
+    rows = MAX(rows, 4 * halo);
+  else
+    rows = height;
+
+  if(rows >= height)
+  {
+    const int err = no_gamma ? dt_dev_pixelpipe_process_no_gamma(pipe, dev, x, y, width, height, scale)
+                             : dt_dev_pixelpipe_process(pipe, dev, x, y, width, height, scale);
+    if(err) return 1;
+    return callback(pipe, pipe->backbuf, 0, height, width, dt_iop_buffer_dsc_to_bpp(&pipe->dsc), data) ? 1 : 0;
+  }
+
+  dt_print(DT_DEBUG_PIPE | DT_DEBUG_PERF, "[pixelpipe_process_strips] [%s] %dx%d in strips of %d rows, margin %d\n",
+           dt_dev_pixelpipe_type_to_str(pipe->type), width, height, rows, halo);
+
+  for(int y0 = 0; y0 < height; y0 += rows)
+  {
+    const int y1 = MIN(height, y0 + rows);
+    const int ey0 = MAX(0, y0 - halo);
+    const int ey1 = MIN(height, y1 + halo);
+    const int err = no_gamma ? dt_dev_pixelpipe_process_no_gamma(pipe, dev, x, y + ey0, width, ey1 - ey0, scale)
+                             : dt_dev_pixelpipe_process(pipe, dev, x, y + ey0, width, ey1 - ey0, scale);
+    if(err) return 1;
+
+    // the output format is only known once the pipe ran
+    const size_t bpp = dt_iop_buffer_dsc_to_bpp(&pipe->dsc);
+    if(callback(pipe, pipe->backbuf + bpp * width * (y0 - ey0), y0, y1 - y0, width, bpp, data)) return 1;
+  }
+  return 0;
+}
+
+typedef struct _pipe_stitch_t
+{
+  uint8_t *out;
+  int height;
+} _pipe_stitch_t;
+
+static int _pipe_stitch(dt_dev_pixelpipe_t *pipe, uint8_t *rows, const int first_row, const int num_rows,
+                        const int width, const size_t bpp, void *data)
+{
+  _pipe_stitch_t *s = (_pipe_stitch_t *)data;
+  // processed in one go, backbuf already holds everything
+  if(first_row == 0 && num_rows == s->height) return 0;
+
+  if(!s->out) s->out = dt_alloc_align(64, bpp * width * s->height);
+  if(!s->out) return 1;
+  memcpy(s->out + bpp * width * first_row, rows, bpp * width * num_rows);
+  return 0;
+}
+
+int dt_dev_pixelpipe_process_tiled(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width,
+                                   int height, float scale, const gboolean no_gamma, const float tile_mpix)
+{
+  _pipe_stitch_t s = { NULL, height };
+  if(dt_dev_pixelpipe_process_strips(pipe, dev, x, y, width, height, scale, no_gamma, tile_mpix, _pipe_stitch, &s))
+  {
+    dt_free_align(s.out);
+    return 1;
+  }
+  if(!s.out) return 0;
+
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  dt_free_align(pipe->tiled_backbuf);
+  pipe->tiled_backbuf = s.out;
+  pipe->backbuf = s.out;
+  pipe->backbuf_width = pipe->final_width = width;
+  pipe->backbuf_height = pipe->final_height = height;
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  return 0;
+}
+
 void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_flush(&pipe->cache);
@@ -127,6 +127,8 @@ typedef struct dt_dev_pixelpipe_t
   float backbuf_zoom_x, backbuf_zoom_y;
   uint64_t backbuf_hash;
   dt_pthread_mutex_t backbuf_mutex, busy_mutex;
+  // stitched output of dt_dev_pixelpipe_process_tiled(), backbuf points here then
+  uint8_t *tiled_backbuf;
   // output buffer (for display)
   uint8_t *output_backbuf;
   int output_backbuf_width, output_backbuf_height;
@@ -224,6 +226,8 @@ void dt_dev_pixelpipe_change(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev)
 void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe);
 // sync with develop_t history stack from scratch (new node added, have to pop old ones)
 void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
+// keep the nodes for a new image if dev has the same module instances as before, else recreate them
+void dt_dev_pixelpipe_update_nodes(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
 // sync with develop_t history stack by just copying the top item params (same op, new params on top)
 void dt_dev_pixelpipe_synch_all(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
 // adjust output node according to history stack (history pop event)
@@ -237,6 +241,19 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev,
 // convenience method that does not gamma-compress the image.
 int dt_dev_pixelpipe_process_no_gamma(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y,
                                       int width, int height, float scale);
+// receives num_rows finished rows of the output starting at first_row, return != 0 to abort.
+typedef int (*dt_dev_pixelpipe_strip_callback_t)(dt_dev_pixelpipe_t *pipe, uint8_t *rows, const int first_row,
+                                                 const int num_rows, const int width, const size_t bpp, void *data);
+// process the region in horizontal strips of about tile_mpix megapixels, each grown by the margin the
+// modules need, and hand them to callback top to bottom. without strips callback gets the whole region.
+int dt_dev_pixelpipe_process_strips(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width,
+                                    int height, float scale, const gboolean no_gamma, const float tile_mpix,
+                                    dt_dev_pixelpipe_strip_callback_t callback, void *data);
+// process the region in horizontal strips of about tile_mpix megapixels, each grown by the margin the
+// modules need, and stitch them into pipe->backbuf. falls back to dt_dev_pixelpipe_process(_no_gamma)
+// in one go if tile_mpix is 0, the region is small or a module can't work on parts of the image.
+int dt_dev_pixelpipe_process_tiled(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width,
+                                   int height, float scale, const gboolean no_gamma, const float tile_mpix);
 
 // disable given op and all that comes after it in the pipe:
 void dt_dev_pixelpipe_disable_after(dt_dev_pixelpipe_t *pipe, const char *op);
@@ -27,6 +27,7 @@
 #include "common/selection.h"
 #include "common/undo.h"
 #include "control/control.h"
+#include "control/jobs/image_jobs.h"
 #include "gui/accelerators.h"
 #include "gui/drag_and_drop.h"
 #include "views/view.h"
@@ -608,6 +609,104 @@ static int _thumbs_load_needed(dt_thumbtable_t *table)
   return changed;
 }
 
+// how far ahead of the scrolling to prefetch, in seconds at the current speed
+#define DT_THUMBTABLE_PREFETCH_HORIZON 0.5f
+// the system job queue holds 30 jobs, leave room for the visible thumbnails
+#define DT_THUMBTABLE_PREFETCH_MAX 20
+
+// drop the prefetches that are still queued
+static void _thumbs_prefetch_cancel(dt_thumbtable_t *table)
+{
+  dt_atomic_add_int(&table->prefetch_generation, 1);
+  table->prefetch_rowid = 0;
+}
+
+// track the scrolling speed and direction after a move of (x,y) pixels
+static void _thumbs_prefetch_track(dt_thumbtable_t *table, const int x, const int y)
+{
+  // moving the thumbs up or left brings the next images in
+  const int delta = (table->mode == DT_THUMBTABLE_MODE_FILMSTRIP) ? x : y;
+  if(delta == 0) return;
+  const int dir = (delta < 0) ? 1 : -1;
+  if(dir != table->prefetch_dir)
+  {
+    _thumbs_prefetch_cancel(table);
+    table->prefetch_dir = dir;
+    table->prefetch_speed = 0.0f;
+  }
+
+  const double now = dt_get_wtime();
+  const double dt = now - table->prefetch_time;
+  table->prefetch_time = now;
+  const float speed = abs(delta) / MAX(dt, 0.001);
+  // after a pause we start over, otherwise smooth out the jerkiness of the scroll events
+  table->prefetch_speed = (dt > 0.5 || table->prefetch_speed == 0.0f) ? speed
+                                                                       : 0.5f * (table->prefetch_speed + speed);
+}
+
+// queue the thumbnails about to scroll in, nearest last so they are loaded first
+static void _thumbs_prefetch(dt_thumbtable_t *table)
+{
+  if(!table->list || table->prefetch_dir == 0 || table->thumb_size <= 0
+     || (table->mode != DT_THUMBTABLE_MODE_FILEMANAGER && table->mode != DT_THUMBTABLE_MODE_FILMSTRIP))
+    return;
+
+  // at least the next row, at most what the speed covers until the horizon
+  const int rows = CLAMP(ceilf(table->prefetch_speed * DT_THUMBTABLE_PREFETCH_HORIZON / table->thumb_size), 1,
+                         2 * MAX(table->rows, 1));
+  const int count = MIN(rows * table->thumbs_per_row, DT_THUMBTABLE_PREFETCH_MAX);
+
+  int from, to;
+  if(table->prefetch_dir > 0)
+  {
+    const dt_thumbnail_t *last = (dt_thumbnail_t *)g_list_last(table->list)->data;
+    from = MAX(last->rowid, table->prefetch_rowid) + 1;
+    to = last->rowid + count;
+  }
+  else
+  {
+    const dt_thumbnail_t *first = (dt_thumbnail_t *)table->list->data;
+    from = first->rowid - count;
+    to = (table->prefetch_rowid > 0 ? MIN(first->rowid, table->prefetch_rowid) : first->rowid) - 1;
+  }
+  if(from > to || to < 1) return;
+
+  // same size as the visible ones will ask for, see dt_view_image_get_surface()
+  const dt_thumbnail_t *thumb = (dt_thumbnail_t *)table->list->data;
+  int image_w = 0, image_h = 0;
+  gtk_widget_get_size_request(thumb->w_image_box, &image_w, &image_h);
+  if(image_w <= 0 || image_h <= 0) image_w = image_h = table->thumb_size;
+  const dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(
+      darktable.mipmap_cache, image_w * darktable.gui->ppd, image_h * darktable.gui->ppd);
+
+  sqlite3_stmt *stmt;
+  // clang-format off
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              (table->prefetch_dir > 0)
+                              ? "SELECT imgid FROM memory.collected_images"
+                                " WHERE rowid >= ?1 AND rowid <= ?2 ORDER BY rowid DESC"
+                              : "SELECT imgid FROM memory.collected_images"
+                                " WHERE rowid >= ?1 AND rowid <= ?2 ORDER BY rowid",
+                              -1, &stmt, NULL);
+  // clang-format on
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, from);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, to);
+  int queued = 0;
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG,
+                       dt_image_prefetch_job_create(sqlite3_column_int(stmt, 0), mip,
+                                                    &table->prefetch_generation));
+    queued++;
+  }
+  sqlite3_finalize(stmt);
+
+  // rows past the end of the collection are not there, don't remember them as queued
+  if(queued) table->prefetch_rowid = (table->prefetch_dir > 0) ? from + queued - 1 : to - queued + 1;
+  dt_print(DT_DEBUG_LIGHTTABLE, "[thumbtable] prefetch %d thumbs (rows %d to %d) at %.0f px/s\n", queued, from, to,
+           table->prefetch_speed);
+}
+
 // move all thumbs from the table.
 // if clamp, we verify that the move is allowed (collection bounds, etc...)
 static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean clamp)
@@ -744,6 +843,10 @@ static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean
   // update scrollbars
   _thumbtable_update_scrollbars(table);
 
+  // and get the next ones ready
+  _thumbs_prefetch_track(table, posx, posy);
+  _thumbs_prefetch(table);
+
   return TRUE;
 }
 
@@ -1954,6 +2057,7 @@ void dt_thumbtable_full_redraw(dt_thumbtable_t *table, gboolean force)
 
     const double start = dt_get_wtime();
     table->dragging = FALSE;
+    _thumbs_prefetch_cancel(table);
     sqlite3_stmt *stmt;
     dt_print(DT_DEBUG_LIGHTTABLE,
              "reload thumbs from db. force=%d w=%d h=%d zoom=%d rows=%d size=%d offset=%d centering=%d...\n",
@@ -16,6 +16,7 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 /** a class to manage a table of thumbnail for lighttable and filmstrip.  */
+#include "common/atomic.h"
 #include "dtgtk/thumbnail.h"
 #include <gtk/gtk.h>
 
@@ -103,6 +104,13 @@ typedef struct dt_thumbtable_t
   // let's remember previous thumbnail generation settings to detect if they change
   int pref_embedded;
   int pref_hq;
+
+  // prefetch of the thumbnails ahead of the scrolling
+  dt_atomic_int prefetch_generation; // bumped to drop the queued prefetches
+  int prefetch_dir;                  // 1 towards the end of the collection, -1 towards the start
+  int prefetch_rowid;                // furthest rowid already queued in that direction
+  double prefetch_time;              // of the last move
+  float prefetch_speed;              // smoothed scrolling speed in pixels per second
 } dt_thumbtable_t;
 
 dt_thumbtable_t *dt_thumbtable_new();
@@ -17,6 +17,7 @@
 */
 
 #include <glib.h>    // for g_mkdir_with_parents, _
+#include <glib/gstdio.h> // for g_unlink
 #include <gtk/gtk.h> // for gtk_init_check
 #include <libintl.h> // for bind_textdomain_codeset, etc
 #include <limits.h>  // for PATH_MAX
@@ -45,7 +46,132 @@
 #include "win/main_wrapper.h"
 #endif
 
-static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const int32_t min_imgid, const int32_t max_imgid)
+// images handed out to the workers. the ring doubles as the window of images in flight:
+// an image only leaves it once it and all the ones before it are done, which gives the
+// point to resume from.
+typedef struct dt_generate_queue_t
+{
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int32_t *ids;
+  gchar **filenames;
+  gboolean *done;
+  size_t size;      // capacity of the ring
+  size_t tail;      // next slot the producer fills
+  size_t next;      // next slot a worker takes
+  size_t committed; // all slots before this one are done
+  gboolean finished;
+
+  dt_mipmap_size_t min_mip, max_mip;
+  size_t image_count, counter;
+  int32_t resume_imgid; // all images up to this id are done
+  double start, last_save;
+  char resume_file[PATH_MAX];
+} dt_generate_queue_t;
+
+// save the progress every this many seconds
+#define DT_GENERATE_RESUME_INTERVAL 10.0
+
+static void _save_resume(const dt_generate_queue_t *q)
+{
+  gchar *content = g_strdup_printf("%d\n", q->resume_imgid);
+  g_file_set_contents(q->resume_file, content, -1, NULL);
+  g_free(content);
+}
+
+static int32_t _load_resume(const char *resume_file)
+{
+  gchar *content = NULL;
+  int32_t imgid = -1;
+  if(g_file_get_contents(resume_file, &content, NULL, NULL))
+    imgid = atoi(content);
+  g_free(content);
+  return imgid;
+}
+
+static void _generate_image(const int32_t imgid, const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip)
+{
+  gboolean missing[DT_MIPMAP_F] = { FALSE };
+  gboolean any_missing = FALSE;
+  for(int k = max_mip; k >= min_mip && k >= 0; k--)
+  {
+    // if a valid thumbnail is already on disc - do nothing
+    missing[k] = !dt_mipmap_cache_is_on_disk(darktable.mipmap_cache, imgid, k);
+    any_missing |= missing[k];
+  }
+
+  if(any_missing)
+  {
+    // render the largest size once, or read it back from disc, and keep it locked so the
+    // smaller sizes are downsampled from it instead of running the pipe again.
+    dt_mipmap_buffer_t top;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &top, imgid, max_mip, DT_MIPMAP_BLOCKING, 'r');
+    for(int k = max_mip - 1; k >= min_mip && k >= 0; k--)
+    {
+      if(!missing[k]) continue;
+      dt_mipmap_buffer_t buf;
+      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
+      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    }
+    dt_mipmap_cache_release(darktable.mipmap_cache, &top);
+  }
+
+  // and immediately write thumbs to disc and remove from mipmap cache.
+  dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
+  // thumbnail in sync with image
+  dt_history_hash_set_mipmap(imgid);
+}
+
+static void *_generate_worker(void *arg)
+{
+  dt_generate_queue_t *q = (dt_generate_queue_t *)arg;
+  dt_pthread_setname("generate-cache");
+
+  dt_pthread_mutex_lock(&q->mutex);
+  while(TRUE)
+  {
+    while(q->next == q->tail && !q->finished) dt_pthread_cond_wait(&q->cond, &q->mutex);
+    if(q->next == q->tail) break;
+
+    const size_t slot = q->next++ % q->size;
+    const int32_t imgid = q->ids[slot];
+    dt_pthread_mutex_unlock(&q->mutex);
+
+    _generate_image(imgid, q->min_mip, q->max_mip);
+
+    dt_pthread_mutex_lock(&q->mutex);
+    q->done[slot] = TRUE;
+    q->counter++;
+    const double now = dt_get_wtime();
+    const double rate = q->counter / MAX(now - q->start, 1e-3);
+    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d, file=%s) %.2f images/s, %.0f s left\n", q->counter,
+            q->image_count, 100.0 * q->counter / (float)q->image_count, imgid, q->filenames[slot], rate,
+            (q->image_count - MIN(q->counter, q->image_count)) / rate);
+
+    // move the resume point past everything that is done, in order
+    while(q->committed < q->next && q->done[q->committed % q->size])
+    {
+      const size_t c = q->committed++ % q->size;
+      q->resume_imgid = q->ids[c];
+      q->done[c] = FALSE;
+      g_free(q->filenames[c]);
+      q->filenames[c] = NULL;
+    }
+    if(now - q->last_save > DT_GENERATE_RESUME_INTERVAL)
+    {
+      _save_resume(q);
+      q->last_save = now;
+    }
+    // wake up the producer waiting for free slots
+    pthread_cond_broadcast(&q->cond);
+  }
+  dt_pthread_mutex_unlock(&q->mutex);
+  return NULL;
+}
+
+static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip,
+                                    int32_t min_imgid, const int32_t max_imgid, const int threads,
+                                    const gboolean resume)
 {
   fprintf(stderr, _("creating cache directories\n"));
   for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
@@ -61,9 +187,21 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
+  dt_generate_queue_t q = { 0 };
+  snprintf(q.resume_file, sizeof(q.resume_file), "%s.d/generate-cache.resume", darktable.mipmap_cache->cachedir);
+  if(resume)
+  {
+    const int32_t done_imgid = _load_resume(q.resume_file);
+    if(done_imgid >= min_imgid)
+    {
+      fprintf(stderr, _("resuming after image id %d\n"), done_imgid);
+      min_imgid = done_imgid + 1;
+    }
+  }
+
   // some progress counter
   sqlite3_stmt *stmt;
-  size_t image_count = 0, counter = 0;
+  size_t image_count = 0;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
@@ -87,43 +225,81 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // go through all images:
+  // a few images per worker keep everybody busy without reading ahead the whole library
+  q.size = 4 * threads;
+  q.ids = calloc(q.size, sizeof(int32_t));
+  q.filenames = calloc(q.size, sizeof(gchar *));
+  q.done = calloc(q.size, sizeof(gboolean));
+  pthread_t *workers = calloc(threads, sizeof(pthread_t));
+  if(!q.ids || !q.filenames || !q.done || !workers)
+  {
+    free(workers);
+    free(q.ids);
+    free(q.filenames);
+    free(q.done);
+    return 1;
+  }
+  q.min_mip = min_mip;
+  q.max_mip = max_mip;
+  q.image_count = image_count;
+  q.resume_imgid = min_imgid - 1;
+  q.start = q.last_save = dt_get_wtime();
+  dt_pthread_mutex_init(&q.mutex, NULL);
+  pthread_cond_init(&q.cond, NULL);
+
+  fprintf(stderr, _("generating thumbnails with %d threads\n"), threads);
+  int started = 0;
+  for(; started < threads; started++)
+    if(dt_pthread_create(&workers[started], _generate_worker, &q)) break;
+
+  // go through all images, in order of id so that the progress can be resumed:
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id, filename FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
+                              "SELECT id, filename FROM main.images WHERE id >= ?1 AND id <= ?2 ORDER BY id",
+                              -1, &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  while(started && sqlite3_step(stmt) == SQLITE_ROW)
   {
     const int32_t imgid = sqlite3_column_int(stmt, 0);
-    const char *imgfilename = (const char*)sqlite3_column_text(stmt, 1);
-
-    counter++;
-    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d, file=%s)\n", counter, image_count, 100.0 * counter / (float)image_count, imgid, imgfilename);
+    const char *imgfilename = (const char *)sqlite3_column_text(stmt, 1);
+
+    dt_pthread_mutex_lock(&q.mutex);
+    while(q.tail - q.committed >= q.size) dt_pthread_cond_wait(&q.cond, &q.mutex);
+    const size_t slot = q.tail++ % q.size;
+    q.ids[slot] = imgid;
+    q.filenames[slot] = g_strdup(imgfilename);
+    pthread_cond_broadcast(&q.cond);
+    dt_pthread_mutex_unlock(&q.mutex);
+  }
+  sqlite3_finalize(stmt);
 
-    for(int k = max_mip; k >= min_mip && k >= 0; k--)
-    {
-      char filename[PATH_MAX] = { 0 };
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
+  dt_pthread_mutex_lock(&q.mutex);
+  q.finished = TRUE;
+  pthread_cond_broadcast(&q.cond);
+  dt_pthread_mutex_unlock(&q.mutex);
 
-      // if a valid thumbnail file is already on disc - do nothing
-      if(dt_util_test_image_file(filename)) continue;
+  for(int k = 0; k < started; k++) pthread_join(workers[k], NULL);
+  free(workers);
 
-      // else, generate thumbnail and store in mipmap cache.
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
-      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
-    }
+  const double elapsed = dt_get_wtime() - q.start;
+  const int res = (started && q.committed == q.tail) ? 0 : 1;
+  // all done, a later resume starts over
+  if(res == 0)
+    g_unlink(q.resume_file);
+  else
+    _save_resume(&q);
 
-    // and immediately write thumbs to disc and remove from mipmap cache.
-    dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
-    // thumbnail in sync with image
-    dt_history_hash_set_mipmap(imgid);
-  }
+  for(size_t k = 0; k < q.size; k++) g_free(q.filenames[k]);
+  free(q.ids);
+  free(q.filenames);
+  free(q.done);
+  pthread_cond_destroy(&q.cond);
+  dt_pthread_mutex_destroy(&q.mutex);
 
-  sqlite3_finalize(stmt);
-  fprintf(stderr, "done\n");
+  fprintf(stderr, "done, %zu images in %.1f s (%.2f images/s)\n", q.counter, elapsed,
+          q.counter / MAX(elapsed, 1e-3));
 
-  return 0;
+  return res;
 }
 
 static void usage(const char *progname)
@@ -132,13 +308,17 @@ static void usage(const char *progname)
           "usage: %s [-h, --help; --version]\n"
           "  [--min-mip <0-8> (default = 0)] [-m, --max-mip <0-8> (default = 2)]\n"
           "  [--min-imgid <N>] [--max-imgid <N>]\n"
+          "  [-j, --threads <N> (default = auto)] [--resume]\n"
           "  [--core <darktable options>]\n"
           "\n"
           "When multiple mipmap sizes are requested, the biggest one is computed\n"
           "while the rest are quickly downsampled.\n"
           "\n"
           "The --min-imgid and --max-imgid specify the range of internal image ID\n"
-          "numbers to work on.\n",
+          "numbers to work on.\n"
+          "\n"
+          "With --resume, images up to the last one recorded as done by an\n"
+          "interrupted run are skipped.\n",
           progname);
 }
 
@@ -164,6 +344,8 @@ int main(int argc, char *arg[])
   dt_mipmap_size_t max_mip = DT_MIPMAP_2;
   int32_t min_imgid = 0;
   int32_t max_imgid = INT32_MAX;
+  int threads = 0;
+  gboolean resume = FALSE;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -199,6 +381,15 @@ int main(int argc, char *arg[])
       k++;
       max_imgid = (int32_t)MIN(MAX(atoi(arg[k]), 0), INT32_MAX);
     }
+    else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--threads")) && argc > k + 1)
+    {
+      k++;
+      threads = MIN(MAX(atoi(arg[k]), 0), 256);
+    }
+    else if(!strcmp(arg[k], "--resume"))
+    {
+      resume = TRUE;
+    }
     else if(!strcmp(arg[k], "--core"))
     {
       // everything from here on should be passed to the core
@@ -252,7 +443,9 @@ int main(int argc, char *arg[])
 
   fprintf(stderr, _("creating complete lighttable thumbnail cache\n"));
 
-  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid))
+  if(threads == 0) threads = dt_worker_threads();
+
+  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid, threads, resume))
   {
     free(m_arg);
     exit(EXIT_FAILURE);
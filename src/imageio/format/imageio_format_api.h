@@ -80,6 +80,15 @@ REQUIRED(int, write_image, struct dt_imageio_module_data_t *data, const char *fi
                            dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                            void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
                            const gboolean export_masks);
+/* incremental writing of large images, rows arrive top to bottom in the same layout as for write_image.
+   begin returns a handle or NULL on fail, it may keep exif until end which is always called once begin
+   succeeded. rows and end return != 0 on fail. formats not providing these are written in one go. */
+OPTIONAL(void *, write_image_begin, struct dt_imageio_module_data_t *data, const char *filename,
+                                    dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                                    void *exif, int exif_len, int imgid);
+OPTIONAL(int, write_image_rows, struct dt_imageio_module_data_t *data, void *handle, const void *in,
+                                const int first_row, const int num_rows);
+OPTIONAL(int, write_image_end, struct dt_imageio_module_data_t *data, void *handle);
 /* flag that describes the available precision/levels of output format. mainly used for dithering. */
 OPTIONAL(int, levels, struct dt_imageio_module_data_t *data);
 
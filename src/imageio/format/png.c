@@ -117,43 +117,11 @@ static void PNGwriteRawProfile(png_struct *ping, png_info *ping_info, char *prof
   png_free(ping, text);
 }
 
-int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+// everything up to the pixels, must be called with png_jmpbuf set up
+static void _write_header(const dt_imageio_png_t *p, png_structp png_ptr, png_infop info_ptr,
+                          dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                          void *exif, int exif_len, int imgid)
 {
-  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
-  const int width = p->global.width, height = p->global.height;
-  FILE *f = g_fopen(filename, "wb");
-  if(!f) return 1;
-
-  png_structp png_ptr;
-  png_infop info_ptr;
-
-  png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  if(!png_ptr)
-  {
-    fclose(f);
-    return 1;
-  }
-
-  info_ptr = png_create_info_struct(png_ptr);
-  if(!info_ptr)
-  {
-    fclose(f);
-    png_destroy_write_struct(&png_ptr, NULL);
-    return 1;
-  }
-
-  if(setjmp(png_jmpbuf(png_ptr)))
-  {
-    fclose(f);
-    png_destroy_write_struct(&png_ptr, &info_ptr);
-    return 1;
-  }
-
-  png_init_io(png_ptr, f);
-
   png_set_compression_level(png_ptr, p->compression);
   png_set_compression_mem_level(png_ptr, 8);
   png_set_compression_strategy(png_ptr, Z_DEFAULT_STRATEGY);
@@ -161,8 +129,8 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
   png_set_compression_method(png_ptr, 8);
   png_set_compression_buffer_size(png_ptr, 8192);
 
-  png_set_IHDR(png_ptr, info_ptr, width, height, p->bpp, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
-               PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_set_IHDR(png_ptr, info_ptr, p->global.width, p->global.height, p->bpp, PNG_COLOR_TYPE_RGB,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
   // metadata has to be written before the pixels
 
@@ -212,13 +180,53 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
    */
   png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
 
+  /* swap bytes of 16 bit files to most significant bit first */
+  if(p->bpp > 8) png_set_swap(png_ptr);
+}
+
+int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  const int width = p->global.width, height = p->global.height;
+  FILE *f = g_fopen(filename, "wb");
+  if(!f) return 1;
+
+  png_structp png_ptr;
+  png_infop info_ptr;
+
+  png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if(!png_ptr)
+  {
+    fclose(f);
+    return 1;
+  }
+
+  info_ptr = png_create_info_struct(png_ptr);
+  if(!info_ptr)
+  {
+    fclose(f);
+    png_destroy_write_struct(&png_ptr, NULL);
+    return 1;
+  }
+
+  if(setjmp(png_jmpbuf(png_ptr)))
+  {
+    fclose(f);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    return 1;
+  }
+
+  png_init_io(png_ptr, f);
+
+  _write_header(p, png_ptr, info_ptr, over_type, over_filename, exif, exif_len, imgid);
+
   png_bytep *row_pointers = dt_alloc_align(64, sizeof(png_bytep) * height);
 
   if(p->bpp > 8)
   {
-    /* swap bytes of 16 bit files to most significant bit first */
-    png_set_swap(png_ptr);
-
     for(unsigned i = 0; i < height; i++) row_pointers[i] = (png_bytep)((uint16_t *)ivoid + (size_t)4 * i * width);
   }
   else
@@ -236,6 +244,86 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
   return 0;
 }
 
+typedef struct _png_stream_t
+{
+  FILE *f;
+  png_structp png_ptr;
+  png_infop info_ptr;
+  int next_row;
+  gboolean failed;
+} _png_stream_t;
+
+void *write_image_begin(dt_imageio_module_data_t *p_tmp, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                        void *exif, int exif_len, int imgid)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  _png_stream_t *s = calloc(1, sizeof(_png_stream_t));
+  if(!s) return NULL;
+
+  s->f = g_fopen(filename, "wb");
+  if(!s->f) goto error;
+
+  s->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if(!s->png_ptr) goto error;
+
+  s->info_ptr = png_create_info_struct(s->png_ptr);
+  if(!s->info_ptr) goto error;
+
+  if(setjmp(png_jmpbuf(s->png_ptr))) goto error;
+
+  png_init_io(s->png_ptr, s->f);
+  _write_header(p, s->png_ptr, s->info_ptr, over_type, over_filename, exif, exif_len, imgid);
+  return s;
+
+error:
+  if(s->png_ptr) png_destroy_write_struct(&s->png_ptr, s->info_ptr ? &s->info_ptr : NULL);
+  if(s->f) fclose(s->f);
+  free(s);
+  return NULL;
+}
+
+int write_image_rows(dt_imageio_module_data_t *p_tmp, void *handle, const void *in, const int first_row,
+                     const int num_rows)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  _png_stream_t *s = (_png_stream_t *)handle;
+  // png rows can only be written in order
+  if(s->failed || first_row != s->next_row) return 1;
+
+  if(setjmp(png_jmpbuf(s->png_ptr)))
+  {
+    s->failed = TRUE;
+    return 1;
+  }
+
+  const size_t stride = (size_t)4 * p->global.width * (p->bpp > 8 ? sizeof(uint16_t) : sizeof(uint8_t));
+  for(int i = 0; i < num_rows; i++) png_write_row(s->png_ptr, (png_bytep)in + stride * i);
+  s->next_row += num_rows;
+  return 0;
+}
+
+int write_image_end(dt_imageio_module_data_t *p_tmp, void *handle)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  _png_stream_t *s = (_png_stream_t *)handle;
+
+  // an incomplete image is left truncated, finishing it would fail anyway
+  int rc = (s->failed || s->next_row != p->global.height) ? 1 : 0;
+  if(rc == 0)
+  {
+    if(setjmp(png_jmpbuf(s->png_ptr)))
+      rc = 1;
+    else
+      png_write_end(s->png_ptr, s->info_ptr);
+  }
+
+  png_destroy_write_struct(&s->png_ptr, &s->info_ptr);
+  fclose(s->f);
+  free(s);
+  return rc;
+}
+
 static int __attribute__((__unused__)) read_header(const char *filename, dt_imageio_module_data_t *p_tmp)
 {
   dt_imageio_png_t *png = (dt_imageio_png_t *)p_tmp;
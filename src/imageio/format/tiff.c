@@ -64,6 +64,153 @@ typedef struct dt_imageio_tiff_gui_t
 } dt_imageio_tiff_gui_t;
 
 
+static TIFF *_tiff_open(const char *filename, const char *mode)
+{
+#ifdef _WIN32
+  wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
+  TIFF *tif = TIFFOpenW(wfilename, mode);
+  g_free(wfilename);
+  return tif;
+#else
+  return TIFFOpen(filename, mode);
+#endif
+}
+
+// serialized output profile, *profile stays NULL if there is none. returns FALSE on allocation failure.
+static gboolean _get_profile(const int imgid, dt_colorspaces_color_profile_type_t over_type,
+                             const char *over_filename, uint8_t **profile, uint32_t *profile_len)
+{
+  *profile = NULL;
+  *profile_len = 0;
+  cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid, over_type, over_filename)->profile;
+  cmsSaveProfileToMem(out_profile, NULL, profile_len);
+  if(*profile_len > 0)
+  {
+    *profile = malloc(*profile_len);
+    if(!*profile) return FALSE;
+    cmsSaveProfileToMem(out_profile, *profile, profile_len);
+  }
+  return TRUE;
+}
+
+static void _set_compression(const dt_imageio_tiff_t *d, TIFF *tif)
+{
+  // http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
+  // "A proprietary ZIP/Flate compression code (0x80b2) has been used by some"
+  // "software vendors. This code should be considered obsolete. We recommend"
+  // "that TIFF implementations recognize and read the obsolete code but only"
+  // "write the official compression code (0x0008)."
+  // http://www.awaresystems.be/imaging/tiff/tifftags/compression.html
+  // http://www.awaresystems.be/imaging/tiff/tifftags/predictor.html
+  if(d->compress == 1)
+  {
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
+    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+  }
+  else if(d->compress == 2)
+  {
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+    if(d->bpp == 32 || (d->bpp == 16 && d->pixelformat))
+      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
+    else
+      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+  }
+}
+
+static void _set_image_fields(const dt_imageio_tiff_t *d, TIFF *tif, const uint16_t layers)
+{
+  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, layers);
+  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)d->bpp);
+  TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT,
+               d->bpp == 32 || (d->bpp == 16 && d->pixelformat) ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT);
+  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)d->global.width);
+  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)d->global.height);
+  if(layers == 3)
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+  else
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+
+  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+  TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
+
+  const int resolution = dt_conf_get_int("metadata/resolution");
+  TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
+  TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
+  TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
+}
+
+// write num_rows rows of the 4 channel pipe output starting at first_row, rowdata holds one row
+static int _write_rows(const dt_imageio_tiff_t *d, TIFF *tif, void *rowdata, const uint16_t layers,
+                       const void *in_void, const int first_row, const int num_rows)
+{
+  if(d->bpp == 32)
+  {
+    for(int y = 0; y < num_rows; y++)
+    {
+      const float *in = (const float *)in_void + (size_t)4 * y * d->global.width;
+      float *out = (float *)rowdata;
+
+      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      {
+        memcpy(out, in, sizeof(float) * layers);
+      }
+
+      if(TIFFWriteScanline(tif, rowdata, first_row + y, 0) == -1) return 1;
+    }
+  }
+#ifdef HAVE_IMATH
+  else if(d->bpp == 16 && d->pixelformat)
+  {
+    for(int y = 0; y < num_rows; y++)
+    {
+      const float *in = (const float *)in_void + (size_t)4 * y * d->global.width;
+      uint16_t *out = (uint16_t *)rowdata;
+
+      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      {
+        for(int l = 0; l < layers; ++l) out[l] = imath_float_to_half(in[l]);
+      }
+
+      if(TIFFWriteScanline(tif, rowdata, first_row + y, 0) == -1) return 1;
+    }
+  }
+#endif
+  else if(d->bpp == 16 && !d->pixelformat)
+  {
+    for(int y = 0; y < num_rows; y++)
+    {
+      const uint16_t *in = (const uint16_t *)in_void + (size_t)4 * y * d->global.width;
+      uint16_t *out = (uint16_t *)rowdata;
+
+      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      {
+        memcpy(out, in, sizeof(uint16_t) * layers);
+      }
+
+      if(TIFFWriteScanline(tif, rowdata, first_row + y, 0) == -1) return 1;
+    }
+  }
+  else // 8bpp
+  {
+    for(int y = 0; y < num_rows; y++)
+    {
+      const uint8_t *in = (const uint8_t *)in_void + (size_t)4 * y * d->global.width;
+      uint8_t *out = (uint8_t *)rowdata;
+
+      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      {
+        memcpy(out, in, sizeof(uint8_t) * layers);
+      }
+
+      if(TIFFWriteScanline(tif, rowdata, first_row + y, 0) == -1) return 1;
+    }
+  }
+  return 0;
+}
+
 int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
@@ -80,22 +227,12 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
 
   gboolean free_mask = FALSE;
   float *raster_mask = NULL;
-#ifdef _WIN32
-  wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
-#endif
   int rc = 1; // default to error
 
-  cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid, over_type, over_filename)->profile;
-  cmsSaveProfileToMem(out_profile, NULL, &profile_len);
-  if(profile_len > 0)
+  if(!_get_profile(imgid, over_type, over_filename, &profile, &profile_len))
   {
-    profile = malloc(profile_len);
-    if(!profile)
-    {
-      rc = 1;
-      goto exit;
-    }
-    cmsSaveProfileToMem(out_profile, profile, &profile_len);
+    rc = 1;
+    goto exit;
   }
 
   uint16_t n_pages = 1;
@@ -107,11 +244,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   }
 
   // Create little endian tiff image
-#ifdef _WIN32
-  tif = TIFFOpenW(wfilename, "wl");
-#else
-  tif = TIFFOpen(filename, "wl");
-#endif
+  tif = _tiff_open(filename, "wl");
 
   if(!tif)
   {
@@ -130,28 +263,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
 
   TIFFSetField(tif, TIFFTAG_DOCUMENTNAME, filename);
 
-  // http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
-  // "A proprietary ZIP/Flate compression code (0x80b2) has been used by some"
-  // "software vendors. This code should be considered obsolete. We recommend"
-  // "that TIFF implementations recognize and read the obsolete code but only"
-  // "write the official compression code (0x0008)."
-  // http://www.awaresystems.be/imaging/tiff/tifftags/compression.html
-  // http://www.awaresystems.be/imaging/tiff/tifftags/predictor.html
-  if(d->compress == 1)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-  }
-  else if(d->compress == 2)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-    if(d->bpp == 32 || (d->bpp == 16 && d->pixelformat))
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
-    else
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-  }
+  _set_compression(d, tif);
 
   if(profile != NULL)
   {
@@ -227,25 +339,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   if(layers == 1)
     dt_control_log(_("will export as a grayscale image"));
 
-  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, layers);
-  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)d->bpp);
-  TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT,
-               d->bpp == 32 || (d->bpp == 16 && d->pixelformat) ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT);
-  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)d->global.width);
-  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)d->global.height);
-  if(layers == 3)
-    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-  else
-    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-
-  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-  TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
-  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
-
-  const int resolution = dt_conf_get_int("metadata/resolution");
-  TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
-  TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
-  TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
+  _set_image_fields(d, tif, layers);
 
   const size_t rowsize = (d->global.width * layers) * d->bpp / 8;
   if((rowdata = malloc(rowsize)) == NULL)
@@ -254,83 +348,10 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     goto exit;
   }
 
-  if(d->bpp == 32)
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-      float *out = (float *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(float) * layers);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-#ifdef HAVE_IMATH
-  else if(d->bpp == 16 && d->pixelformat)
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-      uint16_t *out = (uint16_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        for(int l = 0; l < layers; ++l) out[l] = imath_float_to_half(in[l]);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-#endif
-  else if(d->bpp == 16 && !d->pixelformat)
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->global.width;
-      uint16_t *out = (uint16_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(uint16_t) * layers);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-  else // 8bpp
+  if(_write_rows(d, tif, rowdata, layers, in_void, 0, d->global.height))
   {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->global.width;
-      uint8_t *out = (uint8_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, sizeof(uint8_t) * layers);
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
+    rc = 1;
+    goto exit;
   }
 
   rc = 0;
@@ -352,11 +373,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
 
   if(rc == 0 && n_pages > 1)
   {
-#ifdef _WIN32
-    tif = TIFFOpenW(wfilename, "al");
-#else
-    tif = TIFFOpen(filename, "al");
-#endif
+    tif = _tiff_open(filename, "al");
 
     if(!tif)
     {
@@ -374,6 +391,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
                                          0.0, 0.0, 1.0, 1.0, 1.0, 1.0, 0.0, 0.0,
                                          0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
     static const size_t missing_raster_mask_w = 8, missing_raster_mask_h = 8;
+    const int resolution = dt_conf_get_int("metadata/resolution");
     uint16_t page = 1;
     for(GList *iter = pipe->nodes; iter; iter = g_list_next(iter))
     {
@@ -408,21 +426,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
         else
           TIFFSetField(tif, TIFFTAG_PAGENAME, piece->module->name());
 
-        if(d->compress == 1)
-        {
-          TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-          TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
-          TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-        }
-        else if(d->compress == 2)
-        {
-          TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-          if(d->bpp == 32 || (d->bpp == 16 && d->pixelformat))
-            TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
-          else
-            TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
-          TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-        }
+        _set_compression(d, tif);
 
         TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
         TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
@@ -576,15 +580,94 @@ exit:
   profile = NULL;
   free(rowdata);
   rowdata = NULL;
-#ifdef _WIN32
-  g_free(wfilename);
-#endif
   if(free_mask)
     dt_free_align(raster_mask);
 
   return rc;
 }
 
+typedef struct _tiff_stream_t
+{
+  TIFF *tif;
+  void *rowdata;
+  uint8_t *profile;
+  char *filename;
+  void *exif;
+  int exif_len;
+  gboolean failed;
+} _tiff_stream_t;
+
+void *write_image_begin(dt_imageio_module_data_t *d_tmp, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                        void *exif, int exif_len, int imgid)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  // the pixels aren't known yet when the header is written, so there is no grayscale
+  // detection for shortfile and the image is always stored as rgb.
+  const uint16_t layers = 3;
+
+  _tiff_stream_t *s = calloc(1, sizeof(_tiff_stream_t));
+  if(!s) return NULL;
+
+  uint32_t profile_len = 0;
+  if(!_get_profile(imgid, over_type, over_filename, &s->profile, &profile_len)) goto error;
+
+  s->rowdata = malloc((size_t)d->global.width * layers * d->bpp / 8);
+  if(!s->rowdata) goto error;
+
+  // Create little endian tiff image
+  s->tif = _tiff_open(filename, "wl");
+  if(!s->tif) goto error;
+
+  TIFFSetField(s->tif, TIFFTAG_SUBFILETYPE, 0);
+  TIFFSetField(s->tif, TIFFTAG_DOCUMENTNAME, filename);
+  _set_compression(d, s->tif);
+  if(s->profile != NULL) TIFFSetField(s->tif, TIFFTAG_ICCPROFILE, profile_len, s->profile);
+  _set_image_fields(d, s->tif, layers);
+
+  s->filename = g_strdup(filename);
+  s->exif = exif;
+  s->exif_len = exif_len;
+  return s;
+
+error:
+  free(s->rowdata);
+  free(s->profile);
+  free(s);
+  return NULL;
+}
+
+int write_image_rows(dt_imageio_module_data_t *d_tmp, void *handle, const void *in, const int first_row,
+                     const int num_rows)
+{
+  _tiff_stream_t *s = (_tiff_stream_t *)handle;
+  if(!s->failed && _write_rows((dt_imageio_tiff_t *)d_tmp, s->tif, s->rowdata, 3, in, first_row, num_rows))
+    s->failed = TRUE;
+  return s->failed ? 1 : 0;
+}
+
+int write_image_end(dt_imageio_module_data_t *d_tmp, void *handle)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  _tiff_stream_t *s = (_tiff_stream_t *)handle;
+
+  // close the file before adding exif data
+  TIFFClose(s->tif);
+  int rc = s->failed ? 1 : 0;
+  if(rc == 0 && s->exif)
+  {
+    rc = dt_exif_write_blob(s->exif, s->exif_len, s->filename, d->compress > 0);
+    // Until we get symbolic error status codes, if rc is 1, return 0
+    rc = (rc == 1) ? 0 : 1;
+  }
+
+  g_free(s->filename);
+  free(s->rowdata);
+  free(s->profile);
+  free(s);
+  return rc;
+}
+
 #if 0
 int dt_imageio_tiff_read_header(const char *filename, dt_imageio_tiff_t *tiff)
 {
@@ -49,6 +49,7 @@
 #include "imageio/imageio_pfm.h"
 #include "imageio/imageio_png.h"
 #include "imageio/imageio_pnm.h"
+#include "imageio/imageio_preview.h"
 #include "imageio/imageio_qoi.h"
 #include "imageio/imageio_rawspeed.h"
 #include "imageio/imageio_libraw.h"
@@ -128,9 +129,20 @@ dt_image_flags_t dt_imageio_get_type_from_extension(const char *extension)
   return 0;
 }
 
+// embedded previews smaller than this (on the long edge) are the thumbnails some raws keep next to a
+// larger preview
+#define DT_IMAGEIO_THUMBNAIL_SMALL 1024
+
 // load a full-res thumbnail:
 int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
                                dt_colorspaces_color_profile_type_t *color_space)
+{
+  return dt_imageio_large_thumbnail_scaled(filename, buffer, width, height, color_space, 0, 0);
+}
+
+int dt_imageio_large_thumbnail_scaled(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
+                                      dt_colorspaces_color_profile_type_t *color_space, const int min_width,
+                                      const int min_height)
 {
   int res = 1;
 
@@ -138,14 +150,47 @@ int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *
   char *mime_type = NULL;
   size_t bufsize;
 
-  // get the biggest thumb from exif
-  if(dt_exif_get_thumbnail(filename, &buf, &bufsize, &mime_type)) goto error;
+  // get the biggest thumb. tiff based raws are read directly, which avoids the global exiv2 lock
+  // when many thumbnails are created in parallel, exiv2 takes care of everything else.
+  int direct_width = 0, direct_height = 0;
+  if(!dt_imageio_preview_read_jpeg(filename, &buf, &bufsize, &direct_width, &direct_height))
+  {
+    mime_type = strdup("image/jpeg");
+    // the ifds may only hold a small thumbnail with the large preview in the maker notes (pef, orf),
+    // which only exiv2 knows about. without a requested size anything but such a thumbnail will do.
+    const gboolean too_small = (min_width > 0 || min_height > 0)
+                                   ? direct_width < min_width && direct_height < min_height
+                                   : MAX(direct_width, direct_height) < DT_IMAGEIO_THUMBNAIL_SMALL;
+    uint8_t *exif_buf = NULL;
+    size_t exif_bufsize = 0;
+    char *exif_mime_type = NULL;
+    int exif_width = 0, exif_height = 0;
+    if(too_small && !dt_exif_get_thumbnail(filename, &exif_buf, &exif_bufsize, &exif_mime_type)
+       && (strcmp(exif_mime_type, "image/jpeg")
+           || (dt_imageio_preview_jpeg_size(exif_buf, exif_bufsize, &exif_width, &exif_height)
+               && (uint64_t)exif_width * exif_height > (uint64_t)direct_width * direct_height)))
+    {
+      free(buf);
+      free(mime_type);
+      buf = exif_buf;
+      bufsize = exif_bufsize;
+      mime_type = exif_mime_type;
+    }
+    else
+    {
+      free(exif_buf);
+      free(exif_mime_type);
+    }
+  }
+  else if(dt_exif_get_thumbnail(filename, &buf, &bufsize, &mime_type))
+    goto error;
 
   if(strcmp(mime_type, "image/jpeg") == 0)
   {
     // Decompress the JPG into our own memory format
     dt_imageio_jpeg_t jpg;
     if(dt_imageio_jpeg_decompress_header(buf, bufsize, &jpg)) goto error;
+    if(min_width > 0 || min_height > 0) dt_imageio_jpeg_decompress_scale(&jpg, min_width, min_height);
     *buffer = (uint8_t *)dt_alloc_align(64, sizeof(uint8_t) * 4 * jpg.width * jpg.height);
     if(!*buffer) goto error;
 
@@ -726,6 +771,160 @@ int dt_imageio_export(const int32_t imgid,
   }
 }
 
+// downconversion of the pipe output to low-precision formats, in place:
+static void _export_convert(uint8_t *outbuf, const size_t npixels, const int bpp,
+                            const gboolean display_byteorder, const gboolean high_quality_processing)
+{
+  if(bpp == 8)
+  {
+    if(display_byteorder)
+    {
+      if(high_quality_processing)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < npixels; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
+          const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
+          const uint8_t b = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      // else processing output was 8-bit already, and no need to swap order
+    }
+    else // need to flip
+    {
+      // ldr output: char
+      if(high_quality_processing)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < npixels; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
+          const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
+          const uint8_t b = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      else
+      { // !display_byteorder, need to swap:
+        uint8_t *const buf8 = outbuf;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(npixels, buf8) \
+  schedule(static)
+#endif
+        // just flip byte order
+        for(size_t k = 0; k < npixels; k++)
+        {
+          uint8_t tmp = buf8[4 * k + 0];
+          buf8[4 * k + 0] = buf8[4 * k + 2];
+          buf8[4 * k + 2] = tmp;
+        }
+      }
+    }
+  }
+  else if(bpp == 16)
+  {
+    // uint16_t per color channel
+    float *buff = (float *)outbuf;
+    uint16_t *buf16 = (uint16_t *)outbuf;
+    for(size_t k = 0; k < npixels; k++)
+    {
+      // convert in place
+      for(int i = 0; i < 3; i++) buf16[4 * k + i] = roundf(CLAMP(buff[4 * k + i] * 0xffff, 0, 0xffff));
+    }
+  }
+  // else output float, no further harm done to the pixels :)
+}
+
+// reads the exif blob to embed, returns its length or 0 if there is nothing to write
+static int _export_exif(const int32_t imgid, dt_imageio_module_format_t *format, const gboolean ignore_exif,
+                        dt_export_metadata_t *metadata, const int sRGB, const int width, const int height,
+                        uint8_t **exif_profile)
+{
+  *exif_profile = NULL;
+
+  // Check if all the metadata export flags are set for AVIF/EXR/JPEG XL (opt-in)
+  // TODO: this is a workround as these formats do not support fine grained metadata control through
+  // dt_exif_xmp_attach_export() below due to lack of exiv2 write support
+  // Note: that this is done only when we do not ignore_exif, so we have a proper filename
+  //       otherwise the export is done in a memory buffer.
+  gboolean md_flags_set = TRUE;
+  if(!ignore_exif
+     && (!strcmp(format->mime(NULL), "image/avif")
+         || !strcmp(format->mime(NULL), "image/x-exr")
+         || !strcmp(format->mime(NULL), "image/jxl")))
+  {
+    const int32_t meta_all = DT_META_EXIF | DT_META_METADATA | DT_META_GEOTAG | DT_META_TAG
+                             | DT_META_HIERARCHICAL_TAG | DT_META_DT_HISTORY | DT_META_PRIVATE_TAG
+                             | DT_META_SYNONYMS_TAG | DT_META_OMIT_HIERARCHY;
+    md_flags_set = metadata ? (metadata->flags & meta_all) == meta_all : FALSE;
+  }
+
+  if(ignore_exif || !md_flags_set) return 0;
+
+  // Exif data should be 65536 bytes max, but if original size is close to that,
+  // adding new tags could make it go over that... so let it be and see what
+  // happens when we write the image
+  char pathname[PATH_MAX] = { 0 };
+  gboolean from_cache = TRUE;
+  dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
+  // last param is dng mode, it's false here
+  return dt_exif_read_blob(exif_profile, pathname, imgid, sRGB, width, height, 0);
+}
+
+typedef struct _export_stream_t
+{
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *format_params;
+  void *handle;
+  int bpp;
+  gboolean display_byteorder;
+  gboolean high_quality_processing;
+} _export_stream_t;
+
+// converts the finished rows of a strip and hands them to the format
+static int _export_stream_rows(dt_dev_pixelpipe_t *pipe, uint8_t *rows, const int first_row, const int num_rows,
+                               const int width, const size_t bpp, void *data)
+{
+  _export_stream_t *s = (_export_stream_t *)data;
+  _export_convert(rows, (size_t)width * num_rows, s->bpp, s->display_byteorder, s->high_quality_processing);
+  return s->format->write_image_rows(s->format_params, s->handle, rows, first_row, num_rows);
+}
+
+// the develop and pixelpipe kept by dt_imageio_export_keep_pipe() for the exports of one thread
+typedef struct _export_pipe_t
+{
+  dt_develop_t dev;
+  dt_dev_pixelpipe_t pipe;
+  gboolean loaded; // dev and pipe are initialised
+} _export_pipe_t;
+
+static __thread _export_pipe_t *_export_kept = NULL;
+
+void dt_imageio_export_keep_pipe(const gboolean keep)
+{
+  if(keep && !_export_kept)
+    _export_kept = (_export_pipe_t *)calloc(1, sizeof(_export_pipe_t));
+  else if(!keep && _export_kept)
+  {
+    if(_export_kept->loaded)
+    {
+      dt_dev_pixelpipe_cleanup(&_export_kept->pipe);
+      dt_dev_cleanup(&_export_kept->dev);
+    }
+    free(_export_kept);
+    _export_kept = NULL;
+  }
+}
+
 // internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
 int dt_imageio_export_with_flags(const int32_t imgid,
                                  const char *filename,
@@ -750,11 +949,22 @@ int dt_imageio_export_with_flags(const int32_t imgid,
                                  dt_export_metadata_t *metadata,
                                  const int history_end)
 {
-  dt_develop_t dev;
-  dt_dev_init(&dev, FALSE);
-  dt_dev_load_image(&dev, imgid);
+  // a kept develop and pipe already have the modules and nodes of the previous image
+  _export_pipe_t *const kept = thumbnail_export ? NULL : _export_kept;
+  gboolean pipe_ready = kept && kept->loaded;
+  dt_develop_t dev_storage;
+  dt_dev_pixelpipe_t pipe_storage;
+  dt_develop_t *dev = kept ? &kept->dev : &dev_storage;
+  dt_dev_pixelpipe_t *pipe = kept ? &kept->pipe : &pipe_storage;
+  if(pipe_ready)
+    dt_dev_change_image(dev, pipe, imgid);
+  else
+  {
+    dt_dev_init(dev, FALSE);
+    dt_dev_load_image(dev, imgid);
+  }
   if(history_end != -1)
-    dt_dev_pop_history_items_ext(&dev, history_end);
+    dt_dev_pop_history_items_ext(dev, history_end);
 
   const gboolean buf_is_downscaled = (thumbnail_export && dt_conf_get_bool("ui/performance"));
   dt_mipmap_buffer_t buf;
@@ -763,13 +973,13 @@ int dt_imageio_export_with_flags(const int32_t imgid,
   else
     dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
 
-  const dt_image_t *img = &dev.image_storage;
+  const dt_image_t *img = &dev->image_storage;
 
   if(!buf.buf || !buf.width || !buf.height)
   {
     fprintf(stderr, "[dt_imageio_export_with_flags] mipmap allocation for `%s' failed\n", filename);
     dt_control_log(_("image `%s' is not available!"), img->filename);
-    goto error_early;
+    goto error;
   }
 
   const int wd = img->width;
@@ -777,10 +987,23 @@ int dt_imageio_export_with_flags(const int32_t imgid,
 
   dt_times_t start;
   dt_get_times(&start);
-  dt_dev_pixelpipe_t pipe;
-  gboolean res = thumbnail_export
-    ? dt_dev_pixelpipe_init_thumbnail(&pipe, wd, ht)
-    : dt_dev_pixelpipe_init_export(&pipe, wd, ht, format->levels(format_params), export_masks);
+  gboolean res = TRUE;
+  if(pipe_ready)
+  {
+    // forget what the pipe cached and masked for the previous image
+    dt_dev_pixelpipe_cache_flush(&pipe->cache);
+    dt_dev_clear_rawdetail_mask(pipe);
+    pipe->want_detail_mask = DT_DEV_DETAIL_MASK_NONE;
+    pipe->levels = format->levels(format_params);
+    pipe->store_all_raster_masks = export_masks;
+  }
+  else
+  {
+    pipe_ready = TRUE;
+    res = thumbnail_export
+      ? dt_dev_pixelpipe_init_thumbnail(pipe, wd, ht)
+      : dt_dev_pixelpipe_init_export(pipe, wd, ht, format->levels(format_params), export_masks);
+  }
   if(!res)
   {
     dt_control_log(
@@ -789,7 +1012,7 @@ int dt_imageio_export_with_flags(const int32_t imgid,
     goto error;
   }
 
-  const int final_history_end = history_end == -1 ? dev.history_end : history_end;
+  const int final_history_end = history_end == -1 ? dev->history_end : history_end;
   const gboolean use_style = !thumbnail_export && format_params->style[0] != '\0';
   const gboolean appending = format_params->style_append != FALSE;
   //  If a style is to be applied during export, add the iop params into the history
@@ -804,28 +1027,31 @@ int dt_imageio_export_with_flags(const int32_t imgid,
 
     GList *modules_used = NULL;
 
-    if(!appending) dt_dev_pop_history_items_ext(&dev, 0);
+    if(!appending) dt_dev_pop_history_items_ext(dev, 0);
 
-    dt_ioppr_update_for_style_items(&dev, style_items, appending);
+    dt_ioppr_update_for_style_items(dev, style_items, appending);
 
     for(GList *st_items = style_items; st_items; st_items = g_list_next(st_items))
     {
       dt_style_item_t *st_item = (dt_style_item_t *)st_items->data;
-      dt_styles_apply_style_item(&dev, st_item, &modules_used, appending);
+      dt_styles_apply_style_item(dev, st_item, &modules_used, appending);
     }
 
     g_list_free(modules_used);
     g_list_free_full(style_items, dt_style_item_free);
   }
   else if(history_end != -1)
-    dt_dev_pop_history_items_ext(&dev, final_history_end);
+    dt_dev_pop_history_items_ext(dev, final_history_end);
 
-  dt_ioppr_resync_modules_order(&dev);
+  dt_ioppr_resync_modules_order(dev);
 
-  dt_dev_pixelpipe_set_icc(&pipe, icc_type, icc_filename, icc_intent);
-  dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
-  dt_dev_pixelpipe_create_nodes(&pipe, &dev);
-  dt_dev_pixelpipe_synch_all(&pipe, &dev);
+  dt_dev_pixelpipe_set_icc(pipe, icc_type, icc_filename, icc_intent);
+  dt_dev_pixelpipe_set_input(pipe, dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+  if(kept)
+    dt_dev_pixelpipe_update_nodes(pipe, dev);
+  else
+    dt_dev_pixelpipe_create_nodes(pipe, dev);
+  dt_dev_pixelpipe_synch_all(pipe, dev);
   if(darktable.unmuted & DT_DEBUG_IMAGEIO)
   {
     fprintf(stderr,"[dt_imageio_export_with_flags] ");
@@ -836,7 +1062,7 @@ int dt_imageio_export_with_flags(const int32_t imgid,
     }
     else fprintf(stderr,"\n");
     int cnt = 0;
-    for(GList *nodes = pipe.nodes; nodes; nodes = g_list_next(nodes))
+    for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
     {
       dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
       if(piece->enabled)
@@ -850,12 +1076,12 @@ int dt_imageio_export_with_flags(const int32_t imgid,
 
   if(filter)
   {
-    if(!strncmp(filter, "pre:", 4)) dt_dev_pixelpipe_disable_after(&pipe, filter + 4);
-    if(!strncmp(filter, "post:", 5)) dt_dev_pixelpipe_disable_before(&pipe, filter + 5);
+    if(!strncmp(filter, "pre:", 4)) dt_dev_pixelpipe_disable_after(pipe, filter + 4);
+    if(!strncmp(filter, "post:", 5)) dt_dev_pixelpipe_disable_before(pipe, filter + 5);
   }
 
-  dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
-                                  &pipe.processed_height);
+  dt_dev_pixelpipe_get_dimensions(pipe, dev, pipe->iwidth, pipe->iheight, &pipe->processed_width,
+                                  &pipe->processed_height);
 
   dt_show_times(&start, "[export] creating pixelpipe");
 
@@ -868,7 +1094,7 @@ int dt_imageio_export_with_flags(const int32_t imgid,
   else if(icc_type == DT_COLORSPACE_NONE)
   {
     dt_iop_module_t *colorout = NULL;
-    for(GList *modules = dev.iop; modules; modules = g_list_next(modules))
+    for(GList *modules = dev->iop; modules; modules = g_list_next(modules))
     {
       colorout = (dt_iop_module_t *)modules->data;
       if(colorout->get_p && strcmp(colorout->op, "colorout") == 0)
@@ -892,25 +1118,25 @@ int dt_imageio_export_with_flags(const int32_t imgid,
 
   if(!thumbnail_export && width == 0 && height == 0)
   {
-    width = pipe.processed_width;
-    height = pipe.processed_height;
+    width = pipe->processed_width;
+    height = pipe->processed_height;
   }
 
   const double max_possible_scale = 100.0; // FIXME can we calculate a reasonable maximum scale for available memory?
   const double max_scale = (upscale && ((width > 0 || height > 0) || is_scaling)) ? max_possible_scale : 1.00;
 
-  const double scalex = width > 0 ? fmin((double)width / (double)pipe.processed_width, max_scale) : max_scale;
-  const double scaley = height > 0 ? fmin((double)height / (double)pipe.processed_height, max_scale) : max_scale;
+  const double scalex = width > 0 ? fmin((double)width / (double)pipe->processed_width, max_scale) : max_scale;
+  const double scaley = height > 0 ? fmin((double)height / (double)pipe->processed_height, max_scale) : max_scale;
   double scale = fmin(scalex, scaley);
 
   float origin[] = { 0.0f, 0.0f };
 
-  if(dt_dev_distort_backtransform_plus(&dev, &pipe, 0.f, DT_DEV_TRANSFORM_DIR_ALL, origin, 1))
+  if(dt_dev_distort_backtransform_plus(dev, pipe, 0.f, DT_DEV_TRANSFORM_DIR_ALL, origin, 1))
   {
-    if(width == 0) width = pipe.processed_width;
-    if(height == 0) height = pipe.processed_height;
-    scale = fmin(width >  0 ? fmin((double)width / (double)pipe.processed_width, max_scale) : max_scale,
-                 height > 0 ? fmin((double)height / (double)pipe.processed_height, max_scale) : max_scale);
+    if(width == 0) width = pipe->processed_width;
+    if(height == 0) height = pipe->processed_height;
+    scale = fmin(width >  0 ? fmin((double)width / (double)pipe->processed_width, max_scale) : max_scale,
+                 height > 0 ? fmin((double)height / (double)pipe->processed_height, max_scale) : max_scale);
 
     if(is_scaling)
     {
@@ -925,16 +1151,43 @@ int dt_imageio_export_with_flags(const int32_t imgid,
     }
   }
 
-  const int processed_width = floor(scale * pipe.processed_width);
-  const int processed_height = floor(scale * pipe.processed_height);
+  const int processed_width = floor(scale * pipe->processed_width);
+  const int processed_height = floor(scale * pipe->processed_height);
 
   dt_print(DT_DEBUG_IMAGEIO,"[dt_imageio_export] [%s] imgid %d, %ix%i --> %ix%i (scale %7f). upscale=%s, hq=%s\n",
            thumbnail_export ? "thumbnail" : "export", imgid,
-           pipe.processed_width, pipe.processed_height, processed_width, processed_height, scale,
+           pipe->processed_width, pipe->processed_height, processed_width, processed_height, scale,
            upscale ? "yes" : "no", high_quality_processing ? "yes" : "no");
 
   const int bpp = format->bpp(format_params);
 
+  // opt-in: process very large exports in strips to bound the memory of the pipe.
+  // masks are stored per piece for the whole image, so they need the one-go processing.
+  const float tile_mpix = (thumbnail_export || export_masks)
+                              ? 0.0f
+                              : dt_conf_get_int("plugins/lighttable/export/pipe_tile_mpix");
+
+  // formats able to write row by row get the strips as they leave the pipe, so the full
+  // image never has to be held in memory. the pixels are converted per strip.
+  const gboolean streaming = tile_mpix > 0.0f && format->write_image_begin && format->write_image_rows
+                             && format->write_image_end;
+  _export_stream_t stream = { format, format_params, NULL, bpp, display_byteorder, high_quality_processing };
+  uint8_t *exif_profile = NULL;
+  if(streaming)
+  {
+    format_params->width = processed_width;
+    format_params->height = processed_height;
+    const int length = _export_exif(imgid, format, ignore_exif, metadata, sRGB, processed_width, processed_height,
+                                    &exif_profile);
+    stream.handle = format->write_image_begin(format_params, filename, icc_type, icc_filename, exif_profile,
+                                              length, imgid);
+    if(!stream.handle)
+    {
+      free(exif_profile);
+      goto error;
+    }
+  }
+
   dt_get_times(&start);
   if(high_quality_processing)
   {
@@ -942,7 +1195,11 @@ int dt_imageio_export_with_flags(const int32_t imgid,
      * if high quality processing was requested, downsampling will be done
      * at the very end of the pipe (just before border and watermark)
      */
-    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+    if(streaming)
+      res = dt_dev_pixelpipe_process_strips(pipe, dev, 0, 0, processed_width, processed_height, scale, TRUE,
+                                            tile_mpix, _export_stream_rows, &stream);
+    else
+      dt_dev_pixelpipe_process_tiled(pipe, dev, 0, 0, processed_width, processed_height, scale, TRUE, tile_mpix);
   }
   else
   {
@@ -953,7 +1210,7 @@ int dt_imageio_export_with_flags(const int32_t imgid,
     // find the finalscale module
     dt_dev_pixelpipe_iop_t *finalscale = NULL;
     {
-      for(const GList *nodes = g_list_last(pipe.nodes); nodes; nodes = g_list_previous(nodes))
+      for(const GList *nodes = g_list_last(pipe->nodes); nodes; nodes = g_list_previous(nodes))
       {
         dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)(nodes->data);
         if(!strcmp(node->module->op, "finalscale"))
@@ -967,141 +1224,62 @@ int dt_imageio_export_with_flags(const int32_t imgid,
     if(finalscale) finalscale->enabled = 0;
 
     // do the processing (8-bit with special treatment, to make sure we can use openmp further down):
-    if(bpp == 8)
-      dt_dev_pixelpipe_process(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+    if(streaming)
+      res = dt_dev_pixelpipe_process_strips(pipe, dev, 0, 0, processed_width, processed_height, scale,
+                                            bpp != 8, tile_mpix, _export_stream_rows, &stream);
     else
-      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+      dt_dev_pixelpipe_process_tiled(pipe, dev, 0, 0, processed_width, processed_height, scale, bpp != 8,
+                                     tile_mpix);
 
     if(finalscale) finalscale->enabled = 1;
   }
   dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing"
                                          : "[dev_process_export] pixel pipeline processing");
 
-  uint8_t *outbuf = pipe.backbuf;
-  if(outbuf == NULL)
-  {
-    dt_print(DT_DEBUG_IMAGEIO, "[dt_imageio_export_with_flags] no valid output buffer\n");
-    goto error;
-  }
-
-  // downconversion to low-precision formats:
-  if(bpp == 8)
+  if(streaming)
   {
-    if(display_byteorder)
-    {
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
-          const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
-          const uint8_t b = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      // else processing output was 8-bit already, and no need to swap order
-    }
-    else // need to flip
+    // always close the file, also if a strip failed
+    if(format->write_image_end(format_params, stream.handle)) res = 1;
+    free(exif_profile);
+    // the end of a stream leaves a valid looking file even if rows are missing, don't keep it
+    if(res)
     {
-      // ldr output: char
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
-          const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
-          const uint8_t b = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      else
-      { // !display_byteorder, need to swap:
-        uint8_t *const buf8 = pipe.backbuf;
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(processed_width, processed_height, buf8) \
-  schedule(static)
-#endif
-        // just flip byte order
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          uint8_t tmp = buf8[4 * k + 0];
-          buf8[4 * k + 0] = buf8[4 * k + 2];
-          buf8[4 * k + 2] = tmp;
-        }
-      }
+      dt_print(DT_DEBUG_IMAGEIO, "[dt_imageio_export_with_flags] removing incomplete `%s'\n", filename);
+      g_unlink(filename);
     }
   }
-  else if(bpp == 16)
+  else
   {
-    // uint16_t per color channel
-    float *buff = (float *)outbuf;
-    uint16_t *buf16 = (uint16_t *)outbuf;
-    for(int y = 0; y < processed_height; y++)
-      for(int x = 0; x < processed_width; x++)
-      {
-        // convert in place
-        const size_t k = (size_t)processed_width * y + x;
-        for(int i = 0; i < 3; i++) buf16[4 * k + i] = roundf(CLAMP(buff[4 * k + i] * 0xffff, 0, 0xffff));
-      }
-  }
-  // else output float, no further harm done to the pixels :)
+    uint8_t *outbuf = pipe->backbuf;
+    if(outbuf == NULL)
+    {
+      dt_print(DT_DEBUG_IMAGEIO, "[dt_imageio_export_with_flags] no valid output buffer\n");
+      goto error;
+    }
 
-  format_params->width = processed_width;
-  format_params->height = processed_height;
+    _export_convert(outbuf, (size_t)processed_width * processed_height, bpp, display_byteorder,
+                    high_quality_processing);
 
-  // Check if all the metadata export flags are set for AVIF/EXR/JPEG XL (opt-in)
-  // TODO: this is a workround as these formats do not support fine grained metadata control through
-  // dt_exif_xmp_attach_export() below due to lack of exiv2 write support
-  // Note: that this is done only when we do not ignore_exif, so we have a proper filename
-  //       otherwise the export is done in a memory buffer.
-  gboolean md_flags_set = TRUE;
-  if(!ignore_exif
-     && (!strcmp(format->mime(NULL), "image/avif")
-         || !strcmp(format->mime(NULL), "image/x-exr")
-         || !strcmp(format->mime(NULL), "image/jxl")))
-  {
-    const int32_t meta_all = DT_META_EXIF | DT_META_METADATA | DT_META_GEOTAG | DT_META_TAG
-                             | DT_META_HIERARCHICAL_TAG | DT_META_DT_HISTORY | DT_META_PRIVATE_TAG
-                             | DT_META_SYNONYMS_TAG | DT_META_OMIT_HIERARCHY;
-    md_flags_set = metadata ? (metadata->flags & meta_all) == meta_all : FALSE;
-  }
-
-  if(!ignore_exif && md_flags_set)
-  {
-    uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes max, but if original size is close to that,
-                                  // adding new tags could make it go over that... so let it be and see what
-                                  // happens when we write the image
-    char pathname[PATH_MAX] = { 0 };
-    gboolean from_cache = TRUE;
-    dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
-    // last param is dng mode, it's false here
-    const int length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
-
-    res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif_profile, length, imgid,
-                              num, total, &pipe, export_masks);
+    format_params->width = processed_width;
+    format_params->height = processed_height;
 
+    const int length = _export_exif(imgid, format, ignore_exif, metadata, sRGB, processed_width,
+                                    processed_height, &exif_profile);
+    res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif_profile, length,
+                              imgid, num, total, pipe, export_masks);
     free(exif_profile);
   }
-  else
-  {
-    res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, NULL, 0, imgid, num, total,
-                              &pipe, export_masks);
-  }
 
   if(res)
     goto error;
 
-  dt_dev_pixelpipe_cleanup(&pipe);
-  dt_dev_cleanup(&dev);
+  if(kept)
+    kept->loaded = TRUE;
+  else
+  {
+    dt_dev_pixelpipe_cleanup(pipe);
+    dt_dev_cleanup(dev);
+  }
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
   /* now write xmp into that container, if possible */
@@ -1143,9 +1321,10 @@ int dt_imageio_export_with_flags(const int32_t imgid,
   return 0; // success
 
 error:
-  dt_dev_pixelpipe_cleanup(&pipe);
-error_early:
-  dt_dev_cleanup(&dev);
+  // a kept pipe starts over with the next image
+  if(pipe_ready) dt_dev_pixelpipe_cleanup(pipe);
+  dt_dev_cleanup(dev);
+  if(kept) kept->loaded = FALSE;
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
   return 1;
 }
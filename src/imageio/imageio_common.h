@@ -90,6 +90,9 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
                                  const gchar *icc_filename, dt_iop_color_intent_t icc_intent,
                                  dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *storage_params,
                                  int num, int total, dt_export_metadata_t *metadata, const int history_end);
+/** exports of the calling thread keep their develop and pixelpipe from one image to the next until called with
+    FALSE. only the history of each image is read, the nodes are rebuilt when its module instances differ. */
+void dt_imageio_export_keep_pipe(const gboolean keep);
 
 size_t dt_imageio_write_pos(int i, int j, int wd, int ht, float fwd, float fht,
                             dt_image_orientation_t orientation);
@@ -108,6 +111,11 @@ void dt_imageio_flip_buffers_ui8_to_float(float *out, const uint8_t *in, const f
 // allocate buffer and return 0 on success along with largest jpg thumbnail from raw.
 int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
                                dt_colorspaces_color_profile_type_t *color_space);
+// same, but a jpeg thumbnail is only decoded at the smallest of 1, 1/2, 1/4 or 1/8 of its size that still
+// covers min_width or min_height.
+int dt_imageio_large_thumbnail_scaled(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
+                                      dt_colorspaces_color_profile_type_t *color_space, const int min_width,
+                                      const int min_height);
 
 // lookup maker and model, dispatch lookup to rawspeed or libraw
 gboolean dt_imageio_lookup_makermodel(const char *maker, const char *model,
@@ -0,0 +1,241 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2026 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imageio/imageio_preview.h"
+#include "common/darktable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// no raw has more than a handful, this only guards against loops in broken files
+#define DT_PREVIEW_MAX_IFDS 32
+
+typedef struct dt_preview_tiff_t
+{
+  const uint8_t *data;
+  size_t size;
+  gboolean big_endian;
+
+  // the largest jpeg found so far
+  size_t best_offset, best_length;
+  uint64_t best_pixels;
+  int best_width, best_height;
+} dt_preview_tiff_t;
+
+static inline uint16_t _get16(const dt_preview_tiff_t *t, const size_t pos)
+{
+  const uint8_t *p = t->data + pos;
+  return t->big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static inline uint32_t _get32(const dt_preview_tiff_t *t, const size_t pos)
+{
+  const uint8_t *p = t->data + pos;
+  return t->big_endian ? ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+                       : ((uint32_t)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+// the n-th SHORT or LONG value of the ifd entry at pos, 0 if it's not there
+static uint32_t _entry_value(const dt_preview_tiff_t *t, const size_t pos, const uint32_t n)
+{
+  const uint16_t type = _get16(t, pos + 2);
+  const uint32_t count = _get32(t, pos + 4);
+  // SHORT, LONG and IFD
+  const size_t type_size = (type == 3) ? 2 : (type == 4 || type == 13) ? 4 : 0;
+  if(!type_size || n >= count) return 0;
+
+  // values that fit are stored in the entry itself
+  const size_t base = (type_size * count <= 4) ? pos + 8 : _get32(t, pos + 8);
+  const size_t at = base + type_size * n;
+  if(at + type_size > t->size) return 0;
+  return (type_size == 2) ? _get16(t, at) : _get32(t, at);
+}
+
+// walk the markers up to the frame header. only baseline, extended and progressive huffman jpegs with 8 bit
+// samples can be decoded for thumbnails, which rules out the lossless jpeg of the raw data itself.
+gboolean dt_imageio_preview_jpeg_size(const uint8_t *data, const size_t length, int *width, int *height)
+{
+  if(length < 4 || data[0] != 0xff || data[1] != 0xd8) return FALSE;
+  size_t pos = 2;
+  while(pos + 4 <= length)
+  {
+    if(data[pos] != 0xff) return FALSE;
+    const uint8_t marker = data[pos + 1];
+    // fill bytes
+    if(marker == 0xff)
+    {
+      pos++;
+      continue;
+    }
+    // markers without a segment
+    if(marker == 0x01 || (marker >= 0xd0 && marker <= 0xd8))
+    {
+      pos += 2;
+      continue;
+    }
+    // no frame header before the image data
+    if(marker == 0xd9 || marker == 0xda) return FALSE;
+
+    const size_t seglen = (data[pos + 2] << 8) | data[pos + 3];
+    if(seglen < 2) return FALSE;
+    if(marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+    {
+      if(marker > 0xc2 || pos + 9 > length || data[pos + 4] != 8) return FALSE;
+      *height = (data[pos + 5] << 8) | data[pos + 6];
+      *width = (data[pos + 7] << 8) | data[pos + 8];
+      return *width > 0 && *height > 0;
+    }
+    pos += 2 + seglen;
+  }
+  return FALSE;
+}
+
+static void _add_candidate(dt_preview_tiff_t *t, const size_t offset, const size_t length)
+{
+  if(offset == 0 || length == 0 || offset >= t->size || length > t->size - offset) return;
+
+  int width = 0, height = 0;
+  if(!dt_imageio_preview_jpeg_size(t->data + offset, length, &width, &height)) return;
+
+  const uint64_t pixels = (uint64_t)width * height;
+  if(pixels > t->best_pixels)
+  {
+    t->best_offset = offset;
+    t->best_length = length;
+    t->best_pixels = pixels;
+    t->best_width = width;
+    t->best_height = height;
+  }
+}
+
+static void _scan_ifds(dt_preview_tiff_t *t, const size_t first_ifd)
+{
+  size_t queue[DT_PREVIEW_MAX_IFDS];
+  int queued = 0, done = 0, visited = 0;
+  queue[queued++] = first_ifd;
+
+  while(done < queued)
+  {
+    size_t ifd = queue[done++];
+    // follow the chain of ifds, sub ifds are queued as they come
+    while(ifd && ifd + 2 <= t->size)
+    {
+      const uint16_t entries = _get16(t, ifd);
+      if(ifd + 2 + (size_t)12 * entries + 4 > t->size) break;
+
+      uint32_t subfile_type = 0, compression = 0;
+      uint32_t jpeg_offset = 0, jpeg_length = 0;
+      uint32_t strip_offset = 0, strip_length = 0, strips = 0;
+      for(int e = 0; e < entries; e++)
+      {
+        const size_t pos = ifd + 2 + (size_t)12 * e;
+        const uint16_t tag = _get16(t, pos);
+        switch(tag)
+        {
+          case 0x00fe: // NewSubFileType
+            subfile_type = _entry_value(t, pos, 0);
+            break;
+          case 0x0103: // Compression
+            compression = _entry_value(t, pos, 0);
+            break;
+          case 0x0111: // StripOffsets
+            strips = _get32(t, pos + 4);
+            strip_offset = _entry_value(t, pos, 0);
+            break;
+          case 0x0117: // StripByteCounts
+            strip_length = _entry_value(t, pos, 0);
+            break;
+          case 0x0201: // JPEGInterchangeFormat
+            jpeg_offset = _entry_value(t, pos, 0);
+            break;
+          case 0x0202: // JPEGInterchangeFormatLength
+            jpeg_length = _entry_value(t, pos, 0);
+            break;
+          case 0x002e: // JpgFromRaw of panasonic, an UNDEFINED blob
+            _add_candidate(t, _get32(t, pos + 8), _get32(t, pos + 4));
+            break;
+          case 0x014a: // SubIFDs
+          {
+            const uint32_t count = _get32(t, pos + 4);
+            for(uint32_t k = 0; k < count && queued < DT_PREVIEW_MAX_IFDS; k++)
+            {
+              const uint32_t sub = _entry_value(t, pos, k);
+              if(sub) queue[queued++] = sub;
+            }
+            break;
+          }
+          default:
+            break;
+        }
+      }
+
+      _add_candidate(t, jpeg_offset, jpeg_length);
+      // a single strip of old style jpeg, or of new style jpeg in a reduced resolution image, as dng does it.
+      // the frame header check weeds out the lossless jpeg of raw data.
+      if(strips == 1 && (compression == 6 || (compression == 7 && (subfile_type & 1))))
+        _add_candidate(t, strip_offset, strip_length);
+
+      const size_t next = _get32(t, ifd + 2 + (size_t)12 * entries);
+      // only ever move forward to stay out of loops
+      ifd = (next > ifd && ++visited < DT_PREVIEW_MAX_IFDS) ? next : 0;
+    }
+  }
+}
+
+int dt_imageio_preview_read_jpeg(const char *filename, uint8_t **buffer, size_t *size, int *width, int *height)
+{
+  GMappedFile *map = g_mapped_file_new(filename, FALSE, NULL);
+  if(!map) return 1;
+
+  dt_preview_tiff_t t = { 0 };
+  t.data = (const uint8_t *)g_mapped_file_get_contents(map);
+  t.size = g_mapped_file_get_length(map);
+
+  int res = 1;
+  if(t.size < 8 || !((t.data[0] == 'I' && t.data[1] == 'I') || (t.data[0] == 'M' && t.data[1] == 'M')))
+    goto end;
+  t.big_endian = t.data[0] == 'M';
+
+  // plain tiff, panasonic rw2 and olympus orf
+  const uint16_t magic = _get16(&t, 2);
+  if(magic != 42 && magic != 0x55 && magic != 0x4f52 && magic != 0x5352) goto end;
+
+  _scan_ifds(&t, _get32(&t, 4));
+  if(!t.best_pixels) goto end;
+
+  *buffer = (uint8_t *)malloc(t.best_length);
+  if(!*buffer) goto end;
+  memcpy(*buffer, t.data + t.best_offset, t.best_length);
+  *size = t.best_length;
+  *width = t.best_width;
+  *height = t.best_height;
+  res = 0;
+
+  dt_print(DT_DEBUG_IMAGEIO, "[dt_imageio_preview_read_jpeg] found %" G_GUINT64_FORMAT " pixel preview in `%s'\n",
+           (guint64)t.best_pixels, filename);
+
+end:
+  g_mapped_file_unref(map);
+  return res;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,39 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2026 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+/** finds the largest embedded jpeg preview of a tiff based raw (cr2, nef, arw, dng, orf, rw2, pef, ...) by
+ * walking its ifds directly, without exiv2 and its global lock. returns 0 on success with a malloc'ed copy of
+ * the jpeg stream in *buffer and its dimensions, non-zero if the file isn't tiff based or has no usable preview,
+ * in which case the caller should fall back to dt_exif_get_thumbnail(). previews kept in maker notes are not
+ * found, so the caller should also fall back if the result is too small for it. */
+int dt_imageio_preview_read_jpeg(const char *filename, uint8_t **buffer, size_t *size, int *width, int *height);
+
+/** dimensions of a jpeg stream that can be decoded for a thumbnail (8 bit huffman), FALSE for anything else. */
+gboolean dt_imageio_preview_jpeg_size(const uint8_t *data, const size_t length, int *width, int *height);
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -36,10 +36,13 @@
 #ifdef GDK_WINDOWING_QUARTZ
 #include "osx/osx.h"
 #endif
+#include <errno.h>
+#include <fcntl.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 DT_MODULE(3)
 
@@ -218,14 +221,14 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   g_strlcpy(pattern, d->filename, sizeof(pattern));
   gboolean from_cache = FALSE;
   dt_image_full_path(imgid, input_dir, sizeof(input_dir), &from_cache);
-  // set variable values to expand them afterwards in darktable variables
-  dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
-  dt_variables_set_upscale(d->vp, upscale);
 
   gboolean fail = FALSE;
   // we're potentially called in parallel. have sequence number synchronized:
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   {
+    // set variable values to expand them afterwards in darktable variables
+    dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
+    dt_variables_set_upscale(d->vp, upscale);
 try_again:
     // avoid braindead export which is bound to overwrite at random:
     if(total > 1 && !g_strrstr(pattern, "$"))
@@ -283,19 +286,39 @@ try_again:
   failed:
     g_free(output_dir);
 
+    // parallel export pipes only write the file after we leave the critical block, so the name is
+    // claimed by creating the file here. the format module truncates it when writing.
     if(!fail && d->onsave_action == DT_EXPORT_ONCONFLICT_UNIQUEFILENAME)
     {
       int seq = 1;
-      while(g_file_test(filename, G_FILE_TEST_EXISTS))
+      int fd;
+      while((fd = g_open(filename, O_CREAT | O_EXCL | O_WRONLY, 0644)) < 0 && errno == EEXIST)
       {
         snprintf(c, filename_free_space, "_%.2d.%s", seq, ext);
         seq++;
       }
+      if(fd < 0)
+      {
+        fprintf(stderr, "[imageio_storage_disk] could not create file: `%s'!\n", filename);
+        dt_control_log(_("could not export to file `%s'!"), filename);
+        fail = TRUE;
+      }
+      else
+        close(fd);
     }
 
     if(!fail && d->onsave_action == DT_EXPORT_ONCONFLICT_SKIP)
     {
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
+      const int fd = g_open(filename, O_CREAT | O_EXCL | O_WRONLY, 0644);
+      if(fd >= 0)
+        close(fd);
+      else if(errno != EEXIST)
+      {
+        fprintf(stderr, "[imageio_storage_disk] could not create file: `%s'!\n", filename);
+        dt_control_log(_("could not export to file `%s'!"), filename);
+        fail = TRUE;
+      }
+      else
       {
         dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
         fprintf(stderr, "[export_job] skipping `%s'\n", filename);
@@ -314,6 +337,8 @@ try_again:
   {
     fprintf(stderr, "[imageio_storage_disk] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
+    // don't leave the claimed name behind as an empty file
+    if(d->onsave_action != DT_EXPORT_ONCONFLICT_OVERWRITE) g_unlink(filename);
     return 1;
   }
 
@@ -323,6 +348,12 @@ try_again:
   return 0;
 }
 
+gboolean parallel_store(dt_imageio_module_storage_t *self)
+{
+  // file names are claimed on disk under a lock in store(), the rest is independent per image
+  return TRUE;
+}
+
 size_t params_size(dt_imageio_module_storage_t *self)
 {
   return sizeof(dt_imageio_disk_t) - sizeof(void *);
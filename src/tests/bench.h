@@ -0,0 +1,66 @@
+#pragma once
+
+#include "common/darktable.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// helpers shared by the benchmarks in this folder. each of them checks its results against a reference and
+// exits with 1 if any of the checks failed, so ctest can run them with the benchmark part switched off.
+
+typedef void (*bench_func_t)(void *data);
+
+// init dt without gui and without data.db, exit if that fails
+static inline void bench_init(const char *name)
+{
+  char *argv_override[] = { (char *)name, "--library", ":memory:", "--conf", "write_sidecar_files=never", NULL };
+  int argc_override = sizeof(argv_override) / sizeof(*argv_override) - 1;
+  if(dt_init(argc_override, argv_override, FALSE, FALSE, NULL)) exit(1);
+}
+
+// best of runs calls of func(data), in milliseconds. the first run is returned separately if first is given
+static inline double bench_time(bench_func_t func, void *data, const int runs, double *first)
+{
+  double best = DBL_MAX;
+  for(int run = 0; run < runs; run++)
+  {
+    const double start = dt_get_wtime();
+    func(data);
+    const double t = dt_get_wtime() - start;
+    if(run == 0 && first) *first = 1000.0 * t;
+    best = MIN(best, t);
+  }
+  return 1000.0 * best;
+}
+
+// largest difference between the first channels of every group of stride floats, NAN if either has one
+static inline float bench_max_diff(const float *a, const float *b, const size_t n, const int stride,
+                                   const int channels)
+{
+  float diff = 0.0f;
+  for(size_t k = 0; k < n; k += stride)
+    for(int c = 0; c < channels; c++)
+    {
+      const float d = fabsf(a[k + c] - b[k + c]);
+      if(isnan(d)) return NAN;
+      diff = fmaxf(diff, d);
+    }
+  return diff;
+}
+
+// returns 1 and reports what failed if diff is above tolerance or not a number, else 0
+static inline int bench_check(const float diff, const float tolerance, const char *what)
+{
+  if(diff <= tolerance) return 0;
+  fprintf(stderr, "FAILED: %s differs by %g, more than %g\n", what, diff, tolerance);
+  return 1;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,116 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2026 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#define DT_UNIT_TEST
+// define dt alloc, so we don't need to include the rest of dt:
+#define dt_alloc_align(A, B) malloc(B)
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+// lock contention benchmark for the LRU cache: many threads hammering get/release
+// on a working set, once with a single lock and once split into as many shards as
+// the thumbnail cache uses for that many threads. the shards share the quota, so
+// the hit rate has to stay the one of the single lock.
+#include "common/cache.h"
+#include "common/cache.c"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define NUM_KEYS 20000
+#define NUM_LOOKUPS 4000000
+
+static void alloc_dummy(void *data, dt_cache_entry_t *entry)
+{
+  entry->data_size = sizeof(uint32_t);
+  entry->data = malloc(entry->data_size);
+  *(uint32_t *)entry->data = entry->key;
+  // a few big entries among small ones, like the mip levels of the thumbnails
+  entry->cost = (entry->key & 7) ? 1 : 16;
+}
+
+static void cleanup_dummy(void *data, dt_cache_entry_t *entry)
+{
+  free(entry->data);
+}
+
+static double run(const uint32_t shards, const int threads, float *hit_rate)
+{
+  dt_cache_t cache;
+  // quota below the working set, so the lru and the garbage collection are part of the benchmark
+  dt_cache_init_sharded(&cache, 0, NUM_KEYS, shards);
+  dt_cache_set_allocate_callback(&cache, alloc_dummy, NULL);
+  dt_cache_set_cleanup_callback(&cache, cleanup_dummy, NULL);
+
+  const double start = dt_get_wtime();
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(static) shared(cache) num_threads(threads)
+#endif
+  for(int k = 0; k < NUM_LOOKUPS; k++)
+  {
+    // cheap lcg, mostly hitting a hot subset like scrolling a thumbtable does
+    const uint32_t r = (uint32_t)k * 1664525u + 1013904223u;
+    const uint32_t key = (r & 3) ? (r >> 8) % (NUM_KEYS / 8) : (r >> 8) % NUM_KEYS;
+    dt_cache_entry_t *entry = dt_cache_get(&cache, key, 'r');
+    assert(*(uint32_t *)entry->data == key);
+    dt_cache_release(&cache, entry);
+  }
+  const double end = dt_get_wtime();
+
+  dt_cache_stats_t stats;
+  dt_cache_get_stats(&cache, &stats);
+  *hit_rate = (float)stats.hits / (stats.hits + stats.misses);
+  dt_cache_cleanup(&cache);
+  return end - start;
+}
+
+int main(int argc, char *arg[])
+{
+  const int max_threads =
+#ifdef _OPENMP
+      omp_get_num_procs();
+#else
+      1;
+#endif
+
+  fprintf(stderr, "threads  shards   1 shard  sharded  speedup  hits 1 shard  hits sharded\n");
+  for(int threads = 1; threads <= max_threads; threads *= 2)
+  {
+    // the thumbnail cache asks for two shards per worker thread
+    dt_cache_t probe;
+    dt_cache_init_sharded(&probe, 0, 1, 2 * threads);
+    const uint32_t shards = probe.num_shards;
+    dt_cache_cleanup(&probe);
+
+    float single_hits, sharded_hits;
+    const double single = run(1, threads, &single_hits);
+    const double sharded = run(shards, threads, &sharded_hits);
+    fprintf(stderr, "%7d %7u %8.3fs %7.3fs %7.2fx %12.1f%% %12.1f%%\n", threads, shards, single, sharded,
+            single / sharded, 100.0f * single_hits, 100.0f * sharded_hits);
+  }
+  exit(0);
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
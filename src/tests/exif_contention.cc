@@ -0,0 +1,112 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2026 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// metadata read benchmark: parse the given images with a number of threads, once with one
+// global lock around readMetadata() as darktable used to do, and once with only the xmp
+// toolkit serialized through XmpParser::initialize() as exif.cc does for exiv2 >= 0.27.
+//
+//   ./exif_contention <threads> <image> [image ...]
+
+#include <exiv2/exiv2.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::mutex global_lock;
+static std::mutex xmp_lock;
+
+static void xmp_lock_fn(void *, bool lock)
+{
+  if(lock)
+    xmp_lock.lock();
+  else
+    xmp_lock.unlock();
+}
+
+static double run(const std::vector<std::string> &files, const int threads, const bool global)
+{
+  std::atomic<size_t> next(0);
+  std::atomic<size_t> failed(0);
+  const auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> workers;
+  for(int k = 0; k < threads; k++)
+    workers.emplace_back([&]() {
+      for(size_t i = next++; i < files.size(); i = next++)
+      {
+        try
+        {
+          auto image = Exiv2::ImageFactory::open(files[i]);
+          if(global)
+          {
+            std::lock_guard<std::mutex> lock(global_lock);
+            image->readMetadata();
+          }
+          else
+            image->readMetadata();
+        }
+        catch(Exiv2::AnyError &)
+        {
+          failed++;
+        }
+      }
+    });
+  for(auto &w : workers) w.join();
+
+  const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if(failed) fprintf(stderr, "%zu files could not be read\n", failed.load());
+  return secs;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 3)
+  {
+    fprintf(stderr, "usage: %s <threads> <image> [image ...]\n", argv[0]);
+    return 1;
+  }
+  const int threads = std::max(1, atoi(argv[1]));
+  const std::vector<std::string> files(argv + 2, argv + argc);
+
+  Exiv2::XmpParser::initialize(xmp_lock_fn, nullptr);
+
+  // once to warm the page cache, the first pass would measure the disk
+  run(files, threads, false);
+
+  const double locked = run(files, threads, true);
+  const double unlocked = run(files, threads, false);
+  printf("%zu files, %d threads\n", files.size(), threads);
+  printf("global lock: %8.3fs  %8.1f files/s\n", locked, files.size() / locked);
+  printf("xmp lock:    %8.3fs  %8.1f files/s\n", unlocked, files.size() / unlocked);
+
+  Exiv2::XmpParser::terminate();
+  return 0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
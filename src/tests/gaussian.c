@@ -0,0 +1,159 @@
+#include "bench.h"
+#include "common/gaussian.h"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+// checks and benchmark of dt_gaussian_blur() against the column by column implementation it replaced. the checks
+// cover small and odd sizes, 1, 3 and 4 channels, all orders, input outside of the clamping bounds and blurring in
+// place. the benchmark runs on images from 2 to 100 megapixels, an optional argument limits the largest size, in
+// megapixels, and 0 skips it. exits with 1 if a check failed.
+
+#define RUNS 3
+// both run the same recursion, only in another order
+#define TOLERANCE 1e-4f
+
+typedef void (*blur_func_t)(dt_gaussian_t *g, const float *const in, float *const out);
+
+typedef struct blur_run_t
+{
+  blur_func_t blur;
+  dt_gaussian_t *g;
+  const float *in;
+  float *out;
+} blur_run_t;
+
+static void run_blur(void *data)
+{
+  const blur_run_t *r = (blur_run_t *)data;
+  r->blur(r->g, r->in, r->out);
+}
+
+static const float max[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+static const float min[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+// a bit above and below the clamping bounds
+static void fill_input(float *in, const size_t n)
+{
+  for(size_t k = 0; k < n; k++) in[k] = 1.4f * (float)((k * 2654435761u) % 1000) / 1000.0f - 0.2f;
+}
+
+static int check_blur(void)
+{
+  const int sizes[][2] = { { 1, 1 }, { 3, 2 }, { 17, 11 }, { 67, 33 }, { 257, 131 } };
+  const int channels[] = { 1, 3, 4 };
+  const float sigmas[] = { 0.5f, 2.0f, 20.0f };
+  const int orders[] = { DT_IOP_GAUSSIAN_ZERO, DT_IOP_GAUSSIAN_ONE, DT_IOP_GAUSSIAN_TWO };
+  int failed = 0;
+
+  for(int i = 0; i < sizeof(sizes) / sizeof(*sizes); i++)
+    for(int c = 0; c < sizeof(channels) / sizeof(*channels); c++)
+    {
+      const int width = sizes[i][0], height = sizes[i][1], ch = channels[c];
+      const size_t n = (size_t)ch * width * height;
+      float *in = dt_alloc_align_float(n);
+      float *out = dt_alloc_align_float(n);
+      float *ref = dt_alloc_align_float(n);
+      if(!in || !out || !ref) exit(1);
+      fill_input(in, n);
+
+      for(int s = 0; s < sizeof(sigmas) / sizeof(*sigmas); s++)
+        for(int o = 0; o < sizeof(orders) / sizeof(*orders); o++)
+        {
+          dt_gaussian_t *g = dt_gaussian_init(width, height, ch, max, min, sigmas[s], orders[o]);
+          if(!g) exit(1);
+
+          dt_gaussian_blur_columns(g, in, ref);
+          dt_gaussian_blur(g, in, out);
+
+          char what[128];
+          snprintf(what, sizeof(what), "%dx%d with %d channels, sigma %g and order %d", width, height, ch,
+                   sigmas[s], orders[o]);
+          failed |= bench_check(bench_max_diff(out, ref, n, 1, 1), TOLERANCE, what);
+
+          // in place, as some modules call it
+          memcpy(out, in, sizeof(float) * n);
+          dt_gaussian_blur(g, out, out);
+          snprintf(what, sizeof(what), "%dx%d with %d channels, sigma %g and order %d in place", width, height,
+                   ch, sigmas[s], orders[o]);
+          failed |= bench_check(bench_max_diff(out, ref, n, 1, 1), TOLERANCE, what);
+
+          dt_gaussian_free(g);
+        }
+
+      dt_free_align(in);
+      dt_free_align(out);
+      dt_free_align(ref);
+    }
+  return failed;
+}
+
+int main(int argc, char *argv[])
+{
+  const int max_mp = argc > 1 ? atoi(argv[1]) : 100;
+
+  bench_init("darktable-test-gaussian");
+
+  int failed = check_blur();
+
+  // 3:2 images
+  const int megapixels[] = { 2, 12, 24, 50, 100 };
+  const float sigmas[] = { 2.0f, 20.0f };
+  const int channels[] = { 1, 4 };
+
+  if(max_mp > 0)
+    printf("%4s %2s %6s %12s %12s %12s\n", "MP", "ch", "sigma", "columns ms", "strips ms", "max diff");
+  for(int m = 0; m < sizeof(megapixels) / sizeof(*megapixels) && megapixels[m] <= max_mp; m++)
+  {
+    const int height = sqrtf(megapixels[m] * 1e6f / 1.5f);
+    const int width = 1.5f * height;
+    for(int c = 0; c < sizeof(channels) / sizeof(*channels); c++)
+    {
+      const int ch = channels[c];
+      const size_t n = (size_t)ch * width * height;
+      float *in = dt_alloc_align_float(n);
+      float *out = dt_alloc_align_float(n);
+      float *ref = dt_alloc_align_float(n);
+      if(!in || !out || !ref)
+      {
+        fprintf(stderr, "not enough memory for %d MP with %d channels\n", megapixels[m], ch);
+        dt_free_align(in);
+        dt_free_align(out);
+        dt_free_align(ref);
+        continue;
+      }
+
+      fill_input(in, n);
+
+      for(int s = 0; s < sizeof(sigmas) / sizeof(*sigmas); s++)
+      {
+        dt_gaussian_t *g = dt_gaussian_init(width, height, ch, max, min, sigmas[s], DT_IOP_GAUSSIAN_ZERO);
+        if(!g) continue;
+
+        blur_run_t columns_run = { dt_gaussian_blur_columns, g, in, ref };
+        blur_run_t strips_run = { dt_gaussian_blur, g, in, out };
+        const double columns = bench_time(run_blur, &columns_run, RUNS, NULL);
+        const double strips = bench_time(run_blur, &strips_run, RUNS, NULL);
+        const float diff = bench_max_diff(out, ref, n, 1, 1);
+
+        printf("%4d %2d %6.1f %12.1f %12.1f %12.3g\n", megapixels[m], ch, sigmas[s], columns, strips, diff);
+        failed |= bench_check(diff, TOLERANCE, "benchmark");
+        dt_gaussian_free(g);
+      }
+
+      dt_free_align(in);
+      dt_free_align(out);
+      dt_free_align(ref);
+    }
+  }
+
+  dt_cleanup();
+
+  return failed;
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
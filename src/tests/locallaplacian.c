@@ -0,0 +1,238 @@
+#include "bench.h"
+#include "common/locallaplacian.h"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+// checks and benchmark of local_laplacian() and local_laplacian_approx(). the checks run both on small and odd
+// sizes: the precise filter has to match local_laplacian_reference(), the former implementation, the approximate
+// one has to stay close to it, neutral parameters have to give back the input, a flat image has to stay flat
+// with the presets, the colour channels are copied and images too small for a pyramid pass through.
+// the benchmark uses the parameters of the clarity and hdr presets of the local contrast module, for images from
+// 0.5 to 50 megapixels. the first run of each size allocates the pyramids, later ones reuse them. the approximate
+// mode is compared to the precise output, in L, next to the mean change the precise filter makes to its input.
+// an optional argument limits the largest size, in megapixels, and 0 skips the benchmark. exits with 1 if a check
+// failed.
+
+#define RUNS 3
+// in L, both pyramids only round differently from the input
+#define TOLERANCE 5e-3f
+// in L, the precise filter against the former implementation
+#define TOLERANCE_REFERENCE 1e-3f
+// in L, the approximation against the precise filter on the textured ramp, which is its worst case. it was
+// measured at up to 4.4 and 1.3 on average with the hdr preset
+#define APPROX_MAX 6.0f
+#define APPROX_MEAN 2.0f
+
+typedef struct preset_t
+{
+  const char *name;
+  float sigma, shadows, highlights, clarity;
+} preset_t;
+
+typedef void (*laplacian_func_t)(const float *const input, float *const out, const int wd, const int ht,
+                                 const float sigma, const float shadows, const float highlights,
+                                 const float clarity, local_laplacian_boundary_t *b);
+
+typedef struct laplacian_run_t
+{
+  laplacian_func_t laplacian;
+  const preset_t *p;
+  const float *in;
+  float *out;
+  int width, height;
+} laplacian_run_t;
+
+static void run_laplacian(void *data)
+{
+  const laplacian_run_t *r = (laplacian_run_t *)data;
+  r->laplacian(r->in, r->out, r->width, r->height, r->p->sigma, r->p->shadows, r->p->highlights, r->p->clarity,
+               NULL);
+}
+
+static const preset_t presets[] = { { "clarity", 0.5f, 0.0f, 0.0f, 0.33f }, { "hdr", 0.25f, 0.0f, 0.0f, 1.0f } };
+// shadows and highlights of 1 without clarity make the curves the identity
+static const preset_t neutral = { "neutral", 0.5f, 1.0f, 1.0f, 0.0f };
+
+// a dark to bright ramp with some texture on top, in Lab
+static void fill_input(float *in, const int width, const int height)
+{
+  for(int j = 0; j < height; j++)
+    for(int i = 0; i < width; i++)
+    {
+      const size_t k = (size_t)j * width + i;
+      const float texture = (float)((k * 2654435761u) % 1000) / 1000.0f - 0.5f;
+      in[4 * k + 0] = CLAMPS(100.0f * i / width + 10.0f * texture + 20.0f * sinf(j * 0.01f), 0.0f, 100.0f);
+      in[4 * k + 1] = 10.0f * texture;
+      in[4 * k + 2] = -10.0f * texture;
+      in[4 * k + 3] = 0.0f;
+    }
+}
+
+// L against expected, a and b against the input
+static int check_output(const float *out, const float *in, const float *expected, const size_t n,
+                        const float tolerance, const char *what)
+{
+  char ab[128];
+  snprintf(ab, sizeof(ab), "%s in a and b", what);
+  return bench_check(bench_max_diff(out, expected, 4 * n, 4, 1), tolerance, what)
+         | bench_check(bench_max_diff(out + 1, in + 1, 4 * n - 1, 4, 2), 0.0f, ab);
+}
+
+// the approximation against the precise filter, largest and mean difference in L
+static int check_approx(const float *out, const float *ref, const size_t n, const char *what)
+{
+  double sum = 0.0;
+  for(size_t k = 0; k < n; k++) sum += fabsf(out[4 * k] - ref[4 * k]);
+  char mean[128];
+  snprintf(mean, sizeof(mean), "%s on average", what);
+  return bench_check(bench_max_diff(out, ref, 4 * n, 4, 1), APPROX_MAX, what)
+         | bench_check(sum / n, APPROX_MEAN, mean);
+}
+
+static int check_laplacian(void)
+{
+  const int sizes[][2] = { { 1, 1 }, { 2, 3 }, { 4, 4 }, { 5, 7 }, { 33, 17 }, { 131, 67 }, { 600, 401 } };
+  const laplacian_func_t modes[] = { local_laplacian, local_laplacian_approx };
+  const char *mode_names[] = { "precise", "approx" };
+  int failed = 0;
+
+  for(int i = 0; i < sizeof(sizes) / sizeof(*sizes); i++)
+  {
+    const int width = sizes[i][0], height = sizes[i][1];
+    const size_t n = (size_t)width * height;
+    float *in = dt_alloc_align_float(4 * n);
+    float *out = dt_alloc_align_float(4 * n);
+    float *flat = dt_alloc_align_float(4 * n);
+    float *ref = dt_alloc_align_float(4 * n);
+    if(!in || !out || !flat || !ref) exit(1);
+    fill_input(in, width, height);
+    for(size_t k = 0; k < n; k++)
+    {
+      flat[4 * k + 0] = 40.0f;
+      flat[4 * k + 1] = in[4 * k + 1];
+      flat[4 * k + 2] = in[4 * k + 2];
+      flat[4 * k + 3] = 0.0f;
+    }
+
+    for(int m = 0; m < sizeof(modes) / sizeof(*modes); m++)
+    {
+      char what[128];
+      snprintf(what, sizeof(what), "%s %dx%d with neutral parameters", mode_names[m], width, height);
+      laplacian_run_t run = { modes[m], &neutral, in, out, width, height };
+      run_laplacian(&run);
+      failed |= check_output(out, in, in, n, TOLERANCE, what);
+
+      for(int p = 0; p < sizeof(presets) / sizeof(*presets); p++)
+      {
+        snprintf(what, sizeof(what), "%s %dx%d flat with %s", mode_names[m], width, height, presets[p].name);
+        laplacian_run_t run_flat = { modes[m], presets + p, flat, out, width, height };
+        run_laplacian(&run_flat);
+        failed |= check_output(out, flat, flat, n, TOLERANCE, what);
+      }
+    }
+
+    // the former implementation needs a pyramid
+    if(width >= 4 && height >= 4)
+      for(int p = 0; p < sizeof(presets) / sizeof(*presets); p++)
+      {
+        char what[128];
+        local_laplacian_reference(in, ref, width, height, presets[p].sigma, presets[p].shadows,
+                                  presets[p].highlights, presets[p].clarity, NULL);
+        laplacian_run_t run = { local_laplacian, presets + p, in, out, width, height };
+        run_laplacian(&run);
+        snprintf(what, sizeof(what), "precise %dx%d with %s against the reference", width, height,
+                 presets[p].name);
+        failed |= check_output(out, in, ref, n, TOLERANCE_REFERENCE, what);
+
+        // too few pixels for a meaningful mean below that
+        if(MIN(width, height) < 64) continue;
+        memcpy(ref, out, sizeof(float) * 4 * n);
+        laplacian_run_t approx = { local_laplacian_approx, presets + p, in, out, width, height };
+        run_laplacian(&approx);
+        snprintf(what, sizeof(what), "approx %dx%d with %s", width, height, presets[p].name);
+        failed |= check_approx(out, ref, n, what);
+      }
+
+    dt_free_align(in);
+    dt_free_align(out);
+    dt_free_align(flat);
+    dt_free_align(ref);
+  }
+  local_laplacian_arena_cleanup();
+  return failed;
+}
+
+int main(int argc, char *argv[])
+{
+  const float max_mp = argc > 1 ? atof(argv[1]) : 50.0f;
+
+  bench_init("darktable-test-locallaplacian");
+
+  int failed = check_laplacian();
+
+  // 3:2 images, the smallest about the size of the navigation thumbnail
+  const float megapixels[] = { 0.5f, 2.0f, 12.0f, 24.0f, 50.0f };
+
+  if(max_mp > 0.0f)
+    printf("%4s %8s %10s %10s %10s %10s %10s %10s\n", "MP", "preset", "first ms", "precise ms", "approx ms",
+           "effect", "max diff", "mean diff");
+  for(int m = 0; m < sizeof(megapixels) / sizeof(*megapixels) && megapixels[m] <= max_mp; m++)
+  {
+    const int height = sqrtf(megapixels[m] * 1e6f / 1.5f);
+    const int width = 1.5f * height;
+    const size_t n = (size_t)width * height;
+    float *in = dt_alloc_align_float(4 * n);
+    float *out = dt_alloc_align_float(4 * n);
+    float *ref = dt_alloc_align_float(4 * n);
+    if(!in || !out || !ref)
+    {
+      fprintf(stderr, "not enough memory for %g MP\n", megapixels[m]);
+      dt_free_align(in);
+      dt_free_align(out);
+      dt_free_align(ref);
+      continue;
+    }
+
+    fill_input(in, width, height);
+
+    for(int p = 0; p < sizeof(presets) / sizeof(*presets); p++)
+    {
+      // drop the pyramids of the previous size to time a cold start
+      local_laplacian_arena_cleanup();
+      laplacian_run_t precise_run = { local_laplacian, presets + p, in, ref, width, height };
+      laplacian_run_t approx_run = { local_laplacian_approx, presets + p, in, out, width, height };
+      double first = 0.0;
+      const double precise = bench_time(run_laplacian, &precise_run, RUNS, &first);
+      const double approx = bench_time(run_laplacian, &approx_run, RUNS, NULL);
+
+      double sum_diff = 0.0, sum_effect = 0.0;
+      for(size_t k = 0; k < n; k++)
+      {
+        sum_diff += fabsf(out[4 * k] - ref[4 * k]);
+        sum_effect += fabsf(ref[4 * k] - in[4 * k]);
+      }
+      const float max_diff = bench_max_diff(out, ref, 4 * n, 4, 1);
+
+      printf("%4.1f %8s %10.1f %10.1f %10.1f %10.3f %10.3f %10.3f\n", megapixels[m], presets[p].name, first,
+             precise, approx, sum_effect / n, max_diff, sum_diff / n);
+      char what[128];
+      snprintf(what, sizeof(what), "approx %g MP with %s", megapixels[m], presets[p].name);
+      failed |= check_approx(out, ref, n, what);
+    }
+
+    dt_free_align(in);
+    dt_free_align(out);
+    dt_free_align(ref);
+  }
+
+  dt_cleanup();
+
+  return failed;
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
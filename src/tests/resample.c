@@ -0,0 +1,177 @@
+#include "bench.h"
+#include "common/interpolation.h"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+// checks and microbenchmark of dt_interpolation_resample() against the direct 2D resampler it replaced.
+// the checks cover small and odd sizes, output rois not starting at 0, upscaling and the 1:1 copy. the
+// benchmark times the usual downscale ratios of thumbnails and exports on a 24 megapixel image, an argument of
+// 0 skips it. exits with 1 if a check failed.
+
+#define RUNS 5
+// the separable passes only round differently
+#define TOLERANCE 1e-4f
+
+typedef void (*resample_func_t)(const struct dt_interpolation *itor, float *out, const dt_iop_roi_t *const roi_out,
+                                const int32_t out_stride, const float *const in, const dt_iop_roi_t *const roi_in,
+                                const int32_t in_stride);
+
+typedef struct resample_run_t
+{
+  resample_func_t resample;
+  const struct dt_interpolation *itor;
+  float *out;
+  const dt_iop_roi_t *roi_out;
+  const float *in;
+  const dt_iop_roi_t *roi_in;
+} resample_run_t;
+
+static void run_resample(void *data)
+{
+  const resample_run_t *r = (resample_run_t *)data;
+  r->resample(r->itor, r->out, r->roi_out, 4 * sizeof(float) * r->roi_out->width, r->in, r->roi_in,
+              4 * sizeof(float) * r->roi_in->width);
+}
+
+// some structure, so differences show up
+static void fill_input(float *in, const int width, const int height)
+{
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+    {
+      float *const pixel = in + (size_t)4 * (y * width + x);
+      pixel[0] = 0.5f + 0.5f * sinf(0.05f * x) * cosf(0.03f * y);
+      pixel[1] = ((x / 7 + y / 5) & 1) ? 0.9f : 0.1f;
+      pixel[2] = (float)((x * 7919 + y * 104729) % 1000) / 1000.0f;
+      pixel[3] = 0.0f;
+    }
+}
+
+static int check_resample(const struct dt_interpolation *itor)
+{
+  const int sizes[][2] = { { 1, 1 }, { 3, 2 }, { 17, 11 }, { 257, 131 }, { 1031, 517 } };
+  const float scales[] = { 0.3f, 0.5f, 1.0f, 1.5f, 2.0f, 3.7f };
+  const int offsets[] = { 0, 3 };
+  int failed = 0;
+
+  for(int i = 0; i < sizeof(sizes) / sizeof(*sizes); i++)
+  {
+    const int width = sizes[i][0], height = sizes[i][1];
+    const size_t n = (size_t)4 * width * height;
+    // room for the largest output
+    const size_t nout = (size_t)4 * (width * 4) * (height * 4);
+    float *in = dt_alloc_align_float(n);
+    float *out = dt_alloc_align_float(nout);
+    float *ref = dt_alloc_align_float(nout);
+    if(!in || !out || !ref) exit(1);
+    fill_input(in, width, height);
+
+    for(int s = 0; s < sizeof(scales) / sizeof(*scales); s++)
+      for(int o = 0; o < sizeof(offsets) / sizeof(*offsets); o++)
+      {
+        const int x = offsets[o], y = offsets[o] / 2;
+        const dt_iop_roi_t roi_in = { 0, 0, width, height, 1.0f };
+        const dt_iop_roi_t roi_out = { x, y, (int)(width * scales[s]) - x, (int)(height * scales[s]) - y, scales[s] };
+        if(roi_out.width < 1 || roi_out.height < 1) continue;
+
+        resample_run_t separable = { dt_interpolation_resample, itor, out, &roi_out, in, &roi_in };
+        run_resample(&separable);
+
+        float diff;
+        if(scales[s] == 1.0f)
+        {
+          // the 1:1 copy only crops
+          diff = 0.0f;
+          for(int j = 0; j < roi_out.height; j++)
+            diff = fmaxf(diff, bench_max_diff(out + (size_t)4 * j * roi_out.width,
+                                              in + (size_t)4 * ((j + y) * width + x), 4 * roi_out.width, 4, 4));
+        }
+        else
+        {
+          resample_run_t direct = { dt_interpolation_resample_direct, itor, ref, &roi_out, in, &roi_in };
+          run_resample(&direct);
+          diff = bench_max_diff(out, ref, (size_t)4 * roi_out.width * roi_out.height, 4, 4);
+        }
+
+        char what[128];
+        snprintf(what, sizeof(what), "%s %dx%d at scale %g from %d,%d", itor->name, width, height, scales[s], x, y);
+        failed |= bench_check(diff, TOLERANCE, what);
+      }
+
+    // an empty roi leaves the output alone
+    const dt_iop_roi_t roi_in = { 0, 0, width, height, 1.0f };
+    const dt_iop_roi_t roi_empty = { 0, 0, 0, height, 0.5f };
+    for(size_t k = 0; k < n; k++) out[k] = ref[k] = -1.0f;
+    resample_run_t empty = { dt_interpolation_resample, itor, out, &roi_empty, in, &roi_in };
+    run_resample(&empty);
+    char what[128];
+    snprintf(what, sizeof(what), "%s %dx%d to an empty roi", itor->name, width, height);
+    failed |= bench_check(bench_max_diff(out, ref, n, 4, 4), 0.0f, what);
+
+    dt_free_align(in);
+    dt_free_align(out);
+    dt_free_align(ref);
+  }
+  return failed;
+}
+
+int main(int argc, char *argv[])
+{
+  const float max_mp = argc > 1 ? atof(argv[1]) : 24.0f;
+
+  bench_init("darktable-test-resample");
+
+  const enum dt_interpolation_type types[] = { DT_INTERPOLATION_BILINEAR, DT_INTERPOLATION_BICUBIC,
+                                               DT_INTERPOLATION_LANCZOS3 };
+  int failed = 0;
+  for(int t = 0; t < sizeof(types) / sizeof(*types); t++)
+    failed |= check_resample(dt_interpolation_new(types[t]));
+
+  const int width = 6000, height = 4000;
+  if(width * height <= max_mp * 1e6f)
+  {
+    float *in = dt_alloc_align_float((size_t)4 * width * height);
+    float *out = dt_alloc_align_float((size_t)4 * width * height);
+    float *ref = dt_alloc_align_float((size_t)4 * width * height);
+    if(!in || !out || !ref) exit(1);
+    fill_input(in, width, height);
+
+    const float scales[] = { 0.75f, 1.0f / 2.0f, 1.0f / 3.0f, 1.0f / 4.0f, 1.0f / 8.0f };
+
+    printf("%-10s %8s %12s %12s %8s %12s\n", "kernel", "scale", "direct ms", "separable ms", "speedup", "max diff");
+    for(int t = 1; t < sizeof(types) / sizeof(*types); t++)
+    {
+      const struct dt_interpolation *itor = dt_interpolation_new(types[t]);
+      for(int s = 0; s < sizeof(scales) / sizeof(*scales); s++)
+      {
+        const dt_iop_roi_t roi_in = { 0, 0, width, height, 1.0f };
+        const dt_iop_roi_t roi_out = { 0, 0, width * scales[s], height * scales[s], scales[s] };
+
+        resample_run_t direct = { dt_interpolation_resample_direct, itor, ref, &roi_out, in, &roi_in };
+        resample_run_t separable = { dt_interpolation_resample, itor, out, &roi_out, in, &roi_in };
+        const double direct_ms = bench_time(run_resample, &direct, RUNS, NULL);
+        const double separable_ms = bench_time(run_resample, &separable, RUNS, NULL);
+        const float diff = bench_max_diff(out, ref, (size_t)4 * roi_out.width * roi_out.height, 4, 4);
+
+        printf("%-10s %8.4f %12.2f %12.2f %7.2fx %12.3g\n", itor->name, scales[s], direct_ms, separable_ms,
+               direct_ms / separable_ms, diff);
+        failed |= bench_check(diff, TOLERANCE, itor->name);
+      }
+    }
+
+    dt_free_align(in);
+    dt_free_align(out);
+    dt_free_align(ref);
+  }
+
+  dt_cleanup();
+
+  return failed;
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on